@@ -114,6 +114,8 @@ int main(int argc, char **argv)
     /* set logging to DEBUG and open log file */
     cbmfm_log_set_level(CBMFM_LOG_DEBUG);
     cbmfm_log_set_file("gui.log");
+    /* don't let debug logging block the UI */
+    cbmfm_log_async_start();
 
     app = gtk_application_new("nl.compyx.cbmfm", G_APPLICATION_HANDLES_OPEN);
     g_signal_connect(app, "activate", G_CALLBACK(on_activate), NULL);
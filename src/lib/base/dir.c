@@ -37,34 +37,78 @@
 #include "base/errors.h"
 #include "base/file.h"
 #include "base/mem.h"
+#include "base/pattern.h"
 #include "base/petasc.h"
 
 #include "dir.h"
 
 
-/** \brief  Initial size of array of dirent pointers
+/** \brief  Initial size of the dirent array when no size hint is given
  */
-#define DIR_ENTRY_COUNT_INIT    512
+#define DIR_ENTRY_COUNT_INIT    16
 
 
+/** \brief  Add \a n to the reference count of \a dir
+ *
+ * Directories cached in an image are handed to any thread reading the image,
+ * so the reference count is updated atomically where the compiler allows.
+ *
+ * \param[in,out]   dir dir object
+ * \param[in]       n   1 or -1
+ *
+ * \return  new reference count
+ */
+static unsigned int dir_refs_add(cbmfm_dir_t *dir, int n)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return n > 0 ? __atomic_add_fetch(&(dir->refs), 1U, __ATOMIC_RELAXED)
+                 : __atomic_sub_fetch(&(dir->refs), 1U, __ATOMIC_ACQ_REL);
+#else
+    dir->refs = n > 0 ? dir->refs + 1U : dir->refs - 1U;
+    return dir->refs;
+#endif
+}
+
 
 
 /*
  * cbmfm_dir_t methods
  */
 
+/** \brief  Initialize \a dir to a usable state, sized for \a hint entries
+ *
+ * Allocates a single array of \a hint #cbmfm_dirent_t objects, the entries
+ * are stored by value in this array. When \a hint is 0, an array of
+ * #DIR_ENTRY_COUNT_INIT entries is allocated. The array grows when more entries
+ * are appended than \a hint, so the hint only needs to be a good guess.
+ *
+ * \param[in,out]   dir     directory object
+ * \param[in]       hint    expected number of entries
+ */
+void cbmfm_dir_init_size(cbmfm_dir_t *dir, size_t hint)
+{
+    if (hint == 0) {
+        hint = DIR_ENTRY_COUNT_INIT;
+    }
+    dir->entries = cbmfm_malloc(hint * sizeof *(dir->entries));
+    dir->entry_max = hint;
+    dir->entry_used = 0;
+    dir->image = NULL;
+    dir->name_index = NULL;
+    dir->name_index_mask = 0;
+    dir->refs = 1;
+}
+
+
 /** \brief  Initialize \a dir to a usable state
  *
- * Allocates an array of #DIR_ENTRY_COUNT_INIT #cbmfm_dirent_t pointers
+ * Allocates an array of #DIR_ENTRY_COUNT_INIT #cbmfm_dirent_t objects
  *
  * \param[in,out]   dir directory object
  */
 void cbmfm_dir_init(cbmfm_dir_t *dir)
 {
-    dir->entries = cbmfm_malloc(DIR_ENTRY_COUNT_INIT * sizeof *(dir->entries));
-    dir->entry_max = DIR_ENTRY_COUNT_INIT;
-    dir->entry_used = 0;
-    dir->image = NULL;
+    cbmfm_dir_init_size(dir, DIR_ENTRY_COUNT_INIT);
 }
 
 
@@ -90,6 +134,20 @@ cbmfm_dir_t *cbmfm_dir_new(void)
 }
 
 
+/** \brief  Allocate and initialize a new dir object sized for \a hint entries
+ *
+ * \param[in]   hint    expected number of entries (0 for the default)
+ *
+ * \return  dir object
+ */
+cbmfm_dir_t *cbmfm_dir_new_size(size_t hint)
+{
+    cbmfm_dir_t *dir = cbmfm_dir_alloc();
+    cbmfm_dir_init_size(dir, hint);
+    return dir;
+}
+
+
 /** \brief  Clean members of \a dir but not \a dir itself
  *
  * \param[in,out]   dir dir object
@@ -98,34 +156,117 @@ void cbmfm_dir_cleanup(cbmfm_dir_t *dir)
 {
     size_t i;
 
+    /* entries only own their optional file data, the rest is in the array */
     for (i = 0; i < dir->entry_used; i++) {
-        cbmfm_dirent_free(dir->entries[i]);
+        if (dir->entries[i].filedata != NULL) {
+            cbmfm_free(dir->entries[i].filedata);
+        }
     }
     cbmfm_free(dir->entries);
+    cbmfm_free(dir->name_index);
 }
 
 
-/** \brief  Free \a dir and its members
+/** \brief  Release a reference to \a dir, freeing it when it was the last
  *
  * \param[in,out]   dir dir object
  */
 void cbmfm_dir_free(cbmfm_dir_t *dir)
 {
+    if (dir_refs_add(dir, -1) > 0) {
+        return;
+    }
     cbmfm_dir_cleanup(dir);
     cbmfm_free(dir);
 }
 
 
+/** \brief  Add a reference to \a dir
+ *
+ * Each reference must be released with cbmfm_dir_free().
+ *
+ * \param[in,out]   dir dir object
+ *
+ * \return  \a dir
+ */
+cbmfm_dir_t *cbmfm_dir_ref(cbmfm_dir_t *dir)
+{
+    dir_refs_add(dir, 1);
+    return dir;
+}
+
+
+/** \brief  Check if \a dir has more than one reference
+ *
+ * A shared directory, such as the cached directory of an image, must not be
+ * altered: use cbmfm_dir_unshare() to get a private copy first.
+ *
+ * \param[in]   dir dir object
+ *
+ * \return  bool
+ */
+bool cbmfm_dir_is_shared(const cbmfm_dir_t *dir)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __atomic_load_n(&(dir->refs), __ATOMIC_ACQUIRE) > 1U;
+#else
+    return dir->refs > 1U;
+#endif
+}
+
+
+/** \brief  Get a private copy of \a dir that can be altered
+ *
+ * When \a dir is shared, a deep copy is made and the caller's reference to
+ * \a dir is released, otherwise \a dir itself is returned.
+ *
+ * \param[in,out]   dir dir object, the caller's reference is consumed
+ *
+ * \return  dir object with a single reference
+ */
+cbmfm_dir_t *cbmfm_dir_unshare(cbmfm_dir_t *dir)
+{
+    cbmfm_dir_t *copy;
+    size_t i;
+
+    if (!cbmfm_dir_is_shared(dir)) {
+        return dir;
+    }
+    copy = cbmfm_dir_new_size(dir->entry_used);
+    for (i = 0; i < dir->entry_used; i++) {
+        cbmfm_dir_append_dirent(copy, &(dir->entries[i]));
+    }
+    copy->image = dir->image;
+    cbmfm_dir_free(dir);
+    return copy;
+}
+
+
 /** \brief  Append a deep copy of \a dirent to \a dir
  *
- * Creates a deep copy of \a dirent and appends it to \a dir.
+ * Copies \a dirent into the entries array of \a dir, duplicating its file
+ * data if present. Pointers to entries are invalidated when the array has to
+ * grow. Shared directories can't be altered.
  *
  * \param[in,out]   dir     dir object
  * \param[in]       dirent  dirent object
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
  */
-void cbmfm_dir_append_dirent(cbmfm_dir_t *dir, const cbmfm_dirent_t *dirent)
+bool cbmfm_dir_append_dirent(cbmfm_dir_t *dir, const cbmfm_dirent_t *dirent)
 {
     cbmfm_dirent_t *dupl;
+    cbmfm_dirent_t source;
+
+    if (cbmfm_dir_is_shared(dir)) {
+        cbmfm_error_set(CBMFM_ERR_READONLY, NULL, -1);
+        return false;
+    }
+
+    /* dirent may point into the array, so copy it before resizing */
+    source = *dirent;
 
     /* resize array? */
     if (dir->entry_max == dir->entry_used) {
@@ -134,13 +275,200 @@ void cbmfm_dir_append_dirent(cbmfm_dir_t *dir, const cbmfm_dirent_t *dirent)
         dir->entry_max *= 2;
     }
 
-    /* duplicate dirent */
-    dupl = cbmfm_dirent_dup(dirent);
+    /* copy dirent into the array */
+    dupl = &(dir->entries[dir->entry_used++]);
+    *dupl = source;
+    if (source.filedata != NULL) {
+        dupl->filedata = cbmfm_memdup(source.filedata, source.filesize);
+    }
     /* store reference to parent dir */
     dupl->dir = dir;
 
-    /* add to listing */
-    dir->entries[dir->entry_used++] = dupl;
+    /* invalidate name index */
+    cbmfm_free(dir->name_index);
+    dir->name_index = NULL;
+    return true;
+}
+
+
+/** \brief  Directory visitor appending each dirent to a dir
+ *
+ * Allows building a dir object with the `*_visit` functions.
+ *
+ * \param[in]       dirent  dirent object
+ * \param[in,out]   data    dir object
+ *
+ * \return  false when \a data is a shared dir, to stop visiting
+ */
+bool cbmfm_dir_append_visitor(const cbmfm_dirent_t *dirent, void *data)
+{
+    return cbmfm_dir_append_dirent(data, dirent);
+}
+
+
+/** \brief  Call \a visitor for each entry in \a dir
+ *
+ * \param[in]       dir     dir object
+ * \param[in]       visitor visitor callback
+ * \param[in,out]   data    data for \a visitor
+ *
+ * \return  number of entries visited
+ */
+int cbmfm_dir_visit(const cbmfm_dir_t *dir,
+                    cbmfm_dir_visitor_t visitor,
+                    void *data)
+{
+    size_t i;
+
+    for (i = 0; i < dir->entry_used; i++) {
+        if (!visitor(&(dir->entries[i]), data)) {
+            return (int)i + 1;
+        }
+    }
+    return (int)i;
+}
+
+
+/** \brief  Calculate hash of PETSCII file name \a name of \a len bytes
+ *
+ * Uses 32-bit FNV-1a.
+ *
+ * \param[in]   name    file name without padding
+ * \param[in]   len     length of \a name
+ *
+ * \return  hash
+ */
+static size_t dir_name_hash(const uint8_t *name, size_t len)
+{
+    uint32_t hash = 0x811c9dc5U;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= name[i];
+        hash *= 0x01000193U;
+    }
+    return (size_t)hash;
+}
+
+
+/** \brief  Build the name index of \a dir
+ *
+ * The index is an open addressing hash table with linear probing, at least
+ * twice the size of the number of entries. Entries are inserted in directory
+ * order, so a lookup of a duplicate name finds the first entry, like the DOS.
+ * Scratched entries are not indexed. Nothing is done when the index exists.
+ *
+ * Lookups build the index on first use, directories that are going to be
+ * shared between threads should have their index built up front, so lookups
+ * don't alter them.
+ *
+ * \param[in,out]   dir directory object
+ */
+void cbmfm_dir_index_build(cbmfm_dir_t *dir)
+{
+    size_t size = 16;
+    size_t i;
+
+    if (dir->name_index != NULL) {
+        return;
+    }
+
+    while (size < dir->entry_used * 2) {
+        size *= 2;
+    }
+    dir->name_index = cbmfm_calloc(size, sizeof *(dir->name_index));
+    dir->name_index_mask = size - 1;
+
+    for (i = 0; i < dir->entry_used; i++) {
+        const cbmfm_dirent_t *dirent = &(dir->entries[i]);
+        size_t slot;
+
+        if (dirent->filetype == 0x00) {
+            continue;
+        }
+        slot = dir_name_hash(dirent->filename,
+                cbmfm_pattern_name_len(dirent->filename,
+                    CBMFM_CBMDOS_FILE_NAME_LEN)) & dir->name_index_mask;
+        while (dir->name_index[slot] != 0) {
+            slot = (slot + 1) & dir->name_index_mask;
+        }
+        dir->name_index[slot] = i + 1;
+    }
+}
+
+
+/** \brief  Find entry in \a dir with file name \a name
+ *
+ * Padding of \a name with $A0 is ignored. The first lookup builds a hash index
+ * of the names in \a dir, after which lookups are O(1).
+ *
+ * \param[in,out]   dir     directory object
+ * \param[in]       name    PETSCII file name
+ * \param[in]       len     length of \a name
+ *
+ * \return  index of entry in \a dir or -1 when not found
+ *
+ * \throw   #CBMFM_ERR_NOT_FOUND
+ */
+int cbmfm_dir_find(cbmfm_dir_t *dir, const uint8_t *name, size_t len)
+{
+    size_t slot;
+
+    cbmfm_dir_index_build(dir);
+
+    len = cbmfm_pattern_name_len(name, len);
+    slot = dir_name_hash(name, len) & dir->name_index_mask;
+    while (dir->name_index[slot] != 0) {
+        const cbmfm_dirent_t *dirent =
+            &(dir->entries[dir->name_index[slot] - 1]);
+
+        if (cbmfm_pattern_name_len(dirent->filename,
+                    CBMFM_CBMDOS_FILE_NAME_LEN) == len
+                && memcmp(dirent->filename, name, len) == 0) {
+            return (int)(dir->name_index[slot] - 1);
+        }
+        slot = (slot + 1) & dir->name_index_mask;
+    }
+    cbmfm_error_set(CBMFM_ERR_NOT_FOUND, NULL, -1);
+    return -1;
+}
+
+
+/** \brief  Find first entry in \a dir at or after \a start matching \a pattern
+ *
+ * Patterns without wildcards use the name index.
+ *
+ * \param[in,out]   dir     directory object
+ * \param[in]       pattern compiled pattern
+ * \param[in]       start   index of entry to start searching at
+ *
+ * \return  index of entry in \a dir or -1 when not found
+ *
+ * \throw   #CBMFM_ERR_NOT_FOUND
+ */
+int cbmfm_dir_match(cbmfm_dir_t *dir,
+                    const cbmfm_pattern_t *pattern,
+                    size_t start)
+{
+    size_t i;
+
+    if (start == 0 && !pattern->prefix && !pattern->wildcards) {
+        int index = cbmfm_dir_find(dir, pattern->name, pattern->len);
+
+        if (index < 0 || cbmfm_pattern_match(pattern, &(dir->entries[index]))) {
+            return index;
+        }
+        /* first entry with this name has the wrong type */
+        start = (size_t)index + 1;
+    }
+
+    for (i = start; i < dir->entry_used; i++) {
+        if (cbmfm_pattern_match(pattern, &(dir->entries[i]))) {
+            return (int)i;
+        }
+    }
+    cbmfm_error_set(CBMFM_ERR_NOT_FOUND, NULL, -1);
+    return -1;
 }
 
 
@@ -153,7 +481,7 @@ void cbmfm_dir_dump(const cbmfm_dir_t *dir)
     size_t index;
 
     for (index = 0; index < dir->entry_used; index++) {
-        cbmfm_dirent_dump(dir->entries[index]);
+        cbmfm_dirent_dump(&(dir->entries[index]));
     }
 }
 
@@ -219,7 +547,7 @@ bool cbmfm_dxx_dir_iter_next(cbmfm_dxx_dir_iter_t *iter)
 uint8_t *cbmfm_dxx_dir_iter_entry_ptr(cbmfm_dxx_dir_iter_t *iter)
 {
     return iter->image->data +
-        cbmfm_dxx_block_offset(iter->image->zones,
+        cbmfm_dxx_image_block_offset(iter->image,
                 iter->block_iter.curr.track,
                 iter->block_iter.curr.sector) +
         iter->entry_offset;
@@ -37,14 +37,32 @@
 
 cbmfm_dir_t *   cbmfm_dir_alloc(void);
 void            cbmfm_dir_init(cbmfm_dir_t *dir);
+void            cbmfm_dir_init_size(cbmfm_dir_t *dir, size_t hint);
 cbmfm_dir_t *   cbmfm_dir_new(void);
+cbmfm_dir_t *   cbmfm_dir_new_size(size_t hint);
 void            cbmfm_dir_cleanup(cbmfm_dir_t *dir);
 void            cbmfm_dir_free(cbmfm_dir_t *dir);
-void            cbmfm_dir_append_dirent(cbmfm_dir_t *dir,
+cbmfm_dir_t *   cbmfm_dir_ref(cbmfm_dir_t *dir);
+bool            cbmfm_dir_is_shared(const cbmfm_dir_t *dir);
+cbmfm_dir_t *   cbmfm_dir_unshare(cbmfm_dir_t *dir);
+bool            cbmfm_dir_append_dirent(cbmfm_dir_t *dir,
                                         const cbmfm_dirent_t *dirent);
+bool            cbmfm_dir_append_visitor(const cbmfm_dirent_t *dirent,
+                                         void *data);
+int             cbmfm_dir_visit(const cbmfm_dir_t *dir,
+                                cbmfm_dir_visitor_t visitor,
+                                void *data);
 
 void            cbmfm_dir_dump(const cbmfm_dir_t *dir);
 
+void            cbmfm_dir_index_build(cbmfm_dir_t *dir);
+int             cbmfm_dir_find(cbmfm_dir_t *dir,
+                               const uint8_t *name,
+                               size_t len);
+int             cbmfm_dir_match(cbmfm_dir_t *dir,
+                                const cbmfm_pattern_t *pattern,
+                                size_t start);
+
 bool            cbmfm_dxx_dir_iter_init(cbmfm_dxx_dir_iter_t *iter,
                                         cbmfm_dxx_image_t *image,
                                         int track, int sector);
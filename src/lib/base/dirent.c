@@ -123,6 +123,12 @@ cbmfm_dirent_t *cbmfm_dirent_dup(const cbmfm_dirent_t *dirent)
         case CBMFM_IMAGE_TYPE_T64:
             dupl->extra.t64 = dirent->extra.t64;
             break;
+        case CBMFM_IMAGE_TYPE_LNX:
+            dupl->extra.lnx = dirent->extra.lnx;
+            break;
+        case CBMFM_IMAGE_TYPE_ARK:
+            dupl->extra.ark = dirent->extra.ark;
+            break;
         default:
             break;
     }
@@ -41,6 +41,461 @@
 #include "dxx.h"
 
 
+/** \defgroup  lib_base_dxx_geometry Disk geometry tables
+ *
+ * Precomputed tables for translating (track,sector) into block numbers and
+ * back. The block-to-track tables are generated by the preprocessor from the
+ * number of sectors in each track.
+ * @{
+ */
+
+/** \brief  Repeat \a t once */
+#define DXX_REP1(t)     (t)
+/** \brief  Repeat \a t twice */
+#define DXX_REP2(t)     DXX_REP1(t), DXX_REP1(t)
+/** \brief  Repeat \a t 4 times */
+#define DXX_REP4(t)     DXX_REP2(t), DXX_REP2(t)
+/** \brief  Repeat \a t 8 times */
+#define DXX_REP8(t)     DXX_REP4(t), DXX_REP4(t)
+/** \brief  Repeat \a t 16 times */
+#define DXX_REP16(t)    DXX_REP8(t), DXX_REP8(t)
+/** \brief  Repeat \a t 17 times */
+#define DXX_REP17(t)    DXX_REP16(t), DXX_REP1(t)
+/** \brief  Repeat \a t 18 times */
+#define DXX_REP18(t)    DXX_REP16(t), DXX_REP2(t)
+/** \brief  Repeat \a t 19 times */
+#define DXX_REP19(t)    DXX_REP18(t), DXX_REP1(t)
+/** \brief  Repeat \a t 21 times */
+#define DXX_REP21(t)    DXX_REP16(t), DXX_REP4(t), DXX_REP1(t)
+/** \brief  Repeat \a t 23 times */
+#define DXX_REP23(t)    DXX_REP21(t), DXX_REP2(t)
+/** \brief  Repeat \a t 25 times */
+#define DXX_REP25(t)    DXX_REP16(t), DXX_REP8(t), DXX_REP1(t)
+/** \brief  Repeat \a t 27 times */
+#define DXX_REP27(t)    DXX_REP25(t), DXX_REP2(t)
+/** \brief  Repeat \a t 29 times */
+#define DXX_REP29(t)    DXX_REP25(t), DXX_REP4(t)
+/** \brief  Repeat \a t 40 times */
+#define DXX_REP40(t)    DXX_REP16(t), DXX_REP16(t), DXX_REP8(t)
+
+
+/** \brief  Block-to-track entries of tracks \a o+1 to \a o+5, \a n sectors
+ */
+#define DXX_BT5(o, n) \
+    DXX_REP##n((o) + 1), DXX_REP##n((o) + 2), DXX_REP##n((o) + 3), \
+    DXX_REP##n((o) + 4), DXX_REP##n((o) + 5)
+
+/** \brief  Block-to-track entries of a 35-track 1541 disk side at offset \a o
+ */
+#define DXX_BT_1541(o) \
+    DXX_BT5((o) + 0, 21), DXX_BT5((o) + 5, 21), DXX_BT5((o) + 10, 21), \
+    DXX_REP21((o) + 16), DXX_REP21((o) + 17), \
+    DXX_BT5((o) + 17, 19), DXX_REP19((o) + 23), DXX_REP19((o) + 24), \
+    DXX_BT5((o) + 24, 18), DXX_REP18((o) + 30), \
+    DXX_BT5((o) + 30, 17)
+
+/** \brief  Block-to-track entries of a 77-track 8050 disk side at offset \a o
+ */
+#define DXX_BT_8050(o) \
+    DXX_BT5((o) + 0, 29), DXX_BT5((o) + 5, 29), DXX_BT5((o) + 10, 29), \
+    DXX_BT5((o) + 15, 29), DXX_BT5((o) + 20, 29), DXX_BT5((o) + 25, 29), \
+    DXX_BT5((o) + 30, 29), DXX_REP29((o) + 36), DXX_REP29((o) + 37), \
+    DXX_REP29((o) + 38), DXX_REP29((o) + 39), \
+    DXX_BT5((o) + 39, 27), DXX_BT5((o) + 44, 27), DXX_REP27((o) + 50), \
+    DXX_REP27((o) + 51), DXX_REP27((o) + 52), DXX_REP27((o) + 53), \
+    DXX_BT5((o) + 53, 25), DXX_BT5((o) + 58, 25), DXX_REP25((o) + 64), \
+    DXX_BT5((o) + 64, 23), DXX_BT5((o) + 69, 23), DXX_REP23((o) + 75), \
+    DXX_REP23((o) + 76), DXX_REP23((o) + 77)
+
+
+/** \brief  Speed zones for 1541 disks, including the 40 and 42 track modes
+ */
+static const cbmfm_dxx_speedzone_t zones_1541[] = {
+    {  1, 17, 21 },
+    { 18, 24, 19 },
+    { 25, 30, 18 },
+    { 31, 42, 17 },
+    { -1, -1, -1 }
+};
+
+/** \brief  Speed zones for 1571 disks
+ */
+static const cbmfm_dxx_speedzone_t zones_1571[] = {
+    {  1, 17, 21 },
+    { 18, 24, 19 },
+    { 25, 30, 18 },
+    { 31, 35, 17 },
+    { 36, 52, 21 },
+    { 53, 59, 19 },
+    { 60, 65, 18 },
+    { 66, 70, 17 },
+    { -1, -1, -1 }
+};
+
+/** \brief  Speed zones for 8050 disks
+ */
+static const cbmfm_dxx_speedzone_t zones_8050[] = {
+    {  1, 39, 29 },
+    { 40, 53, 27 },
+    { 54, 64, 25 },
+    { 65, 77, 23 },
+    { -1, -1, -1 }
+};
+
+/** \brief  Speed zones for 1581 disks
+ */
+static const cbmfm_dxx_speedzone_t zones_1581[] = {
+    {  1, 80, 40 },
+    { -1, -1, -1 }
+};
+
+/** \brief  Speed zones for 8250 disks
+ */
+static const cbmfm_dxx_speedzone_t zones_8250[] = {
+    {  1,  39, 29 },
+    { 40,  53, 27 },
+    { 54,  64, 25 },
+    { 65,  77, 23 },
+    { 78, 116, 29 },
+    {117, 130, 27 },
+    {131, 141, 25 },
+    {142, 154, 23 },
+    { -1, -1, -1 }
+};
+
+
+/** \brief  Track entries of 1541 disks (up to 42 tracks)
+ */
+static const cbmfm_dxx_track_t tracks_1541[42 + 1] = {
+    {    0,  0 }, {    0, 21 }, {   21, 21 }, {   42, 21 }, {   63, 21 },
+    {   84, 21 }, {  105, 21 }, {  126, 21 }, {  147, 21 }, {  168, 21 },
+    {  189, 21 }, {  210, 21 }, {  231, 21 }, {  252, 21 }, {  273, 21 },
+    {  294, 21 }, {  315, 21 }, {  336, 21 }, {  357, 19 }, {  376, 19 },
+    {  395, 19 }, {  414, 19 }, {  433, 19 }, {  452, 19 }, {  471, 19 },
+    {  490, 18 }, {  508, 18 }, {  526, 18 }, {  544, 18 }, {  562, 18 },
+    {  580, 18 }, {  598, 17 }, {  615, 17 }, {  632, 17 }, {  649, 17 },
+    {  666, 17 }, {  683, 17 }, {  700, 17 }, {  717, 17 }, {  734, 17 },
+    {  751, 17 }, {  768, 17 }, {  785, 17 }
+};
+
+/** \brief  Track entries of 1571 disks
+ */
+static const cbmfm_dxx_track_t tracks_1571[CBMFM_D71_TRACK_MAX + 1] = {
+    {    0,  0 }, {    0, 21 }, {   21, 21 }, {   42, 21 }, {   63, 21 },
+    {   84, 21 }, {  105, 21 }, {  126, 21 }, {  147, 21 }, {  168, 21 },
+    {  189, 21 }, {  210, 21 }, {  231, 21 }, {  252, 21 }, {  273, 21 },
+    {  294, 21 }, {  315, 21 }, {  336, 21 }, {  357, 19 }, {  376, 19 },
+    {  395, 19 }, {  414, 19 }, {  433, 19 }, {  452, 19 }, {  471, 19 },
+    {  490, 18 }, {  508, 18 }, {  526, 18 }, {  544, 18 }, {  562, 18 },
+    {  580, 18 }, {  598, 17 }, {  615, 17 }, {  632, 17 }, {  649, 17 },
+    {  666, 17 }, {  683, 21 }, {  704, 21 }, {  725, 21 }, {  746, 21 },
+    {  767, 21 }, {  788, 21 }, {  809, 21 }, {  830, 21 }, {  851, 21 },
+    {  872, 21 }, {  893, 21 }, {  914, 21 }, {  935, 21 }, {  956, 21 },
+    {  977, 21 }, {  998, 21 }, { 1019, 21 }, { 1040, 19 }, { 1059, 19 },
+    { 1078, 19 }, { 1097, 19 }, { 1116, 19 }, { 1135, 19 }, { 1154, 19 },
+    { 1173, 18 }, { 1191, 18 }, { 1209, 18 }, { 1227, 18 }, { 1245, 18 },
+    { 1263, 18 }, { 1281, 17 }, { 1298, 17 }, { 1315, 17 }, { 1332, 17 },
+    { 1349, 17 }
+};
+
+/** \brief  Track entries of 8050 disks
+ */
+static const cbmfm_dxx_track_t tracks_8050[CBMFM_D80_TRACK_MAX + 1] = {
+    {    0,  0 }, {    0, 29 }, {   29, 29 }, {   58, 29 }, {   87, 29 },
+    {  116, 29 }, {  145, 29 }, {  174, 29 }, {  203, 29 }, {  232, 29 },
+    {  261, 29 }, {  290, 29 }, {  319, 29 }, {  348, 29 }, {  377, 29 },
+    {  406, 29 }, {  435, 29 }, {  464, 29 }, {  493, 29 }, {  522, 29 },
+    {  551, 29 }, {  580, 29 }, {  609, 29 }, {  638, 29 }, {  667, 29 },
+    {  696, 29 }, {  725, 29 }, {  754, 29 }, {  783, 29 }, {  812, 29 },
+    {  841, 29 }, {  870, 29 }, {  899, 29 }, {  928, 29 }, {  957, 29 },
+    {  986, 29 }, { 1015, 29 }, { 1044, 29 }, { 1073, 29 }, { 1102, 29 },
+    { 1131, 27 }, { 1158, 27 }, { 1185, 27 }, { 1212, 27 }, { 1239, 27 },
+    { 1266, 27 }, { 1293, 27 }, { 1320, 27 }, { 1347, 27 }, { 1374, 27 },
+    { 1401, 27 }, { 1428, 27 }, { 1455, 27 }, { 1482, 27 }, { 1509, 25 },
+    { 1534, 25 }, { 1559, 25 }, { 1584, 25 }, { 1609, 25 }, { 1634, 25 },
+    { 1659, 25 }, { 1684, 25 }, { 1709, 25 }, { 1734, 25 }, { 1759, 25 },
+    { 1784, 23 }, { 1807, 23 }, { 1830, 23 }, { 1853, 23 }, { 1876, 23 },
+    { 1899, 23 }, { 1922, 23 }, { 1945, 23 }, { 1968, 23 }, { 1991, 23 },
+    { 2014, 23 }, { 2037, 23 }, { 2060, 23 }
+};
+
+/** \brief  Track entries of 1581 disks
+ */
+static const cbmfm_dxx_track_t tracks_1581[CBMFM_D81_TRACK_MAX + 1] = {
+    {    0,  0 }, {    0, 40 }, {   40, 40 }, {   80, 40 }, {  120, 40 },
+    {  160, 40 }, {  200, 40 }, {  240, 40 }, {  280, 40 }, {  320, 40 },
+    {  360, 40 }, {  400, 40 }, {  440, 40 }, {  480, 40 }, {  520, 40 },
+    {  560, 40 }, {  600, 40 }, {  640, 40 }, {  680, 40 }, {  720, 40 },
+    {  760, 40 }, {  800, 40 }, {  840, 40 }, {  880, 40 }, {  920, 40 },
+    {  960, 40 }, { 1000, 40 }, { 1040, 40 }, { 1080, 40 }, { 1120, 40 },
+    { 1160, 40 }, { 1200, 40 }, { 1240, 40 }, { 1280, 40 }, { 1320, 40 },
+    { 1360, 40 }, { 1400, 40 }, { 1440, 40 }, { 1480, 40 }, { 1520, 40 },
+    { 1560, 40 }, { 1600, 40 }, { 1640, 40 }, { 1680, 40 }, { 1720, 40 },
+    { 1760, 40 }, { 1800, 40 }, { 1840, 40 }, { 1880, 40 }, { 1920, 40 },
+    { 1960, 40 }, { 2000, 40 }, { 2040, 40 }, { 2080, 40 }, { 2120, 40 },
+    { 2160, 40 }, { 2200, 40 }, { 2240, 40 }, { 2280, 40 }, { 2320, 40 },
+    { 2360, 40 }, { 2400, 40 }, { 2440, 40 }, { 2480, 40 }, { 2520, 40 },
+    { 2560, 40 }, { 2600, 40 }, { 2640, 40 }, { 2680, 40 }, { 2720, 40 },
+    { 2760, 40 }, { 2800, 40 }, { 2840, 40 }, { 2880, 40 }, { 2920, 40 },
+    { 2960, 40 }, { 3000, 40 }, { 3040, 40 }, { 3080, 40 }, { 3120, 40 },
+    { 3160, 40 }
+};
+
+/** \brief  Track entries of 8250 disks
+ */
+static const cbmfm_dxx_track_t tracks_8250[CBMFM_D82_TRACK_MAX + 1] = {
+    {    0,  0 }, {    0, 29 }, {   29, 29 }, {   58, 29 }, {   87, 29 },
+    {  116, 29 }, {  145, 29 }, {  174, 29 }, {  203, 29 }, {  232, 29 },
+    {  261, 29 }, {  290, 29 }, {  319, 29 }, {  348, 29 }, {  377, 29 },
+    {  406, 29 }, {  435, 29 }, {  464, 29 }, {  493, 29 }, {  522, 29 },
+    {  551, 29 }, {  580, 29 }, {  609, 29 }, {  638, 29 }, {  667, 29 },
+    {  696, 29 }, {  725, 29 }, {  754, 29 }, {  783, 29 }, {  812, 29 },
+    {  841, 29 }, {  870, 29 }, {  899, 29 }, {  928, 29 }, {  957, 29 },
+    {  986, 29 }, { 1015, 29 }, { 1044, 29 }, { 1073, 29 }, { 1102, 29 },
+    { 1131, 27 }, { 1158, 27 }, { 1185, 27 }, { 1212, 27 }, { 1239, 27 },
+    { 1266, 27 }, { 1293, 27 }, { 1320, 27 }, { 1347, 27 }, { 1374, 27 },
+    { 1401, 27 }, { 1428, 27 }, { 1455, 27 }, { 1482, 27 }, { 1509, 25 },
+    { 1534, 25 }, { 1559, 25 }, { 1584, 25 }, { 1609, 25 }, { 1634, 25 },
+    { 1659, 25 }, { 1684, 25 }, { 1709, 25 }, { 1734, 25 }, { 1759, 25 },
+    { 1784, 23 }, { 1807, 23 }, { 1830, 23 }, { 1853, 23 }, { 1876, 23 },
+    { 1899, 23 }, { 1922, 23 }, { 1945, 23 }, { 1968, 23 }, { 1991, 23 },
+    { 2014, 23 }, { 2037, 23 }, { 2060, 23 }, { 2083, 29 }, { 2112, 29 },
+    { 2141, 29 }, { 2170, 29 }, { 2199, 29 }, { 2228, 29 }, { 2257, 29 },
+    { 2286, 29 }, { 2315, 29 }, { 2344, 29 }, { 2373, 29 }, { 2402, 29 },
+    { 2431, 29 }, { 2460, 29 }, { 2489, 29 }, { 2518, 29 }, { 2547, 29 },
+    { 2576, 29 }, { 2605, 29 }, { 2634, 29 }, { 2663, 29 }, { 2692, 29 },
+    { 2721, 29 }, { 2750, 29 }, { 2779, 29 }, { 2808, 29 }, { 2837, 29 },
+    { 2866, 29 }, { 2895, 29 }, { 2924, 29 }, { 2953, 29 }, { 2982, 29 },
+    { 3011, 29 }, { 3040, 29 }, { 3069, 29 }, { 3098, 29 }, { 3127, 29 },
+    { 3156, 29 }, { 3185, 29 }, { 3214, 27 }, { 3241, 27 }, { 3268, 27 },
+    { 3295, 27 }, { 3322, 27 }, { 3349, 27 }, { 3376, 27 }, { 3403, 27 },
+    { 3430, 27 }, { 3457, 27 }, { 3484, 27 }, { 3511, 27 }, { 3538, 27 },
+    { 3565, 27 }, { 3592, 25 }, { 3617, 25 }, { 3642, 25 }, { 3667, 25 },
+    { 3692, 25 }, { 3717, 25 }, { 3742, 25 }, { 3767, 25 }, { 3792, 25 },
+    { 3817, 25 }, { 3842, 25 }, { 3867, 23 }, { 3890, 23 }, { 3913, 23 },
+    { 3936, 23 }, { 3959, 23 }, { 3982, 23 }, { 4005, 23 }, { 4028, 23 },
+    { 4051, 23 }, { 4074, 23 }, { 4097, 23 }, { 4120, 23 }, { 4143, 23 }
+};
+
+
+/** \brief  Block-to-track table of 1541 disks (up to 42 tracks)
+ */
+static const uint8_t block_track_1541[CBMFM_D64_BLOCK_COUNT_42] = {
+    DXX_BT_1541(0),
+    DXX_BT5(35, 17), DXX_REP17(41), DXX_REP17(42)
+};
+
+/** \brief  Block-to-track table of 1571 disks
+ */
+static const uint8_t block_track_1571[CBMFM_D71_BLOCK_COUNT] = {
+    DXX_BT_1541(0),
+    DXX_BT_1541(35)
+};
+
+/** \brief  Block-to-track table of 8050 disks
+ */
+static const uint8_t block_track_8050[CBMFM_D80_BLOCK_COUNT] = {
+    DXX_BT_8050(0)
+};
+
+/** \brief  Block-to-track table of 1581 disks
+ */
+static const uint8_t block_track_1581[CBMFM_D81_BLOCK_COUNT] = {
+    DXX_BT5(0, 40), DXX_BT5(5, 40), DXX_BT5(10, 40), DXX_BT5(15, 40),
+    DXX_BT5(20, 40), DXX_BT5(25, 40), DXX_BT5(30, 40), DXX_BT5(35, 40),
+    DXX_BT5(40, 40), DXX_BT5(45, 40), DXX_BT5(50, 40), DXX_BT5(55, 40),
+    DXX_BT5(60, 40), DXX_BT5(65, 40), DXX_BT5(70, 40), DXX_BT5(75, 40)
+};
+
+/** \brief  Block-to-track table of 8250 disks
+ */
+static const uint8_t block_track_8250[CBMFM_D82_BLOCK_COUNT] = {
+    DXX_BT_8050(0),
+    DXX_BT_8050(77)
+};
+
+
+/** \brief  Geometry of 35-track D64 images
+ */
+static const cbmfm_dxx_geometry_t geometry_d64 = {
+    zones_1541, CBMFM_D64_TRACK_MAX, CBMFM_D64_BLOCK_COUNT,
+    tracks_1541, block_track_1541
+};
+
+/** \brief  Geometry of 40-track D64 images
+ */
+static const cbmfm_dxx_geometry_t geometry_d64_ext = {
+    zones_1541, CBMFM_D64_TRACK_MAX_EXT, CBMFM_D64_BLOCK_COUNT_EXT,
+    tracks_1541, block_track_1541
+};
+
+/** \brief  Geometry of 42-track D64 images
+ */
+static const cbmfm_dxx_geometry_t geometry_d64_42 = {
+    zones_1541, CBMFM_D64_TRACK_MAX_42, CBMFM_D64_BLOCK_COUNT_42,
+    tracks_1541, block_track_1541
+};
+
+/** \brief  Geometry of D71 images
+ */
+static const cbmfm_dxx_geometry_t geometry_d71 = {
+    zones_1571, CBMFM_D71_TRACK_MAX, CBMFM_D71_BLOCK_COUNT,
+    tracks_1571, block_track_1571
+};
+
+/** \brief  Geometry of D80 images
+ */
+static const cbmfm_dxx_geometry_t geometry_d80 = {
+    zones_8050, CBMFM_D80_TRACK_MAX, CBMFM_D80_BLOCK_COUNT,
+    tracks_8050, block_track_8050
+};
+
+/** \brief  Geometry of D81 images
+ */
+static const cbmfm_dxx_geometry_t geometry_d81 = {
+    zones_1581, CBMFM_D81_TRACK_MAX, CBMFM_D81_BLOCK_COUNT,
+    tracks_1581, block_track_1581
+};
+
+/** \brief  Geometry of D82 images
+ */
+static const cbmfm_dxx_geometry_t geometry_d82 = {
+    zones_8250, CBMFM_D82_TRACK_MAX, CBMFM_D82_BLOCK_COUNT,
+    tracks_8250, block_track_8250
+};
+
+/** @} */
+
+
+/** \brief  Get geometry descriptor for image \a type with \a tracks tracks
+ *
+ * Only D64 images support multiple track counts (35, 40 or 42), for the other
+ * types \a tracks is ignored.
+ *
+ * \param[in]   type    image type
+ * \param[in]   tracks  number of tracks
+ *
+ * \return  geometry descriptor or `NULL` when not found
+ *
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_TYPE_MISMATCH
+ */
+const cbmfm_dxx_geometry_t *cbmfm_dxx_geometry_get(int type, int tracks)
+{
+    switch (type) {
+        case CBMFM_IMAGE_TYPE_D64:
+            switch (tracks) {
+                case CBMFM_D64_TRACK_MAX:
+                    return &geometry_d64;
+                case CBMFM_D64_TRACK_MAX_EXT:
+                    return &geometry_d64_ext;
+                case CBMFM_D64_TRACK_MAX_42:
+                    return &geometry_d64_42;
+                default:
+                    cbmfm_error_set(CBMFM_ERR_ILLEGAL_TRACK, NULL, -1);
+                    return NULL;
+            }
+        case CBMFM_IMAGE_TYPE_D71:
+            return &geometry_d71;
+        case CBMFM_IMAGE_TYPE_D80:
+            return &geometry_d80;
+        case CBMFM_IMAGE_TYPE_D81:
+            return &geometry_d81;
+        case CBMFM_IMAGE_TYPE_D82:
+            return &geometry_d82;
+        default:
+            cbmfm_error_set(CBMFM_ERR_TYPE_MISMATCH, NULL, -1);
+            return NULL;
+    }
+}
+
+
+/** \brief  Get block number of block (\a track, \a sector) using \a geometry
+ *
+ * \param[in]   geometry    geometry descriptor
+ * \param[in]   track       track number
+ * \param[in]   sector      sector number
+ *
+ * \return  block number (starting at 0) or -1 on error
+ *
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
+ */
+int cbmfm_dxx_geometry_block_number(const cbmfm_dxx_geometry_t *geometry,
+                                    int track, int sector)
+{
+    const cbmfm_dxx_track_t *entry;
+
+    if (track < 1 || track > geometry->track_max) {
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_TRACK, NULL, -1);
+        return -1;
+    }
+    entry = &(geometry->tracks[track]);
+    if (sector < 0 || sector >= entry->blocks) {
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_SECTOR, NULL, -1);
+        return -1;
+    }
+    return entry->start + sector;
+}
+
+
+/** \brief  Get (\a track, \a sector) of \a block using \a geometry
+ *
+ * \param[in]   geometry    geometry descriptor
+ * \param[in]   block       block number
+ * \param[out]  track       track number
+ * \param[out]  sector      sector number
+ *
+ * \return  true on success
+ *
+ * \throw   #CBMFM_ERR_INDEX
+ */
+bool cbmfm_dxx_geometry_block_ts(const cbmfm_dxx_geometry_t *geometry,
+                                 int block, int *track, int *sector)
+{
+    int t;
+
+    if (block < 0 || block >= geometry->block_count) {
+        cbmfm_error_set(CBMFM_ERR_INDEX, NULL, -1);
+        return false;
+    }
+    t = geometry->block_track[block];
+    *track = t;
+    *sector = block - geometry->tracks[t].start;
+    return true;
+}
+
+
+/** \brief  Get offset in \a image of block (\a track, \a sector)
+ *
+ * Uses the image's geometry tables when available, falling back to walking
+ * the speed zones otherwise.
+ *
+ * \param[in]   image   dxx image
+ * \param[in]   track   track number
+ * \param[in]   sector  sector number
+ *
+ * \return  offset in \a image or -1 on error
+ *
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
+ */
+intmax_t cbmfm_dxx_image_block_offset(const cbmfm_dxx_image_t *image,
+                                      int track, int sector)
+{
+    int block;
+
+    if (image->geometry == NULL) {
+        return cbmfm_dxx_block_offset(image->zones, track, sector);
+    }
+    block = cbmfm_dxx_geometry_block_number(image->geometry, track, sector);
+    if (block < 0) {
+        return -1;
+    }
+    return (intmax_t)block * CBMFM_BLOCK_SIZE_RAW;
+}
+
+
 /** \brief  Get block number of block (\a track, \a sector)
  *
  * \param[in]   zones   speed zone table
@@ -59,23 +514,22 @@ int cbmfm_dxx_block_number(const cbmfm_dxx_speedzone_t *zones,
     int z = 0;
 
     if (track < 1) {
-        cbmfm_errno = CBMFM_ERR_ILLEGAL_TRACK;
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_TRACK, NULL, -1);
         return -1;
     }
     if (sector < 0) {
-        cbmfm_errno = CBMFM_ERR_ILLEGAL_SECTOR;
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_SECTOR, NULL, -1);
         return -1;
     }
 
     while (zones[z].trk_lo >= 1) {
-        if (sector >= zones[z].blocks) {
-            /* sector# too high */
-            cbmfm_errno = CBMFM_ERR_ILLEGAL_SECTOR;
-            return -1;
-        }
-
         if (track >= zones[z].trk_lo && track <= zones[z].trk_hi) {
             /* in the zone :) */
+            if (sector >= zones[z].blocks) {
+                /* sector# too high */
+                cbmfm_error_set(CBMFM_ERR_ILLEGAL_SECTOR, NULL, -1);
+                return -1;
+            }
             return blocks + (track - zones[z].trk_lo) * zones[z].blocks + sector;
         } else {
             /* add size of zone */
@@ -87,7 +541,7 @@ int cbmfm_dxx_block_number(const cbmfm_dxx_speedzone_t *zones,
     }
 
     /* ran out of zones -> track# too high */
-    cbmfm_errno = CBMFM_ERR_ILLEGAL_TRACK;
+    cbmfm_error_set(CBMFM_ERR_ILLEGAL_TRACK, NULL, -1);
     return -1;
 }
 
@@ -131,9 +585,8 @@ bool cbmfm_dxx_block_read(cbmfm_block_t *block,
                           int track, int sector)
 {
     intmax_t offset;
-    const cbmfm_dxx_speedzone_t *zones = image->zones;
 
-    offset = cbmfm_dxx_block_offset(zones, track, sector);
+    offset = cbmfm_dxx_image_block_offset(image, track, sector);
     if (offset < 0) {
         return false;
     }
@@ -160,9 +613,12 @@ int cbmfm_dxx_track_block_count(cbmfm_dxx_image_t *image, int track)
     int z = 0;
 
     if (track < 1 || track > image->track_max) {
-        cbmfm_errno = CBMFM_ERR_ILLEGAL_TRACK;
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_TRACK, NULL, -1);
         return -1;
     }
+    if (image->geometry != NULL) {
+        return image->geometry->tracks[track].blocks;
+    }
 
     while (track > zones[z].trk_hi && zones[z].trk_hi >= 1) {
         z++;
@@ -194,12 +650,12 @@ bool cbmfm_dxx_block_iter_init(cbmfm_dxx_block_iter_t *iter,
 
     /* check track number */
     if (track < 1 || track > image->track_max) {
-        cbmfm_errno = CBMFM_ERR_ILLEGAL_TRACK;
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_TRACK, NULL, -1);
         return false;
     }
     /* check sector number */
     if (sector < 0 || sector >= cbmfm_dxx_track_block_count(image, track)) {
-        cbmfm_errno = CBMFM_ERR_ILLEGAL_SECTOR;
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_SECTOR, NULL, -1);
         return false;
     }
 
@@ -226,8 +682,12 @@ bool cbmfm_dxx_block_iter_next(cbmfm_dxx_block_iter_t *iter)
         return false;
     }
 
-    offset = cbmfm_dxx_block_offset(iter->image->zones,
+    offset = cbmfm_dxx_image_block_offset(iter->image,
             iter->curr.track, iter->curr.sector);
+    if (offset < 0) {
+        /* invalid link in previous block, error already set */
+        return false;
+    }
     data = iter->image->data + offset;
     next_track = data[0];
     next_sector = data[1];
@@ -251,7 +711,7 @@ void cbmfm_dxx_block_iter_read_data(cbmfm_dxx_block_iter_t *iter, uint8_t *dest)
     intmax_t offset;
     uint8_t *data;
 
-    offset = cbmfm_dxx_block_offset(iter->image->zones,
+    offset = cbmfm_dxx_image_block_offset(iter->image,
             iter->curr.track, iter->curr.sector);
     data = iter->image->data + offset;
 
@@ -259,6 +719,237 @@ void cbmfm_dxx_block_iter_read_data(cbmfm_dxx_block_iter_t *iter, uint8_t *dest)
 }
 
 
+/** \brief  Get pointer to the raw data of the current block in \a iter
+ *
+ * Returns a pointer directly into the image data, no data is copied. The
+ * first two bytes are the (track,sector) link to the next block.
+ *
+ * \param[in]   iter    block iterator
+ *
+ * \return  pointer to 256 bytes of block data or `NULL` on error
+ *
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
+ */
+const uint8_t *cbmfm_dxx_block_iter_block_ptr(const cbmfm_dxx_block_iter_t *iter)
+{
+    intmax_t offset;
+
+    offset = cbmfm_dxx_image_block_offset(iter->image,
+            iter->curr.track, iter->curr.sector);
+    if (offset < 0) {
+        return NULL;
+    }
+    return iter->image->data + offset;
+}
+
+
+/** \brief  Get pointer to the payload of the current block in \a iter
+ *
+ * Returns a pointer directly into the image data, skipping the link bytes.
+ * For the last block of a chain (link track is 0) the link sector holds the
+ * index of the last byte used, so the payload is shorter than 254 bytes.
+ *
+ * \param[in]   iter    block iterator
+ * \param[out]  size    payload size in bytes
+ *
+ * \return  pointer to payload or `NULL` on error
+ *
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
+ */
+const uint8_t *cbmfm_dxx_block_iter_payload(const cbmfm_dxx_block_iter_t *iter,
+                                            size_t *size)
+{
+    const uint8_t *block = cbmfm_dxx_block_iter_block_ptr(iter);
+
+    if (block == NULL) {
+        *size = 0;
+        return NULL;
+    }
+    if (block[0] != 0) {
+        *size = CBMFM_BLOCK_SIZE_DATA;
+    } else {
+        *size = block[1] >= 2 ? (size_t)(block[1] - 1) : 0;
+    }
+    return block + 2;
+}
+
+
+/** \brief  Size in bytes of a bitmap of all blocks of the largest geometry
+ */
+#define DXX_CHAIN_BITMAP_SIZE   ((CBMFM_D82_BLOCK_COUNT + 7) / 8)
+
+
+/** \brief  Check block chain at (\a track,\a sector) and count its data
+ *
+ * Walks the chain once, marking each visited block in a bitmap, so a chain
+ * that links back to a block seen before is rejected instead of looping.
+ *
+ * \param[in]   image   dxx image
+ * \param[in]   track   track number of first block
+ * \param[in]   sector  sector number of first block
+ * \param[out]  blocks  number of blocks in the chain
+ * \param[out]  bytes   number of payload bytes in the chain
+ *
+ * \return  true on success
+ *
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+static bool dxx_chain_check(cbmfm_dxx_image_t *image,
+                            int track, int sector,
+                            size_t *blocks, size_t *bytes)
+{
+    cbmfm_dxx_block_iter_t iter;
+    uint8_t visited[DXX_CHAIN_BITMAP_SIZE];
+
+    *blocks = 0;
+    *bytes = 0;
+    if (!cbmfm_dxx_block_iter_init(&iter, image, track, sector)) {
+        return false;
+    }
+
+    memset(visited, 0, sizeof visited);
+    while (iter.curr.track != 0) {
+        const uint8_t *payload;
+        size_t size;
+        size_t block;
+
+        payload = cbmfm_dxx_block_iter_payload(&iter, &size);
+        if (payload == NULL) {
+            return false;
+        }
+        block = (size_t)(payload - image->data) / CBMFM_BLOCK_SIZE_RAW;
+        if (block >= DXX_CHAIN_BITMAP_SIZE * 8) {
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
+            return false;
+        }
+        if (visited[block / 8] & (1U << (block % 8))) {
+            /* chain links back to a block already seen */
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
+            return false;
+        }
+        visited[block / 8] = (uint8_t)(visited[block / 8] | (1U << (block % 8)));
+
+        (*blocks)++;
+        *bytes += size;
+        if (!cbmfm_dxx_block_iter_next(&iter)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/** \brief  Get extents of the payload of block chain at (\a track,\a sector)
+ *
+ * Stores the offset in the image data and size of each block's payload,
+ * which allows reading, hashing or writing the chain's data without copying
+ * it first.
+ *
+ * \param[in]   image   dxx image
+ * \param[in]   track   track number of first block
+ * \param[in]   sector  sector number of first block
+ * \param[out]  count   number of extents
+ * \param[out]  total   total number of payload bytes (optional)
+ *
+ * \return  heap-allocated array of extents, or `NULL` on error
+ *
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+cbmfm_extent_t *cbmfm_dxx_chain_extents(cbmfm_dxx_image_t *image,
+                                        int track, int sector,
+                                        size_t *count, size_t *total)
+{
+    cbmfm_dxx_block_iter_t iter;
+    cbmfm_extent_t *extents;
+    size_t blocks;
+    size_t bytes;
+    size_t i;
+
+    *count = 0;
+    if (total != NULL) {
+        *total = 0;
+    }
+    if (!dxx_chain_check(image, track, sector, &blocks, &bytes)) {
+        return NULL;
+    }
+
+    /* the chain is valid, so no need to check anything in this pass */
+    extents = cbmfm_malloc((blocks > 0 ? blocks : 1U) * sizeof *extents);
+    cbmfm_dxx_block_iter_init(&iter, image, track, sector);
+    for (i = 0; i < blocks; i++) {
+        const uint8_t *payload = cbmfm_dxx_block_iter_payload(&iter,
+                &(extents[i].size));
+
+        extents[i].offset = (size_t)(payload - image->data);
+        cbmfm_dxx_block_iter_next(&iter);
+    }
+
+    *count = blocks;
+    if (total != NULL) {
+        *total = bytes;
+    }
+    return extents;
+}
+
+
+/** \brief  Read payload of block chain at (\a track,\a sector)
+ *
+ * The chain is checked and measured first, so the data is allocated once with
+ * the exact size and then copied. Chains that loop or link to illegal blocks
+ * are rejected.
+ *
+ * \param[in]   image   dxx image
+ * \param[in]   track   track number of first block
+ * \param[in]   sector  sector number of first block
+ * \param[out]  data    heap-allocated chain data
+ * \param[out]  size    size of \a data
+ *
+ * \return  true on success
+ *
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+bool cbmfm_dxx_chain_read(cbmfm_dxx_image_t *image,
+                          int track, int sector,
+                          uint8_t **data, size_t *size)
+{
+    cbmfm_dxx_block_iter_t iter;
+    uint8_t *buffer;
+    size_t blocks;
+    size_t bytes;
+    size_t offset = 0;
+    size_t i;
+
+    *data = NULL;
+    *size = 0;
+    if (!dxx_chain_check(image, track, sector, &blocks, &bytes)) {
+        return false;
+    }
+
+    buffer = cbmfm_malloc(bytes > 0 ? bytes : 1U);
+    cbmfm_dxx_block_iter_init(&iter, image, track, sector);
+    for (i = 0; i < blocks; i++) {
+        size_t len;
+        const uint8_t *payload = cbmfm_dxx_block_iter_payload(&iter, &len);
+
+        memcpy(buffer + offset, payload, len);
+        offset += len;
+        cbmfm_dxx_block_iter_next(&iter);
+    }
+
+    *data = buffer;
+    *size = bytes;
+    return true;
+}
+
+
 /** \brief  Write data to current block
  *
  * \param[in,out]   iter    Dxx block iterator
@@ -271,7 +962,7 @@ void cbmfm_dxx_block_iter_write_data(cbmfm_dxx_block_iter_t *iter,
 {
     intmax_t offset;
 
-    offset = cbmfm_dxx_block_offset(iter->image->zones,
+    offset = cbmfm_dxx_image_block_offset(iter->image,
             iter->curr.track, iter->curr.sector);
     memcpy(iter->image->data + offset, data, size);
 }
@@ -49,6 +49,14 @@
  */
 #define CBMFM_D64_TRACK_MAX     35
 
+/** \brief  Highest track number for extended D64 images
+ */
+#define CBMFM_D64_TRACK_MAX_EXT 40
+
+/** \brief  Highest track number for 42-track D64 images
+ */
+#define CBMFM_D64_TRACK_MAX_42  42
+
 /** \brief  Highest track number for D71 images
  */
 #define CBMFM_D71_TRACK_MAX     70
@@ -74,6 +82,26 @@
  */
 #define CBMFM_D64_BLOCK_COUNT_EXT   768
 
+/** \brief  Number of blocks in a 42-track d64 image
+ */
+#define CBMFM_D64_BLOCK_COUNT_42    802
+
+/** \brief  Number of blocks in a d71 image
+ */
+#define CBMFM_D71_BLOCK_COUNT       1366
+
+/** \brief  Number of blocks in a d80 image
+ */
+#define CBMFM_D80_BLOCK_COUNT       2083
+
+/** \brief  Number of blocks in a d81 image
+ */
+#define CBMFM_D81_BLOCK_COUNT       3200
+
+/** \brief  Number of blocks in a d82 image
+ */
+#define CBMFM_D82_BLOCK_COUNT       4166
+
 
 
 /** \brief  Size of a standard 35-track image, no error bytes
@@ -120,6 +148,22 @@
 #define CBMFM_D64_DIR_SECTOR    1
 
 
+/** \brief  Maximum number of directory entries of a D64
+ *
+ * 18 directory sectors of 8 entries each.
+ */
+#define CBMFM_D64_DIR_ENTRIES_MAX   144
+
+
+/** \brief  Sector interleave used by the 1541 DOS for file data
+ */
+#define CBMFM_D64_INTERLEAVE_DATA   10
+
+/** \brief  Sector interleave used by the 1541 DOS for directory blocks
+ */
+#define CBMFM_D64_INTERLEAVE_DIR    3
+
+
 /** \brief  BAM track number
  */
 #define CBMFM_D64_BAM_TRACK     18
@@ -238,6 +282,16 @@
 
 
 
+const cbmfm_dxx_geometry_t *
+            cbmfm_dxx_geometry_get(int type, int tracks);
+int         cbmfm_dxx_geometry_block_number(
+                                    const cbmfm_dxx_geometry_t *geometry,
+                                    int track, int sector);
+bool        cbmfm_dxx_geometry_block_ts(const cbmfm_dxx_geometry_t *geometry,
+                                        int block, int *track, int *sector);
+intmax_t    cbmfm_dxx_image_block_offset(const cbmfm_dxx_image_t *image,
+                                         int track, int sector);
+
 int         cbmfm_dxx_block_number(const cbmfm_dxx_speedzone_t *zones,
                                    int track, int sector);
 intmax_t    cbmfm_dxx_block_offset(const cbmfm_dxx_speedzone_t *zones,
@@ -254,6 +308,18 @@ bool        cbmfm_dxx_block_iter_init(cbmfm_dxx_block_iter_t *iter,
 bool        cbmfm_dxx_block_iter_next(cbmfm_dxx_block_iter_t *iter);
 void        cbmfm_dxx_block_iter_read_data(cbmfm_dxx_block_iter_t *iter,
                                            uint8_t *dest);
+const uint8_t *
+            cbmfm_dxx_block_iter_block_ptr(const cbmfm_dxx_block_iter_t *iter);
+const uint8_t *
+            cbmfm_dxx_block_iter_payload(const cbmfm_dxx_block_iter_t *iter,
+                                         size_t *size);
+cbmfm_extent_t *
+            cbmfm_dxx_chain_extents(cbmfm_dxx_image_t *image,
+                                    int track, int sector,
+                                    size_t *count, size_t *total);
+bool        cbmfm_dxx_chain_read(cbmfm_dxx_image_t *image,
+                                 int track, int sector,
+                                 uint8_t **data, size_t *size);
 
 void        cbmfm_dxx_dirent_init(cbmfm_dirent_t *dirent, int type);
 
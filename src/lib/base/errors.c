@@ -36,9 +36,39 @@
 #include "errors.h"
 
 
-/** \brief  Global error code for the library
+/** \brief  Thread-local storage class specifier
+ *
+ * C99 doesn't have one, so use the compiler extensions. Without one, all
+ * threads share the same context.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+# define CBMFM_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+# define CBMFM_THREAD_LOCAL __declspec(thread)
+#else
+# define CBMFM_THREAD_LOCAL
+#endif
+
+
+/** \brief  Default context
+ *
+ * Holds the logging configuration used by threads without a context set with
+ * cbmfm_ctx_set(), and the initial logging configuration of new contexts.
  */
-int cbmfm_errno;
+static cbmfm_ctx_t ctx_default = { 0, 0, NULL, -1, 0, NULL, false };
+
+/** \brief  Context set for the calling thread with cbmfm_ctx_set()
+ */
+static CBMFM_THREAD_LOCAL cbmfm_ctx_t *ctx_current = NULL;
+
+/** \brief  Implicit error state of the calling thread
+ *
+ * Used when no context was set with cbmfm_ctx_set(). Only the error members
+ * are used, logging goes through #ctx_default.
+ */
+static CBMFM_THREAD_LOCAL cbmfm_ctx_t ctx_thread = {
+    0, 0, NULL, -1, 0, NULL, false
+};
 
 
 /** \brief  Error messages
@@ -59,10 +89,147 @@ static const char *cbmfm_err_messages[CBMFM_ERR_CODE_COUNT] = {
     "buffer underflow",
     "buffer overflow",
     "file is readonly",
-    "missing filename"
+    "missing filename",
+    "disk full"
 };
 
 
+/** \brief  Initialize \a ctx
+ *
+ * Clears the error state and copies the logging configuration of the default
+ * context. The log file of the default context is shared, not owned: calling
+ * cbmfm_log_close() with \a ctx set doesn't close it.
+ *
+ * \param[out]  ctx context
+ */
+void cbmfm_ctx_init(cbmfm_ctx_t *ctx)
+{
+    ctx->err_code = CBMFM_ERR_OK;
+    ctx->err_detail_code = CBMFM_ERR_OK;
+    ctx->err_detail = NULL;
+    ctx->err_offset = -1;
+    ctx->log_level = ctx_default.log_level;
+    ctx->log_file = ctx_default.log_file;
+    ctx->log_file_owned = false;
+}
+
+
+/** \brief  Use \a ctx for library calls made by the calling thread
+ *
+ * The context must stay valid until it is replaced. Use `NULL` to return to
+ * the implicit per-thread error state and the default logging configuration.
+ *
+ * \param[in]   ctx context or `NULL`
+ */
+void cbmfm_ctx_set(cbmfm_ctx_t *ctx)
+{
+    ctx_current = ctx;
+}
+
+
+/** \brief  Get context holding the error state of the calling thread
+ *
+ * \return  context set with cbmfm_ctx_set() or the implicit thread context
+ */
+cbmfm_ctx_t *cbmfm_ctx_get(void)
+{
+    return ctx_current != NULL ? ctx_current : &ctx_thread;
+}
+
+
+/** \brief  Get the default context
+ *
+ * Its logging configuration is set with cbmfm_log_set_level() and
+ * cbmfm_log_set_file(), which should be done before starting any threads.
+ *
+ * \return  default context
+ */
+cbmfm_ctx_t *cbmfm_ctx_default(void)
+{
+    return &ctx_default;
+}
+
+
+/** \brief  Get context holding the logging configuration of the calling thread
+ *
+ * \return  context set with cbmfm_ctx_set() or the default context
+ */
+cbmfm_ctx_t *cbmfm_ctx_log(void)
+{
+    return ctx_current != NULL ? ctx_current : &ctx_default;
+}
+
+
+/** \brief  Get location of the error code of the calling thread
+ *
+ * Used by the #cbmfm_errno macro.
+ *
+ * \return  pointer to error code
+ */
+int *cbmfm_errno_location(void)
+{
+    return &(cbmfm_ctx_get()->err_code);
+}
+
+
+/** \brief  Set error code with a detail message and offset of offending data
+ *
+ * \param[in]   code    error code
+ * \param[in]   detail  detail message, must be a static string (or `NULL`)
+ * \param[in]   offset  offset of offending data in an image or file, or -1
+ */
+void cbmfm_error_set(int code, const char *detail, intmax_t offset)
+{
+    cbmfm_ctx_t *ctx = cbmfm_ctx_get();
+
+    ctx->err_code = code;
+    ctx->err_detail_code = code;
+    ctx->err_detail = detail;
+    ctx->err_offset = offset;
+}
+
+
+/** \brief  Clear error state of the calling thread
+ */
+void cbmfm_error_clear(void)
+{
+    cbmfm_error_set(CBMFM_ERR_OK, NULL, -1);
+}
+
+
+/** \brief  Get detail message of the current error
+ *
+ * Only errors set with cbmfm_error_set() have details.
+ *
+ * \return  detail message or `NULL`
+ */
+const char *cbmfm_error_detail(void)
+{
+    cbmfm_ctx_t *ctx = cbmfm_ctx_get();
+
+    if (ctx->err_detail_code != ctx->err_code) {
+        /* error code was set directly after the detail */
+        return NULL;
+    }
+    return ctx->err_detail;
+}
+
+
+/** \brief  Get offset of the offending data of the current error
+ *
+ * \return  offset or -1 when unknown
+ */
+intmax_t cbmfm_error_offset(void)
+{
+    cbmfm_ctx_t *ctx = cbmfm_ctx_get();
+
+    if (ctx->err_detail_code != ctx->err_code) {
+        return -1;
+    }
+    return ctx->err_offset;
+}
+
+
 /** \brief  Get error message for error code
  *
  * \param[in]   code    error code
@@ -81,20 +248,31 @@ const char *cbmfm_strerror(int code)
 /** \brief  Print current error code and message on stderr
  *
  * Prints current library error code and message and stderr, and in case of
- * CBMF_ERR_IO, the C-lib errno and strerror
+ * CBMF_ERR_IO, the C-lib errno and strerror. The detail message and offset
+ * are printed when available.
  *
  * \param[in]   prefix  optional prefix for the message (NULL to disable)
  */
 void cbmfm_perror(const char *prefix)
 {
+    const char *detail = cbmfm_error_detail();
+    intmax_t offset = cbmfm_error_offset();
+
     if (prefix != NULL && *prefix != '\0') {
         fprintf(stderr, "%s: ", prefix);
     }
     if (cbmfm_errno == CBMFM_ERR_IO) {
-        fprintf(stderr, "%d: %s (%d: %s)\n",
+        fprintf(stderr, "%d: %s (%d: %s)",
                 cbmfm_errno, cbmfm_strerror(cbmfm_errno),
                 errno, strerror(errno));
     } else {
-        fprintf(stderr, "%d: %s\n", cbmfm_errno, cbmfm_strerror(cbmfm_errno));
+        fprintf(stderr, "%d: %s", cbmfm_errno, cbmfm_strerror(cbmfm_errno));
+    }
+    if (detail != NULL) {
+        fprintf(stderr, ": %s", detail);
+    }
+    if (offset >= 0) {
+        fprintf(stderr, " (offset $%" PRIxMAX ")", (uintmax_t)offset);
     }
+    fputc('\n', stderr);
 }
@@ -28,7 +28,18 @@
 #ifndef CBMFM_LIB_BASE_ERRORS_H
 #define CBMFM_LIB_BASE_ERRORS_H
 
-extern int cbmfm_errno;
+#include <stdint.h>
+
+#include "cbmfm_types.h"
+
+
+/** \brief  Error code of the calling thread's library context
+ *
+ * Can be assigned to and read like a variable, see cbmfm_errno_location().
+ * Assigning it directly doesn't clear the detail of an earlier error with the
+ * same code, the library itself sets errors with cbmfm_error_set().
+ */
+#define cbmfm_errno (*cbmfm_errno_location())
 
 
 /** \brief  Error codes
@@ -50,12 +61,25 @@ typedef enum cbmfm_err_e {
     CBMFM_ERR_BUFFER_OVERFLOW,  /**< buffer overflow */
     CBMFM_ERR_READONLY,         /**< file is read-only */
     CBMFM_ERR_MISSING_FILENAME, /**< missing filename */
+    CBMFM_ERR_DISK_FULL,        /**< no free blocks or directory entries */
 
     CBMFM_ERR_CODE_COUNT        /**< number of error messages */
 
 } cbmfm_err_t;
 
-const char *cbmfm_strerror(int code);
-void        cbmfm_perror(const char *prefix);
+void            cbmfm_ctx_init(cbmfm_ctx_t *ctx);
+void            cbmfm_ctx_set(cbmfm_ctx_t *ctx);
+cbmfm_ctx_t *   cbmfm_ctx_get(void);
+cbmfm_ctx_t *   cbmfm_ctx_default(void);
+cbmfm_ctx_t *   cbmfm_ctx_log(void);
+
+int *           cbmfm_errno_location(void);
+void            cbmfm_error_set(int code, const char *detail, intmax_t offset);
+void            cbmfm_error_clear(void);
+const char *    cbmfm_error_detail(void);
+intmax_t        cbmfm_error_offset(void);
+
+const char *    cbmfm_strerror(int code);
+void            cbmfm_perror(const char *prefix);
 
 #endif
@@ -114,6 +114,8 @@ void cbmfm_file_init(cbmfm_file_t *file)
     file->data = NULL;
     file->size = 0;
     file->type = 0;
+    file->prefix_len = 0;
+    file->borrowed = false;
 }
 
 
@@ -132,12 +134,13 @@ cbmfm_file_t *cbmfm_file_new(void)
 /** \brief  Free members of \a file but not \a file itself
  *
  * Frees memory used by \a file's members and reinitializes it for new use.
+ * Borrowed data isn't freed.
  *
  * \param[in,out]   file    file object
  */
 void cbmfm_file_cleanup(cbmfm_file_t *file)
 {
-    if (file->data != NULL) {
+    if (file->data != NULL && !file->borrowed) {
         cbmfm_free(file->data);
     }
     cbmfm_file_init(file);
@@ -155,6 +158,65 @@ void cbmfm_file_free(cbmfm_file_t *file)
 }
 
 
+/** \brief  Let \a file borrow \a size bytes of \a data
+ *
+ * The data isn't copied and won't be freed by cbmfm_file_cleanup().
+ *
+ * \param[in,out]   file    file object
+ * \param[in]       data    data to borrow
+ * \param[in]       size    size of \a data
+ */
+void cbmfm_file_borrow(cbmfm_file_t *file, uint8_t *data, size_t size)
+{
+    file->data = data;
+    file->size = size;
+    file->prefix_len = 0;
+    file->borrowed = true;
+}
+
+
+/** \brief  Get size of \a file, including its prefix
+ *
+ * \param[in]   file    file object
+ *
+ * \return  size in bytes
+ */
+size_t cbmfm_file_get_size(const cbmfm_file_t *file)
+{
+    return file->prefix_len + file->size;
+}
+
+
+/** \brief  Make \a file own a contiguous copy of its contents
+ *
+ * Copies borrowed data, joined with the prefix, into memory owned by \a file.
+ * Does nothing when \a file already owns its data.
+ *
+ * \param[in,out]   file    file object
+ */
+void cbmfm_file_own(cbmfm_file_t *file)
+{
+    uint8_t *data;
+
+    if (!file->borrowed && file->prefix_len == 0) {
+        return;
+    }
+
+    data = cbmfm_malloc(cbmfm_file_get_size(file));
+    memcpy(data, file->prefix, file->prefix_len);
+    if (file->size > 0) {
+        memcpy(data + file->prefix_len, file->data, file->size);
+    }
+    if (!file->borrowed) {
+        cbmfm_free(file->data);
+    }
+    file->data = data;
+    file->size = cbmfm_file_get_size(file);
+    file->prefix_len = 0;
+    file->borrowed = false;
+}
+
+
 /** \brief  Write \a file to host OS
  *
  * If \a name is `NULL`, the PETSCII file name will be converted to the host
@@ -167,7 +229,8 @@ void cbmfm_file_free(cbmfm_file_t *file)
  */
 bool cbmfm_file_write_host(const cbmfm_file_t *file, const char *name)
 {
-    char hname[CBMFM_CBMDOS_FILE_NAME_LEN + 1];
+    /* name, '.', three character extension and terminator */
+    char hname[CBMFM_CBMDOS_FILE_NAME_LEN + 5];
 
     if (name == NULL) {
         const char *suffix = cbmfm_cbmdos_filetype(file->type);
@@ -176,7 +239,8 @@ bool cbmfm_file_write_host(const cbmfm_file_t *file, const char *name)
     }
 
     cbmfm_log_debug("writing file as '%s'\n", name);
-    return cbmfm_write_file(file->data, file->size, name);
+    return cbmfm_write_file_prefixed(file->prefix, file->prefix_len,
+            file->data, file->size, name);
 }
 
 
@@ -193,10 +257,10 @@ void cbmfm_file_dump(const cbmfm_file_t *file)
     name[CBMFM_CBMDOS_FILE_NAME_LEN] = '\0';
 
     printf("%5d \"%s\" %c%s%c  (%zu bytes)\n",
-            cbmfm_size_to_blocks(file->size),
+            cbmfm_size_to_blocks(cbmfm_file_get_size(file)),
             name,
             cbmfm_cbmdos_is_closed(file->type) ? ' ' : '*',
             cbmfm_cbmdos_filetype(file->type),
             cbmfm_cbmdos_is_locked(file->type) ? '<' : ' ',
-            file->size);
+            cbmfm_file_get_size(file));
 }
@@ -44,6 +44,11 @@ void            cbmfm_file_init(cbmfm_file_t *file);
 cbmfm_file_t *  cbmfm_file_new(void);
 void            cbmfm_file_cleanup(cbmfm_file_t *file);
 void            cbmfm_file_free(cbmfm_file_t *file);
+void            cbmfm_file_borrow(cbmfm_file_t *file,
+                                  uint8_t *data,
+                                  size_t size);
+size_t          cbmfm_file_get_size(const cbmfm_file_t *file);
+void            cbmfm_file_own(cbmfm_file_t *file);
 bool            cbmfm_file_write_host(const cbmfm_file_t *file,
                                       const char *name);
 void            cbmfm_file_dump(const cbmfm_file_t *file);
@@ -33,6 +33,7 @@
 #include <ctype.h>
 
 #include "cbmfm_types.h"
+#include "lib/base/dir.h"
 #include "lib/base/errors.h"
 #include "lib/base/mem.h"
 #include "lib/base/io.h"
@@ -165,6 +166,9 @@ void cbmfm_image_init(cbmfm_image_t *image)
     image->path = NULL;
     image->flags = 0;
     image->type = CBMFM_IMAGE_TYPE_INVALID;
+    image->generation = 0;
+    image->dir_cache = NULL;
+    image->dir_cache_generation = 0;
 }
 
 
@@ -194,10 +198,31 @@ void cbmfm_image_cleanup(cbmfm_image_t *image)
     if (image->path != NULL) {
         cbmfm_free(image->path);
     }
+    cbmfm_image_free_data(image);
+    cbmfm_image_init(image);
+}
+
+
+/** \brief  Free or unmap the data of \a image
+ *
+ * Releases the image data, using munmap(2) when the data is a memory mapping
+ * and cbmfm_free() otherwise. Other members of \a image are left alone.
+ *
+ * \param[in,out]   image   image handle
+ */
+void cbmfm_image_free_data(cbmfm_image_t *image)
+{
     if (image->data != NULL) {
-        cbmfm_free(image->data);
+        if (cbmfm_image_get_mapped(image)) {
+            cbmfm_unmap_file(image->data, image->size);
+        } else {
+            cbmfm_free(image->data);
+        }
     }
-    cbmfm_image_init(image);
+    image->data = NULL;
+    image->size = 0;
+    cbmfm_image_set_flag(image, CBMFM_IMAGE_FLAG_MAPPED, false);
+    cbmfm_image_dir_cache_clear(image);
 }
 
 
@@ -235,6 +260,77 @@ bool cbmfm_image_read_data(cbmfm_image_t *image, const char *path)
     }
     image->size = (size_t)size;
     image->path = cbmfm_strdup(path);
+    cbmfm_image_dir_cache_clear(image);
+    cbmfm_image_set_dirty(image, false);
+    return true;
+}
+
+
+/** \brief  Map data from \a path into \a image
+ *
+ * Like cbmfm_image_read_data(), but the image data is a private read-only
+ * memory mapping of \a path, so opening the image doesn't copy its data onto
+ * the heap. The image is marked read only, functions altering the image data
+ * must not be used on it. cbmfm_image_cleanup() releases the mapping.
+ *
+ * If the file cannot be mapped, the data is read onto the heap instead and the
+ * image behaves as if opened with cbmfm_image_read_data(), except for the
+ * read only flag.
+ *
+ * \param[in,out]   image   image handle
+ * \param[in]       path    path to image file
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_FILE_TOO_LARGE
+ */
+bool cbmfm_image_map_data(cbmfm_image_t *image, const char *path)
+{
+    intmax_t size;
+    bool mapped;
+
+    size = cbmfm_map_file(&(image->data), path, &mapped);
+    if (size < 0) {
+        /* error already set */
+        return false;
+    }
+    image->size = (size_t)size;
+    image->path = cbmfm_strdup(path);
+    cbmfm_image_dir_cache_clear(image);
+    cbmfm_image_set_flag(image, CBMFM_IMAGE_FLAG_MAPPED, mapped);
+    cbmfm_image_set_readonly(image, true);
+    cbmfm_image_set_dirty(image, false);
+    return true;
+}
+
+
+/** \brief  Read data of a probed file into \a image
+ *
+ * Like cbmfm_image_read_data(), but reuses the open file handle and header
+ * of \a probe instead of opening the file again. The probe is closed
+ * afterwards.
+ *
+ * \param[in,out]   image   image handle
+ * \param[in,out]   probe   probe object, see cbmfm_probe_open()
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_FILE_TOO_LARGE
+ */
+bool cbmfm_image_read_probe(cbmfm_image_t *image, cbmfm_probe_t *probe)
+{
+    intmax_t size;
+
+    size = cbmfm_probe_read_data(probe, &(image->data));
+    if (size < 0) {
+        /* error already set */
+        return false;
+    }
+    image->size = (size_t)size;
+    image->path = cbmfm_strdup(probe->path);
+    cbmfm_image_dir_cache_clear(image);
     cbmfm_image_set_dirty(image, false);
     return true;
 }
@@ -259,13 +355,13 @@ bool cbmfm_image_write_data(cbmfm_image_t *image, const char *filename)
 {
     /* we need data */
     if (image->data == NULL) {
-        cbmfm_errno = CBMFM_ERR_INVALID_NULL;
+        cbmfm_error_set(CBMFM_ERR_INVALID_NULL, NULL, -1);
         return false;
     }
 
     /* make sure if the filename arg is NULL we have a filename in the image */
     if ((filename == NULL || *filename == '\0') && image->path == NULL) {
-        cbmfm_errno = CBMFM_ERR_MISSING_FILENAME;
+        cbmfm_error_set(CBMFM_ERR_MISSING_FILENAME, NULL, -1);
         return false;
     }
 
@@ -276,11 +372,11 @@ bool cbmfm_image_write_data(cbmfm_image_t *image, const char *filename)
     if (filename != NULL && image->path != NULL) {
         if (strcmp(filename, image->path) == 0 && cbmfm_image_get_readonly(image)) {
             /* same path, reject */
-            cbmfm_errno = CBMFM_ERR_READONLY;
+            cbmfm_error_set(CBMFM_ERR_READONLY, NULL, -1);
             return false;
         }
     } else if (image->path != NULL && cbmfm_image_get_readonly(image)) {
-        cbmfm_errno = CBMFM_ERR_READONLY;
+        cbmfm_error_set(CBMFM_ERR_READONLY, NULL, -1);
         return false;
     }
 
@@ -356,6 +452,18 @@ void cbmfm_image_set_readonly(cbmfm_image_t *image, bool readonly)
 }
 
 
+/** \brief  Check if the data of \a image is a memory mapping
+ *
+ * \param[in]   image   image handle
+ *
+ * \return  bool
+ */
+bool cbmfm_image_get_mapped(const cbmfm_image_t *image)
+{
+    return cbmfm_image_get_flag(image, CBMFM_IMAGE_FLAG_MAPPED);
+}
+
+
 /** \brief  Check if \a image is dirty
  *
  * In this context, dirty means the data in the image has changed since it
@@ -372,6 +480,9 @@ bool cbmfm_image_get_dirty(const cbmfm_image_t *image)
 
 
 /** \brief  Set dirty flag on \a image
+ *
+ * Setting the flag also increments the generation of \a image, invalidating
+ * its cached directory.
  *
  * \param[in,out]   image   image handle
  * \param[in]       dirty   image has unsaved changes
@@ -379,6 +490,94 @@ bool cbmfm_image_get_dirty(const cbmfm_image_t *image)
 void cbmfm_image_set_dirty(cbmfm_image_t *image, bool dirty)
 {
     cbmfm_image_set_flag(image, CBMFM_IMAGE_FLAG_DIRTY, dirty);
+    if (dirty) {
+        image->generation++;
+    }
+}
+
+
+/** \brief  Get modification generation of \a image
+ *
+ * \param[in]   image   image handle
+ *
+ * \return  generation
+ */
+uint32_t cbmfm_image_get_generation(const cbmfm_image_t *image)
+{
+    return image->generation;
+}
+
+
+/** \brief  Get cached directory of \a image without adding a reference
+ *
+ * The returned directory is only valid until \a image is modified.
+ *
+ * \param[in]   image   image handle
+ *
+ * \return  directory or `NULL` when no valid directory is cached
+ */
+const cbmfm_dir_t *cbmfm_image_dir_cache_peek(const cbmfm_image_t *image)
+{
+    if (image->dir_cache == NULL
+            || image->dir_cache_generation != image->generation) {
+        return NULL;
+    }
+    return image->dir_cache;
+}
+
+
+/** \brief  Get cached directory of \a image
+ *
+ * The cached directory is only returned when the image wasn't modified since
+ * it was stored. The caller owns a reference to the returned directory and
+ * should release it with cbmfm_dir_free().
+ *
+ * \param[in]   image   image handle
+ *
+ * \return  directory or `NULL` when no valid directory is cached
+ */
+cbmfm_dir_t *cbmfm_image_dir_cache_get(cbmfm_image_t *image)
+{
+    if (cbmfm_image_dir_cache_peek(image) == NULL) {
+        return NULL;
+    }
+    return cbmfm_dir_ref(image->dir_cache);
+}
+
+
+/** \brief  Store \a dir as the cached directory of \a image
+ *
+ * From here on \a dir is shared: every caller of the image's `*_dir_read`
+ * function gets a reference to it. Its name index is built here, so lookups
+ * don't alter it, and cbmfm_dir_append_dirent() refuses to alter it; use
+ * cbmfm_dir_unshare() to get a private copy.
+ *
+ * The reference count of a directory is atomic, so references to a cached
+ * directory may be used and released from any thread. The image itself isn't
+ * locked: it must not be modified while other threads use it.
+ *
+ * \param[in,out]   image   image handle
+ * \param[in,out]   dir     directory, a reference is added for the cache
+ */
+void cbmfm_image_dir_cache_set(cbmfm_image_t *image, cbmfm_dir_t *dir)
+{
+    cbmfm_dir_index_build(dir);
+    cbmfm_image_dir_cache_clear(image);
+    image->dir_cache = cbmfm_dir_ref(dir);
+    image->dir_cache_generation = image->generation;
+}
+
+
+/** \brief  Release the cached directory of \a image
+ *
+ * \param[in,out]   image   image handle
+ */
+void cbmfm_image_dir_cache_clear(cbmfm_image_t *image)
+{
+    if (image->dir_cache != NULL) {
+        cbmfm_dir_free(image->dir_cache);
+        image->dir_cache = NULL;
+    }
 }
 
 
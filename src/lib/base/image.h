@@ -47,8 +47,12 @@ void            cbmfm_image_init(cbmfm_image_t *image);
 cbmfm_image_t * cbmfm_image_alloc(void);
 void            cbmfm_image_cleanup(cbmfm_image_t *image);
 void            cbmfm_image_free(cbmfm_image_t *image);
+void            cbmfm_image_free_data(cbmfm_image_t *image);
 
 bool            cbmfm_image_read_data(cbmfm_image_t *image, const char *path);
+bool            cbmfm_image_map_data(cbmfm_image_t *image, const char *path);
+bool            cbmfm_image_read_probe(cbmfm_image_t *image,
+                                       cbmfm_probe_t *probe);
 bool            cbmfm_image_write_data(cbmfm_image_t *image,
                                        const char *filename);
 /*
@@ -61,8 +65,17 @@ void            cbmfm_image_set_flag(cbmfm_image_t *image, uint32_t flag,
 
 bool            cbmfm_image_get_readonly(const cbmfm_image_t *image);
 void            cbmfm_image_set_readonly(cbmfm_image_t *image, bool readonly);
+bool            cbmfm_image_get_mapped(const cbmfm_image_t *image);
 bool            cbmfm_image_get_dirty(const cbmfm_image_t *image);
 void            cbmfm_image_set_dirty(cbmfm_image_t *image, bool dirty);
+uint32_t        cbmfm_image_get_generation(const cbmfm_image_t *image);
+
+const cbmfm_dir_t *
+                cbmfm_image_dir_cache_peek(const cbmfm_image_t *image);
+cbmfm_dir_t *   cbmfm_image_dir_cache_get(cbmfm_image_t *image);
+void            cbmfm_image_dir_cache_set(cbmfm_image_t *image,
+                                          cbmfm_dir_t *dir);
+void            cbmfm_image_dir_cache_clear(cbmfm_image_t *image);
 bool            cbmfm_image_get_invalid(const cbmfm_image_t *image);
 void            cbmfm_image_set_invalid(cbmfm_image_t *image, bool invalid);
 
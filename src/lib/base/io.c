@@ -25,6 +25,11 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
  */
 
+#ifdef CBMFM_HOST_UNIX
+/* required for fileno(3), fstat(2) and mmap(2) with -std=c99 */
+# define _POSIX_C_SOURCE 200112L
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
@@ -34,6 +39,15 @@
 #include <errno.h>
 #include <ctype.h>
 
+#ifdef CBMFM_HOST_UNIX
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+# include <sys/uio.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
 #include "errors.h"
 #include "log.h"
 #include "mem.h"
@@ -90,7 +104,7 @@ intmax_t cbmfm_read_file_sizereq(uint8_t **dest, const char *path, size_t sizere
 
     fd = fopen(path, "rb");
     if (fd == NULL) {
-        cbmfm_errno = CBMFM_ERR_IO;
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
         return -1;
     }
 
@@ -104,7 +118,7 @@ intmax_t cbmfm_read_file_sizereq(uint8_t **dest, const char *path, size_t sizere
 
             /* check limit */
             if (size >= (size_t)INTMAX_MAX + 1) {
-                cbmfm_errno = CBMFM_ERR_FILE_TOO_LARGE;
+                cbmfm_error_set(CBMFM_ERR_FILE_TOO_LARGE, NULL, -1);
                 cbmfm_free(data);
                 fclose(fd);
                 return -1;
@@ -135,7 +149,7 @@ intmax_t cbmfm_read_file_sizereq(uint8_t **dest, const char *path, size_t sizere
                 return (intmax_t)final_size;
             } else {
                 /* IO error */
-                cbmfm_errno = CBMFM_ERR_IO;
+                cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
                 cbmfm_free(data);
                 *dest = NULL;
                 fclose(fd);
@@ -185,6 +199,211 @@ intmax_t cbmfm_read_file(uint8_t **dest, const char *path)
 }
 
 
+/** \brief  Map file \a path read-only into memory
+ *
+ * Creates a private, read-only memory mapping of \a path and stores a pointer
+ * to it in \a dest, avoiding the heap allocation and copy done by
+ * cbmfm_read_file(). The mapping must be released with cbmfm_unmap_file().
+ *
+ * When the file cannot be mapped (empty file, not a regular file, or a host
+ * without mmap(2)), the data is read onto the heap with cbmfm_read_file()
+ * instead, and \a mapped is set to false: in that case the data must be freed
+ * with cbmfm_free().
+ *
+ * \param[out]  dest    object to store pointer to data
+ * \param[in]   path    path to file
+ * \param[out]  mapped  object to store whether the data is mapped
+ *
+ * \return  number of bytes available at \a *dest, or -1 on failure
+ *
+ * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_FILE_TOO_LARGE
+ */
+intmax_t cbmfm_map_file(uint8_t **dest, const char *path, bool *mapped)
+{
+#ifdef CBMFM_HOST_UNIX
+    FILE *fp;
+    struct stat st;
+    void *data;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
+        return -1;
+    }
+    if (fstat(fileno(fp), &st) != 0) {
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
+        fclose(fp);
+        return -1;
+    }
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        if ((uintmax_t)st.st_size > (uintmax_t)SIZE_MAX) {
+            cbmfm_error_set(CBMFM_ERR_FILE_TOO_LARGE, NULL, -1);
+            fclose(fp);
+            return -1;
+        }
+        data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                fileno(fp), 0);
+        /* the mapping stays valid after closing the file */
+        fclose(fp);
+        if (data != MAP_FAILED) {
+            *dest = data;
+            *mapped = true;
+            return (intmax_t)st.st_size;
+        }
+        cbmfm_log_debug("%s(): mmap() failed, reading '%s' instead\n",
+                __func__, path);
+    } else {
+        fclose(fp);
+    }
+#endif
+    *mapped = false;
+    return cbmfm_read_file(dest, path);
+}
+
+
+/** \brief  Release memory mapping created by cbmfm_map_file()
+ *
+ * \param[in]   data    mapped data
+ * \param[in]   size    size of mapping
+ */
+void cbmfm_unmap_file(uint8_t *data, size_t size)
+{
+#ifdef CBMFM_HOST_UNIX
+    munmap(data, size);
+#else
+    (void)data;
+    (void)size;
+#endif
+}
+
+
+/** \brief  Open \a path for probing
+ *
+ * Opens \a path, determines its size with a single stat call and reads up to
+ * #CBMFM_PROBE_HEADER_SIZE bytes into the probe's header buffer. The file is
+ * kept open so cbmfm_probe_read_data() can read the remainder of the file
+ * without reopening it.
+ *
+ * \param[out] probe   probe object
+ * \param[in]  path    path to file
+ *
+ * \return  bool
+ * \throw   #CBMFM_ERR_IO
+ */
+bool cbmfm_probe_open(cbmfm_probe_t *probe, const char *path)
+{
+#ifdef CBMFM_HOST_UNIX
+    struct stat st;
+#else
+    long size;
+#endif
+
+    probe->path = path;
+    probe->size = 0;
+    probe->header_len = 0;
+
+    probe->fp = fopen(path, "rb");
+    if (probe->fp == NULL) {
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
+        return false;
+    }
+
+#ifdef CBMFM_HOST_UNIX
+    if (fstat(fileno(probe->fp), &st) != 0 || !S_ISREG(st.st_mode)) {
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
+        cbmfm_probe_close(probe);
+        return false;
+    }
+    probe->size = (intmax_t)st.st_size;
+#else
+    if (fseek(probe->fp, 0L, SEEK_END) != 0
+            || (size = ftell(probe->fp)) < 0
+            || fseek(probe->fp, 0L, SEEK_SET) != 0) {
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
+        cbmfm_probe_close(probe);
+        return false;
+    }
+    probe->size = (intmax_t)size;
+#endif
+
+    probe->header_len = fread(probe->header, 1U, sizeof probe->header,
+            probe->fp);
+    if (probe->header_len < sizeof probe->header && ferror(probe->fp)) {
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
+        cbmfm_probe_close(probe);
+        return false;
+    }
+    return true;
+}
+
+
+/** \brief  Read all data of a probed file
+ *
+ * Copies the probe's header into a new buffer and reads the rest of the file
+ * from the still-open handle. The probe is closed afterwards.
+ *
+ * \param[in,out]  probe   probe object
+ * \param[out]     dest    destination of data
+ *
+ * \return  number of bytes read or -1 on error
+ * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_FILE_TOO_LARGE
+ */
+intmax_t cbmfm_probe_read_data(cbmfm_probe_t *probe, uint8_t **dest)
+{
+    uint8_t *data;
+    size_t size;
+    size_t rest;
+
+    *dest = NULL;
+    if (probe->fp == NULL) {
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
+        return -1;
+    }
+    if ((uintmax_t)probe->size > (uintmax_t)SIZE_MAX) {
+        cbmfm_error_set(CBMFM_ERR_FILE_TOO_LARGE, NULL, -1);
+        cbmfm_probe_close(probe);
+        return -1;
+    }
+    size = (size_t)probe->size;
+    if (size < probe->header_len) {
+        /* file grew between stat and read */
+        size = probe->header_len;
+    }
+
+    data = cbmfm_malloc(size > 0 ? size : 1U);
+    memcpy(data, probe->header, probe->header_len);
+    rest = size - probe->header_len;
+    if (rest > 0 && fread(data + probe->header_len, 1U, rest, probe->fp)
+            != rest) {
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
+        cbmfm_free(data);
+        cbmfm_probe_close(probe);
+        return -1;
+    }
+
+    cbmfm_probe_close(probe);
+    *dest = data;
+    return (intmax_t)size;
+}
+
+
+/** \brief  Close file handle of \a probe
+ *
+ * The header data and size remain valid.
+ *
+ * \param[in,out]  probe   probe object
+ */
+void cbmfm_probe_close(cbmfm_probe_t *probe)
+{
+    if (probe->fp != NULL) {
+        fclose(probe->fp);
+        probe->fp = NULL;
+    }
+}
+
+
 /** \brief  Write \a size bytes of \a data to file \a path
  *
  * \param[in]   data    data to write
@@ -199,18 +418,121 @@ bool cbmfm_write_file(const uint8_t *data, size_t size, const char *path)
 
     fp = fopen(path, "wb");
     if (fp == NULL) {
-        cbmfm_errno = CBMFM_ERR_IO;
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
         return false;
     }
 
     if (fwrite(data, 1U, size, fp) != size) {
-        cbmfm_errno = CBMFM_ERR_IO;
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
+        fclose(fp);
+        return false;
+    }
+
+    fclose(fp);
+    return true;
+}
+
+
+#ifdef CBMFM_HOST_UNIX
+/** \brief  Write all data in \a iov to \a fd, resuming after short writes
+ *
+ * \param[in]       fd      file descriptor
+ * \param[in,out]   iov     I/O vectors, modified on short writes
+ * \param[in]       count   number of elements in \a iov
+ *
+ * \return  bool
+ */
+static bool io_writev_all(int fd, struct iovec *iov, int count)
+{
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        /* skip vectors that were written completely */
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= (ssize_t)(iov->iov_len);
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (uint8_t *)(iov->iov_base) + written;
+            iov->iov_len -= (size_t)written;
+        }
+    }
+    return true;
+}
+#endif
+
+
+/** \brief  Write \a prefix followed by \a data to file \a path
+ *
+ * Allows writing data that is split in a small header and a body without
+ * first joining them, using writev(2) on Unix.
+ *
+ * \param[in]   prefix      data to write first (can be `NULL` if
+ *                          \a prefix_len is 0)
+ * \param[in]   prefix_len  number of bytes in \a prefix
+ * \param[in]   data        data to write after \a prefix
+ * \param[in]   size        number of bytes in \a data
+ * \param[in]   path        file to write to
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_IO
+ */
+bool cbmfm_write_file_prefixed(const uint8_t *prefix, size_t prefix_len,
+                               const uint8_t *data, size_t size,
+                               const char *path)
+{
+#ifdef CBMFM_HOST_UNIX
+    struct iovec iov[2];
+    int fd;
+    bool result;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
+        return false;
+    }
+
+    /* writev(2) doesn't write through iov_base, so dropping const is safe */
+    iov[0].iov_base = (void *)(uintptr_t)prefix;
+    iov[0].iov_len = prefix_len;
+    iov[1].iov_base = (void *)(uintptr_t)data;
+    iov[1].iov_len = size;
+
+    result = io_writev_all(fd, iov, 2);
+    if (close(fd) != 0) {
+        result = false;
+    }
+    if (!result) {
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
+    }
+    return result;
+#else
+    FILE *fp;
+
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
+        return false;
+    }
+
+    if (fwrite(prefix, 1U, prefix_len, fp) != prefix_len
+            || fwrite(data, 1U, size, fp) != size) {
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
         fclose(fp);
         return false;
     }
 
     fclose(fp);
     return true;
+#endif
 }
 
 
@@ -233,7 +555,7 @@ long cbmfm_file_size(const char *path)
     /* open file */
     fp = fopen(path, "rb");
     if (fp == NULL) {
-        cbmfm_errno = CBMFM_ERR_IO;
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
         return -1;
     }
 
@@ -246,7 +568,7 @@ long cbmfm_file_size(const char *path)
     /* get position */
     result = ftell(fp);
     if (result < 0) {
-        cbmfm_errno = CBMFM_ERR_IO;
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
     }
     fclose(fp);
     return result;
@@ -280,7 +602,7 @@ intmax_t cbmfm_read_file_fixed(uint8_t **dest, size_t size, const char *path)
     fp = fopen(path, "rb");
     if (fp == NULL) {
         cbmfm_log_debug("failed to open '%s'\n", path);
-        cbmfm_errno = CBMFM_ERR_IO;
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
         return -1;
     }
 
@@ -288,7 +610,7 @@ intmax_t cbmfm_read_file_fixed(uint8_t **dest, size_t size, const char *path)
     data = cbmfm_calloc(size, 1U);
     result = fread(data, 1U, size, fp);
     if (result != size && ferror(fp)) {
-        cbmfm_errno = CBMFM_ERR_IO;
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
         cbmfm_free(data);
         *dest = NULL;
         fclose(fp);
@@ -315,7 +637,7 @@ char *cbmfm_get_ext_lcase(const char *path)
     char *ext;
     int i;
 
-    while (s > path && *path != '.') {
+    while (s > path && *s != '.') {
         s--;
     }
     if (s == path) {
@@ -331,7 +653,7 @@ char *cbmfm_get_ext_lcase(const char *path)
         i++;
         s++;
     }
-    ext[1] = '\0';
+    ext[i] = '\0';
 
     return ext;
 }
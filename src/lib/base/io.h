@@ -32,6 +32,9 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
+#include "cbmfm_types.h"
+
+
 intmax_t    cbmfm_read_file(uint8_t **dest, const char *path);
 intmax_t    cbmfm_read_file_sizereq(uint8_t **dest,
                                     const char *path,
@@ -39,9 +42,19 @@ intmax_t    cbmfm_read_file_sizereq(uint8_t **dest,
 intmax_t    cbmfm_read_file_fixed(uint8_t **dest,
                                   size_t size,
                                   const char *path);
+bool        cbmfm_probe_open(cbmfm_probe_t *probe, const char *path);
+intmax_t    cbmfm_probe_read_data(cbmfm_probe_t *probe, uint8_t **dest);
+void        cbmfm_probe_close(cbmfm_probe_t *probe);
+intmax_t    cbmfm_map_file(uint8_t **dest, const char *path, bool *mapped);
+void        cbmfm_unmap_file(uint8_t *data, size_t size);
 bool        cbmfm_write_file(const uint8_t *data,
                              size_t size,
                              const char *path);
+bool        cbmfm_write_file_prefixed(const uint8_t *prefix,
+                                      size_t prefix_len,
+                                      const uint8_t *data,
+                                      size_t size,
+                                      const char *path);
 
 long        cbmfm_file_size(const char *path);
 
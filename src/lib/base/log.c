@@ -25,17 +25,97 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
  */
 
+#ifdef CBMFM_HOST_UNIX
+/* required for flockfile(3) with -std=c99 */
+# define _POSIX_C_SOURCE 200112L
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <string.h>
 #include <time.h>
 
 #include "lib/base/errors.h"
 
 #include "log.h"
 
+/* The asynchronous sink needs threads and atomics */
+#if defined(CBMFM_HOST_UNIX) && (defined(__GNUC__) || defined(__clang__))
+# define LOG_ASYNC
+# include <pthread.h>
+#endif
+
+
+/** \brief  Size of the buffer used to format a message
+ *
+ * Longer messages are written directly to the log file when logging
+ * synchronously, and truncated when logging asynchronously.
+ */
+#define LOG_MSG_MAX     256
+
+#ifdef LOG_ASYNC
+/** \brief  Number of slots in the ring buffer (must be a power of two)
+ */
+#define LOG_RING_SIZE   256
+
+
+/** \brief  Slot in the ring buffer
+ */
+typedef struct log_slot_s {
+    size_t  seq;                /**< sequence number of the slot */
+    FILE *  fp;                 /**< log file to write the message to */
+    size_t  len;                /**< length of the message */
+    char    text[LOG_MSG_MAX];  /**< message, including prefix */
+} log_slot_t;
+
+
+/** \brief  Ring buffer of pending messages
+ *
+ * A bounded multi-producer/single-consumer queue: producers claim a slot by
+ * advancing #log_ring_head, and publish the message by updating the sequence
+ * number of the slot. The background thread consumes slots in order.
+ */
+static log_slot_t log_ring[LOG_RING_SIZE];
+
+/** \brief  Position of the next slot to claim by a producer
+ */
+static size_t log_ring_head;
+
+/** \brief  Position of the next slot to write to the log file
+ *
+ * Only used by the thread draining the ring buffer.
+ */
+static size_t log_ring_tail;
+
+/** \brief  Number of messages dropped due to a full ring buffer
+ */
+static size_t log_ring_dropped;
+
+/** \brief  Asynchronous logging is active
+ */
+static int log_async_running;
+
+/** \brief  Thread draining the ring buffer
+ */
+static pthread_t log_async_thread;
+
+/** \brief  Draining thread is (about to be) waiting on #log_async_cond
+ */
+static int log_async_waiting;
+
+/** \brief  Mutex protecting the wait on #log_async_cond
+ */
+static pthread_mutex_t log_async_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** \brief  Signalled when a message is queued or logging is stopped
+ */
+static pthread_cond_t log_async_cond = PTHREAD_COND_INITIALIZER;
+#endif
+
 
 /** \brief  Prefixes used in log messages
  */
@@ -48,26 +128,23 @@ static const char *log_prefixes[] = {
 };
 
 
-/** \brief  Log file pointer
- */
-static FILE *log_file = NULL;
-
-/** \brief  Log level
- */
-static cbmfm_log_level_t log_level = CBMFM_LOG_NONE;
-
-
 /** \brief  Set log level
+ *
+ * Sets the level of the default context, or the context set for the calling
+ * thread with cbmfm_ctx_set().
  *
  * \param[in]   level   log level
  */
 void cbmfm_log_set_level(cbmfm_log_level_t level)
 {
-    log_level = level;
+    cbmfm_ctx_log()->log_level = (int)level;
 }
 
 
 /** \brief  Set log file to \a path
+ *
+ * Sets the log file of the default context, or the context set for the calling
+ * thread with cbmfm_ctx_set().
  *
  * \param[in]   path    log file path
  *
@@ -77,13 +154,20 @@ void cbmfm_log_set_level(cbmfm_log_level_t level)
  */
 bool cbmfm_log_set_file(const char *path)
 {
+    cbmfm_ctx_t *ctx = cbmfm_ctx_log();
     time_t curr_time;
+    FILE *log_file;
 
     log_file = fopen(path, "wb");
     if (log_file == NULL) {
-        cbmfm_errno = CBMFM_ERR_IO;
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
         return false;
     }
+    if (ctx->log_file != NULL && ctx->log_file_owned) {
+        fclose(ctx->log_file);
+    }
+    ctx->log_file = log_file;
+    ctx->log_file_owned = true;
 
     /* write current date/time to the log file */
     curr_time = time(NULL);
@@ -103,40 +187,343 @@ bool cbmfm_log_set_file(const char *path)
 }
 
 
+/** \brief  Check if messages of \a level are logged at run time
+ *
+ * Used by the log macros to skip formatting and argument evaluation of
+ * messages that would be discarded.
+ *
+ * \param[in]   level   log level
+ *
+ * \return  true if messages of \a level are logged
+ */
+bool cbmfm_log_enabled(cbmfm_log_level_t level)
+{
+    int current = cbmfm_ctx_log()->log_level;
+
+    return current != CBMFM_LOG_NONE && (int)level <= current;
+}
+
+
+/** \brief  Format log message with prefix into \a buffer
+ *
+ * \param[out]  buffer  buffer for the message
+ * \param[in]   size    size of \a buffer
+ * \param[in]   level   log level
+ * \param[in]   fmt     printf format string
+ * \param[in]   args    arguments for \a fmt
+ *
+ * \return  length of the full message, can be larger than \a size - 1
+ */
+static size_t log_format(char *buffer,
+                         size_t size,
+                         cbmfm_log_level_t level,
+                         const char *fmt,
+                         va_list args)
+{
+    int plen;
+    int mlen;
+
+    plen = snprintf(buffer, size, "%s: ", log_prefixes[level]);
+    if (plen < 0) {
+        plen = 0;
+        buffer[0] = '\0';
+    }
+    if ((size_t)plen >= size) {
+        return (size_t)plen;
+    }
+    mlen = vsnprintf(buffer + plen, size - (size_t)plen, fmt, args);
+    if (mlen < 0) {
+        mlen = 0;
+        buffer[plen] = '\0';
+    }
+    return (size_t)plen + (size_t)mlen;
+}
+
+
+#ifdef LOG_ASYNC
+/** \brief  Reset ring buffer to empty
+ */
+static void log_ring_reset(void)
+{
+    size_t i;
+
+    for (i = 0; i < LOG_RING_SIZE; i++) {
+        log_ring[i].seq = i;
+    }
+    log_ring_head = 0;
+    log_ring_tail = 0;
+    log_ring_dropped = 0;
+}
+
+
+/** \brief  Add message to the ring buffer
+ *
+ * Drops the message when the ring buffer is full.
+ *
+ * \param[in]   fp      log file
+ * \param[in]   level   log level
+ * \param[in]   fmt     printf format string
+ * \param[in]   args    arguments for \a fmt
+ */
+static void log_ring_push(FILE *fp,
+                          cbmfm_log_level_t level,
+                          const char *fmt,
+                          va_list args)
+{
+    log_slot_t *slot;
+    size_t pos;
+    size_t len;
+
+    pos = __atomic_load_n(&log_ring_head, __ATOMIC_RELAXED);
+    for (;;) {
+        ptrdiff_t diff;
+
+        slot = &log_ring[pos & (LOG_RING_SIZE - 1)];
+        diff = (ptrdiff_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            /* slot is free, try to claim it */
+            if (__atomic_compare_exchange_n(&log_ring_head, &pos, pos + 1,
+                        true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* full */
+            __atomic_fetch_add(&log_ring_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            /* another producer claimed the slot */
+            pos = __atomic_load_n(&log_ring_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    len = log_format(slot->text, sizeof slot->text, level, fmt, args);
+    if (len >= sizeof slot->text) {
+        /* truncated, keep the line ending */
+        len = sizeof slot->text - 1;
+        slot->text[len - 1] = '\n';
+    }
+    slot->fp = fp;
+    slot->len = len;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+    /* only wake the draining thread when it has found the ring empty */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&log_async_waiting, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&log_async_lock);
+        pthread_cond_signal(&log_async_cond);
+        pthread_mutex_unlock(&log_async_lock);
+    }
+}
+
+
+/** \brief  Check if the next message in the ring buffer is ready to write
+ *
+ * \return  true if log_ring_drain() would write a message
+ */
+static bool log_ring_ready(void)
+{
+    size_t pos = log_ring_tail;
+
+    return __atomic_load_n(&log_ring[pos & (LOG_RING_SIZE - 1)].seq,
+                           __ATOMIC_ACQUIRE) == pos + 1;
+}
+
+
+/** \brief  Write pending messages in the ring buffer to their log files
+ *
+ * \return  true if any messages were written
+ */
+static bool log_ring_drain(void)
+{
+    FILE *last = NULL;
+    size_t dropped;
+
+    for (;;) {
+        size_t pos = log_ring_tail;
+        log_slot_t *slot = &log_ring[pos & (LOG_RING_SIZE - 1)];
+
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+            /* empty, or the producer hasn't finished the message yet */
+            break;
+        }
+        if (last != NULL && last != slot->fp) {
+            fflush(last);
+        }
+        last = slot->fp;
+        fwrite(slot->text, 1, slot->len, last);
+        __atomic_store_n(&slot->seq, pos + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        log_ring_tail = pos + 1;
+    }
+
+    dropped = __atomic_exchange_n(&log_ring_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped > 0) {
+        FILE *fp = last != NULL ? last : stdout;
+        fprintf(fp, "%s: %zu log messages dropped\n",
+                log_prefixes[CBMFM_LOG_WARNING], dropped);
+        last = fp;
+    }
+
+    if (last != NULL) {
+        fflush(last);
+        return true;
+    }
+    return false;
+}
+
+
+/** \brief  Thread function draining the ring buffer
+ *
+ * Sleeps on #log_async_cond while the ring buffer is empty. The waiting flag
+ * is raised before checking the ring buffer once more, so a producer either
+ * sees the flag and signals, or its message is seen by that check.
+ *
+ * \param[in]   arg     unused
+ *
+ * \return  NULL
+ */
+static void *log_async_func(void *arg)
+{
+    (void)arg;
+    while (__atomic_load_n(&log_async_running, __ATOMIC_ACQUIRE)) {
+        if (log_ring_drain()) {
+            continue;
+        }
+        pthread_mutex_lock(&log_async_lock);
+        __atomic_store_n(&log_async_waiting, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (!log_ring_ready()
+                && __atomic_load_n(&log_async_running, __ATOMIC_ACQUIRE)) {
+            pthread_cond_wait(&log_async_cond, &log_async_lock);
+        }
+        __atomic_store_n(&log_async_waiting, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&log_async_lock);
+    }
+    log_ring_drain();
+    return NULL;
+}
+#endif
+
+
+/** \brief  Start asynchronous logging
+ *
+ * Messages are queued in a ring buffer and written by a background thread, so
+ * threads calling the log functions never wait on I/O. When the ring buffer
+ * is full, messages are dropped and the number of dropped messages is logged.
+ *
+ * \return  true on success, false when not supported on the host or when
+ *          the thread couldn't be started
+ *
+ * \throw   #CBMFM_ERR_IO
+ */
+bool cbmfm_log_async_start(void)
+{
+#ifdef LOG_ASYNC
+    if (__atomic_load_n(&log_async_running, __ATOMIC_ACQUIRE)) {
+        return true;
+    }
+    log_ring_reset();
+    __atomic_store_n(&log_async_running, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&log_async_thread, NULL, log_async_func, NULL) != 0) {
+        __atomic_store_n(&log_async_running, 0, __ATOMIC_RELEASE);
+        cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
+        return false;
+    }
+    return true;
+#else
+    cbmfm_error_set(CBMFM_ERR_IO, NULL, -1);
+    return false;
+#endif
+}
+
+
+/** \brief  Stop asynchronous logging
+ *
+ * Writes all pending messages and stops the background thread. Other threads
+ * should have stopped logging before calling this.
+ */
+void cbmfm_log_async_stop(void)
+{
+#ifdef LOG_ASYNC
+    if (!__atomic_load_n(&log_async_running, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    __atomic_store_n(&log_async_running, 0, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&log_async_lock);
+    pthread_cond_signal(&log_async_cond);
+    pthread_mutex_unlock(&log_async_lock);
+    pthread_join(log_async_thread, NULL);
+    log_ring_drain();
+#endif
+}
+
+
 /** \brief  Close log file
+ *
+ * Stops asynchronous logging first, if active. A log file inherited from the
+ * default context by cbmfm_ctx_init() is only detached, not closed.
  */
 void cbmfm_log_close(void)
 {
-    if (log_file != NULL) {
-        fclose(log_file);
+    cbmfm_ctx_t *ctx = cbmfm_ctx_log();
+
+    cbmfm_log_async_stop();
+    if (ctx->log_file != NULL && ctx->log_file_owned) {
+        fclose(ctx->log_file);
     }
+    ctx->log_file = NULL;
+    ctx->log_file_owned = false;
 }
 
 
 /** \brief  Send a message to the log
  *
- * Send a message to the log, using variable arguments.
+ * Send a message to the log, using variable arguments. The message is
+ * formatted into a buffer and written with a single call, so messages of
+ * different threads don't get mixed. With asynchronous logging active, the
+ * message is queued instead.
+ *
+ * Use the log macros instead of calling this directly, they check the log
+ * level before evaluating the arguments.
  *
  * \param[in]   level   log level
  * \param[in]   fmt     printf format string
  */
 void cbmfm_log_message(cbmfm_log_level_t level, const char *fmt, ...)
 {
-    FILE *fp = log_file != NULL ? log_file : stdout;
+    const cbmfm_ctx_t *ctx = cbmfm_ctx_log();
+    FILE *fp = ctx->log_file != NULL ? ctx->log_file : stdout;
+    char buffer[LOG_MSG_MAX];
+    size_t len;
     va_list args;
 
-    if (log_level == 0) {
+    if (ctx->log_level == CBMFM_LOG_NONE || (int)level > ctx->log_level) {
         return;
     }
 
-    if (level <= log_level) {
-        fprintf(fp, "%s: ", log_prefixes[level]);
-        fflush(fp);
+    va_start(args, fmt);
+#ifdef LOG_ASYNC
+    if (__atomic_load_n(&log_async_running, __ATOMIC_ACQUIRE)) {
+        log_ring_push(fp, level, fmt, args);
+        va_end(args);
+        return;
+    }
+#endif
+    len = log_format(buffer, sizeof buffer, level, fmt, args);
+    va_end(args);
 
+    if (len < sizeof buffer) {
+        fwrite(buffer, 1, len, fp);
+    } else {
+        /* too long for the buffer, format again directly into the file */
+#ifdef CBMFM_HOST_UNIX
+        flockfile(fp);
+#endif
+        fprintf(fp, "%s: ", log_prefixes[level]);
         va_start(args, fmt);
-
         vfprintf(fp, fmt, args);
-
         va_end(args);
+#ifdef CBMFM_HOST_UNIX
+        funlockfile(fp);
+#endif
     }
 }
@@ -45,35 +45,59 @@ typedef enum cbmfm_log_level_e {
 } cbmfm_log_level_t;
 
 
+/** \brief  Most verbose log level compiled in
+ *
+ * Log macros for less severe levels expand to dead code, so their arguments
+ * are never evaluated. Override with for example
+ * `-DCBMFM_LOG_COMPILE_LEVEL=CBMFM_LOG_INFO` for release builds.
+ */
+#ifndef CBMFM_LOG_COMPILE_LEVEL
+# define CBMFM_LOG_COMPILE_LEVEL    CBMFM_LOG_DEBUG
+#endif
+
+
 void cbmfm_log_set_level(cbmfm_log_level_t level);
 bool cbmfm_log_set_file(const char *path);
 void cbmfm_log_close(void);
 
+bool cbmfm_log_async_start(void);
+void cbmfm_log_async_stop(void);
+
+bool cbmfm_log_enabled(cbmfm_log_level_t level);
 void cbmfm_log_message(cbmfm_log_level_t level, const char *fmt, ...);
 
 
+/** \brief  Log message at \a level
+ *
+ * Checks the compile-time and run-time log levels before evaluating the
+ * arguments.
+ */
+#define cbmfm_log_at(level, ...) \
+    do { \
+        if ((level) <= CBMFM_LOG_COMPILE_LEVEL && cbmfm_log_enabled(level)) { \
+            cbmfm_log_message((level), __VA_ARGS__); \
+        } \
+    } while (0)
+
 /** \brief  Log error message
  */
 #define cbmfm_log_error(...) \
-    cbmfm_log_message(CBMFM_LOG_ERROR, __VA_ARGS__)
+    cbmfm_log_at(CBMFM_LOG_ERROR, __VA_ARGS__)
 
 /** \brief  Log warning message
  */
 #define cbmfm_log_warning(...) \
-    cbmfm_log_message(CBMFM_LOG_WARNING, __VA_ARGS__)
+    cbmfm_log_at(CBMFM_LOG_WARNING, __VA_ARGS__)
 
 /** \brief  Log info message
  */
 #define cbmfm_log_info(...) \
-    cbmfm_log_message(CBMFM_LOG_INFO, __VA_ARGS__)
+    cbmfm_log_at(CBMFM_LOG_INFO, __VA_ARGS__)
 
 /** \brief  Log debug message
  */
 #define cbmfm_log_debug(...) \
-    cbmfm_log_message(CBMFM_LOG_DEBUG, __VA_ARGS__)
-
-
-
+    cbmfm_log_at(CBMFM_LOG_DEBUG, __VA_ARGS__)
 
 
 #endif
@@ -245,6 +245,53 @@ int cbmfm_popcount_byte(uint8_t b)
 }
 
 
+/** \brief  Count number of set(1) bits in \a v
+ *
+ * \param[in]   v   64-bit value
+ *
+ * \return  number of set bits in \a v
+ */
+int cbmfm_popcount64(uint64_t v)
+{
+#ifdef __GNUC__
+    return __builtin_popcountll(v);
+#else
+    int count = 0;
+
+    while (v != 0) {
+        v &= v - 1U;
+        count++;
+    }
+    return count;
+#endif
+}
+
+
+/** \brief  Count number of trailing zero bits in \a v
+ *
+ * \param[in]   v   64-bit value
+ *
+ * \return  index of lowest set bit in \a v, or 64 when \a v is 0
+ */
+int cbmfm_ctz64(uint64_t v)
+{
+#ifdef __GNUC__
+    return v == 0 ? 64 : __builtin_ctzll(v);
+#else
+    int count = 0;
+
+    if (v == 0) {
+        return 64;
+    }
+    while ((v & 1U) == 0) {
+        v >>= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+
 /** \brief  Calculate number of blocks from \a size
  *
  * Calculate the number of blocks a file of \a size bytes would occupy on a
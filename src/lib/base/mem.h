@@ -44,6 +44,8 @@ char *      cbmfm_strndup(const char *s, size_t n);
 void *      cbmfm_memdup(const void *data, size_t size);
 
 int         cbmfm_popcount_byte(uint8_t b);
+int         cbmfm_popcount64(uint64_t v);
+int         cbmfm_ctz64(uint64_t v);
 uint16_t    cbmfm_size_to_blocks(size_t size);
 void        cbmfm_hexdump(const uint8_t *data, size_t skip, size_t size);
 
@@ -0,0 +1,212 @@
+/* vim: set et ts=4 sw=4 sts=4 fdm=marker syntax=c.doxygen : */
+
+/** \file   src/lib/base/pattern.c
+ * \brief   CBM DOS file name pattern matching
+ *
+ * \author  Bas Wassink <b.wassink@ziggo.nl>
+ */
+
+/*
+ *  CbmFM - a file manager for CBM 8-bit emulation files
+ *  Copyright (C) 2018  Bas Wassink <b.wassink@ziggo.nl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "cbmfm_types.h"
+#include "base/errors.h"
+#include "base/petasc.h"
+
+#include "pattern.h"
+
+
+/** \brief  Get length of CBMDOS file name \a name
+ *
+ * A name ends at the first shifted space ($A0) padding byte, or at a 0 byte
+ * when the name was padded with zeroes.
+ *
+ * \param[in]   name    PETSCII file name
+ * \param[in]   len     maximum length of \a name
+ *
+ * \return  length of \a name without padding
+ */
+size_t cbmfm_pattern_name_len(const uint8_t *name, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (name[i] == 0xa0 || name[i] == 0x00) {
+            break;
+        }
+    }
+    return i;
+}
+
+
+/** \brief  Get CBMDOS file type for type letter \a ch
+ *
+ * Both the unshifted and the shifted letters are accepted, so an upper case
+ * ASCII letter converted with cbmfm_asc_to_pet_str() works as well.
+ *
+ * \param[in]   ch  PETSCII type letter
+ *
+ * \return  file type or -1 when \a ch isn't a valid type letter
+ */
+static int pattern_type(uint8_t ch)
+{
+    switch (ch & 0x7f) {
+        case 0x44:  /* 'D' */
+            return CBMFM_CBMDOS_DEL;
+        case 0x53:  /* 'S' */
+            return CBMFM_CBMDOS_SEQ;
+        case 0x50:  /* 'P' */
+            return CBMFM_CBMDOS_PRG;
+        case 0x55:  /* 'U' */
+            return CBMFM_CBMDOS_USR;
+        case 0x52:  /* 'R' */
+            return CBMFM_CBMDOS_REL;
+        default:
+            return -1;
+    }
+}
+
+
+/** \brief  Compile CBM DOS file name pattern \a text into \a pattern
+ *
+ * Supports an optional drive prefix ("0:"), the '?' wildcard matching any
+ * single character, the '*' wildcard matching the remainder of a name (any
+ * characters after it are ignored, as the DOS does) and a file type filter
+ * following a ',' or '=' (",P", "=S" etc.).
+ *
+ * \param[out]  pattern compiled pattern
+ * \param[in]   text    PETSCII pattern text
+ * \param[in]   len     length of \a text
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+bool cbmfm_pattern_compile(cbmfm_pattern_t *pattern,
+                           const uint8_t *text,
+                           size_t len)
+{
+    const uint8_t *colon;
+    size_t i;
+
+    memset(pattern->name, 0xa0, CBMFM_CBMDOS_FILE_NAME_LEN);
+    pattern->len = 0;
+    pattern->type = -1;
+    pattern->prefix = false;
+    pattern->wildcards = false;
+
+    /* skip drive prefix */
+    colon = memchr(text, ':', len);
+    if (colon != NULL) {
+        len -= (size_t)(colon - text) + 1;
+        text = colon + 1;
+    }
+
+    for (i = 0; i < len && text[i] != ',' && text[i] != '='; i++) {
+        if (pattern->prefix) {
+            /* ignored after '*' */
+            continue;
+        }
+        if (text[i] == '*') {
+            pattern->prefix = true;
+        } else if (pattern->len == CBMFM_CBMDOS_FILE_NAME_LEN) {
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
+            return false;
+        } else {
+            if (text[i] == '?') {
+                pattern->wildcards = true;
+            }
+            pattern->name[pattern->len++] = text[i];
+        }
+    }
+
+    /* file type filter */
+    if (i < len) {
+        if (i + 1 >= len || (pattern->type = pattern_type(text[i + 1])) < 0) {
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/** \brief  Compile ASCII pattern \a text into \a pattern
+ *
+ * \param[out]  pattern compiled pattern
+ * \param[in]   text    ASCII pattern text
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+bool cbmfm_pattern_compile_asc(cbmfm_pattern_t *pattern, const char *text)
+{
+    uint8_t pet[CBMFM_PATTERN_MAX_LEN];
+    size_t len = strlen(text);
+
+    if (len > CBMFM_PATTERN_MAX_LEN) {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
+        return false;
+    }
+    cbmfm_asc_to_pet_str(pet, text, len);
+    return cbmfm_pattern_compile(pattern, pet, len);
+}
+
+
+/** \brief  Check if \a dirent matches \a pattern
+ *
+ * Scratched entries (file type 0) never match.
+ *
+ * \param[in]   pattern compiled pattern
+ * \param[in]   dirent  directory entry
+ *
+ * \return  bool
+ */
+bool cbmfm_pattern_match(const cbmfm_pattern_t *pattern,
+                         const cbmfm_dirent_t *dirent)
+{
+    size_t len;
+    size_t i;
+
+    if (dirent->filetype == 0x00) {
+        return false;
+    }
+    if (pattern->type >= 0 && (dirent->filetype & 0x07) != pattern->type) {
+        return false;
+    }
+
+    len = cbmfm_pattern_name_len(dirent->filename, CBMFM_CBMDOS_FILE_NAME_LEN);
+    if (pattern->prefix ? len < pattern->len : len != pattern->len) {
+        return false;
+    }
+    for (i = 0; i < pattern->len; i++) {
+        if (pattern->name[i] != dirent->filename[i]
+                && pattern->name[i] != '?') {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+/* vim: set et ts=4 sw=4 sts=4 fdm=marker syntax=c.doxygen : */
+
+/** \file   src/lib/base/pattern.h
+ * \brief   CBM DOS file name pattern matching - header
+ *
+ * \author  Bas Wassink <b.wassink@ziggo.nl>
+ */
+
+/*
+ *  CbmFM - a file manager for CBM 8-bit emulation files
+ *  Copyright (C) 2018  Bas Wassink <b.wassink@ziggo.nl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
+ */
+
+#ifndef CBMFM_LIB_BASE_PATTERN_H
+#define CBMFM_LIB_BASE_PATTERN_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cbmfm_types.h"
+
+
+size_t  cbmfm_pattern_name_len(const uint8_t *name, size_t len);
+bool    cbmfm_pattern_compile(cbmfm_pattern_t *pattern,
+                              const uint8_t *text,
+                              size_t len);
+bool    cbmfm_pattern_compile_asc(cbmfm_pattern_t *pattern, const char *text);
+bool    cbmfm_pattern_match(const cbmfm_pattern_t *pattern,
+                            const cbmfm_dirent_t *dirent);
+
+#endif
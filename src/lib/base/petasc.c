@@ -159,6 +159,290 @@ static uint8_t asc_to_pet_table[256] = {
 
 
 
+/** \brief  PETSCII to UTF-8 table entry
+ */
+typedef struct petasc_utf8_s {
+    uint8_t len;        /**< number of bytes used in \a utf8 */
+    uint8_t utf8[4];    /**< UTF-8 encoded code point */
+} petasc_utf8_t;
+
+
+/** \brief  PETSCII to UTF-8 translation table
+ *
+ * Maps the unshifted (upper case/graphics) character set to Unicode, using
+ * the "Symbols for Legacy Computing" block added in Unicode 13 for the
+ * glyphs that have no older equivalent. Control codes map to U+FFFD.
+ *
+ * Generated from the code points listed in the comments, do not edit the
+ * encoded bytes by hand.
+ */
+static const petasc_utf8_t pet_to_utf8_table[256] = {
+    /* $00: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $01: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $02: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $03: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $04: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $05: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $06: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $07: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $08: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $09: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $0a: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $0b: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $0c: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $0d: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $0e: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $0f: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $10: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $11: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $12: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $13: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $14: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $15: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $16: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $17: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $18: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $19: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $1a: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $1b: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $1c: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $1d: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $1e: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $1f: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $20: U+0020 */ { 1, { 0x20 } },
+    /* $21: U+0021 */ { 1, { 0x21 } },
+    /* $22: U+0022 */ { 1, { 0x22 } },
+    /* $23: U+0023 */ { 1, { 0x23 } },
+    /* $24: U+0024 */ { 1, { 0x24 } },
+    /* $25: U+0025 */ { 1, { 0x25 } },
+    /* $26: U+0026 */ { 1, { 0x26 } },
+    /* $27: U+0027 */ { 1, { 0x27 } },
+    /* $28: U+0028 */ { 1, { 0x28 } },
+    /* $29: U+0029 */ { 1, { 0x29 } },
+    /* $2a: U+002A */ { 1, { 0x2a } },
+    /* $2b: U+002B */ { 1, { 0x2b } },
+    /* $2c: U+002C */ { 1, { 0x2c } },
+    /* $2d: U+002D */ { 1, { 0x2d } },
+    /* $2e: U+002E */ { 1, { 0x2e } },
+    /* $2f: U+002F */ { 1, { 0x2f } },
+    /* $30: U+0030 */ { 1, { 0x30 } },
+    /* $31: U+0031 */ { 1, { 0x31 } },
+    /* $32: U+0032 */ { 1, { 0x32 } },
+    /* $33: U+0033 */ { 1, { 0x33 } },
+    /* $34: U+0034 */ { 1, { 0x34 } },
+    /* $35: U+0035 */ { 1, { 0x35 } },
+    /* $36: U+0036 */ { 1, { 0x36 } },
+    /* $37: U+0037 */ { 1, { 0x37 } },
+    /* $38: U+0038 */ { 1, { 0x38 } },
+    /* $39: U+0039 */ { 1, { 0x39 } },
+    /* $3a: U+003A */ { 1, { 0x3a } },
+    /* $3b: U+003B */ { 1, { 0x3b } },
+    /* $3c: U+003C */ { 1, { 0x3c } },
+    /* $3d: U+003D */ { 1, { 0x3d } },
+    /* $3e: U+003E */ { 1, { 0x3e } },
+    /* $3f: U+003F */ { 1, { 0x3f } },
+    /* $40: U+0040 */ { 1, { 0x40 } },
+    /* $41: U+0041 */ { 1, { 0x41 } },
+    /* $42: U+0042 */ { 1, { 0x42 } },
+    /* $43: U+0043 */ { 1, { 0x43 } },
+    /* $44: U+0044 */ { 1, { 0x44 } },
+    /* $45: U+0045 */ { 1, { 0x45 } },
+    /* $46: U+0046 */ { 1, { 0x46 } },
+    /* $47: U+0047 */ { 1, { 0x47 } },
+    /* $48: U+0048 */ { 1, { 0x48 } },
+    /* $49: U+0049 */ { 1, { 0x49 } },
+    /* $4a: U+004A */ { 1, { 0x4a } },
+    /* $4b: U+004B */ { 1, { 0x4b } },
+    /* $4c: U+004C */ { 1, { 0x4c } },
+    /* $4d: U+004D */ { 1, { 0x4d } },
+    /* $4e: U+004E */ { 1, { 0x4e } },
+    /* $4f: U+004F */ { 1, { 0x4f } },
+    /* $50: U+0050 */ { 1, { 0x50 } },
+    /* $51: U+0051 */ { 1, { 0x51 } },
+    /* $52: U+0052 */ { 1, { 0x52 } },
+    /* $53: U+0053 */ { 1, { 0x53 } },
+    /* $54: U+0054 */ { 1, { 0x54 } },
+    /* $55: U+0055 */ { 1, { 0x55 } },
+    /* $56: U+0056 */ { 1, { 0x56 } },
+    /* $57: U+0057 */ { 1, { 0x57 } },
+    /* $58: U+0058 */ { 1, { 0x58 } },
+    /* $59: U+0059 */ { 1, { 0x59 } },
+    /* $5a: U+005A */ { 1, { 0x5a } },
+    /* $5b: U+005B */ { 1, { 0x5b } },
+    /* $5c: U+00A3 */ { 2, { 0xc2, 0xa3 } },
+    /* $5d: U+005D */ { 1, { 0x5d } },
+    /* $5e: U+2191 */ { 3, { 0xe2, 0x86, 0x91 } },
+    /* $5f: U+2190 */ { 3, { 0xe2, 0x86, 0x90 } },
+    /* $60: U+2500 */ { 3, { 0xe2, 0x94, 0x80 } },
+    /* $61: U+2660 */ { 3, { 0xe2, 0x99, 0xa0 } },
+    /* $62: U+1FB72 */ { 4, { 0xf0, 0x9f, 0xad, 0xb2 } },
+    /* $63: U+1FB78 */ { 4, { 0xf0, 0x9f, 0xad, 0xb8 } },
+    /* $64: U+1FB77 */ { 4, { 0xf0, 0x9f, 0xad, 0xb7 } },
+    /* $65: U+1FB76 */ { 4, { 0xf0, 0x9f, 0xad, 0xb6 } },
+    /* $66: U+1FB7A */ { 4, { 0xf0, 0x9f, 0xad, 0xba } },
+    /* $67: U+1FB71 */ { 4, { 0xf0, 0x9f, 0xad, 0xb1 } },
+    /* $68: U+1FB74 */ { 4, { 0xf0, 0x9f, 0xad, 0xb4 } },
+    /* $69: U+256E */ { 3, { 0xe2, 0x95, 0xae } },
+    /* $6a: U+2570 */ { 3, { 0xe2, 0x95, 0xb0 } },
+    /* $6b: U+256F */ { 3, { 0xe2, 0x95, 0xaf } },
+    /* $6c: U+1FB7C */ { 4, { 0xf0, 0x9f, 0xad, 0xbc } },
+    /* $6d: U+2572 */ { 3, { 0xe2, 0x95, 0xb2 } },
+    /* $6e: U+2571 */ { 3, { 0xe2, 0x95, 0xb1 } },
+    /* $6f: U+1FB7D */ { 4, { 0xf0, 0x9f, 0xad, 0xbd } },
+    /* $70: U+1FB7E */ { 4, { 0xf0, 0x9f, 0xad, 0xbe } },
+    /* $71: U+25CF */ { 3, { 0xe2, 0x97, 0x8f } },
+    /* $72: U+1FB7B */ { 4, { 0xf0, 0x9f, 0xad, 0xbb } },
+    /* $73: U+2665 */ { 3, { 0xe2, 0x99, 0xa5 } },
+    /* $74: U+1FB70 */ { 4, { 0xf0, 0x9f, 0xad, 0xb0 } },
+    /* $75: U+256D */ { 3, { 0xe2, 0x95, 0xad } },
+    /* $76: U+2573 */ { 3, { 0xe2, 0x95, 0xb3 } },
+    /* $77: U+25CB */ { 3, { 0xe2, 0x97, 0x8b } },
+    /* $78: U+2663 */ { 3, { 0xe2, 0x99, 0xa3 } },
+    /* $79: U+1FB75 */ { 4, { 0xf0, 0x9f, 0xad, 0xb5 } },
+    /* $7a: U+2666 */ { 3, { 0xe2, 0x99, 0xa6 } },
+    /* $7b: U+253C */ { 3, { 0xe2, 0x94, 0xbc } },
+    /* $7c: U+1FB8C */ { 4, { 0xf0, 0x9f, 0xae, 0x8c } },
+    /* $7d: U+2502 */ { 3, { 0xe2, 0x94, 0x82 } },
+    /* $7e: U+03C0 */ { 2, { 0xcf, 0x80 } },
+    /* $7f: U+25E5 */ { 3, { 0xe2, 0x97, 0xa5 } },
+    /* $80: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $81: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $82: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $83: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $84: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $85: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $86: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $87: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $88: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $89: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $8a: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $8b: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $8c: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $8d: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $8e: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $8f: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $90: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $91: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $92: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $93: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $94: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $95: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $96: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $97: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $98: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $99: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $9a: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $9b: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $9c: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $9d: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $9e: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $9f: U+FFFD */ { 3, { 0xef, 0xbf, 0xbd } },
+    /* $a0: U+00A0 */ { 2, { 0xc2, 0xa0 } },
+    /* $a1: U+258C */ { 3, { 0xe2, 0x96, 0x8c } },
+    /* $a2: U+2584 */ { 3, { 0xe2, 0x96, 0x84 } },
+    /* $a3: U+2594 */ { 3, { 0xe2, 0x96, 0x94 } },
+    /* $a4: U+2581 */ { 3, { 0xe2, 0x96, 0x81 } },
+    /* $a5: U+258F */ { 3, { 0xe2, 0x96, 0x8f } },
+    /* $a6: U+2592 */ { 3, { 0xe2, 0x96, 0x92 } },
+    /* $a7: U+2595 */ { 3, { 0xe2, 0x96, 0x95 } },
+    /* $a8: U+1FB8F */ { 4, { 0xf0, 0x9f, 0xae, 0x8f } },
+    /* $a9: U+25E4 */ { 3, { 0xe2, 0x97, 0xa4 } },
+    /* $aa: U+1FB87 */ { 4, { 0xf0, 0x9f, 0xae, 0x87 } },
+    /* $ab: U+251C */ { 3, { 0xe2, 0x94, 0x9c } },
+    /* $ac: U+2597 */ { 3, { 0xe2, 0x96, 0x97 } },
+    /* $ad: U+2514 */ { 3, { 0xe2, 0x94, 0x94 } },
+    /* $ae: U+2510 */ { 3, { 0xe2, 0x94, 0x90 } },
+    /* $af: U+2582 */ { 3, { 0xe2, 0x96, 0x82 } },
+    /* $b0: U+250C */ { 3, { 0xe2, 0x94, 0x8c } },
+    /* $b1: U+2534 */ { 3, { 0xe2, 0x94, 0xb4 } },
+    /* $b2: U+252C */ { 3, { 0xe2, 0x94, 0xac } },
+    /* $b3: U+2524 */ { 3, { 0xe2, 0x94, 0xa4 } },
+    /* $b4: U+258E */ { 3, { 0xe2, 0x96, 0x8e } },
+    /* $b5: U+258D */ { 3, { 0xe2, 0x96, 0x8d } },
+    /* $b6: U+1FB88 */ { 4, { 0xf0, 0x9f, 0xae, 0x88 } },
+    /* $b7: U+1FB82 */ { 4, { 0xf0, 0x9f, 0xae, 0x82 } },
+    /* $b8: U+1FB83 */ { 4, { 0xf0, 0x9f, 0xae, 0x83 } },
+    /* $b9: U+2583 */ { 3, { 0xe2, 0x96, 0x83 } },
+    /* $ba: U+1FB7F */ { 4, { 0xf0, 0x9f, 0xad, 0xbf } },
+    /* $bb: U+2596 */ { 3, { 0xe2, 0x96, 0x96 } },
+    /* $bc: U+259D */ { 3, { 0xe2, 0x96, 0x9d } },
+    /* $bd: U+2518 */ { 3, { 0xe2, 0x94, 0x98 } },
+    /* $be: U+2598 */ { 3, { 0xe2, 0x96, 0x98 } },
+    /* $bf: U+259A */ { 3, { 0xe2, 0x96, 0x9a } },
+    /* $c0: U+2500 */ { 3, { 0xe2, 0x94, 0x80 } },
+    /* $c1: U+2660 */ { 3, { 0xe2, 0x99, 0xa0 } },
+    /* $c2: U+1FB72 */ { 4, { 0xf0, 0x9f, 0xad, 0xb2 } },
+    /* $c3: U+1FB78 */ { 4, { 0xf0, 0x9f, 0xad, 0xb8 } },
+    /* $c4: U+1FB77 */ { 4, { 0xf0, 0x9f, 0xad, 0xb7 } },
+    /* $c5: U+1FB76 */ { 4, { 0xf0, 0x9f, 0xad, 0xb6 } },
+    /* $c6: U+1FB7A */ { 4, { 0xf0, 0x9f, 0xad, 0xba } },
+    /* $c7: U+1FB71 */ { 4, { 0xf0, 0x9f, 0xad, 0xb1 } },
+    /* $c8: U+1FB74 */ { 4, { 0xf0, 0x9f, 0xad, 0xb4 } },
+    /* $c9: U+256E */ { 3, { 0xe2, 0x95, 0xae } },
+    /* $ca: U+2570 */ { 3, { 0xe2, 0x95, 0xb0 } },
+    /* $cb: U+256F */ { 3, { 0xe2, 0x95, 0xaf } },
+    /* $cc: U+1FB7C */ { 4, { 0xf0, 0x9f, 0xad, 0xbc } },
+    /* $cd: U+2572 */ { 3, { 0xe2, 0x95, 0xb2 } },
+    /* $ce: U+2571 */ { 3, { 0xe2, 0x95, 0xb1 } },
+    /* $cf: U+1FB7D */ { 4, { 0xf0, 0x9f, 0xad, 0xbd } },
+    /* $d0: U+1FB7E */ { 4, { 0xf0, 0x9f, 0xad, 0xbe } },
+    /* $d1: U+25CF */ { 3, { 0xe2, 0x97, 0x8f } },
+    /* $d2: U+1FB7B */ { 4, { 0xf0, 0x9f, 0xad, 0xbb } },
+    /* $d3: U+2665 */ { 3, { 0xe2, 0x99, 0xa5 } },
+    /* $d4: U+1FB70 */ { 4, { 0xf0, 0x9f, 0xad, 0xb0 } },
+    /* $d5: U+256D */ { 3, { 0xe2, 0x95, 0xad } },
+    /* $d6: U+2573 */ { 3, { 0xe2, 0x95, 0xb3 } },
+    /* $d7: U+25CB */ { 3, { 0xe2, 0x97, 0x8b } },
+    /* $d8: U+2663 */ { 3, { 0xe2, 0x99, 0xa3 } },
+    /* $d9: U+1FB75 */ { 4, { 0xf0, 0x9f, 0xad, 0xb5 } },
+    /* $da: U+2666 */ { 3, { 0xe2, 0x99, 0xa6 } },
+    /* $db: U+253C */ { 3, { 0xe2, 0x94, 0xbc } },
+    /* $dc: U+1FB8C */ { 4, { 0xf0, 0x9f, 0xae, 0x8c } },
+    /* $dd: U+2502 */ { 3, { 0xe2, 0x94, 0x82 } },
+    /* $de: U+03C0 */ { 2, { 0xcf, 0x80 } },
+    /* $df: U+25E5 */ { 3, { 0xe2, 0x97, 0xa5 } },
+    /* $e0: U+00A0 */ { 2, { 0xc2, 0xa0 } },
+    /* $e1: U+258C */ { 3, { 0xe2, 0x96, 0x8c } },
+    /* $e2: U+2584 */ { 3, { 0xe2, 0x96, 0x84 } },
+    /* $e3: U+2594 */ { 3, { 0xe2, 0x96, 0x94 } },
+    /* $e4: U+2581 */ { 3, { 0xe2, 0x96, 0x81 } },
+    /* $e5: U+258F */ { 3, { 0xe2, 0x96, 0x8f } },
+    /* $e6: U+2592 */ { 3, { 0xe2, 0x96, 0x92 } },
+    /* $e7: U+2595 */ { 3, { 0xe2, 0x96, 0x95 } },
+    /* $e8: U+1FB8F */ { 4, { 0xf0, 0x9f, 0xae, 0x8f } },
+    /* $e9: U+25E4 */ { 3, { 0xe2, 0x97, 0xa4 } },
+    /* $ea: U+1FB87 */ { 4, { 0xf0, 0x9f, 0xae, 0x87 } },
+    /* $eb: U+251C */ { 3, { 0xe2, 0x94, 0x9c } },
+    /* $ec: U+2597 */ { 3, { 0xe2, 0x96, 0x97 } },
+    /* $ed: U+2514 */ { 3, { 0xe2, 0x94, 0x94 } },
+    /* $ee: U+2510 */ { 3, { 0xe2, 0x94, 0x90 } },
+    /* $ef: U+2582 */ { 3, { 0xe2, 0x96, 0x82 } },
+    /* $f0: U+250C */ { 3, { 0xe2, 0x94, 0x8c } },
+    /* $f1: U+2534 */ { 3, { 0xe2, 0x94, 0xb4 } },
+    /* $f2: U+252C */ { 3, { 0xe2, 0x94, 0xac } },
+    /* $f3: U+2524 */ { 3, { 0xe2, 0x94, 0xa4 } },
+    /* $f4: U+258E */ { 3, { 0xe2, 0x96, 0x8e } },
+    /* $f5: U+258D */ { 3, { 0xe2, 0x96, 0x8d } },
+    /* $f6: U+1FB88 */ { 4, { 0xf0, 0x9f, 0xae, 0x88 } },
+    /* $f7: U+1FB82 */ { 4, { 0xf0, 0x9f, 0xae, 0x82 } },
+    /* $f8: U+1FB83 */ { 4, { 0xf0, 0x9f, 0xae, 0x83 } },
+    /* $f9: U+2583 */ { 3, { 0xe2, 0x96, 0x83 } },
+    /* $fa: U+1FB7F */ { 4, { 0xf0, 0x9f, 0xad, 0xbf } },
+    /* $fb: U+2596 */ { 3, { 0xe2, 0x96, 0x96 } },
+    /* $fc: U+259D */ { 3, { 0xe2, 0x96, 0x9d } },
+    /* $fd: U+2518 */ { 3, { 0xe2, 0x94, 0x98 } },
+    /* $fe: U+2598 */ { 3, { 0xe2, 0x96, 0x98 } },
+    /* $ff: U+03C0 */ { 2, { 0xcf, 0x80 } }
+};
+
+
+#if (defined(__GNUC__) || defined(__clang__)) \
+    && (defined(__x86_64__) || defined(__i386__))
+# define PETASC_HAVE_X86_SIMD
+# include <immintrin.h>
+#endif
+
+
 /** @brief  Illegal characters in file names and paths
  *
  * In UNIX(-like) systems, just about evething is allowed with escaping, except
@@ -205,6 +489,150 @@ uint8_t cbmfm_asc_to_pet(uint8_t asc)
 }
 
 
+/*
+ * Bulk table lookup
+ *
+ * A 256-entry table is split into sixteen rows of sixteen bytes, one per high
+ * nybble. For each row the source bytes are XOR'ed with the row's high nybble
+ * and a saturated 0x70 is added: bytes belonging to the row end up as an
+ * index 0x70-0x7f, which PSHUFB resolves using the low nybble, all other
+ * bytes end up with bit 7 set, which PSHUFB turns into 0. OR'ing the sixteen
+ * shuffles gives the translated vector.
+ *
+ * If \a sub is not 0, results with bit 7 set are replaced with \a sub.
+ */
+
+#ifdef PETASC_HAVE_X86_SIMD
+
+/** \brief  Translate 16-byte chunks of \a src via \a table using SSSE3
+ *
+ * \param[out]  dst     destination
+ * \param[in]   src     source
+ * \param[in]   n       number of bytes in \a src
+ * \param[in]   table   translation table (256 bytes)
+ * \param[in]   sub     substitute for results >= 0x80 (0: don't substitute)
+ *
+ * \return  number of bytes translated (a multiple of 16)
+ */
+__attribute__((target("ssse3")))
+static size_t petasc_lut_ssse3(uint8_t *dst, const uint8_t *src, size_t n,
+                               const uint8_t *table, uint8_t sub)
+{
+    __m128i rows[16];
+    __m128i bias = _mm_set1_epi8(0x70);
+    __m128i zero = _mm_setzero_si128();
+    __m128i subv = _mm_set1_epi8((char)sub);
+    __m128i enable = _mm_set1_epi8(sub != 0 ? -1 : 0);
+    size_t i;
+    int h;
+
+    for (h = 0; h < 16; h++) {
+        rows[h] = _mm_loadu_si128((const __m128i *)(const void *)
+                (table + h * 16));
+    }
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(const void *)
+                (src + i));
+        __m128i r = zero;
+        __m128i mask;
+
+        for (h = 0; h < 16; h++) {
+            __m128i idx = _mm_adds_epu8(
+                    _mm_xor_si128(x, _mm_set1_epi8((char)(h << 4))), bias);
+            r = _mm_or_si128(r, _mm_shuffle_epi8(rows[h], idx));
+        }
+        mask = _mm_and_si128(_mm_cmplt_epi8(r, zero), enable);
+        r = _mm_or_si128(_mm_andnot_si128(mask, r), _mm_and_si128(mask, subv));
+        _mm_storeu_si128((__m128i *)(void *)(dst + i), r);
+    }
+    return i;
+}
+
+
+/** \brief  Translate 32-byte chunks of \a src via \a table using AVX2
+ *
+ * \param[out]  dst     destination
+ * \param[in]   src     source
+ * \param[in]   n       number of bytes in \a src
+ * \param[in]   table   translation table (256 bytes)
+ * \param[in]   sub     substitute for results >= 0x80 (0: don't substitute)
+ *
+ * \return  number of bytes translated (a multiple of 32)
+ */
+__attribute__((target("avx2")))
+static size_t petasc_lut_avx2(uint8_t *dst, const uint8_t *src, size_t n,
+                              const uint8_t *table, uint8_t sub)
+{
+    __m256i rows[16];
+    __m256i bias = _mm256_set1_epi8(0x70);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i subv = _mm256_set1_epi8((char)sub);
+    __m256i enable = _mm256_set1_epi8(sub != 0 ? -1 : 0);
+    size_t i;
+    int h;
+
+    /* VPSHUFB shuffles within 128-bit lanes, so each row goes in both */
+    for (h = 0; h < 16; h++) {
+        rows[h] = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+                    (const __m128i *)(const void *)(table + h * 16)));
+    }
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(const void *)
+                (src + i));
+        __m256i r = zero;
+        __m256i mask;
+
+        for (h = 0; h < 16; h++) {
+            __m256i idx = _mm256_adds_epu8(
+                    _mm256_xor_si256(x, _mm256_set1_epi8((char)(h << 4))),
+                    bias);
+            r = _mm256_or_si256(r, _mm256_shuffle_epi8(rows[h], idx));
+        }
+        mask = _mm256_and_si256(_mm256_cmpgt_epi8(zero, r), enable);
+        r = _mm256_or_si256(_mm256_andnot_si256(mask, r),
+                            _mm256_and_si256(mask, subv));
+        _mm256_storeu_si256((__m256i *)(void *)(dst + i), r);
+    }
+    return i;
+}
+
+#endif
+
+
+/** \brief  Translate \a n bytes of \a src via \a table into \a dst
+ *
+ * Uses AVX2 or SSSE3 when the CPU supports it, handling the remainder (and
+ * everything on other hosts) with plain table lookups.
+ *
+ * \param[out]  dst     destination
+ * \param[in]   src     source
+ * \param[in]   n       number of bytes to translate
+ * \param[in]   table   translation table (256 bytes)
+ * \param[in]   sub     substitute for results >= 0x80 (0: don't substitute)
+ */
+static void petasc_lut(uint8_t *dst, const uint8_t *src, size_t n,
+                       const uint8_t *table, uint8_t sub)
+{
+    size_t i = 0;
+
+#ifdef PETASC_HAVE_X86_SIMD
+    if (n >= 32 && __builtin_cpu_supports("avx2")) {
+        i = petasc_lut_avx2(dst, src, n, table, sub);
+    }
+    if (n - i >= 16 && __builtin_cpu_supports("ssse3")) {
+        i += petasc_lut_ssse3(dst + i, src + i, n - i, table, sub);
+    }
+#endif
+
+    while (i < n) {
+        uint8_t b = table[src[i]];
+        dst[i++] = (sub != 0 && b >= 0x80) ? sub : b;
+    }
+}
+
+
 
 
 /** \brief  Check if character \a ch is allowed in a filename/path on the host
@@ -236,13 +664,12 @@ bool cbmfm_is_host_allowed_char(int ch)
 void cbmfm_pet_to_asc_str(char *asc, const uint8_t *pet, size_t n)
 {
     size_t i = 0;
+
     while (i < n && pet[i] != '\0') {
-        int b = cbmfm_pet_to_asc(pet[i]);
-        asc[i] = b < 0x80 ? (char)b : '_';
         i++;
     }
+    cbmfm_pet_to_asc_buf(asc, pet, i);
     asc[i] = '\0';
-
 }
 
 
@@ -260,12 +687,71 @@ void cbmfm_asc_to_pet_str(uint8_t *pet, const char *asc, size_t n)
     size_t i = 0;
 
     while (i < n && asc[i] != '\0') {
-        pet[i] = cbmfm_asc_to_pet((uint8_t)(asc[i]));
         i++;
     }
-    while (i < n) {
-        pet[i++] = 0x00;
+    cbmfm_asc_to_pet_buf(pet, asc, i);
+    memset(pet + i, 0x00, n - i);
+}
+
+
+/** \brief  Translate \a n bytes of \a pet to ASCII in \a asc
+ *
+ * Unlike cbmfm_pet_to_asc_str() this doesn't stop at 0x00 and doesn't
+ * terminate \a asc, it translates exactly \a n bytes. Codes that don't
+ * translate into 7-bit ASCII are replaced with '_'.
+ *
+ * \param[out]  asc     target ASCII buffer (at least \a n bytes)
+ * \param[in]   pet     PETSCII buffer
+ * \param[in]   n       number of bytes to translate
+ */
+void cbmfm_pet_to_asc_buf(char *asc, const uint8_t *pet, size_t n)
+{
+    petasc_lut((uint8_t *)asc, pet, n, pet_to_asc_table, '_');
+}
+
+
+/** \brief  Translate \a n bytes of \a asc to PETSCII in \a pet
+ *
+ * Unlike cbmfm_asc_to_pet_str() this doesn't stop at 0x00, it translates
+ * exactly \a n bytes, using the same mapping as cbmfm_asc_to_pet().
+ *
+ * \param[out]  pet     target PETSCII buffer (at least \a n bytes)
+ * \param[in]   asc     ASCII buffer
+ * \param[in]   n       number of bytes to translate
+ */
+void cbmfm_asc_to_pet_buf(uint8_t *pet, const char *asc, size_t n)
+{
+    petasc_lut(pet, (const uint8_t *)asc, n, asc_to_pet_table, 0);
+}
+
+
+/** \brief  Translate at most \a n characters of \a pet to UTF-8 in \a utf8
+ *
+ * Translation stops at the first 0x0 in \a pet, but will never exceed \a n
+ * characters. Graphics characters are translated to their Unicode
+ * equivalents, control codes to U+FFFD. The result is always terminated.
+ *
+ * \param[out]  utf8    target UTF-8 string, must be at least
+ *                      CBMFM_PET_UTF8_SIZE(\a n) bytes
+ * \param[in]   pet     PETSCII string, optionally 0-terminated
+ * \param[in]   n       translate at most this number of characters
+ *
+ * \return  length of the string in \a utf8, in bytes
+ */
+size_t cbmfm_pet_to_utf8_str(char *utf8, const uint8_t *pet, size_t n)
+{
+    char *p = utf8;
+    size_t i = 0;
+
+    while (i < n && pet[i] != 0x00) {
+        const petasc_utf8_t *entry = &pet_to_utf8_table[pet[i++]];
+
+        /* always copy four bytes, the buffer size allows for it */
+        memcpy(p, entry->utf8, sizeof entry->utf8);
+        p += entry->len;
     }
+    *p = '\0';
+    return (size_t)(p - utf8);
 }
 
 
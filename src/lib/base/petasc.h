@@ -32,11 +32,21 @@
 #include <stdint.h>
 
 
+/** \brief  Size of a buffer for cbmfm_pet_to_utf8_str() of \a n characters
+ *
+ * Each PETSCII code takes at most four bytes in UTF-8, plus the terminator.
+ */
+#define CBMFM_PET_UTF8_SIZE(n)  ((n) * 4 + 1)
+
+
 uint8_t cbmfm_pet_to_asc(uint8_t pet);
 uint8_t cbmfm_asc_to_pet(uint8_t asc);
 bool    cbmfm_is_host_allowed_char(int ch);
 void    cbmfm_pet_to_asc_str(char *asc, const uint8_t *pet, size_t n);
 void    cbmfm_asc_to_pet_str(uint8_t *pet, const char *asc, size_t n);
+void    cbmfm_pet_to_asc_buf(char *asc, const uint8_t *pet, size_t n);
+void    cbmfm_asc_to_pet_buf(uint8_t *pet, const char *asc, size_t n);
+size_t  cbmfm_pet_to_utf8_str(char *utf8, const uint8_t *pet, size_t n);
 void    cbmfm_pet_filename_to_host(char *asc, const uint8_t *pet, const char *ext);
 int     cbmfm_write_petscii_digits(uint8_t *pet, int value, size_t len);
 char *  cbmfm_basename(char *path);
@@ -40,9 +40,16 @@
 
 /** \brief  Decode RLE data
  *
- * \param[out]  dst destination of decoded data
- * \param[in]   src pointer to the zipcode block to decode (must point at the
- *                  first byte of the block, the track+flags byte)
+ * Literal spans up to the next pack byte are located with memchr() and copied
+ * in bulk, runs are expanded with memset().
+ *
+ * A run overflowing the block by a single byte is silently truncated, runs
+ * overflowing it by more bytes are an error.
+ *
+ * \param[out]  dst     destination of decoded data
+ * \param[in]   src     pointer to the zipcode block to decode (must point at
+ *                      the first byte of the block, the track+flags byte)
+ * \param[in]   size    size of the decoded block
  *
  * \return  number of bytes used during decoding, including the track+flags and
  *          sector byte in the zipcode block, or -1 on error
@@ -52,7 +59,7 @@
  *
  * \ingroup lib_archive_zipcode
  */
-static int zipcode_rle_decode(uint8_t *dst, const uint8_t *src)
+static int zipcode_rle_decode(uint8_t *dst, const uint8_t *src, size_t size)
 {
     size_t rle_len = src[CBMFM_ZIPCODE_BLOCK_RLE_LEN];
     uint8_t pack_byte = src[CBMFM_ZIPCODE_BLOCK_RLE_PACK_BYTE];
@@ -63,37 +70,52 @@ static int zipcode_rle_decode(uint8_t *dst, const uint8_t *src)
     cbmfm_log_debug("decoding RLE data: len = %zu, pack-byte = %u\n",
             rle_len, (unsigned int)pack_byte);
 
-    while (dst_idx < CBMFM_BLOCK_SIZE_RAW && rle_idx < rle_len) {
-
-        /* run or normal data? */
-        if (rle_data[rle_idx] != pack_byte) {
-            /* normal data, copy */
-            dst[dst_idx] = rle_data[rle_idx];
-            dst_idx++;
-            rle_idx++;
+    while (dst_idx < size && rle_idx < rle_len) {
+        const uint8_t *pack;
+        size_t span;
+        size_t len;
+        size_t fill;
 
-        } else {
-            /* handle run */
-            int len = rle_data[++rle_idx];      /* run length */
-            uint8_t b = rle_data[++rle_idx];    /* run value */
-
-            cbmfm_log_debug("got run of %d bytes of %d\n", len, (int)b);
+        /* copy literal data up to the next pack byte */
+        span = rle_len - rle_idx;
+        if (span > size - dst_idx) {
+            span = size - dst_idx;
+        }
+        pack = memchr(rle_data + rle_idx, pack_byte, span);
+        if (pack != NULL) {
+            span = (size_t)(pack - (rle_data + rle_idx));
+        }
+        memcpy(dst + dst_idx, rle_data + rle_idx, span);
+        dst_idx += span;
+        rle_idx += span;
+        if (pack == NULL) {
+            continue;
+        }
 
-            rle_idx++;  /* idx now 'points at' the first byte of RLE data */
+        /* handle run */
+        if (rle_idx + 2 >= rle_len) {
+            /* run length and value missing */
+            cbmfm_error_set(CBMFM_ERR_BUFFER_UNDERFLOW, NULL, -1);
+            return -1;
+        }
+        len = rle_data[rle_idx + 1];
+        fill = size - dst_idx;
+        if (fill > len) {
+            fill = len;
+        }
+        memset(dst + dst_idx, rle_data[rle_idx + 2], fill);
+        dst_idx += fill;
+        rle_idx += 3;   /* idx now 'points at' the first byte of RLE data */
 
-            while (len-- > 0 && dst_idx < CBMFM_BLOCK_SIZE_RAW) {
-                dst[dst_idx++] = b;
-            }
-            if (dst_idx == CBMFM_BLOCK_SIZE_RAW && len > 0) {
-                /* buffer overflow */
-                cbmfm_errno = CBMFM_ERR_BUFFER_OVERFLOW;
-                return -1;
-            }
+        if (len > fill + 1) {
+            /* buffer overflow */
+            cbmfm_error_set(CBMFM_ERR_BUFFER_OVERFLOW, NULL, -1);
+            return -1;
         }
     }
-    if (dst_idx < CBMFM_BLOCK_SIZE_RAW) {
+    if (dst_idx < size) {
         /* insufficient data */
-        cbmfm_errno = CBMFM_ERR_BUFFER_UNDERFLOW;
+        cbmfm_error_set(CBMFM_ERR_BUFFER_UNDERFLOW, NULL, -1);
         return -1;
     }
 
@@ -102,7 +124,6 @@ static int zipcode_rle_decode(uint8_t *dst, const uint8_t *src)
 }
 
 
-
 /** \brief  Unpack zipcoded block \a src into \a dst
  *
  * \param[out]  dst destination of unpacked data
@@ -129,12 +150,189 @@ int cbmfm_zipcode_unpack(uint8_t *dst, const uint8_t *src)
                     CBMFM_BLOCK_SIZE_RAW);
             return 3;
         case CBMFM_ZIPCODE_FLAG_RLE:
-            /* TODO: decode RLE sequence */
-            return zipcode_rle_decode(dst, src);
+            return zipcode_rle_decode(dst, src, CBMFM_BLOCK_SIZE_RAW);
+
+        default:
+            /* invalid flags value */
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
+            return -1;
+    }
+}
+
+
+/** \brief  Unpack file-zip block entry \a src into \a dst
+ *
+ * File-zip entries use the same encodings as disk entries, but hold a block
+ * of a file: the track and sector bytes are the block link, followed by 254
+ * bytes of (encoded) data. A stored entry is therefore the raw block.
+ *
+ * \param[out]  dst destination of unpacked block, including the block link
+ * \param[in]   src file-zip block entry
+ *
+ * \return  number of bytes used from \a src, or -1 on error
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA     compression flags are invalid (ie 0xc0)
+ * \throw   #CBMFM_ERR_BUFFER_UNDERFLOW not enough RLE data to fill block
+ * \throw   #CBMFM_ERR_BUFFER_OVERFLOW  RLE data would overflow block
+ *
+ * \ingroup lib_archive_zipcode
+ */
+int cbmfm_zipcode_unpack_file(uint8_t *dst, const uint8_t *src)
+{
+    dst[0] = src[CBMFM_ZIPCODE_BLOCK_TRACK] & 0x3f;
+    dst[1] = src[CBMFM_ZIPCODE_BLOCK_SECTOR];
+
+    switch (src[CBMFM_ZIPCODE_BLOCK_TRACK] & 0xc0) {
+        case CBMFM_ZIPCODE_FLAG_STORE:
+            memcpy(dst + 2, src + CBMFM_ZIPCODE_BLOCK_DATA,
+                    CBMFM_BLOCK_SIZE_DATA);
+            return CBMFM_BLOCK_SIZE_RAW;
+        case CBMFM_ZIPCODE_FLAG_FILL:
+            memset(dst + 2, src[CBMFM_ZIPCODE_BLOCK_FILL_BYTE],
+                    CBMFM_BLOCK_SIZE_DATA);
+            return 3;
+        case CBMFM_ZIPCODE_FLAG_RLE:
+            return zipcode_rle_decode(dst + 2, src, CBMFM_BLOCK_SIZE_DATA);
 
         default:
             /* invalid flags value */
-            cbmfm_errno = CBMFM_ERR_INVALID_DATA;
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
             return -1;
     }
 }
+
+
+/** \brief  Maximum size of RLE data worth using
+ *
+ * Beyond this, storing the block as-is is at least as small.
+ */
+#define ZIPCODE_RLE_LEN_MAX \
+    (CBMFM_ZIPCODE_ENTRY_SIZE_MAX - CBMFM_ZIPCODE_BLOCK_RLE_DATA - 1)
+
+
+/** \brief  Select pack byte for RLE encoding \a src
+ *
+ * Picks the least used byte value, so the fewest literals need escaping.
+ *
+ * \param[in]   src block data
+ *
+ * \return  pack byte
+ */
+static uint8_t zipcode_pack_byte(const uint8_t *src)
+{
+    unsigned int hist[256];
+    unsigned int best = 0;
+    size_t i;
+
+    memset(hist, 0, sizeof hist);
+    for (i = 0; i < CBMFM_BLOCK_SIZE_RAW; i++) {
+        hist[src[i]]++;
+    }
+    for (i = 1; i < 256 && hist[best] > 0; i++) {
+        if (hist[i] < hist[best]) {
+            best = (unsigned int)i;
+        }
+    }
+    return (uint8_t)best;
+}
+
+
+/** \brief  RLE encode block \a src
+ *
+ * Runs longer than three bytes, and any occurence of the pack byte, are
+ * encoded as pack byte, length and value.
+ *
+ * \param[out]  dst         destination of RLE data (at least
+ *                          #ZIPCODE_RLE_LEN_MAX bytes)
+ * \param[in]   src         block data
+ * \param[in]   pack_byte   pack byte
+ *
+ * \return  size of RLE data, or 0 when larger than #ZIPCODE_RLE_LEN_MAX
+ */
+static size_t zipcode_rle_encode(uint8_t *dst,
+                                 const uint8_t *src,
+                                 uint8_t pack_byte)
+{
+    size_t src_idx = 0;
+    size_t dst_idx = 0;
+
+    while (src_idx < CBMFM_BLOCK_SIZE_RAW) {
+        uint8_t b = src[src_idx];
+        size_t run = 1;
+
+        while (src_idx + run < CBMFM_BLOCK_SIZE_RAW
+                && src[src_idx + run] == b && run < 0xff) {
+            run++;
+        }
+
+        if (run > 3 || b == pack_byte) {
+            if (dst_idx + 3 > ZIPCODE_RLE_LEN_MAX) {
+                return 0;
+            }
+            dst[dst_idx++] = pack_byte;
+            dst[dst_idx++] = (uint8_t)run;
+            dst[dst_idx++] = b;
+        } else {
+            if (dst_idx + run > ZIPCODE_RLE_LEN_MAX) {
+                return 0;
+            }
+            memset(dst + dst_idx, b, run);
+            dst_idx += run;
+        }
+        src_idx += run;
+    }
+    return dst_idx;
+}
+
+
+/** \brief  Pack block \a src into a zipcode block entry
+ *
+ * Uses the method resulting in the smallest entry: fill for blocks with a
+ * single value, RLE when it's smaller than storing the block.
+ *
+ * \param[out]  dst     destination of the entry (at least
+ *                      #CBMFM_ZIPCODE_ENTRY_SIZE_MAX bytes)
+ * \param[in]   src     block data (256 bytes)
+ * \param[in]   track   track number (1-63)
+ * \param[in]   sector  sector number
+ *
+ * \return  size of the entry
+ *
+ * \ingroup lib_archive_zipcode
+ */
+size_t cbmfm_zipcode_pack(uint8_t *dst, const uint8_t *src,
+                          int track, int sector)
+{
+    uint8_t pack_byte;
+    size_t rle_len;
+    size_t i;
+
+    dst[CBMFM_ZIPCODE_BLOCK_SECTOR] = (uint8_t)sector;
+
+    /* single value? */
+    for (i = 1; i < CBMFM_BLOCK_SIZE_RAW && src[i] == src[0]; i++) {
+        /* NOP */
+    }
+    if (i == CBMFM_BLOCK_SIZE_RAW) {
+        dst[CBMFM_ZIPCODE_BLOCK_TRACK] =
+            (uint8_t)((track & 0x3f) | CBMFM_ZIPCODE_FLAG_FILL);
+        dst[CBMFM_ZIPCODE_BLOCK_FILL_BYTE] = src[0];
+        return CBMFM_ZIPCODE_BLOCK_FILL_BYTE + 1;
+    }
+
+    pack_byte = zipcode_pack_byte(src);
+    rle_len = zipcode_rle_encode(dst + CBMFM_ZIPCODE_BLOCK_RLE_DATA, src,
+            pack_byte);
+    if (rle_len > 0) {
+        dst[CBMFM_ZIPCODE_BLOCK_TRACK] =
+            (uint8_t)((track & 0x3f) | CBMFM_ZIPCODE_FLAG_RLE);
+        dst[CBMFM_ZIPCODE_BLOCK_RLE_LEN] = (uint8_t)rle_len;
+        dst[CBMFM_ZIPCODE_BLOCK_RLE_PACK_BYTE] = pack_byte;
+        return CBMFM_ZIPCODE_BLOCK_RLE_DATA + rle_len;
+    }
+
+    dst[CBMFM_ZIPCODE_BLOCK_TRACK] =
+        (uint8_t)((track & 0x3f) | CBMFM_ZIPCODE_FLAG_STORE);
+    memcpy(dst + CBMFM_ZIPCODE_BLOCK_DATA, src, CBMFM_BLOCK_SIZE_RAW);
+    return CBMFM_ZIPCODE_ENTRY_SIZE_MAX;
+}
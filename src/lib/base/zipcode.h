@@ -106,7 +106,20 @@ typedef enum cbmfm_zipcode_flag_e {
 #define CBMFM_ZIPCODE_BLOCK_RLE_DATA        0x04
 
 
-int cbmfm_zipcode_unpack(uint8_t *dst, const uint8_t *src);
+/** \brief  Maximum size of a zipcode block entry
+ *
+ * A stored block: track & flags, sector and 256 bytes of data.
+ *
+ * \ingroup lib_archive_zipcode
+ */
+#define CBMFM_ZIPCODE_ENTRY_SIZE_MAX \
+    (CBMFM_ZIPCODE_BLOCK_DATA + CBMFM_BLOCK_SIZE_RAW)
+
+
+int     cbmfm_zipcode_unpack(uint8_t *dst, const uint8_t *src);
+int     cbmfm_zipcode_unpack_file(uint8_t *dst, const uint8_t *src);
+size_t  cbmfm_zipcode_pack(uint8_t *dst, const uint8_t *src,
+                           int track, int sector);
 
 /** @} */
 
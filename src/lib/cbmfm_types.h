@@ -28,6 +28,7 @@
 #ifndef CBMFM_LIB_TYPES_H
 #define CBMFM_LIB_TYPES_H
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -113,6 +114,14 @@ enum {
 #define CBMFM_IMAGE_FLAG_INVALID    0x04U
 
 
+/** \brief  Image flag: mapped bit
+ *
+ * When set, the image data is a private read-only memory mapping of the image
+ * file rather than a heap-allocated copy. Such an image cannot be altered.
+ */
+#define CBMFM_IMAGE_FLAG_MAPPED     0x08U
+
+
 /** \brief  Image type enumerators
  */
 typedef enum {
@@ -132,6 +141,46 @@ typedef enum {
 } cbmfm_image_type_t;
 
 
+/** \brief  Number of header bytes read when probing a file
+ *
+ * Large enough for the Lynx BASIC stub and signature, the T64 header and the
+ * first ARK directory entries.
+ */
+#define CBMFM_PROBE_HEADER_SIZE 0x100
+
+
+/** \brief  Probe score: file doesn't match the format
+ */
+#define CBMFM_PROBE_SCORE_NONE          0
+
+/** \brief  Probe score: only the file extension matches the format
+ */
+#define CBMFM_PROBE_SCORE_EXTENSION     25
+
+/** \brief  Probe score: file size matches one of the format's fixed sizes
+ */
+#define CBMFM_PROBE_SCORE_SIZE          60
+
+/** \brief  Probe score: file contains the format's signature
+ */
+#define CBMFM_PROBE_SCORE_SIGNATURE     90
+
+
+/** \brief  File probe object
+ *
+ * Result of a single open, stat and header read of a file, used by the image
+ * type detection code. The file handle is kept open so a subsequent open of
+ * the image can continue reading where the probe stopped.
+ */
+typedef struct cbmfm_probe_s {
+    FILE *      fp;             /**< file handle (`NULL` when closed) */
+    const char *path;           /**< path to file (borrowed) */
+    intmax_t    size;           /**< size of file in bytes */
+    size_t      header_len;     /**< number of valid bytes in \a header */
+    uint8_t     header[CBMFM_PROBE_HEADER_SIZE];    /**< start of file */
+} cbmfm_probe_t;
+
+
 
 /** \brief  Block object
  *
@@ -148,6 +197,17 @@ typedef struct cbmfm_block_s {
 } cbmfm_block_t;
 
 
+/** \brief  Extent object
+ *
+ * Describes a contiguous range of bytes inside image data, for example the
+ * payload of a single block of a file.
+ */
+typedef struct cbmfm_extent_s {
+    size_t  offset; /**< offset in image data */
+    size_t  size;   /**< number of bytes */
+} cbmfm_extent_t;
+
+
 /** \brief  T64 specific dirent fields
  */
 typedef struct cbmfm_dirent_t64_s {
@@ -170,9 +230,17 @@ typedef struct cbmfm_dirent_dxx_s {
 typedef struct cbmfm_dirent_lnx_s {
     uint8_t remainder;  /**< number of bytes in the final block of a file
                              (not always reliable) */
+    size_t  data_offset;    /**< offset in image of file data */
 } cbmfm_dirent_lnx_t;
 
 
+/** \brief  ARK specific dirent fields
+ */
+typedef struct cbmfm_dirent_ark_s {
+    size_t  data_offset;    /**< offset in image of file data */
+} cbmfm_dirent_ark_t;
+
+
 /** \brief  Directory entry object
  *
  * Contains information on a directory entry.
@@ -196,6 +264,7 @@ typedef struct cbmfm_dirent_s {
         cbmfm_dirent_dxx_t dxx;     /**< Dxx specific data */
         cbmfm_dirent_t64_t t64;     /**< T64 specific data */
         cbmfm_dirent_lnx_t lnx;     /**< Lynx specific data */
+        cbmfm_dirent_ark_t ark;     /**< ARK specific data */
     } extra;
 
     int image_type; /**< image type (\see #cbmfm_image_type_t) */
@@ -207,22 +276,66 @@ typedef struct cbmfm_dirent_s {
  *
  */
 typedef struct cbmfm_dir_s {
-    cbmfm_dirent_t **entries;       /**< array of dirent pointers */
+    cbmfm_dirent_t *entries;        /**< array of dirents, stored by value */
     size_t entry_max;               /**< size of entries array */
     size_t entry_used;              /**< number of used entries */
 
     struct cbmfm_image_s *image;    /**< parent image reference */
 
+    size_t *name_index;             /**< hash index of file names, contains
+                                         entry index + 1 or 0 when unused,
+                                         `NULL` until the first lookup */
+    size_t name_index_mask;         /**< size of name index - 1 */
+
+    unsigned int refs;              /**< reference count, see cbmfm_dir_ref()
+                                         and cbmfm_dir_free() */
+
 } cbmfm_dir_t;
 
 
+/** \brief  Directory visitor callback
+ *
+ * Called for each entry of a directory by the `*_visit` functions. The dirent
+ * is only valid during the call, it must be copied to keep it.
+ *
+ * \param[in]   dirent  directory entry
+ * \param[in]   data    user data passed to the visit function
+ *
+ * \return  true to continue, false to stop visiting
+ */
+typedef bool (*cbmfm_dir_visitor_t)(const cbmfm_dirent_t *dirent, void *data);
+
+
+/** \brief  Maximum length of a CBM DOS file name pattern
+ *
+ * Drive prefix, file name and file type filter.
+ */
+#define CBMFM_PATTERN_MAX_LEN   0x20
+
+
+/** \brief  Compiled CBM DOS file name pattern
+ */
+typedef struct cbmfm_pattern_s {
+    uint8_t name[CBMFM_CBMDOS_FILE_NAME_LEN];   /**< name part, '?' matches any
+                                                     character */
+    size_t  len;        /**< length of the name part */
+    int     type;       /**< file type filter or -1 for any type */
+    bool    prefix;     /**< name part was followed by '*' */
+    bool    wildcards;  /**< name part contains '?' */
+} cbmfm_pattern_t;
+
+
 
 #define CBMFM_IMAGE_SHARED_MEMBERS \
     uint8_t *   data;   /**< raw image data */ \
     size_t      size;   /**< size of raw image data */ \
     char *      path;   /**< path to image file */ \
     cbmfm_image_type_t type;    /**< image type */ \
-    uint32_t    flags;  /**< image flags */
+    uint32_t    flags;  /**< image flags */ \
+    uint32_t    generation; /**< modification counter, incremented when \
+                                 the image is marked dirty */ \
+    struct cbmfm_dir_s *dir_cache;  /**< cached parsed directory */ \
+    uint32_t    dir_cache_generation;   /**< generation of `dir_cache` */
 
 
 /** \brief  Image object
@@ -241,10 +354,34 @@ typedef struct cbmfm_dxx_speedzone_s {
 } cbmfm_dxx_speedzone_t;
 
 
+/** \brief  Track entry of a disk geometry
+ */
+typedef struct cbmfm_dxx_track_s {
+    uint16_t    start;  /**< block number of sector 0 of the track */
+    uint8_t     blocks; /**< number of blocks/sectors in the track */
+} cbmfm_dxx_track_t;
+
+
+/** \brief  Disk geometry descriptor
+ *
+ * Precomputed tables to translate (track,sector) into block numbers and back
+ * without walking the speed zones.
+ */
+typedef struct cbmfm_dxx_geometry_s {
+    const cbmfm_dxx_speedzone_t *zones; /**< speed zones */
+    int     track_max;                  /**< number of tracks */
+    int     block_count;                /**< number of blocks */
+    const cbmfm_dxx_track_t *tracks;    /**< track entries, indexed by track
+                                             number (entry 0 is unused) */
+    const uint8_t *block_track;         /**< track number of each block */
+} cbmfm_dxx_geometry_t;
+
+
 /** \brief  Dxx image shared members
  */
 #define CBMFM_DXX_IMAGE_SHARED_MEMBERS \
     const cbmfm_dxx_speedzone_t *zones; /**< speed zones */ \
+    const cbmfm_dxx_geometry_t *geometry;   /**< geometry descriptor */ \
     int track_max;  /**< maximum track number */ \
     bool errors;    /**< image contains error bytes */
 
@@ -257,14 +394,51 @@ typedef struct cbmfm_dxx_image_s {
 } cbmfm_dxx_image_t;
 
 
+/** \brief  Number of tracks covered by the BAM of a D64 image
+ */
+#define CBMFM_D64_BAM_TRACKS    35
+
+
 /** \brief  D64 image
+ *
+ * The BAM bitmaps are mirrored in `bam_map`, one word per track with bit N
+ * set when sector N is free. The mirror is built from the image data on first
+ * use and kept in sync by the BAM functions in d64.c.
  */
 typedef struct cbmfm_d64_s {
     CBMFM_IMAGE_SHARED_MEMBERS
     CBMFM_DXX_IMAGE_SHARED_MEMBERS
+    uint64_t    bam_map[CBMFM_D64_BAM_TRACKS + 1];  /**< BAM mirror, indexed
+                                                         by track number */
+    int         bam_free;   /**< blocks free, excluding the directory track */
+    bool        bam_synced; /**< BAM mirror is in sync with the image data */
+    bool        bam_deferred;   /**< only update the BAM mirror, the BAM
+                                     bytes are written on commit */
 } cbmfm_d64_t;
 
 
+/** \brief  Validation result of a D64 image
+ *
+ * Contains the block link graph built by cbmfm_d64_validate() and the number
+ * of problems found. The `next` and `owner` arrays are indexed by block number.
+ */
+typedef struct cbmfm_d64_validate_s {
+    int     block_count;    /**< number of blocks in the graph */
+    int     dir_blocks;     /**< number of directory blocks claimed */
+    int *   next;           /**< next block in chain, or one of the
+                                 CBMFM_VALIDATE_NEXT_* constants */
+    int *   owner;          /**< index of dirent owning the block, or one of
+                                 the CBMFM_VALIDATE_OWNER_* constants */
+    int     files;          /**< number of closed files */
+    int     splat_files;    /**< number of unclosed ('splat') files */
+    int     cross_links;    /**< chains running into another chain */
+    int     loops;          /**< chains linking back to themselves */
+    int     illegal_links;  /**< chains linking to an invalid block */
+    int     orphans;        /**< blocks marked used but not owned */
+    int     free_used;      /**< blocks owned but marked free */
+} cbmfm_d64_validate_t;
+
+
 /** \brief  Disk image block iterator
  *
  * An object to iterate over a block chain of a file/directory listing.
@@ -289,6 +463,48 @@ typedef struct cbmfm_dxx_dir_iter_s {
 } cbmfm_dxx_dir_iter_t;
 
 
+/** \brief  Size of a directory entry, excluding the directory block link
+ */
+#define CBMFM_D64_WRITER_DIRENT_SIZE    0x1e
+
+
+/** \brief  D64 streaming file writer
+ *
+ * Writes a file to a D64 image in chunks of arbitrary size, allocating blocks
+ * as data arrives. The `iter.curr` member is the block being filled, the
+ * directory entry is created when opening the writer and finalized when
+ * closing it.
+ */
+typedef struct cbmfm_d64_writer_s {
+    cbmfm_d64_t *           image;  /**< image written to */
+    cbmfm_dxx_block_iter_t  iter;   /**< block iterator */
+    size_t                  used;   /**< bytes used in the current block */
+    uint16_t                blocks; /**< number of blocks allocated */
+    intmax_t                entry;  /**< offset in image data of the
+                                         directory entry */
+    uint8_t                 dirent[CBMFM_D64_WRITER_DIRENT_SIZE];
+                                    /**< original directory entry */
+    cbmfm_block_t           dir_last;   /**< directory block extended for
+                                             the entry (track 0 if the
+                                             directory wasn't extended) */
+    bool                    open;   /**< writer is open */
+} cbmfm_d64_writer_t;
+
+
+/** \brief  D64 bulk import item
+ *
+ * Describes a file to import with cbmfm_d64_import(), either a host file or
+ * a buffer in memory.
+ */
+typedef struct cbmfm_d64_import_s {
+    const char *    path;   /**< host file path, `NULL` to use `data` */
+    const uint8_t * data;   /**< file data, used when `path` is `NULL` */
+    size_t          size;   /**< size of `data` */
+    uint8_t         name[CBMFM_CBMDOS_FILE_NAME_LEN];   /**< PETSCII name */
+    uint8_t         type;   /**< CBMDOS file type and flags */
+} cbmfm_d64_import_t;
+
+
 /** \brief  Length of the header magic bytes
  */
 #define CBMFM_T64_HDR_MAGIC_LEN 0x20
@@ -313,13 +529,27 @@ typedef struct cbmfm_t64_s {
 
 
 
+/** \brief  Maximum size of the prefix of a file object
+ */
+#define CBMFM_FILE_PREFIX_MAX   2
+
+
 /** \brief  Object to pass files around
+ *
+ * A file object either owns its data, or borrows it from an image, in which
+ * case it is only valid while the image is open and unmodified. Borrowed data
+ * can be preceded by a small prefix, for example the load address T64 images
+ * strip from their files. The contents of the file are the prefix followed by
+ * the data, see cbmfm_file_get_size() and cbmfm_file_own().
  */
 typedef struct cbmfm_file_s {
     uint8_t     name[CBMFM_CBMDOS_FILE_NAME_LEN];   /**< PESCII file name */
     uint8_t *   data;   /**< file data */
-    size_t      size;   /**< file size */
+    size_t      size;   /**< size of data, excluding the prefix */
     uint8_t     type;   /**< CBMDOS file type and flags */
+    uint8_t     prefix[CBMFM_FILE_PREFIX_MAX];  /**< data preceding data */
+    size_t      prefix_len; /**< number of bytes used in prefix */
+    bool        borrowed;   /**< data is borrowed, don't free it */
 } cbmfm_file_t;
 
 
@@ -351,4 +581,23 @@ typedef struct cbmfm_zipcode_file_s {
 
 
 
+/** \brief  Library context
+ *
+ * Holds the error state and logging configuration of the library, see
+ * src/lib/base/errors.c. Each thread uses its own context, so images can be
+ * handled on several threads at once.
+ */
+typedef struct cbmfm_ctx_s {
+    int         err_code;       /**< error code, see #cbmfm_err_t */
+    int         err_detail_code;    /**< error code \a err_detail and
+                                         \a err_offset belong to */
+    const char *err_detail;     /**< optional detail message (static string) */
+    intmax_t    err_offset;     /**< offset of offending data or -1 */
+    int         log_level;      /**< log level, see #cbmfm_log_level_t */
+    FILE *      log_file;       /**< log file or `NULL` for stdout */
+    bool        log_file_owned; /**< \a log_file was opened for this context
+                                     and is closed by cbmfm_log_close() */
+} cbmfm_ctx_t;
+
+
 #endif
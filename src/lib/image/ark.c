@@ -38,6 +38,7 @@
 #include "lib/base/file.h"
 #include "lib/base/image.h"
 #include "lib/base/io.h"
+#include "lib/base/log.h"
 #include "lib/base/mem.h"
 
 #include "ark.h"
@@ -102,7 +103,7 @@ static int ark_dirent_count(const cbmfm_image_t *image)
 static bool ark_file_index_check(const cbmfm_image_t *image, int index)
 {
     if (index < 0 || index >= ark_dirent_count(image)) {
-        cbmfm_errno = CBMFM_ERR_INDEX;
+        cbmfm_error_set(CBMFM_ERR_INDEX, NULL, -1);
         return false;
     }
     return true;
@@ -129,40 +130,6 @@ static uint8_t *ark_dirent_ptr(cbmfm_image_t *image, int index)
 }
 
 
-/** \brief  Get pointer to file data of file \a index in \a image
- *
- * \param[in]   image   ARK image
- * \param[in]   index   file index in the 'directory' of \a image
- *
- * \return  pointer to file data or `NULL` on index error
- *
- * \throw   #CBMFM_ERR_INDEX
- */
-static uint8_t *ark_file_data_ptr(cbmfm_image_t *image, int index)
-{
-    int ent_idx = 0;
-    uint8_t *data = image->data + ark_file_data_offset(image);
-
-    if (!ark_file_index_check(image, index)) {
-        return NULL;
-    }
-
-    while (ent_idx < index) {
-        size_t blocks;
-        uint8_t *entry;
-
-        entry = ark_dirent_ptr(image, ent_idx);
-        blocks = (size_t)(entry[CBMFM_ARK_DIRENT_FILESIZE]
-                + entry[CBMFM_ARK_DIRENT_FILESIZE + 1]);
-
-        data += (blocks * CBMFM_BLOCK_SIZE_DATA);
-
-        ent_idx++;
-    }
-    return data;
-}
-
-
 #if 0
 static size_t ark_file_data_size(cbmfm_image_t *image, int index)
 {
@@ -204,6 +171,7 @@ static bool ark_parse_dirent(
     /* initialize dirent */
     cbmfm_dirent_init(dirent);
     dirent->image_type = CBMFM_IMAGE_TYPE_ARK;
+    dirent->extra.ark.data_offset = 0;
 
     /* get CBMDOS filename */
     memcpy(dirent->filename, data + CBMFM_ARK_DIRENT_FILENAME,
@@ -249,6 +217,41 @@ bool cbmfm_ark_open(cbmfm_image_t *image, const char *path)
 }
 
 
+/** \brief  Map ark archive \a path read-only
+ *
+ * Opens \a path without copying its data, see cbmfm_image_map_data().
+ *
+ * \param[in,out]   image   image handle
+ * \param[in]       path    path to ARK file
+ *
+ * \return  bool
+ */
+bool cbmfm_ark_open_mapped(cbmfm_image_t *image, const char *path)
+{
+    cbmfm_image_init(image);
+    image->type = CBMFM_IMAGE_TYPE_ARK;
+    return cbmfm_image_map_data(image, path);
+}
+
+
+/** \brief  Open ark archive through \a probe
+ *
+ * Reads the archive data from the file handle left open by cbmfm_probe_open().
+ *
+ * \param[in,out]   image   image handle
+ * \param[in,out]   probe   probe object
+ *
+ * \return  bool
+ */
+bool cbmfm_ark_open_probe(cbmfm_image_t *image, cbmfm_probe_t *probe)
+{
+    cbmfm_image_init(image);
+    image->type = CBMFM_IMAGE_TYPE_ARK;
+    cbmfm_image_set_readonly(image, true);
+    return cbmfm_image_read_probe(image, probe);
+}
+
+
 /** \brief  Free memory used by the members of \a image, but not \a image itself
  *
  * \param[in,out]   image   image handle
@@ -277,46 +280,115 @@ void cbmfm_ark_dump_stats(const cbmfm_image_t *image)
 /** \brief  Read directory of \a image and return a new dir object
  *
  * Read directory of \a image, optionally reading each entry's file data into
- * its dirent.
+ * its dirent. A directory without file data is cached in \a image until the
+ * image is modified.
  *
  * \param[in]   image           ARK image
  * \param[in]   read_file_data  read data of each file into its dirent
  *
- * \return  new dir object
+ * \return  dir object or `NULL` on failure
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ *
+ * \note    The caller is responsible for calling cbmfm_dir_free() on the
+ *          returned pointer.
  */
 cbmfm_dir_t *cbmfm_ark_read_dir(cbmfm_image_t *image, bool read_file_data)
 {
     cbmfm_dir_t *dir;
+
+    if (!read_file_data) {
+        dir = cbmfm_image_dir_cache_get(image);
+        if (dir != NULL) {
+            return dir;
+        }
+    }
+
+    dir = cbmfm_dir_new_size((size_t)ark_dirent_count(image));
+    /* appending copies the file data the dirents point to */
+    if (cbmfm_ark_visit_dir(image, read_file_data,
+                cbmfm_dir_append_visitor, dir) < 0) {
+        cbmfm_dir_free(dir);
+        return NULL;
+    }
+
+    /* store reference to parent image */
+    dir->image = image;
+    if (!read_file_data) {
+        cbmfm_image_dir_cache_set(image, dir);
+    }
+    return dir;
+}
+
+
+/** \brief  Call \a visitor for each entry in the directory of \a image
+ *
+ * Parses each entry into a dirent on the stack and hands it to \a visitor,
+ * without allocating memory. When \a file_data is true, the filedata member
+ * of the dirent points at the file data inside \a image, it must not be
+ * freed or modified.
+ *
+ * The offset of each file's data is determined in the same pass and stored in
+ * the dirent. Entries are checked against the size of \a image before they
+ * are visited.
+ *
+ * \param[in]       image       ARK image
+ * \param[in]       file_data   set filedata member of the dirents
+ * \param[in]       visitor     visitor callback, return false to stop
+ * \param[in,out]   data        data for \a visitor
+ *
+ * \return  number of entries visited or -1 on error
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+int cbmfm_ark_visit_dir(cbmfm_image_t *image,
+                        bool file_data,
+                        cbmfm_dir_visitor_t visitor,
+                        void *data)
+{
     cbmfm_dirent_t dirent;
-    int index = 0;
+    size_t offset;
+    int index;
 
-    dir = cbmfm_dir_new();
+    if (image->size <= CBMFM_ARK_DIRENT_COUNT
+            || ark_file_data_offset(image) > image->size) {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                "directory doesn't fit in the image", CBMFM_ARK_DIRENT_COUNT);
+        return -1;
+    }
 
+    offset = ark_file_data_offset(image);
     for (index = 0; index < ark_dirent_count(image); index++) {
         ark_parse_dirent(image, &dirent, index);
-        /* read file data into dirent */
-        if (read_file_data) {
-            uint8_t *data = ark_file_data_ptr(image, index);
-#if 0
-            printf("file data offset = %ld\n", (long)(data - image->data));
-            printf("file data size = %zu\n", dirent.filesize);
-#endif
-            if (data != NULL) {
-                dirent.filedata = cbmfm_memdup(data, dirent.filesize);
-            }
+        if (offset > image->size
+                || dirent.size_blocks == 0
+                || dirent.filesize > image->size - offset) {
+            cbmfm_log_debug("entry %d doesn't fit in the image\n", index);
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                    "directory entry doesn't fit in the image",
+                    (intmax_t)(CBMFM_ARK_DIR_OFFSET
+                        + index * CBMFM_ARK_DIRENT_SIZE));
+            return -1;
+        }
+        dirent.extra.ark.data_offset = offset;
+        if (file_data) {
+            dirent.filedata = image->data + offset;
         }
         dirent.index = (uint16_t)index;
-        cbmfm_dir_append_dirent(dir, &dirent);
-        cbmfm_dirent_cleanup(&dirent);
+        if (!visitor(&dirent, data)) {
+            return index + 1;
+        }
+        offset += (size_t)dirent.size_blocks * CBMFM_BLOCK_SIZE_DATA;
     }
-
-    /* store reference to parent image */
-    dir->image = image;
-    return dir;
+    return index;
 }
 
 
-/** \brief  Read file from \a image into \a file object
+/** \brief  Get a view of file \a index in \a image without copying its data
+ *
+ * The file data borrows from \a image and is valid while \a image is open and
+ * unmodified. The data offsets are looked up in the (cached) directory of
+ * \a image.
  *
  * \param[in]   image   ARK archive
  * \param[out]  file    file object
@@ -325,30 +397,56 @@ cbmfm_dir_t *cbmfm_ark_read_dir(cbmfm_image_t *image, bool read_file_data)
  * \return  bool
  *
  * \throw   #CBMFM_ERR_INDEX
+ * \throw   #CBMFM_ERR_INVALID_DATA
  */
-bool cbmfm_ark_read_file(cbmfm_image_t *image, cbmfm_file_t *file, int index)
+bool cbmfm_ark_file_view(cbmfm_image_t *image, cbmfm_file_t *file, int index)
 {
-    cbmfm_dirent_t dirent;
+    cbmfm_dir_t *dir;
+    const cbmfm_dirent_t *dirent;
 
     if (!ark_file_index_check(image, index)) {
         return false;
     }
 
     /* grab the dirent */
-    cbmfm_dirent_init(&dirent);
-    ark_parse_dirent(image, &dirent, index);
+    dir = cbmfm_ark_read_dir(image, false);
+    if (dir == NULL) {
+        return false;
+    }
+    dirent = &(dir->entries[index]);
 
-    /* copy data to file object */
-    memcpy(file->name, dirent.filename, CBMFM_CBMDOS_FILE_NAME_LEN);
-    file->data = cbmfm_malloc(dirent.filesize);
-    memcpy(file->data, ark_file_data_ptr(image, index), dirent.filesize);
-    file->size = dirent.filesize;
-    file->type = dirent.filetype;
+    cbmfm_file_init(file);
+    cbmfm_file_borrow(file, image->data + dirent->extra.ark.data_offset,
+            dirent->filesize);
+    memcpy(file->name, dirent->filename, CBMFM_CBMDOS_FILE_NAME_LEN);
+    file->type = dirent->filetype;
+    cbmfm_dir_free(dir);
 
     return true;
 }
 
 
+/** \brief  Read file from \a image into \a file object
+ *
+ * \param[in]   image   ARK archive
+ * \param[out]  file    file object
+ * \param[in]   index   index in archive
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_INDEX
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+bool cbmfm_ark_read_file(cbmfm_image_t *image, cbmfm_file_t *file, int index)
+{
+    if (!cbmfm_ark_file_view(image, file, index)) {
+        return false;
+    }
+    cbmfm_file_own(file);
+    return true;
+}
+
+
 /** \brief  Extract file at \a index from \a image
  *
  * \param[in]   image   Ark image
@@ -362,7 +460,7 @@ bool cbmfm_ark_extract_file(cbmfm_image_t *image, const char *name, int index)
     cbmfm_file_t file;
     bool result;
 
-    if (!cbmfm_ark_read_file(image, &file, index)) {
+    if (!cbmfm_ark_file_view(image, &file, index)) {
         return false;
     }
 
@@ -395,6 +493,40 @@ bool cbmfm_ark_extract_all(cbmfm_image_t *image)
 }
 
 
+/** \brief  Probe data in \a probe for the ARK format
+ *
+ * ARK doesn't have a signature, so the file extension is checked, and the
+ * directory size indicated by the first byte must fit inside the file.
+ *
+ * \param[in]   probe   probe object
+ *
+ * \return  score
+ */
+int cbmfm_ark_probe(const cbmfm_probe_t *probe)
+{
+    char *ext;
+    bool result;
+    intmax_t dir_size;
+
+    if (probe->header_len < 1U) {
+        return CBMFM_PROBE_SCORE_NONE;
+    }
+    dir_size = CBMFM_ARK_DIR_OFFSET
+        + probe->header[CBMFM_ARK_DIRENT_COUNT] * CBMFM_ARK_DIRENT_SIZE;
+    if (dir_size > probe->size) {
+        return CBMFM_PROBE_SCORE_NONE;
+    }
+
+    ext = cbmfm_get_ext_lcase(probe->path);
+    if (ext == NULL) {
+        return CBMFM_PROBE_SCORE_NONE;
+    }
+    result = (bool)(strcmp(ext, "ark") == 0);
+    cbmfm_free(ext);
+    return result ? CBMFM_PROBE_SCORE_EXTENSION : CBMFM_PROBE_SCORE_NONE;
+}
+
+
 /** \brief  Determine if \a path *could* be an ARK archive
  *
  * Since ARK doesn't have any signature, the only way to determine if \a path
@@ -406,12 +538,13 @@ bool cbmfm_ark_extract_all(cbmfm_image_t *image)
  */
 bool cbmfm_is_ark(const char *filename)
 {
-    char *ext = cbmfm_get_ext_lcase(filename);
-    bool result = false;
+    cbmfm_probe_t probe;
+    int score;
 
-    if (ext != NULL) {
-        result = (bool)(strcmp(ext, "ark") == 0);
-        cbmfm_free(ext);
+    if (!cbmfm_probe_open(&probe, filename)) {
+        return false;
     }
-    return result;
+    score = cbmfm_ark_probe(&probe);
+    cbmfm_probe_close(&probe);
+    return score > CBMFM_PROBE_SCORE_NONE;
 }
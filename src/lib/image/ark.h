@@ -85,15 +85,23 @@
 
 
 bool cbmfm_is_ark(const char *filename);
+int  cbmfm_ark_probe(const cbmfm_probe_t *probe);
 
 bool cbmfm_ark_open(cbmfm_image_t *image, const char *path);
+bool cbmfm_ark_open_mapped(cbmfm_image_t *image, const char *path);
+bool cbmfm_ark_open_probe(cbmfm_image_t *image, cbmfm_probe_t *probe);
 void cbmfm_ark_cleanup(cbmfm_image_t *image);
 
 void cbmfm_ark_dump_stats(const cbmfm_image_t *image);
 
 
 cbmfm_dir_t *cbmfm_ark_read_dir(cbmfm_image_t *image, bool read_file_data);
+int          cbmfm_ark_visit_dir(cbmfm_image_t *image,
+                                 bool file_data,
+                                 cbmfm_dir_visitor_t visitor,
+                                 void *data);
 
+bool cbmfm_ark_file_view(cbmfm_image_t *image, cbmfm_file_t *file, int index);
 bool cbmfm_ark_read_file(cbmfm_image_t *image, cbmfm_file_t *file, int index);
 bool cbmfm_ark_extract_file(cbmfm_image_t *image, const char *name, int index);
 bool cbmfm_ark_extract_all(cbmfm_image_t *image);
@@ -47,15 +47,187 @@
 /** \ingroup    lib_image_d64
  */
 
-/** \brief  Speed zones for D64 images
+/** \brief  Set number of tracks of \a image and its geometry
+ *
+ * \param[in,out]   image   d64 image
+ * \param[in]       tracks  number of tracks (35, 40 or 42)
+ *
+ * \return  false when there's no D64 geometry for \a tracks, leaving \a image
+ *          unchanged
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+static bool d64_set_tracks(cbmfm_d64_t *image, int tracks)
+{
+    const cbmfm_dxx_geometry_t *geometry;
+
+    geometry = cbmfm_dxx_geometry_get(CBMFM_IMAGE_TYPE_D64, tracks);
+    if (geometry == NULL) {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA, "unsupported track count",
+                -1);
+        return false;
+    }
+    image->geometry = geometry;
+    image->zones = geometry->zones;
+    image->track_max = tracks;
+    return true;
+}
+
+
+/** \brief  Get number of tracks covered by the BAM of \a image
+ *
+ * \param[in]   image   d64 image
+ *
+ * \return  number of tracks
+ */
+static int d64_bam_track_max(const cbmfm_d64_t *image)
+{
+    return image->track_max < CBMFM_D64_BAM_TRACKS
+        ? image->track_max : CBMFM_D64_BAM_TRACKS;
+}
+
+
+/** \brief  Update BAM mirror of \a image for \a track from the image data
+ *
+ * \param[in,out]   image   d64 image
+ * \param[in]       track   track number
+ */
+static void d64_bam_sync_track(cbmfm_d64_t *image, int track)
+{
+    const uint8_t *bament = cbmfm_d64_bam_ptr_trk(image, track);
+    uint64_t mask = (UINT64_C(1) << image->geometry->tracks[track].blocks) - 1U;
+    uint64_t map;
+
+    map = ((uint64_t)bament[1] | ((uint64_t)bament[2] << 8)
+            | ((uint64_t)bament[3] << 16)) & mask;
+    if (track != CBMFM_D64_DIR_TRACK) {
+        image->bam_free += cbmfm_popcount64(map)
+            - cbmfm_popcount64(image->bam_map[track]);
+    }
+    image->bam_map[track] = map;
+}
+
+
+/** \brief  Get BAM mirror of \a image, building it when required
+ *
+ * \param[in,out]   image   d64 image
+ *
+ * \return  BAM mirror, indexed by track number
+ */
+static const uint64_t *d64_bam_map(cbmfm_d64_t *image)
+{
+    if (!image->bam_synced) {
+        cbmfm_d64_bam_sync(image);
+    }
+    return image->bam_map;
+}
+
+
+/** \brief  Find first free sector of \a track, starting at \a sector
+ *
+ * Wraps around to sector 0 when no free sector is found at or above \a sector.
+ *
+ * \param[in,out]   image   d64 image
+ * \param[in]       track   track number
+ * \param[in]       sector  sector number to start searching at
+ *
+ * \return  sector number or -1 when the track is full
+ */
+static int d64_track_find_free(cbmfm_d64_t *image, int track, int sector)
+{
+    uint64_t map = d64_bam_map(image)[track];
+    uint64_t above;
+
+    if (map == 0) {
+        return -1;
+    }
+    above = map & ~((UINT64_C(1) << sector) - 1U);
+    return cbmfm_ctz64(above != 0 ? above : map);
+}
+
+
+/** \brief  Apply \a interleave to \a sector the way the 1541 DOS does
+ *
+ * When the result exceeds the sector count of \a track it is wrapped around,
+ * subtracting one extra if the result isn't sector 0.
+ *
+ * \param[in]   image       d64 image
+ * \param[in]   track       track number
+ * \param[in]   sector      sector number
+ * \param[in]   interleave  interleave
+ *
+ * \return  sector number
+ */
+static int d64_interleave(const cbmfm_d64_t *image,
+                          int track,
+                          int sector,
+                          int interleave)
+{
+    int blocks = image->geometry->tracks[track].blocks;
+
+    sector += interleave;
+    if (sector >= blocks) {
+        sector -= blocks;
+        if (sector > 0) {
+            sector--;
+        }
+    }
+    return sector;
+}
+
+
+/** \brief  Get pointer to block (\a track,\a sector) in \a image
+ *
+ * \param[in]   image   d64 image
+ * \param[in]   track   track number
+ * \param[in]   sector  sector number
+ *
+ * \return  pointer to block data or `NULL` on error
+ */
+static uint8_t *d64_block_ptr(cbmfm_d64_t *image, int track, int sector)
+{
+    intmax_t offset;
+
+    offset = cbmfm_dxx_image_block_offset((cbmfm_dxx_image_t *)image,
+            track, sector);
+    return offset < 0 ? NULL : image->data + offset;
+}
+
+
+/** \brief  Check if \a image may be altered
+ *
+ * The data of a memory-mapped image isn't writable, mapped images are also
+ * marked read only.
+ *
+ * \param[in]   image   d64 image
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
+ */
+static bool d64_writable(const cbmfm_d64_t *image)
+{
+    if (cbmfm_image_get_readonly((const cbmfm_image_t *)image)
+            || cbmfm_image_get_mapped((const cbmfm_image_t *)image)) {
+        cbmfm_error_set(CBMFM_ERR_READONLY, NULL, -1);
+        return false;
+    }
+    return true;
+}
+
+
+/** \brief  Mark \a image as modified
+ *
+ * Sets the dirty flag, which bumps the generation of \a image so its cached
+ * directory is no longer handed out. Every function altering the image data
+ * calls this.
+ *
+ * \param[in,out]   image   d64 image
  */
-static const cbmfm_dxx_speedzone_t zones_d64[] = {
-    {  1, 17, 21 },
-    { 18, 24, 19 },
-    { 25, 30, 18 },
-    { 31, 40, 17 },
-    { -1, -1, -1 }
-};
+static void d64_modified(cbmfm_d64_t *image)
+{
+    cbmfm_image_set_dirty((cbmfm_image_t *)image, true);
+}
 
 
 /** \brief  Allocate a d64 image object
@@ -76,7 +248,10 @@ void cbmfm_d64_init(cbmfm_d64_t *image)
 {
     cbmfm_image_init((cbmfm_image_t *)image);
     image->type = CBMFM_IMAGE_TYPE_D64;
-    image->zones = zones_d64;
+    image->errors = false;
+    image->bam_synced = false;
+    image->bam_deferred = false;
+    d64_set_tracks(image, CBMFM_D64_TRACK_MAX);
 }
 
 
@@ -113,51 +288,117 @@ void cbmfm_d64_free(cbmfm_d64_t *image)
 }
 
 
-/** \brief  Read d64 file \a name into \a image
+/** \brief  Check size of \a image and set track count and error bytes flag
+ *
+ * Releases the image data when the size doesn't match any known D64 size.
  *
  * \param[in,out]   image   d64 image
- * \param[in]       name    image file name
  *
  * \return  true on success
  *
- * \throw   #CBMFM_ERR_IO
  * \throw   #CBMFM_ERR_SIZE_MISMATCH
  */
-bool cbmfm_d64_open(cbmfm_d64_t *image, const char *name)
+static bool d64_check_size(cbmfm_d64_t *image)
 {
-    if (!cbmfm_image_read_data((cbmfm_image_t *)image, name)) {
-        return false;
-    }
+    int tracks;
+
+    image->bam_synced = false;
 
     /* check size, set track count & error bytes */
     switch (image->size) {
         case CBMFM_D64_SIZE_STD:
-            image->track_max = 35;
+            tracks = CBMFM_D64_TRACK_MAX;
             image->errors = false;
             break;
         case CBMFM_D64_SIZE_STD_ERR:
-            image->track_max = 35;
+            tracks = CBMFM_D64_TRACK_MAX;
             image->errors = true;
             break;
         case CBMFM_D64_SIZE_EXT:
-            image->track_max = 40;
+            tracks = CBMFM_D64_TRACK_MAX_EXT;
             image->errors = false;
             break;
         case CBMFM_D64_SIZE_EXT_ERR:
-            image->track_max = 40;
+            tracks = CBMFM_D64_TRACK_MAX_EXT;
             image->errors = true;
             break;
         default:
             /* invalid size */
-            cbmfm_free(image->data);
-            image->data = NULL;
-            cbmfm_errno = CBMFM_ERR_SIZE_MISMATCH;
+            cbmfm_image_free_data((cbmfm_image_t *)image);
+            cbmfm_error_set(CBMFM_ERR_SIZE_MISMATCH, NULL, -1);
             return false;
     }
+    if (!d64_set_tracks(image, tracks)) {
+        cbmfm_image_free_data((cbmfm_image_t *)image);
+        return false;
+    }
     return true;
 }
 
 
+/** \brief  Read d64 file \a name into \a image
+ *
+ * \param[in,out]   image   d64 image
+ * \param[in]       name    image file name
+ *
+ * \return  true on success
+ *
+ * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_SIZE_MISMATCH
+ */
+bool cbmfm_d64_open(cbmfm_d64_t *image, const char *name)
+{
+    if (!cbmfm_image_read_data((cbmfm_image_t *)image, name)) {
+        return false;
+    }
+    return d64_check_size(image);
+}
+
+
+/** \brief  Map d64 file \a name read-only into \a image
+ *
+ * Opens \a name without copying its data, see cbmfm_image_map_data(). The
+ * image is read only: only use it with functions that don't alter the image.
+ *
+ * \param[in,out]   image   d64 image
+ * \param[in]       name    image file name
+ *
+ * \return  true on success
+ *
+ * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_SIZE_MISMATCH
+ */
+bool cbmfm_d64_open_mapped(cbmfm_d64_t *image, const char *name)
+{
+    if (!cbmfm_image_map_data((cbmfm_image_t *)image, name)) {
+        return false;
+    }
+    return d64_check_size(image);
+}
+
+
+/** \brief  Open d64 image through \a probe
+ *
+ * Reads the image data from the file handle left open by cbmfm_probe_open(),
+ * avoiding opening the file again after detecting its type.
+ *
+ * \param[in,out]   image   d64 image
+ * \param[in,out]   probe   probe object
+ *
+ * \return  true on success
+ *
+ * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_SIZE_MISMATCH
+ */
+bool cbmfm_d64_open_probe(cbmfm_d64_t *image, cbmfm_probe_t *probe)
+{
+    if (!cbmfm_image_read_probe((cbmfm_image_t *)image, probe)) {
+        return false;
+    }
+    return d64_check_size(image);
+}
+
+
 /** \brief  Get pointer to BAM of \a image
  *
  * \param   image   d64 image
@@ -166,9 +407,9 @@ bool cbmfm_d64_open(cbmfm_d64_t *image, const char *name)
  */
 uint8_t *cbmfm_d64_bam_ptr(cbmfm_d64_t *image)
 {
-    return image->data + cbmfm_dxx_block_offset(image->zones,
-                                                CBMFM_D64_BAM_TRACK,
-                                                CBMFM_D64_BAM_SECTOR);
+    return image->data + cbmfm_dxx_image_block_offset(
+            (const cbmfm_dxx_image_t *)image,
+            CBMFM_D64_BAM_TRACK, CBMFM_D64_BAM_SECTOR);
 }
 
 
@@ -180,11 +421,13 @@ uint8_t *cbmfm_d64_bam_ptr(cbmfm_d64_t *image)
  * \return  pointer to track entry or `NULL` on illegal track number
  *
  * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ *
+ * \note    The standard BAM only contains entries for tracks 1-35
  */
 uint8_t *cbmfm_d64_bam_ptr_trk(cbmfm_d64_t *image, int track)
 {
-    if (track < 1 || track > image->track_max) {
-        cbmfm_errno = CBMFM_ERR_ILLEGAL_TRACK;
+    if (track < 1 || track > d64_bam_track_max(image)) {
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_TRACK, NULL, -1);
         return NULL;
     }
     return cbmfm_d64_bam_ptr(image) + CBMFM_D64_BAM_ENTRIES
@@ -225,13 +468,18 @@ bool cbmfm_d64_bam_get_bament(cbmfm_d64_t *image, int track, uint8_t *dest)
  *
  * \return  bool
  *
+ * \throw   #CBMFM_ERR_READONLY
  * \throw   #CBMFM_ERR_ILLEGAL_TRACK
  */
 bool cbmfm_d64_bam_init_bament(cbmfm_d64_t *image, int track)
 {
-    uint8_t *bam = cbmfm_d64_bam_ptr_trk(image, track);
+    uint8_t *bam;
     int blocks;
 
+    if (!d64_writable(image)) {
+        return false;
+    }
+    bam = cbmfm_d64_bam_ptr_trk(image, track);
     if (bam == NULL) {
         return false;
     }
@@ -243,6 +491,10 @@ bool cbmfm_d64_bam_init_bament(cbmfm_d64_t *image, int track)
     bam[2] = 0xFF;  /* sector 8-15 are always valid */
     bam[3] = (uint8_t)((1 << (blocks - 16)) - 1);
 
+    if (image->bam_synced) {
+        d64_bam_sync_track(image, track);
+    }
+    d64_modified(image);
     return true;
 }
 
@@ -323,13 +575,20 @@ void cbmfm_d64_get_disk_id_asc(cbmfm_d64_t *image, char *id)
  *
  * \param[in,out]   image   d64 image
  * \param[in]       name    PETSCII disk name (16 bytes)
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
  */
-void cbmfm_d64_set_disk_name_pet(cbmfm_d64_t *image, const uint8_t *name)
+bool cbmfm_d64_set_disk_name_pet(cbmfm_d64_t *image, const uint8_t *name)
 {
-    uint8_t *bam = cbmfm_d64_bam_ptr(image);
-
-    memcpy(bam + CBMFM_D64_BAM_DISK_NAME, name, CBMFM_CBMDOS_DISK_NAME_LEN);
-    cbmfm_image_set_dirty((cbmfm_image_t *)image, true);
+    if (!d64_writable(image)) {
+        return false;
+    }
+    memcpy(cbmfm_d64_bam_ptr(image) + CBMFM_D64_BAM_DISK_NAME, name,
+            CBMFM_CBMDOS_DISK_NAME_LEN);
+    d64_modified(image);
+    return true;
 }
 
 
@@ -340,8 +599,12 @@ void cbmfm_d64_set_disk_name_pet(cbmfm_d64_t *image, const uint8_t *name)
  *
  * \param[in,out]   image   d64 image
  * \param[in]       name    ASSCII disk name
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
  */
-void cbmfm_d64_set_disk_name_asc(cbmfm_d64_t *image, const char *name)
+bool cbmfm_d64_set_disk_name_asc(cbmfm_d64_t *image, const char *name)
 {
     uint8_t pet[CBMFM_CBMDOS_DISK_NAME_LEN];
     int index;
@@ -356,9 +619,7 @@ void cbmfm_d64_set_disk_name_asc(cbmfm_d64_t *image, const char *name)
     }
 
     /* set disk name in PETSCII */
-    cbmfm_d64_set_disk_name_pet(image, pet);
-
-    cbmfm_image_set_dirty((cbmfm_image_t *)image, true);
+    return cbmfm_d64_set_disk_name_pet(image, pet);
 }
 
 
@@ -367,13 +628,19 @@ void cbmfm_d64_set_disk_name_asc(cbmfm_d64_t *image, const char *name)
  * \param[in,out]   image   d64 image
  * \param[in]       id      disk ID in PETSCII
  * \param[in]       len     length of \a id
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
  */
-static void set_disk_id_pet(cbmfm_d64_t *image, const uint8_t *id, size_t len)
+static bool set_disk_id_pet(cbmfm_d64_t *image, const uint8_t *id, size_t len)
 {
-    uint8_t *bam = cbmfm_d64_bam_ptr(image);
-
-    memcpy(bam + CBMFM_D64_BAM_DISK_ID, id, len);
-    cbmfm_image_set_dirty((cbmfm_image_t *)image, true);
+    if (!d64_writable(image)) {
+        return false;
+    }
+    memcpy(cbmfm_d64_bam_ptr(image) + CBMFM_D64_BAM_DISK_ID, id, len);
+    d64_modified(image);
+    return true;
 }
 
 
@@ -381,11 +648,14 @@ static void set_disk_id_pet(cbmfm_d64_t *image, const uint8_t *id, size_t len)
  *
  * \param[in,out]   image   d64 image
  * \param[in]       id      2-byte disk ID
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
  */
-void cbmfm_d64_set_disk_id_pet(cbmfm_d64_t *image, const uint8_t *id)
+bool cbmfm_d64_set_disk_id_pet(cbmfm_d64_t *image, const uint8_t *id)
 {
-    set_disk_id_pet(image, id, CBMFM_CBMDOS_DISK_ID_LEN);
-    cbmfm_image_set_dirty((cbmfm_image_t *)image, true);
+    return set_disk_id_pet(image, id, CBMFM_CBMDOS_DISK_ID_LEN);
 }
 
 
@@ -393,11 +663,14 @@ void cbmfm_d64_set_disk_id_pet(cbmfm_d64_t *image, const uint8_t *id)
  *
  * \param[in,out]   image   d64 image
  * \param[in]       id      5-byte disk ID
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
  */
-void cbmfm_d64_set_disk_id_pet_ext(cbmfm_d64_t *image, const uint8_t *id)
+bool cbmfm_d64_set_disk_id_pet_ext(cbmfm_d64_t *image, const uint8_t *id)
 {
-    set_disk_id_pet(image, id, CBMFM_CBMDOS_DISK_ID_LEN_EXT);
-    cbmfm_image_set_dirty((cbmfm_image_t *)image, true);
+    return set_disk_id_pet(image, id, CBMFM_CBMDOS_DISK_ID_LEN_EXT);
 }
 
 
@@ -406,16 +679,17 @@ void cbmfm_d64_set_disk_id_pet_ext(cbmfm_d64_t *image, const uint8_t *id)
  * \param[in,out]   image   d64 image
  * \param[in]       id      disk ID in ASCII
  * \param[in]       len     max length of \a id
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
  */
-static void set_disk_id_asc(cbmfm_d64_t *image, const char *id, size_t len)
+static bool set_disk_id_asc(cbmfm_d64_t *image, const char *id, size_t len)
 {
-    uint8_t *bam;
     uint8_t pet[CBMFM_CBMDOS_DISK_ID_LEN_EXT];
 
-    bam = cbmfm_d64_bam_ptr(image);
     cbmfm_asc_to_pet_str(pet, id, len);
-    memcpy(bam + CBMFM_D64_BAM_DISK_ID, pet, len);
-    cbmfm_image_set_dirty((cbmfm_image_t *)image, true);
+    return set_disk_id_pet(image, pet, len);
 }
 
 
@@ -425,10 +699,14 @@ static void set_disk_id_asc(cbmfm_d64_t *image, const char *id, size_t len)
  *
  * \param[in,out]   image   d64 image
  * \param[in]       id      2-byte disk ID
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
  */
-void cbmfm_d64_set_disk_id_asc(cbmfm_d64_t *image, const char *id)
+bool cbmfm_d64_set_disk_id_asc(cbmfm_d64_t *image, const char *id)
 {
-    set_disk_id_asc(image, id, CBMFM_CBMDOS_DISK_ID_LEN);
+    return set_disk_id_asc(image, id, CBMFM_CBMDOS_DISK_ID_LEN);
 }
 
 
@@ -438,15 +716,19 @@ void cbmfm_d64_set_disk_id_asc(cbmfm_d64_t *image, const char *id)
  *
  * \param[in,out]   image   d64 image
  * \param[in]       id      5-byte disk ID
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
  */
-void cbmfm_d64_set_disk_id_asc_ext(cbmfm_d64_t *image, const char *id)
+bool cbmfm_d64_set_disk_id_asc_ext(cbmfm_d64_t *image, const char *id)
 {
     size_t len = strlen(id);
 
     if (len > CBMFM_CBMDOS_DISK_ID_LEN_EXT) {
         len = CBMFM_CBMDOS_DISK_ID_LEN_EXT;
     }
-    set_disk_id_asc(image, id, len);
+    return set_disk_id_asc(image, id, len);
 }
 
 
@@ -461,6 +743,9 @@ void cbmfm_d64_set_disk_id_asc_ext(cbmfm_d64_t *image, const char *id)
  * \param[out]  state   free state target
  *
  * \return  true if the input was valid
+ *
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
  */
 bool cbmfm_d64_bam_sector_get_free(
         cbmfm_d64_t *image,
@@ -468,33 +753,27 @@ bool cbmfm_d64_bam_sector_get_free(
         int sector,
         bool *state)
 {
-    int blk_count;
-    uint8_t bament[CBMFM_D64_BAMENT_SIZE];
-    int offset;
-    unsigned int mask;
+    const uint64_t *map;
 
-    blk_count = cbmfm_dxx_track_block_count((cbmfm_dxx_image_t *)image, track);
-    if (blk_count < 0) {
+    if (track < 1 || track > d64_bam_track_max(image)) {
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_TRACK, NULL, -1);
         return false;
     }
-    if (sector >= blk_count) {
-        cbmfm_errno = CBMFM_ERR_ILLEGAL_SECTOR;
+    if (sector < 0 || sector >= image->geometry->tracks[track].blocks) {
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_SECTOR, NULL, -1);
         return false;
     }
 
-    cbmfm_d64_bam_get_bament(image, track, bament);
-
-    /* offset in bament of bitmap byte */
-    offset = 1 + sector / 8;
-    mask = 1U << (sector % 8);
-
-    *state = bament[offset] & mask ? true : false;
-
+    map = d64_bam_map(image);
+    *state = (map[track] >> sector) & 1U ? true : false;
     return true;
 }
 
 
 /** \brief  Set free state of (\a track,\a sector) in \a image to \a state
+ *
+ * Updates the bitmap and free block count of the track's BAM entry. While
+ * `bam_deferred` is set only the BAM mirror is updated.
  *
  * \param[in,out]   image   d64 image
  * \param[in]       track   track number of block to mark
@@ -503,6 +782,7 @@ bool cbmfm_d64_bam_sector_get_free(
  *
  * \return  bool
  *
+ * \throw   #CBMFM_ERR_READONLY
  * \throw   #CBMFM_ERR_ILLEGAL_TRACK
  * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
  */
@@ -512,31 +792,41 @@ bool cbmfm_d64_bam_sector_set_free(
         int sector,
         bool state)
 {
-    int blk_count;
     uint8_t *bament;
-    uint8_t mask;
-    int offset;
+    uint64_t map;
+    uint64_t bit;
 
-    blk_count = cbmfm_dxx_track_block_count((cbmfm_dxx_image_t *)image, track);
-    if (blk_count < 0) {
+    if (!d64_writable(image)) {
         return false;
     }
-    if (sector >= blk_count) {
-        cbmfm_errno = CBMFM_ERR_ILLEGAL_SECTOR;
+    if (track < 1 || track > d64_bam_track_max(image)) {
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_TRACK, NULL, -1);
+        return false;
+    }
+    if (sector < 0 || sector >= image->geometry->tracks[track].blocks) {
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_SECTOR, NULL, -1);
         return false;
     }
 
-    bament = cbmfm_d64_bam_ptr_trk(image, track);
-
-    offset = 1 + sector / 8;
-    mask = (uint8_t)(1U << (sector % 8));
-
-    if (state) {
-        /* mark free */
-        bament[offset] |= mask;
-    } else {
-        bament[offset] &= (uint8_t)(~mask);
+    map = d64_bam_map(image)[track];
+    bit = UINT64_C(1) << sector;
+    if (((map & bit) != 0) == state) {
+        /* nothing to do */
+        return true;
+    }
+    map ^= bit;
+    image->bam_map[track] = map;
+    if (track != CBMFM_D64_DIR_TRACK) {
+        image->bam_free += state ? 1 : -1;
     }
+    d64_modified(image);
+    if (image->bam_deferred) {
+        return true;
+    }
+
+    bament = cbmfm_d64_bam_ptr_trk(image, track);
+    bament[0] = (uint8_t)cbmfm_popcount64(map);
+    bament[1 + sector / 8] = (uint8_t)(map >> (sector & ~7));
     return true;
 }
 
@@ -552,26 +842,53 @@ bool cbmfm_d64_bam_sector_set_free(
  */
 int cbmfm_d64_bam_track_get_blocks_free(cbmfm_d64_t *image, int track)
 {
-    uint8_t bament[CBMFM_D64_BAMENT_SIZE];
-    int blk_count;
-    int blocks;
-    uint8_t mask;
-
-    blk_count = cbmfm_dxx_track_block_count((cbmfm_dxx_image_t *)image, track);
-    if (blk_count < 0) {
+    if (track < 1 || track > d64_bam_track_max(image)) {
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_TRACK, NULL, -1);
         return -1;
     }
+    return cbmfm_popcount64(d64_bam_map(image)[track]);
+}
+
+
+/** \brief  Get first free sector of \a track in \a image
+ *
+ * \param[in]   image   d64 image
+ * \param[in]   track   track number
+ *
+ * \return  sector number, or -1 when the track is full or on error
+ *
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ */
+int cbmfm_d64_bam_track_get_first_free(cbmfm_d64_t *image, int track)
+{
+    uint64_t map;
 
-    /* get bament */
-    cbmfm_d64_bam_get_bament(image, track, bament);
+    if (track < 1 || track > d64_bam_track_max(image)) {
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_TRACK, NULL, -1);
+        return -1;
+    }
+    map = d64_bam_map(image)[track];
+    return map == 0 ? -1 : cbmfm_ctz64(map);
+}
 
-    /* every track in a Dxx image has at least 17 blocks per track: */
-    blocks = cbmfm_popcount_byte(bament[1]) + cbmfm_popcount_byte(bament[2]);
 
-    /* create bitmask to filter out the bits that matter for track 17+ */
-    mask = (uint8_t)((1U << (blk_count - 16)) - 1U);
+/** \brief  Synchronize the BAM mirror of \a image with the image data
+ *
+ * Only required after altering the BAM bytes directly, the BAM functions in
+ * this module keep the mirror up to date.
+ *
+ * \param[in,out]   image   d64 image
+ */
+void cbmfm_d64_bam_sync(cbmfm_d64_t *image)
+{
+    int track;
 
-    return blocks + cbmfm_popcount_byte(bament[3] & mask);
+    memset(image->bam_map, 0, sizeof image->bam_map);
+    image->bam_free = 0;
+    for (track = 1; track <= d64_bam_track_max(image); track++) {
+        d64_bam_sync_track(image, track);
+    }
+    image->bam_synced = true;
 }
 
 
@@ -586,7 +903,7 @@ void cbmfm_d64_bam_dump(cbmfm_d64_t *image)
     printf("                  11111111112\n");
     printf("TRK SF  012345678901234567890\n");
 
-    for (track = 1; track <= image->track_max; track++) {
+    for (track = 1; track <= d64_bam_track_max(image); track++) {
         uint8_t bament[CBMFM_D64_BAMENT_SIZE];
         int sector;
         int sec_count = cbmfm_dxx_track_block_count((cbmfm_dxx_image_t *)image,
@@ -606,9 +923,10 @@ void cbmfm_d64_bam_dump(cbmfm_d64_t *image)
 }
 
 
-/** \brief  Calculate number of blocks free in \a image
+/** \brief  Get number of blocks free in \a image
  *
- * Calculates blocks free by examining the BAM bitmaps for each track.
+ * Returns the free block count of the BAM mirror, which excludes the
+ * BAM/directory track.
  *
  * \param[in]   image   d64 image
  *
@@ -616,16 +934,8 @@ void cbmfm_d64_bam_dump(cbmfm_d64_t *image)
  */
 int cbmfm_d64_blocks_free(cbmfm_d64_t *image)
 {
-    int track;
-    int blocks = 0;
-
-    for (track = 1; track <= image->track_max; track++) {
-        /* skip BAM/directory track */
-        if (track != CBMFM_D64_DIR_TRACK) {
-            blocks += cbmfm_d64_bam_track_get_blocks_free(image, track);
-        }
-    }
-    return blocks;
+    d64_bam_map(image);
+    return image->bam_free;
 }
 
 
@@ -654,37 +964,82 @@ void cbmfm_d64_dirent_parse(cbmfm_dirent_t *dirent, const uint8_t *data)
 
 
 /** \brief  Read directory of \a image
+ *
+ * The parsed directory is cached in \a image and reused until the image is
+ * modified.
  *
  * \param[in]   image   d64 image
  *
  * \return  directory object or `NULL` on failure
+ *
+ * \note    The caller is responsible for calling cbmfm_dir_free() on the
+ *          returned pointer.
  */
 cbmfm_dir_t *cbmfm_d64_dir_read(cbmfm_d64_t *image)
 {
     cbmfm_dir_t *dir;
+
+    dir = cbmfm_image_dir_cache_get((cbmfm_image_t *)image);
+    if (dir != NULL) {
+        return dir;
+    }
+
+    dir = cbmfm_dir_new_size(CBMFM_D64_DIR_ENTRIES_MAX);
+    if (cbmfm_d64_dir_visit(image, cbmfm_dir_append_visitor, dir) < 0) {
+        cbmfm_dir_free(dir);
+        return NULL;
+    }
+    dir->image = (cbmfm_image_t *)image;
+    cbmfm_image_dir_cache_set((cbmfm_image_t *)image, dir);
+    return dir;
+}
+
+
+/** \brief  Call \a visitor for each entry in the directory of \a image
+ *
+ * Walks the directory blocks without allocating memory: each entry is parsed
+ * into a dirent on the stack and handed to \a visitor. When the directory is
+ * cached in \a image, the cached entries are visited instead.
+ *
+ * \param[in]       image   d64 image
+ * \param[in]       visitor visitor callback, return false to stop
+ * \param[in,out]   data    data for \a visitor
+ *
+ * \return  number of entries visited or -1 on error
+ *
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
+ */
+int cbmfm_d64_dir_visit(cbmfm_d64_t *image,
+                        cbmfm_dir_visitor_t visitor,
+                        void *data)
+{
     cbmfm_dxx_dir_iter_t iter;
+    const cbmfm_dir_t *cached;
     uint16_t index = 0;
 
-    dir = cbmfm_dir_new();
+    cached = cbmfm_image_dir_cache_peek((const cbmfm_image_t *)image);
+    if (cached != NULL) {
+        return cbmfm_dir_visit(cached, visitor, data);
+    }
+
     if (!cbmfm_dxx_dir_iter_init(&iter, (cbmfm_dxx_image_t *)(image),
                 CBMFM_D64_DIR_TRACK, CBMFM_D64_DIR_SECTOR)) {
-        cbmfm_dir_free(dir);
-        return NULL;
+        return -1;
     }
 
     do {
         cbmfm_dirent_t dirent;
-        uint8_t *data;
 
-        data = cbmfm_dxx_dir_iter_entry_ptr(&iter);
-        cbmfm_d64_dirent_parse(&dirent, data);
+        cbmfm_d64_dirent_parse(&dirent, cbmfm_dxx_dir_iter_entry_ptr(&iter));
         dirent.index = index++;
-        cbmfm_dir_append_dirent(dir, &dirent);
-
+        dirent.image = (cbmfm_image_t *)image;
+        if (!visitor(&dirent, data)) {
+            break;
+        }
     } while (cbmfm_dxx_dir_iter_next(&iter));
 
-    dir->image = (cbmfm_image_t *)image;
-    return dir;
+    return index;
 }
 
 
@@ -697,6 +1052,10 @@ cbmfm_dir_t *cbmfm_d64_dir_read(cbmfm_d64_t *image)
  *
  * \return  bool
  *
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ *
  * \note    Since the file data is read directory from the image using a
  *          (track,sector) pointer, the 'name' and 'type' fields of \a file
  *          won't contain useful data.
@@ -705,74 +1064,9 @@ bool cbmfm_d64_file_read_from_block(cbmfm_d64_t *image,
                                     cbmfm_file_t *file,
                                     int track, int sector)
 {
-    cbmfm_dxx_block_iter_t iter;
-    uint8_t *buffer;
-    size_t bufsize;
-    size_t offset;
-
     cbmfm_file_init(file);
-
-    cbmfm_log_debug("Initializing block iterator with (%d,%d) .. ",
-            track, sector);
-    if (!cbmfm_dxx_block_iter_init(&iter, (cbmfm_dxx_image_t *)image,
-                track, sector)) {
-        cbmfm_log_debug("failed\n");
-        return false;
-    }
-    printf("OK\n");
-
-    /* allocate buffer for file data */
-    bufsize = 65536;
-    buffer = cbmfm_malloc(bufsize);     /* 64KB should usually be enough */
-    offset = 0;
-
-    do {
-        uint8_t raw_block[CBMFM_BLOCK_SIZE_RAW];
-
-        /* resize buffer ? */
-        if (offset + CBMFM_BLOCK_SIZE_DATA > bufsize) {
-            cbmfm_log_debug("resizing buffer to %zu bytes\n", bufsize * 2);
-            bufsize *= 2;
-            buffer = cbmfm_realloc(buffer, bufsize);
-        }
-
-        /* copy block data */
-        cbmfm_dxx_block_iter_read_data(&iter, raw_block);
-
-        /* check track number */
-        if (raw_block[0] == 0) {
-            uint8_t remainder = raw_block[1];
-
-            cbmfm_log_debug("reading final %d bytes from (%d,%d)\n",
-                    (int)remainder, iter.curr.track, iter.curr.sector);
-
-            /* final block, sector number contains the bytes remaining */
-            memcpy(buffer + offset, raw_block + 2, remainder);
-            offset += remainder;
-            break;  /* iterator stops too late */
-        } else {
-            /* full block of data */
-            cbmfm_log_debug("reading 254 bytes from (%d,%d)\n",
-                    iter.curr.track, iter.curr.sector);
-            memcpy(buffer + offset, raw_block+ 2, CBMFM_BLOCK_SIZE_DATA);
-            offset += CBMFM_BLOCK_SIZE_DATA;
-        }
-
-
-    } while (cbmfm_dxx_block_iter_next(&iter));
-
-    /* try to resize buffer to smallest size */
-    if (offset < bufsize) {
-        bool success;
-        buffer = cbmfm_realloc_smaller(buffer, offset, &success);
-        if (!success) {
-            cbmfm_log_debug("failed to realloc buffer to %zu bytes\n", offset);
-        }
-    }
-
-    file->data = buffer;
-    file->size = offset;
-    return true;
+    return cbmfm_dxx_chain_read((cbmfm_dxx_image_t *)image, track, sector,
+            &(file->data), &(file->size));
 }
 
 
@@ -796,11 +1090,11 @@ bool cbmfm_d64_file_read_from_dirent(cbmfm_dirent_t *dirent,
 
 
     if (dirent->image == NULL) {
-        cbmfm_errno = CBMFM_ERR_INVALID_NULL;
+        cbmfm_error_set(CBMFM_ERR_INVALID_NULL, NULL, -1);
         return false;
     }
     if (dirent->image_type != CBMFM_IMAGE_TYPE_D64) {
-        cbmfm_errno = CBMFM_ERR_TYPE_MISMATCH;
+        cbmfm_error_set(CBMFM_ERR_TYPE_MISMATCH, NULL, -1);
         return false;
     }
 
@@ -827,10 +1121,8 @@ bool cbmfm_d64_file_read_from_dirent(cbmfm_dirent_t *dirent,
  *
  * \return  bool
  *
- * \note    This function reads and frees the directory of the \a image each
- *          time it is called, so when processing multiple files from the same
- *          image, cbmfm_d64_file_read_from_dirent() might be a better function
- *          to use.
+ * \note    The directory is only parsed once while \a image isn't modified,
+ *          see cbmfm_d64_dir_read().
  */
 bool cbmfm_d64_file_read_from_index(cbmfm_d64_t *image,
                                     cbmfm_file_t *file,
@@ -849,7 +1141,7 @@ bool cbmfm_d64_file_read_from_index(cbmfm_d64_t *image,
     }
     cbmfm_log_debug("OK, got directory\n");
 
-    dirent = dir->entries[index];
+    dirent = &(dir->entries[index]);
 #if 0
     status = cbmfm_d64_file_read_block(image, file,
             dirent->extra.dxx.first_block.track,
@@ -867,6 +1159,41 @@ bool cbmfm_d64_file_read_from_index(cbmfm_d64_t *image,
 }
 
 
+/** \brief  Read first file from \a image matching \a pattern
+ *
+ * The directory and its name index are taken from the directory cache of
+ * \a image, so repeated lookups only parse the directory once.
+ *
+ * \param[in]   image   d64 image
+ * \param[out]  file    file object
+ * \param[in]   pattern compiled CBM DOS file name pattern
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_NOT_FOUND
+ */
+bool cbmfm_d64_file_read_from_name(cbmfm_d64_t *image,
+                                   cbmfm_file_t *file,
+                                   const cbmfm_pattern_t *pattern)
+{
+    cbmfm_dir_t *dir;
+    int index;
+    bool status = false;
+
+    /* takes a reference to the cached directory, or reads and caches it */
+    dir = cbmfm_d64_dir_read(image);
+    if (dir == NULL) {
+        return false;
+    }
+    index = cbmfm_dir_match(dir, pattern, 0);
+    if (index >= 0) {
+        status = cbmfm_d64_file_read_from_dirent(&(dir->entries[index]), file);
+    }
+    cbmfm_dir_free(dir);
+    return status;
+}
+
+
 
 /*
  * File writing functions
@@ -874,61 +1201,39 @@ bool cbmfm_d64_file_read_from_index(cbmfm_d64_t *image,
 
 
 /** \brief  Find first empty block in \a image
+ *
+ * Searches outward from the directory track, one track below it first, and
+ * takes the lowest free sector of the first track with free blocks.
  *
  * \param[out]  iter    block iterator
  * \param[in]   image   d64 image
  *
- * \return  true when an empty block was found, false when disk full
+ * \return  true when an empty block was found, false when disk full or
+ *          \a image can't be altered
+ *
+ * \throw   #CBMFM_ERR_READONLY
  */
 bool cbmfm_d64_block_write_iter_init(cbmfm_dxx_block_iter_t *iter,
                                      cbmfm_d64_t *image)
 {
-
+    const uint64_t *map;
+    int track_max = d64_bam_track_max(image);
     int track;
-    int sector;
 
     cbmfm_dxx_block_iter_init(iter, (cbmfm_dxx_image_t *)image, 0, 0);
+    if (!d64_writable(image)) {
+        return false;
+    }
+    map = d64_bam_map(image);
 
     /* start one track below the directory track */
     track = CBMFM_D64_DIR_TRACK - 1;
 
-    while (track >= 1 && track <= image->track_max) {
-        cbmfm_log_debug("%s(): checking track %d\n", __func__, track);
-        int trk_blocks = cbmfm_d64_bam_track_get_blocks_free(image, track);
-        if (trk_blocks > 0) {
-            int sec_max;
-
-            sec_max = cbmfm_dxx_track_block_count((cbmfm_dxx_image_t *)image,
-                    track);
-            /* got track, determine sector */
-            cbmfm_log_error("%s(): track %d has %d free blocks\n",
-                    __func__, track, trk_blocks);
-
+    while (track >= 1 && track <= track_max) {
+        if (map[track] != 0) {
             iter->curr.track = track;
-
-            /* find first block free in track */
-            sector = 0;
-            while (sector < sec_max) {
-                bool state;
-
-                cbmfm_log_debug("%s(): checking (%d,%d) .. ",
-                        __func__, track, sector);
-                if (!cbmfm_d64_bam_sector_get_free(image, track, sector, &state)) {
-                    cbmfm_log_error("%s(): bam_sector_get_free(%d,%d) failed, "
-                            "this shouldn't happen\n", __func__, track, sector);
-                    return false;
-                }
-                if (state) {
-                    /* got free block */
-                    cbmfm_log_debug("%s(): got free block at (%d,%d)\n",
-                            __func__, track, sector);
-                    return true;
-                } else {
-                    cbmfm_log_debug("Nope\n");
-                }
-                sector++;
-            }
-            return false;
+            iter->curr.sector = cbmfm_ctz64(map[track]);
+            return true;
         }
 
         /* update track */
@@ -938,6 +1243,66 @@ bool cbmfm_d64_block_write_iter_init(cbmfm_dxx_block_iter_t *iter,
             track = CBMFM_D64_DIR_TRACK - (track - CBMFM_D64_DIR_TRACK + 1);
         }
     }
+    return false;
+}
+
+
+/** \brief  Allocate the next block of a file after the current block of \a iter
+ *
+ * Follows the 1541 DOS: the next block is searched for at the current sector
+ * plus the interleave, moving away from the directory track when a track is
+ * full and switching to the other half of the disk at the edge. The new block
+ * is marked used and the link of the previous block is back-patched.
+ *
+ * \param[in,out]   iter    block iterator
+ *
+ * \return  true if a block was allocated
+ *
+ * \throw   #CBMFM_ERR_READONLY
+ * \throw   #CBMFM_ERR_DISK_FULL
+ */
+bool cbmfm_d64_block_write_iter_next(cbmfm_dxx_block_iter_t *iter)
+{
+    cbmfm_d64_t *image = (cbmfm_d64_t *)(iter->image);
+    int track_max = d64_bam_track_max(image);
+    int track = iter->curr.track;
+    int sector = -1;
+    uint8_t *prev;
+
+    if (!d64_writable(image)) {
+        return false;
+    }
+    d64_bam_map(image);
+    if (image->bam_free == 0) {
+        cbmfm_error_set(CBMFM_ERR_DISK_FULL, NULL, -1);
+        return false;
+    }
+
+    while (sector < 0) {
+        sector = d64_track_find_free(image, track,
+                d64_interleave(image, track, iter->curr.sector,
+                    CBMFM_D64_INTERLEAVE_DATA));
+        if (sector < 0) {
+            /* move away from the directory track, switch sides at the edge */
+            if (track < CBMFM_D64_DIR_TRACK) {
+                track = track > 1 ? track - 1 : CBMFM_D64_DIR_TRACK + 1;
+            } else {
+                track = track < track_max ? track + 1 : CBMFM_D64_DIR_TRACK - 1;
+            }
+        }
+    }
+    cbmfm_d64_bam_sector_set_free(image, track, sector, false);
+
+    iter->prev.track = iter->curr.track;
+    iter->prev.sector = iter->curr.sector;
+    iter->curr.track = track;
+    iter->curr.sector = sector;
+
+    /* back-patch link of previous block */
+    prev = d64_block_ptr(image, iter->prev.track, iter->prev.sector);
+    prev[0] = (uint8_t)track;
+    prev[1] = (uint8_t)sector;
+    d64_modified(image);
     return true;
 }
 
@@ -948,42 +1313,767 @@ bool cbmfm_d64_block_write_iter_init(cbmfm_dxx_block_iter_t *iter,
  * \param[in]   data    data to write to current block
  * \param[in]   size    number of bytes to write to block
  *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
  */
-void cbmfm_d64_block_write_iter_write_data(cbmfm_dxx_block_iter_t *iter,
+bool cbmfm_d64_block_write_iter_write_data(cbmfm_dxx_block_iter_t *iter,
                                            const uint8_t *data,
                                            size_t size)
 {
+    if (!d64_writable((const cbmfm_d64_t *)(iter->image))) {
+        return false;
+    }
     /* write data */
     cbmfm_dxx_block_iter_write_data(iter, data, size);
-    /* TODO mark block used */
+    return cbmfm_d64_bam_sector_set_free((cbmfm_d64_t *)(iter->image),
+            iter->curr.track, iter->curr.sector, false);
 }
 
 
+/** \brief  Find up to \a count free directory entries in \a image
+ *
+ * Entries with a file type of 0 are considered free. The (track,sector) of
+ * the last directory block is stored in \a last, to allow extending the
+ * directory chain.
+ *
+ * \param[in]   image   d64 image
+ * \param[out]  entries offsets in image data of free entries
+ * \param[in]   count   maximum number of entries to find
+ * \param[out]  found   number of entries found
+ * \param[out]  last    last directory block
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+static bool d64_dir_entries_find(cbmfm_d64_t *image,
+                                 intmax_t *entries,
+                                 size_t count,
+                                 size_t *found,
+                                 cbmfm_block_t *last)
+{
+    uint8_t *block;
+    int track = CBMFM_D64_DIR_TRACK;
+    int sector = CBMFM_D64_DIR_SECTOR;
+    int blocks = 0;
+    size_t entry;
 
-/** \brief  Determine if \a filename is a D64 image
+    *found = 0;
+    while (true) {
+        block = d64_block_ptr(image, track, sector);
+        if (block == NULL) {
+            return false;
+        }
+        for (entry = 0; entry < CBMFM_BLOCK_SIZE_RAW && *found < count;
+                entry += CBMFM_DXX_DIRENT_SIZE) {
+            if (block[entry + CBMFM_D64_DIRENT_FILE_TYPE] == 0x00) {
+                entries[(*found)++] = (block - image->data) + (intmax_t)entry;
+            }
+        }
+        if (block[0] == 0 || *found == count) {
+            break;
+        }
+        if (++blocks >= image->geometry->tracks[CBMFM_D64_DIR_TRACK].blocks) {
+            /* directory chain loops */
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
+            return false;
+        }
+        track = block[0];
+        sector = block[1];
+    }
+    last->track = track;
+    last->sector = sector;
+    return true;
+}
+
+
+/** \brief  Append a new directory block to \a last in \a image
  *
- * Only checks the size of the data in \a filename, so this function is not
- * very reliable.
+ * The block is allocated on the directory track using the DOS directory
+ * interleave, cleared and linked to the end of the chain.
  *
- * \param[in]   filename    file to test
+ * \param[in,out]   image   d64 image
+ * \param[in,out]   last    last directory block, updated to the new block
+ *
+ * \return  offset in image data of the new block or -1 on error
+ *
+ * \throw   #CBMFM_ERR_DISK_FULL
+ */
+static intmax_t d64_dir_block_append(cbmfm_d64_t *image, cbmfm_block_t *last)
+{
+    uint8_t *block;
+    int sector;
+
+    sector = d64_track_find_free(image, CBMFM_D64_DIR_TRACK,
+            d64_interleave(image, CBMFM_D64_DIR_TRACK, last->sector,
+                CBMFM_D64_INTERLEAVE_DIR));
+    if (sector < 0) {
+        cbmfm_error_set(CBMFM_ERR_DISK_FULL, NULL, -1);
+        return -1;
+    }
+    cbmfm_d64_bam_sector_set_free(image, CBMFM_D64_DIR_TRACK, sector, false);
+
+    block = d64_block_ptr(image, last->track, last->sector);
+    block[0] = CBMFM_D64_DIR_TRACK;
+    block[1] = (uint8_t)sector;
+    last->track = CBMFM_D64_DIR_TRACK;
+    last->sector = sector;
+
+    block = d64_block_ptr(image, CBMFM_D64_DIR_TRACK, sector);
+    memset(block, 0, CBMFM_BLOCK_SIZE_RAW);
+    block[1] = 0xff;
+    return block - image->data;
+}
+
+
+/** \brief  Remove the directory block appended to \a last in \a image
+ *
+ * Undoes d64_dir_block_append(): frees the block and terminates the chain at
+ * \a last again.
+ *
+ * \param[in,out]   image   d64 image
+ * \param[in]       last    last directory block before the append
+ */
+static void d64_dir_block_remove(cbmfm_d64_t *image, const cbmfm_block_t *last)
+{
+    uint8_t *block;
+
+    block = d64_block_ptr(image, last->track, last->sector);
+    cbmfm_d64_bam_sector_set_free(image, block[0], block[1], true);
+    block[0] = 0x00;
+    block[1] = 0xff;
+}
+
+
+/** \brief  Find a free directory entry in \a image
+ *
+ * When the directory is full, the directory chain is extended.
+ *
+ * \param[in,out]   image   d64 image
+ * \param[out]      last    block the chain was extended from, track 0 when
+ *                          the directory wasn't extended
+ *
+ * \return  offset in image data of the entry or -1 on error
+ *
+ * \throw   #CBMFM_ERR_DISK_FULL
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+static intmax_t d64_dir_entry_alloc(cbmfm_d64_t *image, cbmfm_block_t *last)
+{
+    cbmfm_block_t tail;
+    intmax_t entry;
+    size_t found;
+
+    last->track = 0;
+    last->sector = 0;
+    if (!d64_dir_entries_find(image, &entry, 1, &found, &tail)) {
+        return -1;
+    }
+    if (found == 1) {
+        return entry;
+    }
+    *last = tail;
+    entry = d64_dir_block_append(image, &tail);
+    if (entry < 0) {
+        last->track = 0;
+    }
+    return entry;
+}
+
+
+/** \brief  Write BAM mirror of \a image to the BAM entries
+ *
+ * Used to commit the BAM once after a series of deferred updates.
+ *
+ * \param[in,out]   image   d64 image
+ */
+static void d64_bam_commit(cbmfm_d64_t *image)
+{
+    int track;
+
+    for (track = 1; track <= d64_bam_track_max(image); track++) {
+        uint8_t *bament = cbmfm_d64_bam_ptr_trk(image, track);
+        uint64_t map = image->bam_map[track];
+
+        bament[0] = (uint8_t)cbmfm_popcount64(map);
+        bament[1] = (uint8_t)(map & 0xff);
+        bament[2] = (uint8_t)((map >> 8) & 0xff);
+        bament[3] = (uint8_t)((map >> 16) & 0xff);
+    }
+}
+
+
+/** \brief  Open \a writer on directory entry at \a entry
+ *
+ * \param[out]      writer  d64 file writer
+ * \param[in,out]   image   d64 image
+ * \param[in]       name    PETSCII file name (16 bytes, padded with 0xA0)
+ * \param[in]       type    CBMDOS file type
+ * \param[in]       entry   offset in image data of a free directory entry
  *
  * \return  bool
+ *
+ * \throw   #CBMFM_ERR_DISK_FULL
  */
-bool cbmfm_is_d64(const char *filename)
+static bool d64_writer_open_entry(cbmfm_d64_writer_t *writer,
+                                  cbmfm_d64_t *image,
+                                  const uint8_t *name,
+                                  uint8_t type,
+                                  intmax_t entry)
 {
+    uint8_t *data;
+
+    if (!cbmfm_d64_block_write_iter_init(&(writer->iter), image)) {
+        cbmfm_error_set(CBMFM_ERR_DISK_FULL, NULL, -1);
+        return false;
+    }
+    cbmfm_d64_bam_sector_set_free(image,
+            writer->iter.curr.track, writer->iter.curr.sector, false);
+
+    /* the first two bytes of an entry are used by the directory block link */
+    data = image->data + entry;
+    memcpy(writer->dirent, data + CBMFM_D64_DIRENT_FILE_TYPE,
+            sizeof writer->dirent);
+    memset(data + CBMFM_D64_DIRENT_FILE_TYPE, 0,
+            CBMFM_DXX_DIRENT_SIZE - CBMFM_D64_DIRENT_FILE_TYPE);
+    data[CBMFM_D64_DIRENT_FILE_TYPE] =
+        (uint8_t)(type & ~CBMFM_CBMDOS_FILE_CLOSED_BIT);
+    data[CBMFM_D64_DIRENT_FILE_TRACK] = (uint8_t)(writer->iter.curr.track);
+    data[CBMFM_D64_DIRENT_FILE_SECTOR] = (uint8_t)(writer->iter.curr.sector);
+    memcpy(data + CBMFM_D64_DIRENT_FILE_NAME, name,
+            CBMFM_CBMDOS_FILE_NAME_LEN);
+    data[CBMFM_D64_DIRENT_BLOCKS_LSB] = 1;
+
+    writer->image = image;
+    writer->used = 0;
+    writer->blocks = 1;
+    writer->entry = entry;
+    writer->dir_last.track = 0;
+    writer->dir_last.sector = 0;
+    writer->open = true;
+    d64_modified(image);
+    return true;
+}
+
 
-    switch (cbmfm_file_size(filename)) {
+/** \brief  Open \a writer to write a file to \a image
+ *
+ * Allocates the first block of the file and creates a directory entry for it,
+ * marked as not closed until cbmfm_d64_writer_close() is called.
+ *
+ * \param[out]      writer  d64 file writer
+ * \param[in,out]   image   d64 image
+ * \param[in]       name    PETSCII file name (16 bytes, padded with 0xA0)
+ * \param[in]       type    CBMDOS file type (`CBMFM_CBMDOS_*`)
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
+ * \throw   #CBMFM_ERR_DISK_FULL
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+bool cbmfm_d64_writer_open(cbmfm_d64_writer_t *writer,
+                           cbmfm_d64_t *image,
+                           const uint8_t *name,
+                           uint8_t type)
+{
+    intmax_t entry;
+
+    cbmfm_block_t last;
+
+    writer->image = image;
+    writer->used = 0;
+    writer->blocks = 0;
+    writer->entry = -1;
+    writer->dir_last.track = 0;
+    writer->dir_last.sector = 0;
+    writer->open = false;
+
+    if (!d64_writable(image)) {
+        return false;
+    }
+
+    d64_bam_map(image);
+    if (image->bam_free == 0) {
+        cbmfm_error_set(CBMFM_ERR_DISK_FULL, NULL, -1);
+        return false;
+    }
+    entry = d64_dir_entry_alloc(image, &last);
+    if (entry < 0) {
+        return false;
+    }
+    if (!d64_writer_open_entry(writer, image, name, type, entry)) {
+        if (last.track != 0) {
+            d64_dir_block_remove(image, &last);
+        }
+        return false;
+    }
+    writer->dir_last = last;
+    return true;
+}
+
+
+/** \brief  Append \a size bytes of \a data to the file of \a writer
+ *
+ * New blocks are allocated when the current block is full, so only a single
+ * block is ever being written. On failure the data written so far remains
+ * and the writer stays open: call cbmfm_d64_writer_abort() to remove the
+ * partial file, closing it would leave a truncated file in the image.
+ *
+ * \param[in,out]   writer  d64 file writer
+ * \param[in]       data    data to append
+ * \param[in]       size    size of \a data
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA (writer not open)
+ * \throw   #CBMFM_ERR_DISK_FULL
+ */
+bool cbmfm_d64_writer_append(cbmfm_d64_writer_t *writer,
+                             const uint8_t *data,
+                             size_t size)
+{
+    if (!writer->open) {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
+        return false;
+    }
+
+    while (size > 0) {
+        uint8_t *block;
+        size_t avail;
+
+        if (writer->used == CBMFM_BLOCK_SIZE_DATA) {
+            if (!cbmfm_d64_block_write_iter_next(&(writer->iter))) {
+                return false;
+            }
+            writer->used = 0;
+            writer->blocks++;
+        }
+
+        avail = CBMFM_BLOCK_SIZE_DATA - writer->used;
+        if (avail > size) {
+            avail = size;
+        }
+        block = d64_block_ptr(writer->image,
+                writer->iter.curr.track, writer->iter.curr.sector);
+        memcpy(block + 2 + writer->used, data, avail);
+        writer->used += avail;
+        data += avail;
+        size -= avail;
+    }
+    d64_modified(writer->image);
+    return true;
+}
+
+
+/** \brief  Close \a writer
+ *
+ * Terminates the block chain and finalizes the directory entry by setting
+ * the block count and the 'closed' bit of the file type.
+ *
+ * \param[in,out]   writer  d64 file writer
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA (writer not open)
+ */
+bool cbmfm_d64_writer_close(cbmfm_d64_writer_t *writer)
+{
+    uint8_t *block;
+    uint8_t *entry;
+
+    if (!writer->open) {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
+        return false;
+    }
+
+    /* last block: track 0, sector is the index of the last byte used */
+    block = d64_block_ptr(writer->image,
+            writer->iter.curr.track, writer->iter.curr.sector);
+    block[0] = 0;
+    block[1] = (uint8_t)(writer->used + 1);
+
+    entry = writer->image->data + writer->entry;
+    entry[CBMFM_D64_DIRENT_FILE_TYPE] |= CBMFM_CBMDOS_FILE_CLOSED_BIT;
+    entry[CBMFM_D64_DIRENT_BLOCKS_LSB] = (uint8_t)(writer->blocks & 0xff);
+    entry[CBMFM_D64_DIRENT_BLOCKS_MSB] = (uint8_t)(writer->blocks >> 8);
+
+    writer->open = false;
+    d64_modified(writer->image);
+    return true;
+}
+
+
+/** \brief  Abort \a writer, removing its file
+ *
+ * Frees the blocks allocated so far, restores the directory entry and
+ * removes the directory block allocated for it, if any, so the directory and
+ * the BAM are as they were before cbmfm_d64_writer_open(). Does nothing when
+ * \a writer isn't open.
+ *
+ * \param[in,out]   writer  d64 file writer
+ */
+void cbmfm_d64_writer_abort(cbmfm_d64_writer_t *writer)
+{
+    uint8_t *entry;
+    int track;
+    int sector;
+    uint16_t block;
+
+    if (!writer->open) {
+        return;
+    }
+
+    /* the blocks are linked as they are allocated */
+    entry = writer->image->data + writer->entry;
+    track = entry[CBMFM_D64_DIRENT_FILE_TRACK];
+    sector = entry[CBMFM_D64_DIRENT_FILE_SECTOR];
+    for (block = 0; block < writer->blocks; block++) {
+        const uint8_t *data = d64_block_ptr(writer->image, track, sector);
+
+        cbmfm_d64_bam_sector_set_free(writer->image, track, sector, true);
+        track = data[0];
+        sector = data[1];
+    }
+    memcpy(entry + CBMFM_D64_DIRENT_FILE_TYPE, writer->dirent,
+            sizeof writer->dirent);
+    if (writer->dir_last.track != 0) {
+        d64_dir_block_remove(writer->image, &(writer->dir_last));
+    }
+
+    writer->open = false;
+    d64_modified(writer->image);
+}
+
+
+/** \brief  Write \a file to \a image
+ *
+ * The prefix of \a file, if any, is written before its data. When the file
+ * doesn't fit, the partial file is removed again, leaving the directory and
+ * the BAM unchanged.
+ *
+ * \param[in,out]   image   d64 image
+ * \param[in]       file    file object
+ *
+ * \return  bool
+ *
+ * \see cbmfm_d64_writer_open() for errors
+ */
+bool cbmfm_d64_file_write(cbmfm_d64_t *image, const cbmfm_file_t *file)
+{
+    cbmfm_d64_writer_t writer;
+
+    if (!cbmfm_d64_writer_open(&writer, image, file->name, file->type)) {
+        return false;
+    }
+    if (!cbmfm_d64_writer_append(&writer, file->prefix, file->prefix_len)
+            || !cbmfm_d64_writer_append(&writer, file->data, file->size)) {
+        cbmfm_d64_writer_abort(&writer);
+        return false;
+    }
+    return cbmfm_d64_writer_close(&writer);
+}
+
+
+/** \brief  Load host files of a bulk import
+ *
+ * Maps the host files in \a files and determines the number of blocks required
+ * to store all files.
+ *
+ * \param[in]   files   import items
+ * \param[in]   count   number of items
+ * \param[out]  host    host file data per item (`NULL` for buffers)
+ * \param[out]  mapped  host file data is mapped per item
+ * \param[out]  sizes   size per item
+ * \param[out]  blocks  total number of data blocks required, saturated at
+ *                      `SIZE_MAX`
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_IO
+ */
+static bool d64_import_load(const cbmfm_d64_import_t *files,
+                            size_t count,
+                            uint8_t **host,
+                            bool *mapped,
+                            size_t *sizes,
+                            size_t *blocks)
+{
+    size_t i;
+
+    *blocks = 0;
+    for (i = 0; i < count; i++) {
+        size_t file_blocks;
+
+        if (files[i].path != NULL) {
+            intmax_t size = cbmfm_map_file(&(host[i]), files[i].path,
+                    &(mapped[i]));
+            if (size < 0) {
+                host[i] = NULL;
+                return false;
+            }
+            sizes[i] = (size_t)size;
+        } else {
+            sizes[i] = files[i].size;
+        }
+        /* an empty file still occupies a block */
+        file_blocks = sizes[i] / CBMFM_BLOCK_SIZE_DATA
+            + (sizes[i] % CBMFM_BLOCK_SIZE_DATA != 0 || sizes[i] == 0);
+        if (file_blocks > SIZE_MAX - *blocks) {
+            *blocks = SIZE_MAX;
+        } else {
+            *blocks += file_blocks;
+        }
+    }
+    return true;
+}
+
+
+/** \brief  Undo a failed bulk import into \a image
+ *
+ * Clears the directory entries used so far, restores the link of the last
+ * directory block and the BAM mirror, and leaves deferred BAM mode. Since
+ * the BAM bytes are only written on commit, they still describe the image as
+ * it was before the import.
+ *
+ * \param[in,out]   image   d64 image
+ * \param[in]       entries directory entry offsets
+ * \param[in]       used    number of entries in \a entries to clear
+ * \param[in]       last    last directory block before the import
+ * \param[in]       link    original link bytes of \a last
+ * \param[in]       map     BAM mirror before the import
+ * \param[in]       bam_free    blocks free before the import
+ */
+static void d64_import_rollback(cbmfm_d64_t *image,
+                                const intmax_t *entries,
+                                size_t used,
+                                const cbmfm_block_t *last,
+                                const uint8_t *link,
+                                const uint64_t *map,
+                                int bam_free)
+{
+    uint8_t *block;
+    size_t i;
+
+    for (i = 0; i < used; i++) {
+        image->data[entries[i] + CBMFM_D64_DIRENT_FILE_TYPE] = 0x00;
+    }
+    block = d64_block_ptr(image, last->track, last->sector);
+    block[0] = link[0];
+    block[1] = link[1];
+    memcpy(image->bam_map, map, sizeof image->bam_map);
+    image->bam_free = bam_free;
+    image->bam_deferred = false;
+}
+
+
+/** \brief  Write the files of a bulk import to \a image
+ *
+ * \param[in,out]   image   d64 image
+ * \param[in]       files   import items
+ * \param[in]       count   number of items
+ * \param[in]       host    host file data per item
+ * \param[in]       sizes   size per item
+ * \param[in]       blocks  number of data blocks required
+ *
+ * On failure the image is restored to its state before the import.
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_DISK_FULL
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+static bool d64_import_write(cbmfm_d64_t *image,
+                             const cbmfm_d64_import_t *files,
+                             size_t count,
+                             uint8_t * const *host,
+                             const size_t *sizes,
+                             size_t blocks)
+{
+    const size_t per_block = CBMFM_BLOCK_SIZE_RAW / CBMFM_DXX_DIRENT_SIZE;
+    cbmfm_d64_writer_t writer;
+    uint64_t map[CBMFM_D64_BAM_TRACKS + 1];
+    int bam_free;
+    intmax_t *entries;
+    cbmfm_block_t last;
+    cbmfm_block_t orig;
+    uint8_t link[2];
+    uint8_t *block;
+    size_t found;
+    size_t dir_blocks;
+    size_t used;
+    size_t i;
+    bool status;
+
+    /* find free directory entries and check if everything fits */
+    entries = cbmfm_malloc(count * sizeof *entries);
+    if (!d64_dir_entries_find(image, entries, count, &found, &last)) {
+        cbmfm_free(entries);
+        return false;
+    }
+    dir_blocks = (count - found + per_block - 1) / per_block;
+    if (blocks > (size_t)cbmfm_d64_blocks_free(image)
+            || dir_blocks > (size_t)cbmfm_popcount64(
+                image->bam_map[CBMFM_D64_DIR_TRACK])) {
+        cbmfm_error_set(CBMFM_ERR_DISK_FULL, NULL, -1);
+        cbmfm_free(entries);
+        return false;
+    }
+
+    /* only update the BAM mirror, keep what's needed to undo the import */
+    memcpy(map, image->bam_map, sizeof map);
+    bam_free = image->bam_free;
+    orig = last;
+    block = d64_block_ptr(image, orig.track, orig.sector);
+    link[0] = block[0];
+    link[1] = block[1];
+    image->bam_deferred = true;
+
+    status = true;
+    used = 0;
+    while (status && found < count) {
+        intmax_t offset = d64_dir_block_append(image, &last);
+        size_t entry;
+
+        status = offset >= 0;
+        for (entry = 0; status && entry < per_block && found < count;
+                entry++) {
+            entries[found++] = offset
+                + (intmax_t)(entry * CBMFM_DXX_DIRENT_SIZE);
+        }
+    }
+    for (i = 0; status && i < count; i++) {
+        status = d64_writer_open_entry(&writer, image, files[i].name,
+                files[i].type, entries[i]);
+        if (status) {
+            used = i + 1;
+            status = cbmfm_d64_writer_append(&writer,
+                    host[i] != NULL ? host[i] : files[i].data, sizes[i]);
+            cbmfm_d64_writer_close(&writer);
+        }
+    }
+    if (!status) {
+        d64_import_rollback(image, entries, used, &orig, link, map, bam_free);
+        cbmfm_free(entries);
+        return false;
+    }
+    image->bam_deferred = false;
+    d64_bam_commit(image);
+
+    cbmfm_free(entries);
+    return true;
+}
+
+
+/** \brief  Import \a count files into \a image in a single transaction
+ *
+ * All host files are loaded and the required data and directory blocks are
+ * determined up front. When the files don't fit, the image is left untouched.
+ * Otherwise the directory is scanned once, extended on the directory track if
+ * needed, all data is written and the BAM is committed once at the end.
+ *
+ * \param[in,out]   image   d64 image
+ * \param[in]       files   files to import
+ * \param[in]       count   number of elements in \a files
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
+ * \throw   #CBMFM_ERR_DISK_FULL
+ * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+bool cbmfm_d64_import(cbmfm_d64_t *image,
+                      const cbmfm_d64_import_t *files,
+                      size_t count)
+{
+    uint8_t **host;
+    bool *mapped;
+    size_t *sizes;
+    size_t blocks;
+    size_t i;
+    bool status;
+
+    if (!d64_writable(image)) {
+        return false;
+    }
+    if (count == 0) {
+        return true;
+    }
+
+    host = cbmfm_calloc(count, sizeof *host);
+    mapped = cbmfm_calloc(count, sizeof *mapped);
+    sizes = cbmfm_calloc(count, sizeof *sizes);
+
+    status = d64_import_load(files, count, host, mapped, sizes, &blocks)
+        && d64_import_write(image, files, count, host, sizes, blocks);
+    if (status) {
+        d64_modified(image);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (host[i] != NULL) {
+            if (mapped[i]) {
+                cbmfm_unmap_file(host[i], sizes[i]);
+            } else {
+                cbmfm_free(host[i]);
+            }
+        }
+    }
+    cbmfm_free(sizes);
+    cbmfm_free(mapped);
+    cbmfm_free(host);
+    return status;
+}
+
+
+
+/** \brief  Probe data in \a probe for the D64 format
+ *
+ * D64 images don't have a signature, so only the file size is checked.
+ *
+ * \param[in]   probe   probe object
+ *
+ * \return  score
+ */
+int cbmfm_d64_probe(const cbmfm_probe_t *probe)
+{
+    switch (probe->size) {
         case CBMFM_D64_SIZE_STD:        /* fall through */
         case CBMFM_D64_SIZE_STD_ERR:    /* fall through */
         case CBMFM_D64_SIZE_EXT:        /* fall through */
         case CBMFM_D64_SIZE_EXT_ERR:
-            return true;
+            return CBMFM_PROBE_SCORE_SIZE;
         default:
-            return false;
+            return CBMFM_PROBE_SCORE_NONE;
     }
 }
 
 
+/** \brief  Determine if \a filename is a D64 image
+ *
+ * Only checks the size of the data in \a filename, so this function is not
+ * very reliable.
+ *
+ * \param[in]   filename    file to test
+ *
+ * \return  bool
+ */
+bool cbmfm_is_d64(const char *filename)
+{
+    cbmfm_probe_t probe;
+    int score;
+
+    if (!cbmfm_probe_open(&probe, filename)) {
+        return false;
+    }
+    score = cbmfm_d64_probe(&probe);
+    cbmfm_probe_close(&probe);
+    return score > CBMFM_PROBE_SCORE_NONE;
+}
+
+
 /** \brief  Initialize BAM of a D64 image
  *
  * Sets dir (track,sector) pointer, disk DOS version, DOS type, initializes
@@ -991,14 +2081,24 @@ bool cbmfm_is_d64(const char *filename)
  * dir block) used), and writes inverted spaces to disk name and ID.
  *
  * \param[in,out]   image   d64 image
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
  */
-void cbmfm_d64_bam_init(cbmfm_d64_t *image)
+bool cbmfm_d64_bam_init(cbmfm_d64_t *image)
 {
-    uint8_t *bam = cbmfm_d64_bam_ptr(image);
+    uint8_t *bam;
     int track;
 
+    if (!d64_writable(image)) {
+        return false;
+    }
+    bam = cbmfm_d64_bam_ptr(image);
+
     /* clear BAM */
     memset(bam, 0, CBMFM_BLOCK_SIZE_RAW);
+    image->bam_synced = false;
 
     /* set directory (track,sector) pointer */
     bam[CBMFM_D64_BAM_DIR_TRACK] = CBMFM_D64_DIR_TRACK;
@@ -1023,6 +2123,8 @@ void cbmfm_d64_bam_init(cbmfm_d64_t *image)
     /* DOS type */
     bam[CBMFM_D64_BAM_DOS_TYPE + 0] = 0x32; /* '2' */
     bam[CBMFM_D64_BAM_DOS_TYPE + 1] = 0x41; /* 'A' */
+    d64_modified(image);
+    return true;
 }
 
 
@@ -1041,15 +2143,26 @@ void cbmfm_d64_bam_init(cbmfm_d64_t *image)
  * \param[in]       name        disk name (`NULL` to leave empty)
  * \param[in]       id          disk ID (`NULL` to leave empty)
  * \param[in]       extended    create a 40-track image instead of 35-track
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
+ * \throw   #CBMFM_ERR_INVALID_DATA
  */
-void cbmfm_d64_format(cbmfm_d64_t *image,
+bool cbmfm_d64_format(cbmfm_d64_t *image,
                       const char *name, const char *id,
                       bool extended)
 {
+    if (!d64_writable(image)) {
+        return false;
+    }
     if (image->data == NULL) {
         /* no data allocated: allocate data */
         int tracks = extended ? 40 : 35;
 
+        if (!d64_set_tracks(image, tracks)) {
+            return false;
+        }
         if (tracks == 35) {
             image->data = cbmfm_malloc(CBMFM_D64_SIZE_STD);
             image->size = CBMFM_D64_SIZE_STD;
@@ -1057,14 +2170,15 @@ void cbmfm_d64_format(cbmfm_d64_t *image,
             image->data = cbmfm_malloc(CBMFM_D64_SIZE_EXT);
             image->size = CBMFM_D64_SIZE_EXT;
         }
-        image->track_max = tracks;
     }
 
     /* clear all data */
     memset(image->data, 0x00, image->size);
+    image->bam_synced = false;
 
-    /* initialize BAM */
+    /* initialize BAM and terminate the (empty) first directory block */
     cbmfm_d64_bam_init(image);
+    d64_block_ptr(image, CBMFM_D64_DIR_TRACK, CBMFM_D64_DIR_SECTOR)[1] = 0xff;
 
     /* set disk name if provided */
     if (name != NULL && *name != '\0') {
@@ -1074,6 +2188,8 @@ void cbmfm_d64_format(cbmfm_d64_t *image,
     if (id != NULL && *id != '\0') {
         cbmfm_d64_set_disk_id_asc_ext(image, id);
     }
+    d64_modified(image);
+    return true;
 }
 
 
@@ -37,6 +37,7 @@
 
 
 bool cbmfm_is_d64(const char *filename);
+int  cbmfm_d64_probe(const cbmfm_probe_t *probe);
 
 cbmfm_d64_t *   cbmfm_d64_alloc(void);
 void            cbmfm_d64_init(cbmfm_d64_t *image);
@@ -45,6 +46,8 @@ void            cbmfm_d64_cleanup(cbmfm_d64_t *image);
 void            cbmfm_d64_free(cbmfm_d64_t *image);
 
 bool            cbmfm_d64_open(cbmfm_d64_t *image, const char *name);
+bool            cbmfm_d64_open_mapped(cbmfm_d64_t *image, const char *name);
+bool            cbmfm_d64_open_probe(cbmfm_d64_t *image, cbmfm_probe_t *probe);
 
 uint8_t *       cbmfm_d64_bam_ptr(cbmfm_d64_t *imge);
 uint8_t *       cbmfm_d64_bam_ptr_trk(cbmfm_d64_t *image, int track);
@@ -57,24 +60,27 @@ void            cbmfm_d64_bam_dump(cbmfm_d64_t *image);
 
 int             cbmfm_d64_bam_track_get_blocks_free(cbmfm_d64_t *image,
                                                     int track);
+int             cbmfm_d64_bam_track_get_first_free(cbmfm_d64_t *image,
+                                                   int track);
+void            cbmfm_d64_bam_sync(cbmfm_d64_t *image);
 
 void            cbmfm_d64_get_disk_name_pet(cbmfm_d64_t *image, uint8_t *name);
 void            cbmfm_d64_get_disk_name_asc(cbmfm_d64_t *image, char *name);
 void            cbmfm_d64_get_disk_id_pet(cbmfm_d64_t *image, uint8_t *id);
 void            cbmfm_d64_get_disk_id_asc(cbmfm_d64_t *image, char *id);
 
-void            cbmfm_d64_set_disk_name_pet(cbmfm_d64_t *image,
+bool            cbmfm_d64_set_disk_name_pet(cbmfm_d64_t *image,
                                             const uint8_t *name);
-void            cbmfm_d64_set_disk_name_asc(cbmfm_d64_t *image,
+bool            cbmfm_d64_set_disk_name_asc(cbmfm_d64_t *image,
                                             const char *name);
 
-void            cbmfm_d64_set_disk_id_pet(cbmfm_d64_t *image,
+bool            cbmfm_d64_set_disk_id_pet(cbmfm_d64_t *image,
                                           const uint8_t *id);
-void            cbmfm_d64_set_disk_id_pet_ext(cbmfm_d64_t *image,
+bool            cbmfm_d64_set_disk_id_pet_ext(cbmfm_d64_t *image,
                                               const uint8_t *id);
 
-void            cbmfm_d64_set_disk_id_asc(cbmfm_d64_t *image, const char *id);
-void            cbmfm_d64_set_disk_id_asc_ext(cbmfm_d64_t *image,
+bool            cbmfm_d64_set_disk_id_asc(cbmfm_d64_t *image, const char *id);
+bool            cbmfm_d64_set_disk_id_asc_ext(cbmfm_d64_t *image,
                                               const char *id);
 
 bool            cbmfm_d64_bam_sector_get_free(cbmfm_d64_t *image,
@@ -92,6 +98,9 @@ void            cbmfm_d64_dirent_parse(cbmfm_dirent_t *dirent,
                                        const uint8_t *data);
 
 cbmfm_dir_t *   cbmfm_d64_dir_read(cbmfm_d64_t *image);
+int             cbmfm_d64_dir_visit(cbmfm_d64_t *image,
+                                    cbmfm_dir_visitor_t visitor,
+                                    void *data);
 
 
 bool            cbmfm_d64_file_read_from_block(cbmfm_d64_t *image,
@@ -102,17 +111,36 @@ bool            cbmfm_d64_file_read_from_dirent(cbmfm_dirent_t *dirent,
 bool            cbmfm_d64_file_read_from_index(cbmfm_d64_t *image,
                                                cbmfm_file_t *file,
                                                uint16_t index);
+bool            cbmfm_d64_file_read_from_name(cbmfm_d64_t *image,
+                                              cbmfm_file_t *file,
+                                              const cbmfm_pattern_t *pattern);
 
 
 bool            cbmfm_d64_block_write_iter_init(cbmfm_dxx_block_iter_t *iter,
                                                 cbmfm_d64_t *image);
-void            cbmfm_d64_block_write_iter_write_data(cbmfm_dxx_block_iter_t *iter,
+bool            cbmfm_d64_block_write_iter_next(cbmfm_dxx_block_iter_t *iter);
+bool            cbmfm_d64_block_write_iter_write_data(cbmfm_dxx_block_iter_t *iter,
                                                       const uint8_t *data,
                                                       size_t size);
 
-void            cbmfm_d64_bam_init(cbmfm_d64_t *image);
-
-void            cbmfm_d64_format(cbmfm_d64_t *image,
+bool            cbmfm_d64_writer_open(cbmfm_d64_writer_t *writer,
+                                      cbmfm_d64_t *image,
+                                      const uint8_t *name,
+                                      uint8_t type);
+bool            cbmfm_d64_writer_append(cbmfm_d64_writer_t *writer,
+                                        const uint8_t *data,
+                                        size_t size);
+bool            cbmfm_d64_writer_close(cbmfm_d64_writer_t *writer);
+void            cbmfm_d64_writer_abort(cbmfm_d64_writer_t *writer);
+bool            cbmfm_d64_file_write(cbmfm_d64_t *image,
+                                     const cbmfm_file_t *file);
+bool            cbmfm_d64_import(cbmfm_d64_t *image,
+                                 const cbmfm_d64_import_t *files,
+                                 size_t count);
+
+bool            cbmfm_d64_bam_init(cbmfm_d64_t *image);
+
+bool            cbmfm_d64_format(cbmfm_d64_t *image,
                                  const char *name, const char *id,
                                  bool extended);
 
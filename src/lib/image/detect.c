@@ -3,10 +3,11 @@
 /** \file   src/lib/image/detect.c
  * \brief   Image auto-detect functions
  *
- * This module attempts to detect the image type of a give file. First image
- * types with a recognizable signature are checked, then images types with
- * fixed sizes and finally as a fall back, the file extension is used to
- * determine the image type.
+ * This module attempts to detect the image type of a give file. The file is
+ * opened and its header read only once, then each registered probe function
+ * scores the data: images types with a recognizable signature score highest,
+ * then images types with fixed sizes and finally as a fall back, the file
+ * extension is used to determine the image type.
  *
  * \author  Bas Wassink <b.wassink@ziggo.nl>
  */
@@ -35,6 +36,8 @@
 #include <stdlib.h>
 #include <inttypes.h>
 
+#include "lib/base/errors.h"
+#include "lib/base/io.h"
 #include "lib/base/log.h"
 #include "lib/image/ark.h"
 #include "lib/image/d64.h"
@@ -44,7 +47,63 @@
 #include "lib/image/detect.h"
 
 
+/** \brief  Probe registry entry
+ */
+typedef struct detect_probe_s {
+    cbmfm_image_type_t type;                        /**< image type */
+    int (*probe)(const cbmfm_probe_t *probe);       /**< probe function */
+} detect_probe_t;
+
+
+/** \brief  List of probe functions
+ *
+ * Formats with a signature come first, so they win ties with formats that are
+ * only detected by file size or extension.
+ */
+static const detect_probe_t probes[] = {
+    { CBMFM_IMAGE_TYPE_LNX, cbmfm_lnx_probe },
+    { CBMFM_IMAGE_TYPE_T64, cbmfm_t64_probe },
+    { CBMFM_IMAGE_TYPE_D64, cbmfm_d64_probe },
+    { CBMFM_IMAGE_TYPE_ARK, cbmfm_ark_probe },
+    { CBMFM_IMAGE_TYPE_INVALID, NULL }
+};
+
+
+/** \brief  Detect the image type of the data in \a probe
+ *
+ * Runs all registered probe functions over the header and size in \a probe
+ * and returns the type with the highest score.
+ *
+ * \param[in]   probe   probe object, see cbmfm_probe_open()
+ * \param[out]  score   score of the detected type (optional)
+ *
+ * \return  image type or #CBMFM_IMAGE_TYPE_INVALID
+ */
+int cbmfm_image_detect_probe(const cbmfm_probe_t *probe, int *score)
+{
+    int best_type = CBMFM_IMAGE_TYPE_INVALID;
+    int best_score = CBMFM_PROBE_SCORE_NONE;
+    int i;
+
+    for (i = 0; probes[i].probe != NULL; i++) {
+        int result = probes[i].probe(probe);
+        if (result > best_score) {
+            best_score = result;
+            best_type = probes[i].type;
+        }
+    }
+    if (score != NULL) {
+        *score = best_score;
+    }
+    return best_type;
+}
+
+
 /** \brief  Try to detect the image type of \a filename
+ *
+ * Opens \a filename once for all probe functions. Use cbmfm_probe_open() and
+ * cbmfm_image_detect_probe() directly to reuse the file handle and header for
+ * opening the image afterwards.
  *
  * \param[in]   filename    filename/path
  *
@@ -52,27 +111,15 @@
  */
 int cbmfm_image_detect_type(const char *filename)
 {
+    cbmfm_probe_t probe;
+    int type;
 
     cbmfm_log_debug("trying to detect image type of '%s'\n", filename);
 
-    /* first check files with header 'magic' */
-    if (cbmfm_is_lnx(filename)) {
-        return CBMFM_IMAGE_TYPE_LNX;
+    if (!cbmfm_probe_open(&probe, filename)) {
+        return CBMFM_IMAGE_TYPE_INVALID;
     }
-    if (cbmfm_is_t64(filename)) {
-        return CBMFM_IMAGE_TYPE_T64;
-    }
-
-    /* check files with fixed sizes */
-    if (cbmfm_is_d64(filename)) {
-        return CBMFM_IMAGE_TYPE_D64;
-    }
-
-    /* check file extensions */
-    if (cbmfm_is_ark(filename)) {
-        return CBMFM_IMAGE_TYPE_ARK;
-    }
-
-    /* give up */
-    return CBMFM_IMAGE_TYPE_INVALID;
+    type = cbmfm_image_detect_probe(&probe, NULL);
+    cbmfm_probe_close(&probe);
+    return type;
 }
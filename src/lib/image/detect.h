@@ -28,7 +28,10 @@
 #ifndef CBMFM_LIB_IMAGE_DETECT_H
 #define CBMFM_LIB_IMAGE_DETECT_H
 
+#include "cbmfm_types.h"
 
+
+int cbmfm_image_detect_probe(const cbmfm_probe_t *probe, int *score);
 int cbmfm_image_detect_type(const char *filename);
 
 #endif
@@ -50,39 +50,56 @@
  */
 
 
-/** \brief  Parse a base-10 integer value
+/** \brief  Skip whitespace at \a *pos, without moving past \a end
  *
- * \param[in]   s       string to parse
- * \param[out]  endptr  object to store pointer to first non-valid char
+ * \param[in,out]   pos pointer into data
+ * \param[in]       end end of data
+ */
+static void lnx_skip_space(const uint8_t **pos, const uint8_t *end)
+{
+    while (*pos < end && isspace(**pos)) {
+        (*pos)++;
+    }
+}
+
+
+/** \brief  Parse a base-10 integer value at \a *pos, skipping whitespace
  *
- * \return  value or -1 on error
+ * On success \a *pos is moved to the first character after the number.
+ *
+ * \param[in,out]   pos     pointer into data
+ * \param[in]       end     end of data
+ * \param[out]      value   parsed value
+ *
+ * \return  bool
  *
  * \throw   #CBMFM_ERR_INVALID_DATA
  */
-static intmax_t cbmfm_parse_int(char *s, char **endptr)
+static bool lnx_parse_int(const uint8_t **pos,
+                          const uint8_t *end,
+                          intmax_t *value)
 {
+    const uint8_t *s = *pos;
     intmax_t result = 0;
-    char *t = s;
 
-    *endptr = s;    /* for errors */
-
-    /* skip leading whitespace */
-    while (*t != '\0' && isspace(*t)) {
-        t++;
+    lnx_skip_space(&s, end);
+    if (s == end || !isdigit(*s)) {
+        /* no number, parse error */
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
+        return false;
     }
 
-    if (*t == '\0') {
-        /* no data, parse error */
-        cbmfm_errno = CBMFM_ERR_INVALID_DATA;
-        return -1;
+    while (s < end && isdigit(*s) && result <= UINT16_MAX) {
+        result = result * 10 + *s - '0';
+        s++;
     }
-
-    while (*t != '\0' && isdigit(*t)) {
-        result = result * 10 + *t - '0';
-        t++;
+    if (result > UINT16_MAX) {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
+        return false;
     }
-    *endptr = t;
-    return result;
+    *value = result;
+    *pos = s;
+    return true;
 }
 
 
@@ -96,47 +113,37 @@ static intmax_t cbmfm_parse_int(char *s, char **endptr)
  */
 static bool lnx_parse_header(cbmfm_lnx_t *image)
 {
-    uint8_t *data = image->data;
+    const uint8_t *end = image->data + image->size;
+    const uint8_t *s = image->data + CBMFM_LNX_HDR;
     intmax_t dir_size = 0;
     intmax_t dir_used = 0;
-    char *endptr = NULL;
-    char *s;
     int i;
 
     /* get dir size in blocks */
-    dir_size = cbmfm_parse_int((char *)(data + CBMFM_LNX_HDR), &endptr);
-    if (dir_size < 0) {
-        cbmfm_errno = CBMFM_ERR_INVALID_DATA;
+    if (!lnx_parse_int(&s, end, &dir_size)) {
         return false;
     }
     image->dir_blocks = (uint16_t)dir_size;
 
-    /* get version string */
+    /* get version string, truncating it when too long */
     memset(image->version_str, 0x00, 32);
-    s = endptr;
-    while (*s != '\0' && isspace(*s)) {
-        s++;
-    }
+    lnx_skip_space(&s, end);
     i = 0;
-    while (*s != 0x0d && i < 31) {
-        image->version_str[i] = *s;
-        i++;
+    while (s < end && *s != 0x0d) {
+        if (i < 31) {
+            image->version_str[i++] = (char)*s;
+        }
         s++;
     }
 
-    dir_used = cbmfm_parse_int(s, &endptr);
-    if (dir_used < 0) {
-        cbmfm_errno = CBMFM_ERR_INVALID_DATA;
+    if (!lnx_parse_int(&s, end, &dir_used)) {
         return false;
     }
     image->dir_used = (uint16_t)dir_used;
 
     /* determine start of actual directory */
-    s = endptr;
-    while (isspace(*s) && ((uint8_t *)s < image->data + image->size)) {
-        s++;
-    }
-    image->dir_start = (uint8_t *)s;
+    lnx_skip_space(&s, end);
+    image->dir_start = (uint8_t *)(image->data + (s - image->data));
     return true;
 }
 
@@ -150,44 +157,62 @@ static void cbmfm_lnx_dirent_init(cbmfm_dirent_t *dirent)
 {
     cbmfm_dirent_init(dirent);
     dirent->extra.lnx.remainder = 0;
+    dirent->extra.lnx.data_offset = 0;
     dirent->image_type = CBMFM_IMAGE_TYPE_LNX;
 }
 
 
-/** \brief  Parse Lynx dirent
+/** \brief  Parse Lynx dirent at \a *pos
+ *
+ * File names are terminated with a carriage return and are at most 16 bytes,
+ * shorter names are padded with $A0. On success \a *pos is moved to the start
+ * of the next entry.
  *
- * \param[out]  dirent  directory entry
- * \param[in]   data    dirent data
+ * Some Lynx versions don't store the remainder of the final entry, in which
+ * case it is accepted as missing when \a last is true: the file size then
+ * gets clamped by the caller to the size of the container.
  *
- * \return  number of bytes parsed, or -1 on failure
+ * \param[out]      dirent  directory entry
+ * \param[in,out]   pos     pointer to entry data
+ * \param[in]       end     end of image data
+ * \param[in]       last    entry is the last in the directory
+ *
+ * \return  bool
  *
  * \throw   #CBMFM_ERR_INVALID_DATA
  */
-static int cbmfm_lnx_dirent_parse(cbmfm_dirent_t *dirent, uint8_t *data)
+static bool cbmfm_lnx_dirent_parse(cbmfm_dirent_t *dirent,
+                                   const uint8_t **pos,
+                                   const uint8_t *end,
+                                   bool last)
 {
     intmax_t blocks;
     intmax_t remainder;
-    char *endptr;
-    char *s;
+    const uint8_t *s = *pos;
+    size_t i;
 
     cbmfm_lnx_dirent_init(dirent);
 
     /* PETSCII file name */
-    memcpy(dirent->filename, data, CBMFM_CBMDOS_FILE_NAME_LEN);
+    memset(dirent->filename, 0xa0, CBMFM_CBMDOS_FILE_NAME_LEN);
+    for (i = 0; i < CBMFM_CBMDOS_FILE_NAME_LEN && s < end && *s != 0x0d; i++) {
+        dirent->filename[i] = *s++;
+    }
+    if (s < end && *s == 0x0d) {
+        s++;
+    }
 
     /* file size in blocks */
-    s = (char *)(data + CBMFM_CBMDOS_FILE_NAME_LEN);
-    blocks = cbmfm_parse_int(s, &endptr);
-    if (blocks < 0) {
-        cbmfm_errno = CBMFM_ERR_INVALID_DATA;
-        return -1;
+    if (!lnx_parse_int(&s, end, &blocks)) {
+        return false;
     }
     dirent->size_blocks = (uint16_t)blocks;
 
     /* file type */
-    s = endptr;
-    while (isspace(*s)) {
-        s++;
+    lnx_skip_space(&s, end);
+    if (s == end) {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
+        return false;
     }
     switch (*s) {
         case 0x50:
@@ -208,31 +233,37 @@ static int cbmfm_lnx_dirent_parse(cbmfm_dirent_t *dirent, uint8_t *data)
             break;
         default:
             /* invalid file type */
-            cbmfm_errno = CBMFM_ERR_INVALID_DATA;
-            return -1;
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
+            return false;
     }
     dirent->filetype |= CBMFM_CBMDOS_FILE_CLOSED_BIT;
 
     s++;
 
-    /* get remainder in final block */
-    remainder = cbmfm_parse_int(s, &endptr);
-    if (remainder < 0) {
-        cbmfm_errno = CBMFM_ERR_INVALID_DATA;
-        return -1;
+    /* get remainder in final block, only a missing one is accepted, without
+     * setting an error */
+    lnx_skip_space(&s, end);
+    if (last && (s == end || !isdigit(*s))) {
+        cbmfm_log_warning("missing remainder for final entry\n");
+        remainder = CBMFM_BLOCK_SIZE_DATA;
+    } else if (lnx_parse_int(&s, end, &remainder)) {
+        dirent->extra.lnx.remainder = (uint8_t)remainder;
+    } else {
+        return false;
     }
-    dirent->extra.lnx.remainder = (uint8_t)remainder;
 
     /* determine file size */
-    dirent->filesize = (size_t)(CBMFM_BLOCK_SIZE_DATA * (blocks - 1) + remainder);
-
-    /* skip trailing whitespace */
-    s = endptr;
-    while (isspace(*s)) {
-        s++;
+    if (blocks > 0) {
+        dirent->filesize = (size_t)(CBMFM_BLOCK_SIZE_DATA * (blocks - 1)
+                + remainder);
+    } else {
+        dirent->filesize = 0;
     }
 
-    return (int)((uint8_t *)s - data);
+    /* skip trailing whitespace */
+    lnx_skip_space(&s, end);
+    *pos = s;
+    return true;
 }
 
 
@@ -295,46 +326,36 @@ void cbmfm_lnx_free(cbmfm_lnx_t *image)
 }
 
 
-/** \brief  Read data from \a path into \a image
+/** \brief  Check data of \a image and parse its header
+ *
+ * Cleans up \a image on failure.
  *
  * \param[in,out]   image   Lynx image
- * \param[in]       path    path to image file
  *
  * \return  bool
  *
- * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_SIZE_MISMATCH
  * \throw   #CBMFM_ERR_INVALID_DATA
  */
-bool cbmfm_lnx_open(cbmfm_lnx_t *image, const char *path)
+static bool lnx_check_data(cbmfm_lnx_t *image)
 {
-    uint8_t *data;
-    intmax_t size;
-
-    size = cbmfm_read_file(&data, path);
-    if (size < 0) {
-        return false;
-    }
+    uint8_t *data = image->data;
 
     /* check size */
-    if (size < CBMFM_LNX_MIN_SIZE) {
-        cbmfm_errno = CBMFM_ERR_SIZE_MISMATCH;
-        cbmfm_free(data);
+    if (image->size < CBMFM_LNX_MIN_SIZE) {
+        cbmfm_error_set(CBMFM_ERR_SIZE_MISMATCH, NULL, -1);
+        cbmfm_lnx_cleanup(image);
         return false;
     }
 
     /* check load address */
     if (data[0] != (CBMFM_LNX_LOAD_ADDR & 0xff)
             || data[1] != ((CBMFM_LNX_LOAD_ADDR >> 8) & 0xff)) {
-        cbmfm_errno = CBMFM_ERR_INVALID_DATA;
-        cbmfm_free(data);
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
+        cbmfm_lnx_cleanup(image);
         return false;
     }
 
-    /* OK: */
-    image->data = data;
-    image->size = (size_t)size;
-    image->path = cbmfm_strdup(path);
-
     if (!lnx_parse_header(image)) {
         cbmfm_lnx_cleanup(image);
         return false;
@@ -343,6 +364,67 @@ bool cbmfm_lnx_open(cbmfm_lnx_t *image, const char *path)
 }
 
 
+/** \brief  Read data from \a path into \a image
+ *
+ * \param[in,out]   image   Lynx image
+ * \param[in]       path    path to image file
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+bool cbmfm_lnx_open(cbmfm_lnx_t *image, const char *path)
+{
+    if (!cbmfm_image_read_data((cbmfm_image_t *)image, path)) {
+        return false;
+    }
+    return lnx_check_data(image);
+}
+
+
+/** \brief  Map data from \a path read-only into \a image
+ *
+ * Opens \a path without copying its data, see cbmfm_image_map_data().
+ *
+ * \param[in,out]   image   Lynx image
+ * \param[in]       path    path to image file
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+bool cbmfm_lnx_open_mapped(cbmfm_lnx_t *image, const char *path)
+{
+    if (!cbmfm_image_map_data((cbmfm_image_t *)image, path)) {
+        return false;
+    }
+    return lnx_check_data(image);
+}
+
+
+/** \brief  Open Lynx image through \a probe
+ *
+ * Reads the image data from the file handle left open by cbmfm_probe_open().
+ *
+ * \param[in,out]   image   Lynx image
+ * \param[in,out]   probe   probe object
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+bool cbmfm_lnx_open_probe(cbmfm_lnx_t *image, cbmfm_probe_t *probe)
+{
+    if (!cbmfm_image_read_probe((cbmfm_image_t *)image, probe)) {
+        return false;
+    }
+    return lnx_check_data(image);
+}
+
+
 /** \brief  Dump some info on \a image on stdout
  *
  * \param[in]   image   Lynx image
@@ -358,6 +440,8 @@ void cbmfm_lnx_dump(const cbmfm_lnx_t *image)
 
 
 /** \brief  Read directory of \a image
+ *
+ * The parsed directory is cached in \a image until the image is modified.
  *
  * \param[in]   image   Lynx image
  *
@@ -368,33 +452,100 @@ void cbmfm_lnx_dump(const cbmfm_lnx_t *image)
 cbmfm_dir_t *cbmfm_lnx_dir_read(cbmfm_lnx_t *image)
 {
     cbmfm_dir_t *dir;
+
+    dir = cbmfm_image_dir_cache_get((cbmfm_image_t *)image);
+    if (dir != NULL) {
+        return dir;
+    }
+
+    dir = cbmfm_dir_new_size(image->dir_used);
+    if (cbmfm_lnx_dir_visit(image, cbmfm_dir_append_visitor, dir) < 0) {
+        cbmfm_dir_free(dir);
+        return NULL;
+    }
+    dir->image = (cbmfm_image_t *)image;
+    cbmfm_image_dir_cache_set((cbmfm_image_t *)image, dir);
+    return dir;
+}
+
+
+/** \brief  Call \a visitor for each entry in the directory of \a image
+ *
+ * Parses each entry into a dirent on the stack and hands it to \a visitor,
+ * without allocating memory. When the directory is cached in \a image, the
+ * cached entries are visited instead.
+ *
+ * The offset of each file's data is determined in the same pass, as the sum
+ * of the sizes of the preceding files, and stored in the dirent. File sizes
+ * are clamped to the end of the image.
+ *
+ * \param[in]       image   Lynx image
+ * \param[in]       visitor visitor callback, return false to stop
+ * \param[in,out]   data    data for \a visitor
+ *
+ * \return  number of entries visited or -1 on error
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+int cbmfm_lnx_dir_visit(cbmfm_lnx_t *image,
+                        cbmfm_dir_visitor_t visitor,
+                        void *data)
+{
+    const cbmfm_dir_t *cached;
     cbmfm_dirent_t dirent;
-    uint8_t *data;
+    const uint8_t *ptr;
+    const uint8_t *end;
+    size_t offset;
     uint16_t index;
 
-    dir = cbmfm_dir_new();
-    data = image->dir_start;
+    cached = cbmfm_image_dir_cache_peek((const cbmfm_image_t *)image);
+    if (cached != NULL) {
+        return cbmfm_dir_visit(cached, visitor, data);
+    }
+
+    ptr = image->dir_start;
+    end = image->data + image->size;
+    /* file data follows the directory blocks */
+    offset = (size_t)image->dir_blocks * CBMFM_BLOCK_SIZE_DATA;
 
     for (index = 0; index < image->dir_used; index++) {
-        int len = cbmfm_lnx_dirent_parse(&dirent, data);
-        if (len < 0) {
-            cbmfm_dir_free(dir);
-            return NULL;
+        if (!cbmfm_lnx_dirent_parse(&dirent, &ptr, end,
+                    index == image->dir_used - 1)) {
+            return -1;
         }
         dirent.index = index;
-        cbmfm_dir_append_dirent(dir, &dirent);
-        data += len;
+        dirent.image = (cbmfm_image_t *)image;
+        dirent.extra.lnx.data_offset = offset;
+
+        /*
+         * Fix bugged entries: seems some Lynx containers have a 'remainder'
+         * value that is one byte to large, making reading data from a final
+         * entry read past valid memory.
+         */
+        if (offset > image->size) {
+            cbmfm_log_warning("entry %u starts past the end of the image\n",
+                    (unsigned int)index);
+            dirent.extra.lnx.data_offset = image->size;
+            dirent.filesize = 0;
+        } else if (dirent.filesize > image->size - offset) {
+            cbmfm_log_warning("adjusting file size from %zu to %zu\n",
+                    dirent.filesize, image->size - offset);
+            dirent.filesize = image->size - offset;
+        }
+
+        if (!visitor(&dirent, data)) {
+            return index + 1;
+        }
+        offset += (size_t)dirent.size_blocks * CBMFM_BLOCK_SIZE_DATA;
     }
-    dir->image = (cbmfm_image_t *)image;
-    return dir;
+    return index;
 }
 
 
-/** \brief  Read file from Lynx dir
+/** \brief  Get a view of file \a index in \a dir without copying its data
  *
- * Reads file data from a Lynx image via \a dir and stores it in \a file. The
- * reason for using a directory rather than directly accessing the Lynx image
- * has to do with the incredibly crappy directory structure of Lynx images.
+ * The file data borrows from the image of \a dir and is valid while the image
+ * is open and unmodified.
  *
  * \param[in]   dir     Lynx directory
  * \param[out]  file    file object
@@ -404,55 +555,52 @@ cbmfm_dir_t *cbmfm_lnx_dir_read(cbmfm_lnx_t *image)
  *
  * \throw   #CBMFM_ERR_INDEX
  */
-bool cbmfm_lnx_file_read(cbmfm_dir_t *dir, cbmfm_file_t *file, uint16_t index)
+bool cbmfm_lnx_file_view(cbmfm_dir_t *dir, cbmfm_file_t *file, uint16_t index)
 {
     cbmfm_lnx_t *image;
     cbmfm_dirent_t *dirent;
-    uint16_t idx;
-    uint8_t *data;
-    size_t filesize;
 
     if (index >= dir->entry_used) {
-        cbmfm_errno = CBMFM_ERR_INDEX;
+        cbmfm_error_set(CBMFM_ERR_INDEX, NULL, -1);
         return false;
     }
 
     image = (cbmfm_lnx_t *)(dir->image);
+    dirent = &(dir->entries[index]);
 
-    /* get pointer to file data section */
-    data = image->data + CBMFM_BLOCK_SIZE_DATA * image->dir_blocks;
+    cbmfm_log_debug("offset in image = %zu\n", dirent->extra.lnx.data_offset);
 
+    /* offset and size were checked against the image size when parsing */
     cbmfm_file_init(file);
+    cbmfm_file_borrow(file, image->data + dirent->extra.lnx.data_offset,
+            dirent->filesize);
+    memcpy(file->name, dirent->filename, CBMFM_CBMDOS_FILE_NAME_LEN);
+    file->type = dirent->filetype;
 
-    idx = 0;
-    while (idx < index) {
-        dirent = dir->entries[idx];
-
-        data += dirent->size_blocks * CBMFM_BLOCK_SIZE_DATA;
-        idx++;
-    }
-    dirent = dir->entries[idx];
+    return true;
+}
 
-    cbmfm_log_debug("offset in image = %zu\n", (size_t)(data - image->data));
 
-    /*
-     * Fix bugged entries: seems some Lynx containers have a 'remainder' value
-     * that is one byte to large, making reading data from a final entry
-     * read past valid memory.
-     */
-    filesize = dirent->filesize;
-    if ((size_t)(data - image->data) + filesize > image->size) {
-        cbmfm_log_warning("adjusting file size from %zu to %zu\n",
-                filesize, image->size - (size_t)(data - image->data));
-        filesize = image->size - (size_t)(data - image->data);
+/** \brief  Read file from Lynx dir
+ *
+ * Reads file data from a Lynx image via \a dir and stores it in \a file. The
+ * reason for using a directory rather than directly accessing the Lynx image
+ * has to do with the incredibly crappy directory structure of Lynx images.
+ *
+ * \param[in]   dir     Lynx directory
+ * \param[out]  file    file object
+ * \param[in]   index   index in \a dir
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_INDEX
+ */
+bool cbmfm_lnx_file_read(cbmfm_dir_t *dir, cbmfm_file_t *file, uint16_t index)
+{
+    if (!cbmfm_lnx_file_view(dir, file, index)) {
+        return false;
     }
-
-    /* store data in file object */
-    file->size = filesize;
-    file->data = cbmfm_memdup(data, filesize);
-    memcpy(file->name, dirent->filename, CBMFM_CBMDOS_FILE_NAME_LEN);
-    file->type = dirent->filetype;
-
+    cbmfm_file_own(file);
     return true;
 }
 
@@ -474,8 +622,8 @@ bool cbmfm_lnx_file_extract(cbmfm_dir_t *dir,
     cbmfm_file_t file;
     bool result;
 
-    /* read fiile data */
-    if (!cbmfm_lnx_file_read(dir, &file, index)) {
+    /* get view of file data */
+    if (!cbmfm_lnx_file_view(dir, &file, index)) {
         return false;
     }
 
@@ -487,6 +635,36 @@ bool cbmfm_lnx_file_extract(cbmfm_dir_t *dir,
 
 
 
+/** \brief  Probe data in \a probe for the Lynx format
+ *
+ * Checks the minimum size, the load address and searches for 'LYNX' in the
+ * header, without reading past the probe's header data.
+ *
+ * \param[in]   probe   probe object
+ *
+ * \return  score
+ */
+int cbmfm_lnx_probe(const cbmfm_probe_t *probe)
+{
+    const uint8_t *header = probe->header;
+    size_t i;
+
+    if (probe->header_len < CBMFM_LNX_MIN_SIZE) {
+        return CBMFM_PROBE_SCORE_NONE;
+    }
+    if (header[0] != (CBMFM_LNX_LOAD_ADDR & 0xff)
+            || header[1] != (CBMFM_LNX_LOAD_ADDR >> 8)) {
+        return CBMFM_PROBE_SCORE_NONE;
+    }
+    for (i = 0x30; i + 4 <= probe->header_len; i++) {
+        if (memcmp(header + i, "LYNX", 4) == 0) {
+            return CBMFM_PROBE_SCORE_SIGNATURE;
+        }
+    }
+    return CBMFM_PROBE_SCORE_NONE;
+}
+
+
 /** \brief  Determine if \a filename is a Lynx archive
  *
  * First checks the file is the minimum required size for a Lynx archive, the
@@ -503,35 +681,17 @@ bool cbmfm_lnx_file_extract(cbmfm_dir_t *dir,
  */
 bool cbmfm_is_lnx(const char *filename)
 {
-    uint8_t *header;
-    intmax_t size;
-    char *s;
+    cbmfm_probe_t probe;
+    int score;
 
-    size = cbmfm_read_file_fixed(&header, CBMFM_LNX_MIN_SIZE, filename);
-    if (size < 0) {
+    if (!cbmfm_probe_open(&probe, filename)) {
         return false;
     }
-    if (size < CBMFM_LNX_MIN_SIZE) {
-        cbmfm_errno = CBMFM_ERR_SIZE_MISMATCH;
-        cbmfm_free(header);
+    score = cbmfm_lnx_probe(&probe);
+    cbmfm_probe_close(&probe);
+    if (score == CBMFM_PROBE_SCORE_NONE) {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
         return false;
     }
-
-    /* check load address */
-    if (header[0] != 0x01 || header[1] != 0x08) {
-        cbmfm_errno = CBMFM_ERR_INVALID_DATA;
-        cbmfm_free(header);
-        return false;
-    }
-
-    /* try to locate the string 'LYNX' */
-    s = strstr((const char *)(header + 0x30), "LYNX");
-    if (s == NULL) {
-        cbmfm_errno = CBMFM_ERR_INVALID_DATA;
-        cbmfm_free(header);
-        return false;
-    }
-
-    cbmfm_free(header);
     return true;
 }
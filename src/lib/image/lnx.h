@@ -68,6 +68,7 @@
 
 
 bool cbmfm_is_lnx(const char *filename);
+int  cbmfm_lnx_probe(const cbmfm_probe_t *probe);
 
 
 cbmfm_lnx_t *   cbmfm_lnx_alloc(void);
@@ -78,9 +79,17 @@ void            cbmfm_lnx_free(cbmfm_lnx_t *image);
 
 
 bool            cbmfm_lnx_open(cbmfm_lnx_t *image, const char *path);
+bool            cbmfm_lnx_open_mapped(cbmfm_lnx_t *image, const char *path);
+bool            cbmfm_lnx_open_probe(cbmfm_lnx_t *image, cbmfm_probe_t *probe);
 void            cbmfm_lnx_dump(const cbmfm_lnx_t *image);
 cbmfm_dir_t *   cbmfm_lnx_dir_read(cbmfm_lnx_t *image);
+int             cbmfm_lnx_dir_visit(cbmfm_lnx_t *image,
+                                    cbmfm_dir_visitor_t visitor,
+                                    void *data);
 
+bool            cbmfm_lnx_file_view(cbmfm_dir_t *dir,
+                                    cbmfm_file_t *file,
+                                    uint16_t index);
 bool            cbmfm_lnx_file_read(cbmfm_dir_t *dir,
                                     cbmfm_file_t *file,
                                     uint16_t index);
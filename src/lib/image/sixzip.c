@@ -0,0 +1,363 @@
+/* vim: set et ts=4 sw=4 sts=4 fdm=marker syntax=c.doxygen : */
+
+/** \file   src/lib/image/sixzip.c
+ * \brief   Six-zip disk (6-file) handling
+ *
+ * A six-zipped disk consists of six files, `1!!name` to `6!!name`, each
+ * holding the raw GCR data of a range of tracks of a 40-track disk.
+ *
+ * Each file starts with the load address, followed by an entry per track.
+ * An entry starts with a 256-byte page with the GCR-encoded block headers at
+ * offset 1, in sector order, followed by 326 bytes per block. The GCR data
+ * block is stored rotated: its last 69 bytes come first, followed by a gap
+ * byte and the first 256 bytes. The final byte of the last block of a track
+ * overlaps the unused first byte of the next entry, or is the final byte of
+ * the file.
+ *
+ * \author  Bas Wassink <b.wassink@ziggo.nl>
+ */
+/*
+ *  CbmFM - a file manager for CBM 8-bit emulation files
+ *  Copyright (C) 2018  Bas Wassink <b.wassink@ziggo.nl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "cbmfm_types.h"
+#include "lib/base/dxx.h"
+#include "lib/base/errors.h"
+#include "lib/base/image.h"
+#include "lib/base/io.h"
+#include "lib/base/log.h"
+#include "lib/base/mem.h"
+#include "d64.h"
+
+#include "sixzip.h"
+
+
+/** \brief  Track range of each file of a six-zipped disk
+ */
+static const struct {
+    int trk_lo;     /**< first track */
+    int trk_hi;     /**< last track */
+} sixzip_parts[CBMFM_SIXZIP_FILES] = {
+    {  1,  6 },
+    {  7, 12 },
+    { 13, 18 },
+    { 19, 25 },
+    { 26, 32 },
+    { 33, 40 }
+};
+
+
+/** \brief  Size of the GCR data block tail stored before the gap byte
+ */
+#define SIXZIP_GCR_TAIL     (CBMFM_SIXZIP_GCR_DATA - CBMFM_BLOCK_SIZE_RAW)
+
+
+/** \brief  GCR decoding table, 0xff for invalid codes
+ */
+static const uint8_t sixzip_gcr_table[32] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x08, 0x00, 0x01, 0xff, 0x0c, 0x04, 0x05,
+    0xff, 0xff, 0x02, 0x03, 0xff, 0x0f, 0x06, 0x07,
+    0xff, 0x09, 0x0a, 0x0b, 0xff, 0x0d, 0x0e, 0xff
+};
+
+
+/** \brief  Decode \a size bytes of GCR data
+ *
+ * Only the GCR codes making up the \a size bytes are read, so any trailing
+ * bytes of a partial group, like the off bytes of a data block, are ignored.
+ *
+ * \param[out]  dst     decoded data
+ * \param[in]   src     GCR data
+ * \param[in]   size    number of bytes to decode
+ *
+ * \return  false if \a src contains an invalid GCR code
+ */
+static bool sixzip_gcr_decode(uint8_t *dst, const uint8_t *src, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size * 2; i++) {
+        size_t bit = i * 5;
+        unsigned int window = (unsigned int)src[bit / 8] << 8;
+        uint8_t nybble;
+
+        /* codes starting past bit 3 of a byte continue in the next one */
+        if (bit % 8 > 3) {
+            window |= src[bit / 8 + 1];
+        }
+        nybble = sixzip_gcr_table[(window >> (11 - bit % 8)) & 0x1f];
+        if (nybble > 0x0f) {
+            return false;
+        }
+        if (i & 1) {
+            dst[i / 2] = (uint8_t)(dst[i / 2] | nybble);
+        } else {
+            dst[i / 2] = (uint8_t)(nybble << 4);
+        }
+    }
+    return true;
+}
+
+
+/** \brief  Decode a track entry into the image
+ *
+ * \param[in,out]   image   d64 image
+ * \param[in,out]   covered coverage map, indexed by block number
+ * \param[in]       data    file data
+ * \param[in]       size    size of \a data
+ * \param[in,out]   pos     position of the entry in \a data, updated to the
+ *                          position of the next entry
+ * \param[in]       track   track number
+ *
+ * \return  true on success
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
+ */
+static bool sixzip_decode_track(cbmfm_d64_t *image,
+                                uint8_t *covered,
+                                const uint8_t *data,
+                                size_t size,
+                                size_t *pos,
+                                int track)
+{
+    int blocks = cbmfm_dxx_track_block_count((cbmfm_dxx_image_t *)image,
+            track);
+    size_t next = *pos + CBMFM_SIXZIP_TRACK_HEADER
+        + (size_t)blocks * CBMFM_SIXZIP_GCR_BLOCK;
+    int i;
+
+    /* the last block ends at the first byte of the next entry */
+    if (blocks < 0 || next >= size) {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA, "truncated six-zip file",
+                (intmax_t)*pos);
+        return false;
+    }
+
+    for (i = 0; i < blocks; i++) {
+        const uint8_t *gcr_hdr = data + *pos + 1 + i * CBMFM_SIXZIP_GCR_HEADER;
+        const uint8_t *gcr_blk = data + *pos + CBMFM_SIXZIP_TRACK_HEADER
+            + i * CBMFM_SIXZIP_GCR_BLOCK;
+        uint8_t gcr[CBMFM_SIXZIP_GCR_DATA];
+        uint8_t hdr[6];
+        uint8_t blk[CBMFM_BLOCK_SIZE_RAW + 2];
+        uint8_t checksum;
+        intmax_t offset;
+        int b;
+
+        if (!sixzip_gcr_decode(hdr, gcr_hdr, sizeof hdr)
+                || hdr[0] != 0x08 || hdr[3] != track
+                || hdr[1] != (hdr[2] ^ hdr[3] ^ hdr[4] ^ hdr[5])) {
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA, "invalid block header",
+                    (intmax_t)(gcr_hdr - data));
+            return false;
+        }
+        offset = cbmfm_dxx_image_block_offset(
+                (const cbmfm_dxx_image_t *)image, track, hdr[2]);
+        if (offset < 0) {
+            cbmfm_error_set(cbmfm_errno, "illegal block",
+                    (intmax_t)(gcr_hdr - data));
+            return false;
+        }
+        if (covered[offset / CBMFM_BLOCK_SIZE_RAW]) {
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA, "duplicate block header",
+                    (intmax_t)(gcr_hdr - data));
+            return false;
+        }
+
+        /* undo the rotation of the GCR data block */
+        memcpy(gcr, gcr_blk + SIXZIP_GCR_TAIL + 2, CBMFM_BLOCK_SIZE_RAW);
+        memcpy(gcr + CBMFM_BLOCK_SIZE_RAW, gcr_blk + 1, SIXZIP_GCR_TAIL);
+        if (!sixzip_gcr_decode(blk, gcr, sizeof blk) || blk[0] != 0x07) {
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA, "invalid data block",
+                    (intmax_t)(gcr_blk - data));
+            return false;
+        }
+        checksum = 0;
+        for (b = 1; b <= CBMFM_BLOCK_SIZE_RAW; b++) {
+            checksum ^= blk[b];
+        }
+        if (checksum != blk[CBMFM_BLOCK_SIZE_RAW + 1]) {
+            cbmfm_log_error("checksum error in block (%d,%d)\n",
+                    track, hdr[2]);
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA, "data block checksum error",
+                    (intmax_t)(gcr_blk - data));
+            return false;
+        }
+
+        memcpy(image->data + offset, blk + 1, CBMFM_BLOCK_SIZE_RAW);
+        covered[offset / CBMFM_BLOCK_SIZE_RAW] = 1;
+    }
+
+    *pos = next;
+    return true;
+}
+
+
+/** \brief  Decode the track entries of a single file into the image
+ *
+ * \param[in,out]   image   d64 image
+ * \param[in,out]   covered coverage map, indexed by block number
+ * \param[in]       data    file data
+ * \param[in]       size    size of \a data
+ * \param[in]       part    index in #sixzip_parts
+ *
+ * \return  true on success
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
+ */
+static bool sixzip_decode(cbmfm_d64_t *image,
+                          uint8_t *covered,
+                          const uint8_t *data,
+                          size_t size,
+                          int part)
+{
+    size_t pos = 2;
+    int track;
+
+    if (size < pos || cbmfm_word_get_le(data) != CBMFM_SIXZIP_LOAD) {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                "invalid six-zip file header", 0);
+        return false;
+    }
+
+    for (track = sixzip_parts[part].trk_lo;
+            track <= sixzip_parts[part].trk_hi; track++) {
+        if (!sixzip_decode_track(image, covered, data, size, &pos, track)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/** \brief  Get offset of the 'N!!' prefix in the filename part of \a path
+ *
+ * \param[in]   path    path to one of the files of a six-zipped disk
+ * \param[out]  prefix  offset in \a path of the prefix
+ *
+ * \return  true if \a path has a valid prefix
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+static bool sixzip_name_prefix(const char *path, size_t *prefix)
+{
+    const char *name;
+
+    name = strrchr(path, '/');
+#ifdef CBMFM_HOST_WINDOWS
+    if (name == NULL) {
+        name = strrchr(path, '\\');
+    }
+#endif
+    name = name != NULL ? name + 1 : path;
+    if (name[0] < '1' || name[0] > '0' + CBMFM_SIXZIP_FILES
+            || name[1] != '!' || name[2] != '!') {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                "not a six-zip disk file name", -1);
+        return false;
+    }
+    *prefix = (size_t)(name - path);
+    return true;
+}
+
+
+/** \brief  Unpack six-zipped disk into a D64 image
+ *
+ * Takes the path to any of the six files of a six-zipped disk (`1!!name` to
+ * `6!!name`), and decodes all six into \a image, which is formatted first.
+ * The files are processed one at a time, each block being decoded from its
+ * GCR data straight into the image, at the sector given by its block header.
+ *
+ * When \a image has no data yet, a 40-track image is allocated. Otherwise
+ * its data is reused and must hold at least 40 tracks.
+ *
+ * On failure the contents of \a image are undefined.
+ *
+ * \param[in,out]   image   d64 image, initialized with cbmfm_d64_init()
+ * \param[in]       path    path to one of the files of the six-zipped disk
+ *
+ * \return  true on success
+ *
+ * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_READONLY
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
+ */
+bool cbmfm_sixzip_unpack(cbmfm_d64_t *image, const char *path)
+{
+    uint8_t covered[CBMFM_D64_BLOCK_COUNT_EXT];
+    char *name;
+    size_t prefix;
+    bool result = true;
+    int i;
+
+    if (!sixzip_name_prefix(path, &prefix)) {
+        return false;
+    }
+    if (image->data != NULL && image->track_max < CBMFM_D64_TRACK_MAX_EXT) {
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_TRACK, NULL, -1);
+        return false;
+    }
+
+    if (!cbmfm_d64_format(image, NULL, NULL, true)) {
+        return false;
+    }
+    memset(covered, 0, sizeof covered);
+
+    name = cbmfm_strdup(path);
+    for (i = 0; result && i < CBMFM_SIXZIP_FILES; i++) {
+        uint8_t *data;
+        intmax_t size;
+        bool mapped;
+
+        name[prefix] = (char)('1' + i);
+        size = cbmfm_map_file(&data, name, &mapped);
+        if (size < 0) {
+            result = false;
+        } else {
+            result = sixzip_decode(image, covered, data, (size_t)size, i);
+            if (mapped) {
+                cbmfm_unmap_file(data, (size_t)size);
+            } else {
+                cbmfm_free(data);
+            }
+        }
+        if (!result) {
+            cbmfm_log_error("failed to process '%s'\n", name);
+        }
+    }
+    cbmfm_free(name);
+
+    /* the BAM was overwritten, rebuild the mirror on next use */
+    image->bam_synced = false;
+    cbmfm_image_set_dirty((cbmfm_image_t *)image, true);
+    return result;
+}
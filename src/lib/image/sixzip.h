@@ -0,0 +1,70 @@
+/* vim: set et ts=4 sw=4 sts=4 fdm=marker syntax=c.doxygen : */
+
+/** \file   src/lib/image/sixzip.h
+ * \brief   Six-zip disk (6-file) handling - header
+ *
+ * \author  Bas Wassink <b.wassink@ziggo.nl>
+ */
+
+/*
+ *  CbmFM - a file manager for CBM 8-bit emulation files
+ *  Copyright (C) 2018  Bas Wassink <b.wassink@ziggo.nl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
+ */
+
+#ifndef CBMFM_LIB_IMAGE_SIXZIP_H
+#define CBMFM_LIB_IMAGE_SIXZIP_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "cbmfm_types.h"
+
+
+/** \brief  Number of files of a six-zipped disk
+ */
+#define CBMFM_SIXZIP_FILES          6
+
+/** \brief  Load address of the files of a six-zipped disk
+ */
+#define CBMFM_SIXZIP_LOAD           0x03ff
+
+/** \brief  Size of the header page of each track
+ *
+ * The page holds the GCR-encoded block headers of the track.
+ */
+#define CBMFM_SIXZIP_TRACK_HEADER   0x100
+
+/** \brief  Size of a GCR-encoded block header
+ */
+#define CBMFM_SIXZIP_GCR_HEADER     10
+
+/** \brief  Size of a GCR-encoded data block
+ *
+ * 260 bytes: data block marker, 256 data bytes, checksum and two off bytes.
+ */
+#define CBMFM_SIXZIP_GCR_DATA       325
+
+/** \brief  Size of the GCR data of a block in a six-zip file
+ *
+ * The GCR data block plus a gap byte.
+ */
+#define CBMFM_SIXZIP_GCR_BLOCK      (CBMFM_SIXZIP_GCR_DATA + 1)
+
+
+bool cbmfm_sixzip_unpack(cbmfm_d64_t *image, const char *path);
+
+#endif
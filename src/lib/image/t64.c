@@ -204,6 +204,44 @@ bool cbmfm_t64_open(cbmfm_t64_t *image, const char *path)
 }
 
 
+/** \brief  Map data from \a path read-only into \a image
+ *
+ * Opens \a path without copying its data, see cbmfm_image_map_data().
+ *
+ * \param[in,out]   image   t64 image
+ * \param[in]       path    path to image data
+ *
+ * \return  bool
+ */
+bool cbmfm_t64_open_mapped(cbmfm_t64_t *image, const char *path)
+{
+    if (!cbmfm_image_map_data((cbmfm_image_t *)image, path)) {
+        return false;
+    }
+    cbmfm_t64_parse_header(image);
+    return true;
+}
+
+
+/** \brief  Open T64 image through \a probe
+ *
+ * Reads the image data from the file handle left open by cbmfm_probe_open().
+ *
+ * \param[in,out]   image   t64 image
+ * \param[in,out]   probe   probe object
+ *
+ * \return  bool
+ */
+bool cbmfm_t64_open_probe(cbmfm_t64_t *image, cbmfm_probe_t *probe)
+{
+    if (!cbmfm_image_read_probe((cbmfm_image_t *)image, probe)) {
+        return false;
+    }
+    cbmfm_t64_parse_header(image);
+    return true;
+}
+
+
 /** \brief  Dump T64 header data on stdout
  *
  * \param[in]   image   t64 image
@@ -278,7 +316,7 @@ bool cbmfm_t64_dirent_parse(cbmfm_t64_t *image,
     cbmfm_dirent_t64_t *extra = &(dirent->extra.t64);
 
     if (index >= image->entry_used) {
-        cbmfm_errno = CBMFM_ERR_INDEX;
+        cbmfm_error_set(CBMFM_ERR_INDEX, NULL, -1);
         return false;
     }
 
@@ -307,59 +345,42 @@ bool cbmfm_t64_dirent_parse(cbmfm_t64_t *image,
 }
 
 
-/** \brief  Function for qsort(), sorting on data offset
- *
- * \param[in]   p1  pointer to first element
- * \param[in]   p2  pointer to secend element
- *
- * \return  -1 when offset(p1) < offset(p2), 0 when offset(p1), == offset(p2),
- *          +1 when offset(p1) > offset(p2)
+/** \brief  Sort key used to repair a T64 directory
  */
-static int compar_offset(const void *p1, const void *p2)
-{
-    const cbmfm_dirent_t *d1 = *(const cbmfm_dirent_t * const *)p1;
-    const cbmfm_dirent_t *d2 = *(const cbmfm_dirent_t * const *)p2;
-
-    cbmfm_log_debug("d1 offset = $%" PRIx32 ", d2 offset = $%" PRIx32 "\n",
-            d1->extra.t64.data_offset, d2->extra.t64.data_offset);
-
-    if (d1->extra.t64.data_offset < d2->extra.t64.data_offset) {
-        return -1;
-    } else if (d1->extra.t64.data_offset > d2->extra.t64.data_offset) {
-        return 1;
-    } else {
-        return 0;
-    }
-}
+typedef struct t64_fix_key_s {
+    uint32_t    offset;     /**< offset in image of file data */
+    size_t      pos;        /**< position of entry in the directory */
+} t64_fix_key_t;
 
 
-/** \brief  Function for qsort(), sorting on directory index
+/** \brief  Function for qsort(), sorting on data offset, then position
  *
  * \param[in]   p1  pointer to first element
  * \param[in]   p2  pointer to secend element
  *
- * \return  -1 when index(p1) < index(p2), 0 when index(p1), == index(p2),
- *          +1 when index(p1) > index(p2)
+ * \return  -1 when key(p1) < key(p2), 0 when key(p1) == key(p2),
+ *          +1 when key(p1) > key(p2)
  */
-static int compar_index(const void *p1, const void *p2)
+static int compar_offset(const void *p1, const void *p2)
 {
-    const cbmfm_dirent_t *d1 = *(const cbmfm_dirent_t * const *)p1;
-    const cbmfm_dirent_t *d2 = *(const cbmfm_dirent_t * const *)p2;
-
-    cbmfm_log_debug("d1 index = $%" PRIx32 ", d2 offset = $%" PRIx32 "\n",
-            d1->index, d2->index);
+    const t64_fix_key_t *k1 = p1;
+    const t64_fix_key_t *k2 = p2;
 
-    if (d1->index < d2->index) {
-        return -1;
-    } else if (d1->index > d2->index) {
-        return 1;
-    } else {
-        return 0;
+    if (k1->offset != k2->offset) {
+        return k1->offset < k2->offset ? -1 : 1;
+    }
+    if (k1->pos != k2->pos) {
+        return k1->pos < k2->pos ? -1 : 1;
     }
+    return 0;
 }
 
 
 /** \brief  Fix possible corruption in \a dir
+ *
+ * The entries are visited in order of their data offset through a sorted
+ * array of keys, leaving the order of the entries in \a dir alone. The keys
+ * are only sorted when the entries aren't already in offset order.
  *
  * \param[in,out]   dir t64 directory
  *
@@ -368,24 +389,38 @@ static int compar_index(const void *p1, const void *p2)
 static int cbmfm_t64_fix_dir(cbmfm_dir_t *dir)
 {
     cbmfm_t64_t *image = (cbmfm_t64_t *)(dir->image);
+    t64_fix_key_t *keys;
     size_t rep_size;    /* reported size */
     size_t act_size;    /* actual size */
+    size_t count = dir->entry_used;
+    size_t i;
+    bool sorted = true;
     int fixes = 0;
-    uint16_t index;
 
     if (image->entry_max == 0) {
         cbmfm_log_warning("adjusting dir max entry count from 0 to 1\n");
         fixes++;
         image->entry_max = 1;
     }
+    if (count == 0) {
+        return fixes;
+    }
 
     /* sort entries based on data-offset */
-    qsort(dir->entries, (size_t)(dir->entry_used),
-            sizeof(cbmfm_dirent_t *), compar_offset);
+    keys = cbmfm_malloc(count * sizeof *keys);
+    for (i = 0; i < count; i++) {
+        keys[i].offset = dir->entries[i].extra.t64.data_offset;
+        keys[i].pos = i;
+        if (i > 0 && keys[i].offset < keys[i - 1].offset) {
+            sorted = false;
+        }
+    }
+    if (!sorted) {
+        qsort(keys, count, sizeof *keys, compar_offset);
+    }
 
-    for (index = 0; index < image->entry_used; index++) {
-        cbmfm_dirent_t *dirent = dir->entries[index];
-        cbmfm_dirent_t *next = NULL;
+    for (i = 0; i < count; i++) {
+        cbmfm_dirent_t *dirent = &(dir->entries[keys[i].pos]);
         cbmfm_dirent_t64_t *t64 = &(dirent->extra.t64);
 
         /* skip C64s FRZ files */
@@ -393,21 +428,16 @@ static int cbmfm_t64_fix_dir(cbmfm_dir_t *dir)
             continue;
         }
 
-        /* get next entry to compare against */
-        if (index < dir->entry_used - 1) {
-            next = dir->entries[index + 1];
-        } else {
-            next = NULL;
-        }
-
         /* get size according to directory entries */
         rep_size = (size_t)(t64->end_addr - t64->load_addr);
 
-        /* determine actual size */
-        if (next != NULL) {
-            act_size = next->extra.t64.data_offset - t64->data_offset;
-        } else {
+        /* determine actual size from the next entry or the image size */
+        if (i < count - 1) {
+            act_size = keys[i + 1].offset - t64->data_offset;
+        } else if (image->size > t64->data_offset) {
             act_size = image->size - t64->data_offset;
+        } else {
+            act_size = 0;
         }
         cbmfm_log_debug("load = $%04x, end = $%04x, reported size = $%04x, "
                 "actual size = $%04x\n",
@@ -417,7 +447,7 @@ static int cbmfm_t64_fix_dir(cbmfm_dir_t *dir)
         if (act_size != rep_size) {
             cbmfm_log_debug("got invalid end address, fixing\n");
 
-            if (index == dir->entry_max -1 && rep_size < act_size) {
+            if (i == count - 1 && rep_size < act_size) {
                 /* don't fix last record when actual size is larger, some
                  * T64's appear to have padding for the last record */
                 continue;
@@ -429,14 +459,8 @@ static int cbmfm_t64_fix_dir(cbmfm_dir_t *dir)
         /* set proper filesize and size_blocks */
         dirent->filesize = (size_t)(t64->end_addr - t64->load_addr + 2);
         dirent->size_blocks = cbmfm_size_to_blocks(dirent->filesize);
-
     }
-
-
-
-    /* return directory to original state by sorting on index */
-    qsort(dir->entries, (size_t)(dir->entry_used),
-            sizeof(cbmfm_dirent_t *), compar_index);
+    cbmfm_free(keys);
 
     if (fixes > 0) {
         cbmfm_log_debug("fixed %d errors\n", fixes);
@@ -447,6 +471,39 @@ static int cbmfm_t64_fix_dir(cbmfm_dir_t *dir)
 }
 
 
+/** \brief  Parse each entry of \a image and hand it to \a visitor
+ *
+ * The entries are reported as found in the image, without repairs.
+ *
+ * \param[in]       image   t64 image
+ * \param[in]       visitor visitor callback, return false to stop
+ * \param[in,out]   data    data for \a visitor
+ *
+ * \return  number of entries visited or -1 on error
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+static int t64_visit_entries(cbmfm_t64_t *image,
+                             cbmfm_dir_visitor_t visitor,
+                             void *data)
+{
+    uint16_t index;
+
+    for (index = 0; index < image->entry_used; index++) {
+        cbmfm_dirent_t dirent;
+
+        cbmfm_log_debug("parsing entry %" PRIx16 "\n", index);
+        if (!cbmfm_t64_dirent_parse(image, &dirent, index)) {
+            return -1;
+        }
+        if (!visitor(&dirent, data)) {
+            return index + 1;
+        }
+    }
+    return index;
+}
+
+
 /** \brief  Read directory of \a image
  *
  * This function reads the directory of \a image and tries to fix any corruption
@@ -457,71 +514,113 @@ static int cbmfm_t64_fix_dir(cbmfm_dir_t *dir)
  * \return  directory or `NULL` on failure
  *
  * \note    The caller is responsible for calling cbmfm_dir_free() on the
- *          returned pointer to free memory used by the directory.
+ *          returned pointer to free memory used by the directory. The parsed
+ *          directory is cached in \a image until the image is modified.
  */
 cbmfm_dir_t *cbmfm_t64_read_dir(cbmfm_t64_t *image)
 {
     cbmfm_dir_t *dir;
-    uint16_t index;
-
-    dir = cbmfm_dir_new();
-    dir->image = (cbmfm_image_t *)image;
 
-    for (index = 0; index < image->entry_used; index++) {
-        cbmfm_dirent_t dirent;
+    dir = cbmfm_image_dir_cache_get((cbmfm_image_t *)image);
+    if (dir != NULL) {
+        return dir;
+    }
 
-        cbmfm_log_debug("parsing entry %" PRIx16 "\n", index);
-        if (!cbmfm_t64_dirent_parse(image, &dirent, index)) {
-            cbmfm_dir_free(dir);
-            return NULL;
-        }
+    dir = cbmfm_dir_new_size(image->entry_used);
+    dir->image = (cbmfm_image_t *)image;
 
-        cbmfm_dir_append_dirent(dir, &dirent);
+    if (t64_visit_entries(image, cbmfm_dir_append_visitor, dir) < 0) {
+        cbmfm_dir_free(dir);
+        return NULL;
     }
 
     /* now fix the end addres fields */
     cbmfm_t64_fix_dir(dir);
+    cbmfm_image_dir_cache_set((cbmfm_image_t *)image, dir);
     return dir;
 }
 
 
-/** \brief  Read file from \a dir into \a file
+/** \brief  Call \a visitor for each entry in the directory of \a image
+ *
+ * Repairing the end addresses requires the data offsets of all entries, so
+ * the entries are visited through the directory cached in \a image, which is
+ * read with cbmfm_t64_read_dir() first if required. The visited entries are
+ * identical to the ones returned by cbmfm_t64_read_dir().
+ *
+ * \param[in]       image   t64 image
+ * \param[in]       visitor visitor callback, return false to stop
+ * \param[in,out]   data    data for \a visitor
+ *
+ * \return  number of entries visited or -1 on error
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+int cbmfm_t64_visit_dir(cbmfm_t64_t *image,
+                        cbmfm_dir_visitor_t visitor,
+                        void *data)
+{
+    const cbmfm_dir_t *cached;
+    cbmfm_dir_t *dir;
+    int result;
+
+    cached = cbmfm_image_dir_cache_peek((const cbmfm_image_t *)image);
+    if (cached != NULL) {
+        return cbmfm_dir_visit(cached, visitor, data);
+    }
+
+    dir = cbmfm_t64_read_dir(image);
+    if (dir == NULL) {
+        return -1;
+    }
+    result = cbmfm_dir_visit(dir, visitor, data);
+    cbmfm_dir_free(dir);
+    return result;
+}
+
+
+/** \brief  Get a view of file \a index in \a dir without copying its data
+ *
+ * The file data borrows from the image of \a dir and is preceded by the load
+ * address as prefix, since T64 images strip it from the file data. The view is
+ * valid while the image is open and unmodified.
  *
  * \param[in]   dir     t64 directory
  * \param[out]  file    file object
  * \param[in]   index   index of file in \a dir
  *
- * \return  bool (false if \a index is too large)
+ * \return  bool
  *
  * \throw   #CBMFM_ERR_INDEX
+ * \throw   #CBMFM_ERR_INVALID_DATA
  */
-bool cbmfm_t64_read_file(cbmfm_dir_t *dir, cbmfm_file_t *file, uint16_t index)
+bool cbmfm_t64_file_view(cbmfm_dir_t *dir, cbmfm_file_t *file, uint16_t index)
 {
     cbmfm_t64_t *image;
     cbmfm_dirent_t *dirent;
-    uint8_t *data;
-    uint8_t *ptr;
 
     if (index >= dir->entry_used) {
-        cbmfm_errno = CBMFM_ERR_INDEX;
+        cbmfm_error_set(CBMFM_ERR_INDEX, NULL, -1);
         return false;
     }
 
     image = (cbmfm_t64_t *)(dir->image);
-    dirent = dir->entries[index];
-    ptr = image->data + dirent->extra.t64.data_offset;
+    dirent = &(dir->entries[index]);
+    if (dirent->filesize < 2
+            || dirent->extra.t64.data_offset > image->size
+            || dirent->filesize - 2 > image->size
+                - dirent->extra.t64.data_offset) {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA, NULL, -1);
+        return false;
+    }
 
-    /* allocate memory for data and copy data */
-    data = cbmfm_malloc(dirent->filesize);
+    cbmfm_file_init(file);
+    cbmfm_file_borrow(file, image->data + dirent->extra.t64.data_offset,
+            dirent->filesize - 2);
     /* the file data in the T64 has its load address stripped off, so lets
      * restore it */
-    cbmfm_word_set_le(data, dirent->extra.t64.load_addr);
-    /* copy remaining data */
-    memcpy(data + 2, ptr, dirent->filesize - 2);
-
-    cbmfm_file_init(file);
-    file->data = data;
-    file->size = dirent->filesize;
+    cbmfm_word_set_le(file->prefix, dirent->extra.t64.load_addr);
+    file->prefix_len = 2;
     file->type = dirent->filetype;
     memcpy(file->name, dirent->filename, CBMFM_CBMDOS_FILE_NAME_LEN);
 
@@ -529,6 +628,27 @@ bool cbmfm_t64_read_file(cbmfm_dir_t *dir, cbmfm_file_t *file, uint16_t index)
 }
 
 
+/** \brief  Read file from \a dir into \a file
+ *
+ * \param[in]   dir     t64 directory
+ * \param[out]  file    file object
+ * \param[in]   index   index of file in \a dir
+ *
+ * \return  bool (false if \a index is too large)
+ *
+ * \throw   #CBMFM_ERR_INDEX
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+bool cbmfm_t64_read_file(cbmfm_dir_t *dir, cbmfm_file_t *file, uint16_t index)
+{
+    if (!cbmfm_t64_file_view(dir, file, index)) {
+        return false;
+    }
+    cbmfm_file_own(file);
+    return true;
+}
+
+
 /** \brief  Extract file at \a index in \a dir
  *
  * Save a file in \a dir at \a index to the host file system. When \a name is
@@ -555,7 +675,7 @@ bool cbmfm_t64_extract_file(cbmfm_dir_t *dir,
     cbmfm_file_t file;
     bool result;
 
-    if (!cbmfm_t64_read_file(dir, &file, index)) {
+    if (!cbmfm_t64_file_view(dir, &file, index)) {
         return false;
     }
 
@@ -590,6 +710,24 @@ bool cbmfm_t64_extract_all(cbmfm_dir_t *dir)
 }
 
 
+/** \brief  Probe data in \a probe for the T64 format
+ *
+ * \param[in]   probe   probe object
+ *
+ * \return  score
+ */
+int cbmfm_t64_probe(const cbmfm_probe_t *probe)
+{
+    if (probe->header_len < CBMFM_T64_HDR_SIZE) {
+        return CBMFM_PROBE_SCORE_NONE;
+    }
+    if (!t64_check_magic((const char *)(probe->header))) {
+        return CBMFM_PROBE_SCORE_NONE;
+    }
+    return CBMFM_PROBE_SCORE_SIGNATURE;
+}
+
+
 /** \brief  Determine if \a path could be a T64 archive
  *
  * Check both minimum size of a T64 archive and its magic.
@@ -603,25 +741,19 @@ bool cbmfm_t64_extract_all(cbmfm_dir_t *dir)
  */
 bool cbmfm_is_t64(const char *filename)
 {
-    uint8_t *header;
-    intmax_t size;
-    bool result;
+    cbmfm_probe_t probe;
+    int score;
 
-    /* TODO: make define for 0x60 */
-    size = cbmfm_read_file_fixed(&header, 0x60, filename);
-    if (size < 0) {
+    if (!cbmfm_probe_open(&probe, filename)) {
         return false;
     }
-    if (size < 0x60) {
-        cbmfm_errno = CBMFM_ERR_SIZE_MISMATCH;
-        cbmfm_free(&header);
+    score = cbmfm_t64_probe(&probe);
+    cbmfm_probe_close(&probe);
+    if (score == CBMFM_PROBE_SCORE_NONE) {
+        cbmfm_error_set(CBMFM_ERR_SIZE_MISMATCH, NULL, -1);
         return false;
     }
-
-    result = t64_check_magic((const char *)header);
-    cbmfm_free(header);
-
-    return result;
+    return true;
 }
 
 
@@ -107,6 +107,7 @@
 
 
 bool            cbmfm_is_t64(const char *filename);
+int             cbmfm_t64_probe(const cbmfm_probe_t *probe);
 
 cbmfm_t64_t *   cbmfm_t64_alloc(void);
 void            cbmfm_t64_init(cbmfm_t64_t *image);
@@ -114,6 +115,8 @@ cbmfm_t64_t *   cbmfm_t64_new(void);
 void            cbmfm_t64_cleanup(cbmfm_t64_t *image);
 void            cbmfm_t64_free(cbmfm_t64_t *image);
 bool            cbmfm_t64_open(cbmfm_t64_t *image, const char *path);
+bool            cbmfm_t64_open_mapped(cbmfm_t64_t *image, const char *path);
+bool            cbmfm_t64_open_probe(cbmfm_t64_t *image, cbmfm_probe_t *probe);
 
 
 void            cbmfm_t64_dump_header(const cbmfm_t64_t *image);
@@ -124,8 +127,14 @@ bool            cbmfm_t64_dirent_parse(cbmfm_t64_t *image,
                                        uint16_t index);
 
 cbmfm_dir_t *   cbmfm_t64_read_dir(cbmfm_t64_t *image);
+int             cbmfm_t64_visit_dir(cbmfm_t64_t *image,
+                                    cbmfm_dir_visitor_t visitor,
+                                    void *data);
 
 
+bool            cbmfm_t64_file_view(cbmfm_dir_t *dir,
+                                    cbmfm_file_t *file,
+                                    uint16_t index);
 bool            cbmfm_t64_read_file(cbmfm_dir_t *dir,
                                     cbmfm_file_t *file,
                                     uint16_t index);
@@ -0,0 +1,418 @@
+/* vim: set et ts=4 sw=4 sts=4 fdm=marker syntax=c.doxygen : */
+
+/** \file   src/lib/image/validate.c
+ * \brief   D64 image validation
+ *
+ * \author  Bas Wassink <b.wassink@ziggo.nl>
+ */
+
+/*
+ *  CbmFM - a file manager for CBM 8-bit emulation files
+ *  Copyright (C) 2018  Bas Wassink <b.wassink@ziggo.nl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "cbmfm_types.h"
+#include "lib/base/dxx.h"
+#include "lib/base/errors.h"
+#include "lib/base/image.h"
+#include "lib/base/mem.h"
+#include "lib/image/d64.h"
+
+#include "validate.h"
+
+
+/** \ingroup    lib_image_d64
+ */
+
+
+/** \brief  Number of directory entries in a directory block
+ */
+#define VALIDATE_DIRENTS_PER_BLOCK  (CBMFM_BLOCK_SIZE_RAW / CBMFM_DXX_DIRENT_SIZE)
+
+/** \brief  Block owner: claimed by the chain currently being walked
+ */
+#define VALIDATE_OWNER_CLAIMING     -4
+
+
+/** \brief  Claim chain at (\a track,\a sector) for \a owner
+ *
+ * Follows the chain through the `next` array, marking each block as owned by
+ * \a owner. The walk stops at the end of the chain or at the first block that
+ * is already owned, so each block is visited at most once over all chains.
+ *
+ * Blocks are marked as being claimed during the walk and handed to \a owner
+ * afterwards, so only a chain running into itself counts as a loop. A chain
+ * running into another chain of the same owner, such as a REL file's side
+ * sectors running into its data, counts as a cross-link.
+ *
+ * \param[in,out]   result  validation result
+ * \param[in]       image   d64 image
+ * \param[in]       track   track number of first block
+ * \param[in]       sector  sector number of first block
+ * \param[in]       owner   owner of the chain
+ *
+ * \return  number of blocks claimed
+ */
+static int validate_claim_chain(cbmfm_d64_validate_t *result,
+                                cbmfm_d64_t *image,
+                                int track, int sector,
+                                int owner)
+{
+    int first;
+    int block;
+    int claimed = 0;
+    int i;
+
+    first = cbmfm_dxx_geometry_block_number(image->geometry, track, sector);
+    if (first < 0) {
+        result->illegal_links++;
+        return 0;
+    }
+
+    block = first;
+    while (true) {
+        if (result->owner[block] == VALIDATE_OWNER_CLAIMING) {
+            result->loops++;
+            break;
+        }
+        if (result->owner[block] != CBMFM_VALIDATE_OWNER_NONE) {
+            result->cross_links++;
+            break;
+        }
+        result->owner[block] = VALIDATE_OWNER_CLAIMING;
+        claimed++;
+
+        if (result->next[block] == CBMFM_VALIDATE_NEXT_END) {
+            break;
+        }
+        if (result->next[block] == CBMFM_VALIDATE_NEXT_ILLEGAL) {
+            result->illegal_links++;
+            break;
+        }
+        block = result->next[block];
+    }
+
+    /* hand the claimed blocks to the owner */
+    block = first;
+    for (i = 0; i < claimed; i++) {
+        result->owner[block] = owner;
+        block = result->next[block];
+    }
+    return claimed;
+}
+
+
+/** \brief  Claim the chains of all closed files in the directory of \a image
+ *
+ * \param[in,out]   result  validation result
+ * \param[in]       image   d64 image
+ * \param[in]       blocks  number of directory blocks claimed
+ */
+static void validate_claim_files(cbmfm_d64_validate_t *result,
+                                 cbmfm_d64_t *image,
+                                 int blocks)
+{
+    int block;
+    int index = 0;
+
+    block = cbmfm_dxx_geometry_block_number(image->geometry,
+            CBMFM_D64_DIR_TRACK, CBMFM_D64_DIR_SECTOR);
+
+    /* only visit the blocks claimed for the directory, which is loop-free */
+    while (blocks-- > 0) {
+        const uint8_t *data = image->data + block * CBMFM_BLOCK_SIZE_RAW;
+        int e;
+
+        for (e = 0; e < VALIDATE_DIRENTS_PER_BLOCK; e++) {
+            const uint8_t *entry = data + e * CBMFM_DXX_DIRENT_SIZE;
+            uint8_t type = entry[CBMFM_D64_DIRENT_FILE_TYPE];
+
+            if (type == 0) {
+                /* empty or scratched entry */
+            } else if ((type & 0x80) == 0) {
+                /* unclosed file: VALIDATE removes these */
+                result->splat_files++;
+            } else {
+                result->files++;
+                validate_claim_chain(result, image,
+                        entry[CBMFM_D64_DIRENT_FILE_TRACK],
+                        entry[CBMFM_D64_DIRENT_FILE_SECTOR],
+                        index);
+                if ((type & 0x07) == 0x04) {
+                    /* REL file: side sectors */
+                    validate_claim_chain(result, image,
+                            entry[CBMFM_D64_DIRENT_REL_SSB_TRACK],
+                            entry[CBMFM_D64_DIRENT_REL_SSB_SECTOR],
+                            index);
+                }
+            }
+            index++;
+        }
+
+        block = result->next[block];
+        if (block < 0) {
+            break;
+        }
+    }
+}
+
+
+/** \brief  Initialize validation \a result
+ *
+ * \param[out]  result  validation result
+ */
+void cbmfm_d64_validate_init(cbmfm_d64_validate_t *result)
+{
+    result->block_count = 0;
+    result->dir_blocks = 0;
+    result->next = NULL;
+    result->owner = NULL;
+    result->files = 0;
+    result->splat_files = 0;
+    result->cross_links = 0;
+    result->loops = 0;
+    result->illegal_links = 0;
+    result->orphans = 0;
+    result->free_used = 0;
+}
+
+
+/** \brief  Free memory used by the members of \a result
+ *
+ * \param[in,out]   result  validation result
+ */
+void cbmfm_d64_validate_cleanup(cbmfm_d64_validate_t *result)
+{
+    if (result->next != NULL) {
+        cbmfm_free(result->next);
+    }
+    if (result->owner != NULL) {
+        cbmfm_free(result->owner);
+    }
+    cbmfm_d64_validate_init(result);
+}
+
+
+/** \brief  Validate \a image
+ *
+ * Builds the block link graph of \a image in a single pass over all blocks,
+ * then claims the BAM, the directory chain and the chains of all closed
+ * files in the directory, recording cross-linked, looping and illegally
+ * linked chains. Finally the block owners are compared with the BAM, finding
+ * blocks marked used which don't belong to any file and blocks that belong to
+ * a file but are marked free. All of this is linear in the number of blocks.
+ *
+ * Only tracks 1-35 are covered by the BAM, blocks on tracks 36+ of extended
+ * images are not checked against it: the extended BAM formats of SpeedDOS,
+ * DolphinDOS and friends aren't supported.
+ *
+ * \param[in]   image   d64 image
+ * \param[out]  result  validation result, free with
+ *                      cbmfm_d64_validate_cleanup()
+ *
+ * \return  true if no problems were found
+ */
+bool cbmfm_d64_validate(cbmfm_d64_t *image, cbmfm_d64_validate_t *result)
+{
+    const cbmfm_dxx_geometry_t *geometry = image->geometry;
+    int count = geometry->block_count;
+    int block;
+    int track;
+    int track_max;
+
+    cbmfm_d64_validate_init(result);
+    result->block_count = count;
+    result->next = cbmfm_malloc((size_t)count * sizeof *(result->next));
+    result->owner = cbmfm_malloc((size_t)count * sizeof *(result->owner));
+
+    /* build link graph */
+    for (block = 0; block < count; block++) {
+        const uint8_t *data = image->data + block * CBMFM_BLOCK_SIZE_RAW;
+
+        if (data[0] == 0) {
+            result->next[block] = CBMFM_VALIDATE_NEXT_END;
+        } else {
+            int next = cbmfm_dxx_geometry_block_number(geometry,
+                    data[0], data[1]);
+            result->next[block] = next < 0 ? CBMFM_VALIDATE_NEXT_ILLEGAL : next;
+        }
+        result->owner[block] = CBMFM_VALIDATE_OWNER_NONE;
+    }
+
+    /* claim BAM and directory */
+    block = cbmfm_dxx_geometry_block_number(geometry,
+            CBMFM_D64_BAM_TRACK, CBMFM_D64_BAM_SECTOR);
+    result->owner[block] = CBMFM_VALIDATE_OWNER_SYSTEM;
+    result->dir_blocks = validate_claim_chain(result, image,
+            CBMFM_D64_DIR_TRACK, CBMFM_D64_DIR_SECTOR,
+            CBMFM_VALIDATE_OWNER_DIR);
+
+    /* claim files */
+    validate_claim_files(result, image, result->dir_blocks);
+
+    /* compare with BAM */
+    track_max = image->track_max < CBMFM_D64_TRACK_MAX
+        ? image->track_max : CBMFM_D64_TRACK_MAX;
+    for (track = 1; track <= track_max; track++) {
+        const uint8_t *bament = cbmfm_d64_bam_ptr_trk(image, track);
+        int start = geometry->tracks[track].start;
+        int sector;
+
+        for (sector = 0; sector < geometry->tracks[track].blocks; sector++) {
+            bool is_free = (bament[1 + sector / 8] >> (sector % 8)) & 1;
+            bool is_used = result->owner[start + sector]
+                != CBMFM_VALIDATE_OWNER_NONE;
+
+            if (is_used && is_free) {
+                result->free_used++;
+            } else if (!is_used && !is_free) {
+                result->orphans++;
+            }
+        }
+    }
+
+    return result->cross_links == 0 && result->loops == 0
+        && result->illegal_links == 0 && result->orphans == 0
+        && result->free_used == 0 && result->splat_files == 0;
+}
+
+
+/** \brief  Remove the unclosed files from the directory of \a image
+ *
+ * Clears the file type of each unclosed ('splat') file, like VALIDATE does.
+ * Their blocks were never claimed, so the rebuilt BAM marks them free.
+ *
+ * \param[in,out]   image   d64 image
+ * \param[in]       result  validation result
+ */
+static void validate_remove_splat_files(cbmfm_d64_t *image,
+                                        const cbmfm_d64_validate_t *result)
+{
+    int blocks = result->dir_blocks;
+    int block;
+
+    block = cbmfm_dxx_geometry_block_number(image->geometry,
+            CBMFM_D64_DIR_TRACK, CBMFM_D64_DIR_SECTOR);
+
+    /* only visit the blocks claimed for the directory, which is loop-free */
+    while (blocks-- > 0) {
+        uint8_t *data = image->data + block * CBMFM_BLOCK_SIZE_RAW;
+        int e;
+
+        for (e = 0; e < VALIDATE_DIRENTS_PER_BLOCK; e++) {
+            uint8_t *type = data + e * CBMFM_DXX_DIRENT_SIZE
+                + CBMFM_D64_DIRENT_FILE_TYPE;
+
+            if (*type != 0 && (*type & 0x80) == 0) {
+                *type = 0;
+            }
+        }
+
+        block = result->next[block];
+        if (block < 0) {
+            break;
+        }
+    }
+}
+
+
+/** \brief  Rebuild the BAM of \a image from validation \a result
+ *
+ * Like the drive's VALIDATE command, removes unclosed files from the
+ * directory, marks all blocks owned by the BAM, the directory or a closed
+ * file as used and all other blocks as free, and recalculates the free block
+ * count of each track.
+ *
+ * Only the standard BAM for tracks 1-35 is rebuilt, the extended BAM of
+ * 40-track images (SpeedDOS, DolphinDOS etc.) isn't supported and is left as
+ * it is.
+ *
+ * \param[in,out]   image   d64 image
+ * \param[in]       result  result of cbmfm_d64_validate() on \a image
+ *
+ * \return  bool
+ *
+ * \throw   #CBMFM_ERR_READONLY
+ * \throw   #CBMFM_ERR_SIZE_MISMATCH
+ */
+bool cbmfm_d64_validate_rebuild_bam(cbmfm_d64_t *image,
+                                    const cbmfm_d64_validate_t *result)
+{
+    const cbmfm_dxx_geometry_t *geometry = image->geometry;
+    int track;
+    int track_max;
+
+    if (cbmfm_image_get_readonly((cbmfm_image_t *)image)
+            || cbmfm_image_get_mapped((cbmfm_image_t *)image)) {
+        cbmfm_error_set(CBMFM_ERR_READONLY, NULL, -1);
+        return false;
+    }
+    if (result->block_count != geometry->block_count) {
+        cbmfm_error_set(CBMFM_ERR_SIZE_MISMATCH, NULL, -1);
+        return false;
+    }
+
+    if (result->splat_files > 0) {
+        validate_remove_splat_files(image, result);
+    }
+
+    track_max = image->track_max < CBMFM_D64_TRACK_MAX
+        ? image->track_max : CBMFM_D64_TRACK_MAX;
+    for (track = 1; track <= track_max; track++) {
+        uint8_t *bament = cbmfm_d64_bam_ptr_trk(image, track);
+        int start = geometry->tracks[track].start;
+        int sector;
+        int blocks_free = 0;
+
+        bament[1] = bament[2] = bament[3] = 0;
+        for (sector = 0; sector < geometry->tracks[track].blocks; sector++) {
+            if (result->owner[start + sector] == CBMFM_VALIDATE_OWNER_NONE) {
+                bament[1 + sector / 8] = (uint8_t)(bament[1 + sector / 8]
+                        | (1U << (sector % 8)));
+                blocks_free++;
+            }
+        }
+        bament[0] = (uint8_t)blocks_free;
+    }
+    cbmfm_d64_bam_sync(image);
+
+    cbmfm_image_set_dirty((cbmfm_image_t *)image, true);
+    return true;
+}
+
+
+/** \brief  Dump validation \a result on stdout
+ *
+ * \param[in]   result  validation result
+ */
+void cbmfm_d64_validate_dump(const cbmfm_d64_validate_t *result)
+{
+    printf("files          : %d\n", result->files);
+    printf("splat files    : %d\n", result->splat_files);
+    printf("cross-links    : %d\n", result->cross_links);
+    printf("loops          : %d\n", result->loops);
+    printf("illegal links  : %d\n", result->illegal_links);
+    printf("orphan blocks  : %d\n", result->orphans);
+    printf("free but used  : %d\n", result->free_used);
+}
@@ -0,0 +1,67 @@
+/* vim: set et ts=4 sw=4 sts=4 fdm=marker syntax=c.doxygen : */
+
+/** \file   src/lib/image/validate.h
+ * \brief   D64 image validation - header
+ *
+ * \author  Bas Wassink <b.wassink@ziggo.nl>
+ */
+
+/*
+ *  CbmFM - a file manager for CBM 8-bit emulation files
+ *  Copyright (C) 2018  Bas Wassink <b.wassink@ziggo.nl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
+ */
+
+
+#ifndef CBMFM_LIB_IMAGE_VALIDATE_H
+#define CBMFM_LIB_IMAGE_VALIDATE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "cbmfm_types.h"
+
+
+/** \brief  Block link: end of chain
+ */
+#define CBMFM_VALIDATE_NEXT_END         -1
+
+/** \brief  Block link: link to an invalid (track,sector)
+ */
+#define CBMFM_VALIDATE_NEXT_ILLEGAL     -2
+
+
+/** \brief  Block owner: not owned
+ */
+#define CBMFM_VALIDATE_OWNER_NONE       -1
+
+/** \brief  Block owner: BAM
+ */
+#define CBMFM_VALIDATE_OWNER_SYSTEM     -2
+
+/** \brief  Block owner: directory
+ */
+#define CBMFM_VALIDATE_OWNER_DIR        -3
+
+
+void    cbmfm_d64_validate_init(cbmfm_d64_validate_t *result);
+void    cbmfm_d64_validate_cleanup(cbmfm_d64_validate_t *result);
+bool    cbmfm_d64_validate(cbmfm_d64_t *image, cbmfm_d64_validate_t *result);
+bool    cbmfm_d64_validate_rebuild_bam(cbmfm_d64_t *image,
+                                       const cbmfm_d64_validate_t *result);
+void    cbmfm_d64_validate_dump(const cbmfm_d64_validate_t *result);
+
+#endif
@@ -0,0 +1,526 @@
+/* vim: set et ts=4 sw=4 sts=4 fdm=marker syntax=c.doxygen : */
+
+/** \file   src/lib/image/zipdisk.c
+ * \brief   Zipcode disk (4-file) handling
+ *
+ * A zipcoded disk consists of four files, `1!name` to `4!name`, each holding
+ * the zipcode block entries of a range of tracks of a 35-track disk.
+ *
+ * \author  Bas Wassink <b.wassink@ziggo.nl>
+ */
+
+/*
+ *  CbmFM - a file manager for CBM 8-bit emulation files
+ *  Copyright (C) 2018  Bas Wassink <b.wassink@ziggo.nl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "cbmfm_types.h"
+#include "lib/base/dxx.h"
+#include "lib/base/errors.h"
+#include "lib/base/image.h"
+#include "lib/base/io.h"
+#include "lib/base/log.h"
+#include "lib/base/mem.h"
+#include "lib/base/zipcode.h"
+#include "d64.h"
+
+#include "zipdisk.h"
+
+#ifdef CBMFM_HOST_UNIX
+# include <pthread.h>
+#endif
+
+
+/** \brief  Track range and header of each file of a zipcoded disk
+ */
+static const struct {
+    int         trk_lo;     /**< first track */
+    int         trk_hi;     /**< last track */
+    uint16_t    load;       /**< load address */
+    size_t      header;     /**< size of the header */
+} zipdisk_parts[CBMFM_ZIPDISK_FILES] = {
+    {  1,  8, CBMFM_ZIPDISK_LOAD_FIRST, 4 },
+    {  9, 16, CBMFM_ZIPDISK_LOAD_OTHER, 2 },
+    { 17, 25, CBMFM_ZIPDISK_LOAD_OTHER, 2 },
+    { 26, 35, CBMFM_ZIPDISK_LOAD_OTHER, 2 }
+};
+
+
+/** \brief  Job for a single file of a zipcoded disk
+ *
+ * The jobs access disjoint track ranges of the image and of the coverage
+ * map, so they can run concurrently.
+ */
+typedef struct zipdisk_job_s {
+    cbmfm_d64_t *   image;      /**< target image */
+    uint8_t *       covered;    /**< coverage map, indexed by block number */
+    const uint8_t * disk_id;    /**< disk ID, written to the first file */
+    char *          path;       /**< path of the file */
+    int             part;       /**< index in #zipdisk_parts */
+    bool            result;     /**< job result */
+    int             err_code;   /**< error code on failure */
+    const char *    err_detail; /**< error detail on failure */
+    intmax_t        err_offset; /**< error offset on failure */
+} zipdisk_job_t;
+
+
+/** \brief  Get size of the zipcode block entry at \a src
+ *
+ * \param[in]   src     zipcode block entry
+ * \param[in]   avail   number of bytes available at \a src
+ *
+ * \return  size of entry, or 0 when the entry is truncated
+ */
+static size_t zipdisk_entry_size(const uint8_t *src, size_t avail)
+{
+    size_t size;
+
+    if (avail < 3) {
+        return 0;
+    }
+    switch (src[CBMFM_ZIPCODE_BLOCK_TRACK] & 0xc0) {
+        case CBMFM_ZIPCODE_FLAG_STORE:
+            size = CBMFM_ZIPCODE_BLOCK_DATA + CBMFM_BLOCK_SIZE_RAW;
+            break;
+        case CBMFM_ZIPCODE_FLAG_FILL:
+            size = CBMFM_ZIPCODE_BLOCK_FILL_BYTE + 1;
+            break;
+        case CBMFM_ZIPCODE_FLAG_RLE:
+            size = CBMFM_ZIPCODE_BLOCK_RLE_DATA
+                + (size_t)src[CBMFM_ZIPCODE_BLOCK_RLE_LEN];
+            break;
+        default:
+            /* invalid flags, reported by cbmfm_zipcode_unpack() */
+            size = 3;
+            break;
+    }
+    return size <= avail ? size : 0;
+}
+
+
+/** \brief  Decode block entries of a single file into the image
+ *
+ * \param[in,out]   job     decoding job
+ * \param[in]       data    file data
+ * \param[in]       size    size of \a data
+ *
+ * \return  true on success
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
+ * \throw   #CBMFM_ERR_BUFFER_UNDERFLOW
+ * \throw   #CBMFM_ERR_BUFFER_OVERFLOW
+ */
+static bool zipdisk_decode(zipdisk_job_t *job,
+                           const uint8_t *data,
+                           size_t size)
+{
+    int trk_lo = zipdisk_parts[job->part].trk_lo;
+    int trk_hi = zipdisk_parts[job->part].trk_hi;
+    size_t pos = zipdisk_parts[job->part].header;
+
+    if (size < pos
+            || cbmfm_word_get_le(data) != zipdisk_parts[job->part].load) {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                "invalid zipcode disk file header", 0);
+        return false;
+    }
+
+    while (pos < size) {
+        const uint8_t *src = data + pos;
+        intmax_t offset;
+        int track;
+        int used;
+
+        if (zipdisk_entry_size(src, size - pos) == 0) {
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                    "truncated zipcode block entry", (intmax_t)pos);
+            return false;
+        }
+        track = src[CBMFM_ZIPCODE_BLOCK_TRACK] & 0x3f;
+        if (track < trk_lo || track > trk_hi) {
+            cbmfm_error_set(CBMFM_ERR_ILLEGAL_TRACK,
+                    "track outside the range of the file", (intmax_t)pos);
+            return false;
+        }
+        offset = cbmfm_dxx_image_block_offset(
+                (const cbmfm_dxx_image_t *)job->image,
+                track, src[CBMFM_ZIPCODE_BLOCK_SECTOR]);
+        if (offset < 0) {
+            cbmfm_error_set(cbmfm_errno, "illegal block", (intmax_t)pos);
+            return false;
+        }
+        if (job->covered[offset / CBMFM_BLOCK_SIZE_RAW]) {
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                    "duplicate zipcode block entry", (intmax_t)pos);
+            return false;
+        }
+
+        used = cbmfm_zipcode_unpack(job->image->data + offset, src);
+        if (used < 0) {
+            cbmfm_error_set(cbmfm_errno, "invalid zipcode block data",
+                    (intmax_t)pos);
+            return false;
+        }
+        job->covered[offset / CBMFM_BLOCK_SIZE_RAW] = 1;
+        pos += (size_t)used;
+    }
+    return true;
+}
+
+
+/** \brief  Copy error state of the calling thread into \a job
+ *
+ * \param[out] job     job
+ */
+static void zipdisk_job_error(zipdisk_job_t *job)
+{
+    job->err_code = cbmfm_errno;
+    job->err_detail = cbmfm_error_detail();
+    job->err_offset = cbmfm_error_offset();
+}
+
+
+/** \brief  Run decoding job
+ *
+ * Maps the file of the job and decodes it. On failure, the error state of
+ * the calling thread is copied into the job.
+ *
+ * \param[in,out]   arg     decoding job
+ *
+ * \return  NULL
+ */
+static void *zipdisk_unpack_job(void *arg)
+{
+    zipdisk_job_t *job = arg;
+    uint8_t *data;
+    intmax_t size;
+    bool mapped;
+
+    size = cbmfm_map_file(&data, job->path, &mapped);
+    if (size < 0) {
+        job->result = false;
+    } else {
+        job->result = zipdisk_decode(job, data, (size_t)size);
+        if (mapped) {
+            cbmfm_unmap_file(data, (size_t)size);
+        } else {
+            cbmfm_free(data);
+        }
+    }
+
+    if (!job->result) {
+        zipdisk_job_error(job);
+    }
+    return NULL;
+}
+
+
+/** \brief  Run encoding job
+ *
+ * Encodes the track range of the job and writes it to the file of the job.
+ * Sectors are stored in the interleaved order used by Zipcode itself. On
+ * failure, the error state of the calling thread is copied into the job.
+ *
+ * \param[in,out]   arg     encoding job
+ *
+ * \return  NULL
+ */
+static void *zipdisk_pack_job(void *arg)
+{
+    zipdisk_job_t *job = arg;
+    cbmfm_dxx_image_t *image = (cbmfm_dxx_image_t *)job->image;
+    int trk_lo = zipdisk_parts[job->part].trk_lo;
+    int trk_hi = zipdisk_parts[job->part].trk_hi;
+    uint8_t *data;
+    size_t size;
+    size_t pos;
+    int track;
+
+    /* worst case: all blocks stored */
+    size = zipdisk_parts[job->part].header;
+    for (track = trk_lo; track <= trk_hi; track++) {
+        size += (size_t)cbmfm_dxx_track_block_count(image, track)
+            * CBMFM_ZIPCODE_ENTRY_SIZE_MAX;
+    }
+    data = cbmfm_malloc(size);
+
+    cbmfm_word_set_le(data, zipdisk_parts[job->part].load);
+    if (zipdisk_parts[job->part].header > 2) {
+        data[2] = job->disk_id[0];
+        data[3] = job->disk_id[1];
+    }
+    pos = zipdisk_parts[job->part].header;
+
+    for (track = trk_lo; track <= trk_hi; track++) {
+        int blocks = cbmfm_dxx_track_block_count(image, track);
+        int half = (blocks + 1) / 2;
+        int i;
+
+        for (i = 0; i < blocks; i++) {
+            int sector = (i & 1) ? half + i / 2 : i / 2;
+            intmax_t offset = cbmfm_dxx_image_block_offset(image, track,
+                    sector);
+
+            pos += cbmfm_zipcode_pack(data + pos, image->data + offset,
+                    track, sector);
+        }
+    }
+
+    job->result = cbmfm_write_file(data, pos, job->path);
+    if (!job->result) {
+        zipdisk_job_error(job);
+    }
+    cbmfm_free(data);
+    return NULL;
+}
+
+
+/** \brief  Get offset of the 'N!' prefix in the filename part of \a path
+ *
+ * \param[in]   path    path to one of the files of a zipcoded disk
+ * \param[out]  prefix  offset in \a path of the prefix
+ *
+ * \return  true if \a path has a valid prefix
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+static bool zipdisk_name_prefix(const char *path, size_t *prefix)
+{
+    const char *name;
+
+    name = strrchr(path, '/');
+#ifdef CBMFM_HOST_WINDOWS
+    if (name == NULL) {
+        name = strrchr(path, '\\');
+    }
+#endif
+    name = name != NULL ? name + 1 : path;
+    if (name[0] < '1' || name[0] > '0' + CBMFM_ZIPDISK_FILES
+            || name[1] != '!') {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                "not a zipcode disk file name", -1);
+        return false;
+    }
+    *prefix = (size_t)(name - path);
+    return true;
+}
+
+
+/** \brief  Run \a func for each of the four jobs
+ *
+ * On hosts supporting threads, the jobs run in parallel. Frees the paths of
+ * the jobs. The error state of the first failed job is set for the calling
+ * thread.
+ *
+ * \param[in,out]   jobs    jobs, initialized except for the path
+ * \param[in]       path    path to one of the files
+ * \param[in]       prefix  offset of the 'N!' prefix in \a path
+ * \param[in]       func    job function
+ *
+ * \return  true if all jobs succeeded
+ */
+static bool zipdisk_jobs_run(zipdisk_job_t *jobs,
+                             const char *path,
+                             size_t prefix,
+                             void *(*func)(void *))
+{
+#ifdef CBMFM_HOST_UNIX
+    pthread_t threads[CBMFM_ZIPDISK_FILES];
+    bool started[CBMFM_ZIPDISK_FILES];
+#endif
+    bool result = true;
+    int i;
+
+    for (i = 0; i < CBMFM_ZIPDISK_FILES; i++) {
+        jobs[i].path = cbmfm_strdup(path);
+        jobs[i].path[prefix] = (char)('1' + i);
+        jobs[i].part = i;
+        jobs[i].result = false;
+        jobs[i].err_code = CBMFM_ERR_OK;
+        jobs[i].err_detail = NULL;
+        jobs[i].err_offset = -1;
+    }
+
+#ifdef CBMFM_HOST_UNIX
+    for (i = 0; i < CBMFM_ZIPDISK_FILES; i++) {
+        started[i] = pthread_create(&threads[i], NULL, func, &jobs[i]) == 0;
+        if (!started[i]) {
+            func(&jobs[i]);
+        }
+    }
+    for (i = 0; i < CBMFM_ZIPDISK_FILES; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+#else
+    for (i = 0; i < CBMFM_ZIPDISK_FILES; i++) {
+        func(&jobs[i]);
+    }
+#endif
+
+    for (i = 0; i < CBMFM_ZIPDISK_FILES; i++) {
+        if (result && !jobs[i].result) {
+            cbmfm_log_error("failed to process '%s'\n", jobs[i].path);
+            cbmfm_error_set(jobs[i].err_code, jobs[i].err_detail,
+                    jobs[i].err_offset);
+            result = false;
+        }
+        cbmfm_free(jobs[i].path);
+    }
+    return result;
+}
+
+
+/** \brief  Check all blocks of the first 35 tracks are covered
+ *
+ * \param[in]   image   d64 image
+ * \param[in]   covered coverage map
+ *
+ * \return  true if all blocks are covered
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+static bool zipdisk_check_coverage(cbmfm_d64_t *image, const uint8_t *covered)
+{
+    int track;
+
+    for (track = 1; track <= CBMFM_D64_TRACK_MAX; track++) {
+        int blocks = cbmfm_dxx_track_block_count((cbmfm_dxx_image_t *)image,
+                track);
+        int sector;
+
+        for (sector = 0; sector < blocks; sector++) {
+            intmax_t offset = cbmfm_dxx_image_block_offset(
+                    (const cbmfm_dxx_image_t *)image, track, sector);
+
+            if (!covered[offset / CBMFM_BLOCK_SIZE_RAW]) {
+                cbmfm_log_error("zipcode disk is missing block (%d,%d)\n",
+                        track, sector);
+                cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                        "block missing from zipcode disk files", -1);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+/** \brief  Unpack zipcoded disk into a D64 image
+ *
+ * Takes the path to any of the four files of a zipcoded disk (`1!name` to
+ * `4!name`), and decodes all four into \a image, which is formatted first.
+ * Each file covers its own range of tracks, so on hosts supporting threads
+ * the files are decoded in parallel.
+ *
+ * On failure the contents of \a image are undefined.
+ *
+ * \param[in,out]   image   d64 image, initialized with cbmfm_d64_init()
+ * \param[in]       path    path to one of the files of the zipcoded disk
+ *
+ * \return  true on success
+ *
+ * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_READONLY
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ * \throw   #CBMFM_ERR_ILLEGAL_SECTOR
+ * \throw   #CBMFM_ERR_BUFFER_UNDERFLOW
+ * \throw   #CBMFM_ERR_BUFFER_OVERFLOW
+ */
+bool cbmfm_zipdisk_unpack(cbmfm_d64_t *image, const char *path)
+{
+    zipdisk_job_t jobs[CBMFM_ZIPDISK_FILES];
+    uint8_t covered[CBMFM_D64_BLOCK_COUNT];
+    size_t prefix;
+    bool result;
+    int i;
+
+    if (!zipdisk_name_prefix(path, &prefix)) {
+        return false;
+    }
+
+    if (!cbmfm_d64_format(image, NULL, NULL, false)) {
+        return false;
+    }
+    memset(covered, 0, sizeof covered);
+
+    for (i = 0; i < CBMFM_ZIPDISK_FILES; i++) {
+        jobs[i].image = image;
+        jobs[i].covered = covered;
+        jobs[i].disk_id = NULL;
+    }
+    result = zipdisk_jobs_run(jobs, path, prefix, zipdisk_unpack_job);
+    if (result) {
+        result = zipdisk_check_coverage(image, covered);
+    }
+
+    /* the BAM was overwritten, rebuild the mirror on next use */
+    image->bam_synced = false;
+    cbmfm_image_set_dirty((cbmfm_image_t *)image, true);
+    return result;
+}
+
+
+/** \brief  Pack the first 35 tracks of a D64 image into a zipcoded disk
+ *
+ * Writes the four files of a zipcoded disk, using \a path as template: its
+ * filename must start with 'N!', where N is replaced with 1 to 4. Each block
+ * is stored with the method resulting in the smallest entry. The files are
+ * encoded in parallel on hosts supporting threads.
+ *
+ * \param[in]   image   d64 image
+ * \param[in]   path    path to one of the files of the zipcoded disk
+ *
+ * \return  true on success
+ *
+ * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ * \throw   #CBMFM_ERR_ILLEGAL_TRACK
+ */
+bool cbmfm_zipdisk_pack(cbmfm_d64_t *image, const char *path)
+{
+    zipdisk_job_t jobs[CBMFM_ZIPDISK_FILES];
+    uint8_t disk_id[CBMFM_CBMDOS_DISK_ID_LEN_EXT];
+    size_t prefix;
+    int i;
+
+    if (!zipdisk_name_prefix(path, &prefix)) {
+        return false;
+    }
+    if (image->track_max < CBMFM_D64_TRACK_MAX) {
+        cbmfm_error_set(CBMFM_ERR_ILLEGAL_TRACK, NULL, -1);
+        return false;
+    }
+
+    cbmfm_d64_get_disk_id_pet(image, disk_id);
+    for (i = 0; i < CBMFM_ZIPDISK_FILES; i++) {
+        jobs[i].image = image;
+        jobs[i].covered = NULL;
+        jobs[i].disk_id = disk_id;
+    }
+    return zipdisk_jobs_run(jobs, path, prefix, zipdisk_pack_job);
+}
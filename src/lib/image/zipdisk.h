@@ -0,0 +1,55 @@
+/* vim: set et ts=4 sw=4 sts=4 fdm=marker syntax=c.doxygen : */
+
+/** \file   src/lib/image/zipdisk.h
+ * \brief   Zipcode disk (4-file) handling - header
+ *
+ * \author  Bas Wassink <b.wassink@ziggo.nl>
+ */
+
+/*
+ *  CbmFM - a file manager for CBM 8-bit emulation files
+ *  Copyright (C) 2018  Bas Wassink <b.wassink@ziggo.nl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
+ */
+
+#ifndef CBMFM_LIB_IMAGE_ZIPDISK_H
+#define CBMFM_LIB_IMAGE_ZIPDISK_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "cbmfm_types.h"
+
+
+/** \brief  Number of files of a zipcoded disk
+ */
+#define CBMFM_ZIPDISK_FILES         4
+
+/** \brief  Load address of the first file of a zipcoded disk
+ *
+ * The load address is followed by the two-byte disk ID.
+ */
+#define CBMFM_ZIPDISK_LOAD_FIRST    0x03fe
+
+/** \brief  Load address of the other files of a zipcoded disk
+ */
+#define CBMFM_ZIPDISK_LOAD_OTHER    0x0400
+
+
+bool cbmfm_zipdisk_unpack(cbmfm_d64_t *image, const char *path);
+bool cbmfm_zipdisk_pack(cbmfm_d64_t *image, const char *path);
+
+#endif
@@ -0,0 +1,400 @@
+/* vim: set et ts=4 sw=4 sts=4 fdm=marker syntax=c.doxygen : */
+
+/** \file   src/lib/image/zipfile.c
+ * \brief   File-zip (single-file zipcode) handling
+ *
+ * A file-zipped disk consists of a directory file, `x!name`, and parts
+ * `a!name`, `b!name` etc. The directory file lists the files of the disk,
+ * the parts hold zipcode entries of the blocks of these files, in directory
+ * order. A file can continue in the next part.
+ *
+ * \author  Bas Wassink <b.wassink@ziggo.nl>
+ */
+/*
+ *  CbmFM - a file manager for CBM 8-bit emulation files
+ *  Copyright (C) 2018  Bas Wassink <b.wassink@ziggo.nl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <string.h>
+
+#include "cbmfm_types.h"
+#include "lib/base/errors.h"
+#include "lib/base/io.h"
+#include "lib/base/log.h"
+#include "lib/base/mem.h"
+#include "lib/base/zipcode.h"
+#include "d64.h"
+
+#include "zipfile.h"
+
+
+/** \brief  State of unpacking a file-zipped disk
+ */
+typedef struct zipfile_state_s {
+    cbmfm_d64_t *       image;  /**< target image */
+    cbmfm_d64_writer_t  writer; /**< writer of the current file */
+    const uint8_t *     dir;    /**< directory entries */
+    int                 files;  /**< number of directory entries */
+    int                 index;  /**< index of the current file */
+    unsigned int        blocks; /**< number of blocks of the current file */
+} zipfile_state_t;
+
+
+/** \brief  Get size of the file-zip block entry at \a src
+ *
+ * \param[in]   src     file-zip block entry
+ * \param[in]   avail   number of bytes available at \a src
+ *
+ * \return  size of entry, or 0 when the entry is truncated
+ */
+static size_t zipfile_entry_size(const uint8_t *src, size_t avail)
+{
+    size_t size;
+
+    if (avail < 3) {
+        return 0;
+    }
+    switch (src[CBMFM_ZIPCODE_BLOCK_TRACK] & 0xc0) {
+        case CBMFM_ZIPCODE_FLAG_STORE:
+            size = CBMFM_BLOCK_SIZE_RAW;
+            break;
+        case CBMFM_ZIPCODE_FLAG_FILL:
+            size = CBMFM_ZIPCODE_BLOCK_FILL_BYTE + 1;
+            break;
+        case CBMFM_ZIPCODE_FLAG_RLE:
+            size = CBMFM_ZIPCODE_BLOCK_RLE_DATA
+                + (size_t)src[CBMFM_ZIPCODE_BLOCK_RLE_LEN];
+            break;
+        default:
+            /* invalid flags, reported by cbmfm_zipcode_unpack_file() */
+            size = 3;
+            break;
+    }
+    return size <= avail ? size : 0;
+}
+
+
+/** \brief  Get CBMDOS file type of a directory entry
+ *
+ * \param[in]   dirent  directory entry
+ * \param[out]  type    CBMDOS file type
+ *
+ * \return  false if the type is invalid or unsupported
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+static bool zipfile_dirent_type(const uint8_t *dirent, uint8_t *type)
+{
+    switch (dirent[CBMFM_ZIPFILE_DIRENT_TYPE] & 0x7f) {
+        case 'D':
+            *type = CBMFM_CBMDOS_DEL;
+            return true;
+        case 'S':
+            *type = CBMFM_CBMDOS_SEQ;
+            return true;
+        case 'P':
+            *type = CBMFM_CBMDOS_PRG;
+            return true;
+        case 'U':
+            *type = CBMFM_CBMDOS_USR;
+            return true;
+        default:
+            /* REL files need side sectors, which aren't stored */
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                    "unsupported file type in file-zip directory", -1);
+            return false;
+    }
+}
+
+
+/** \brief  Decode the block entries of a single part into the image
+ *
+ * Each block is decoded and appended to the file being written, which is
+ * opened on its first block and closed on its last block.
+ *
+ * \param[in,out]   state   unpacking state
+ * \param[in]       data    part data
+ * \param[in]       size    size of \a data
+ *
+ * \return  true on success
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ * \throw   #CBMFM_ERR_BUFFER_UNDERFLOW
+ * \throw   #CBMFM_ERR_BUFFER_OVERFLOW
+ * \throw   #CBMFM_ERR_DISK_FULL
+ */
+static bool zipfile_decode(zipfile_state_t *state,
+                           const uint8_t *data,
+                           size_t size)
+{
+    size_t pos = CBMFM_ZIPFILE_HEADER;
+    int count;
+    int i;
+
+    if (size < pos || cbmfm_word_get_le(data) != CBMFM_ZIPFILE_LOAD) {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                "invalid file-zip part header", 0);
+        return false;
+    }
+    count = data[2];
+
+    for (i = 0; i < count; i++) {
+        const uint8_t *src = data + pos;
+        const uint8_t *dirent;
+        uint8_t block[CBMFM_BLOCK_SIZE_RAW];
+        int used;
+
+        if (zipfile_entry_size(src, size - pos) == 0) {
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                    "truncated file-zip block entry", (intmax_t)pos);
+            return false;
+        }
+        if (state->index >= state->files) {
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                    "block entry beyond the last file", (intmax_t)pos);
+            return false;
+        }
+        dirent = state->dir + state->index * CBMFM_ZIPFILE_DIRENT_SIZE;
+
+        if (!state->writer.open) {
+            uint8_t type;
+
+            if (!zipfile_dirent_type(dirent, &type)
+                    || !cbmfm_d64_writer_open(&(state->writer), state->image,
+                        dirent + CBMFM_ZIPFILE_DIRENT_NAME, type)) {
+                return false;
+            }
+            state->blocks = 0;
+        }
+
+        used = cbmfm_zipcode_unpack_file(block, src);
+        if (used < 0) {
+            cbmfm_error_set(cbmfm_errno, "invalid file-zip block data",
+                    (intmax_t)pos);
+            return false;
+        }
+        pos += (size_t)used;
+        state->blocks++;
+
+        if (block[0] != 0) {
+            if (!cbmfm_d64_writer_append(&(state->writer), block + 2,
+                        CBMFM_BLOCK_SIZE_DATA)) {
+                return false;
+            }
+            continue;
+        }
+
+        /* last block of the file: the sector byte is the index of the last
+         * byte used */
+        if (block[1] == 0) {
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                    "invalid last block of file", (intmax_t)(src - data));
+            return false;
+        }
+        if (!cbmfm_d64_writer_append(&(state->writer), block + 2,
+                    (size_t)block[1] - 1)
+                || !cbmfm_d64_writer_close(&(state->writer))) {
+            return false;
+        }
+        if (state->blocks != cbmfm_word_get_le(
+                    dirent + CBMFM_ZIPFILE_DIRENT_BLOCKS)) {
+            cbmfm_log_error("file %d has %u blocks, directory lists %u\n",
+                    state->index, state->blocks,
+                    (unsigned int)cbmfm_word_get_le(
+                        dirent + CBMFM_ZIPFILE_DIRENT_BLOCKS));
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                    "file size differs from the directory entry",
+                    (intmax_t)(src - data));
+            return false;
+        }
+        state->index++;
+    }
+
+    if (pos != size) {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                "data after the last file-zip block entry", (intmax_t)pos);
+        return false;
+    }
+    return true;
+}
+
+
+/** \brief  Get offset of the 'N!' prefix in the filename part of \a path
+ *
+ * \param[in]   path    path to one of the files of a file-zipped disk
+ * \param[out]  prefix  offset in \a path of the prefix
+ *
+ * \return  true if \a path has a valid prefix
+ *
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ */
+static bool zipfile_name_prefix(const char *path, size_t *prefix)
+{
+    const char *name;
+    int letter;
+
+    name = strrchr(path, '/');
+#ifdef CBMFM_HOST_WINDOWS
+    if (name == NULL) {
+        name = strrchr(path, '\\');
+    }
+#endif
+    name = name != NULL ? name + 1 : path;
+    letter = tolower((unsigned char)name[0]);
+    if (letter < 'a' || letter > CBMFM_ZIPFILE_DIR_LETTER
+            || name[1] != '!') {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                "not a file-zip file name", -1);
+        return false;
+    }
+    *prefix = (size_t)(name - path);
+    return true;
+}
+
+
+/** \brief  Set prefix letter of \a path, keeping the case of the original
+ *
+ * \param[in,out]   path    path to one of the files of a file-zipped disk
+ * \param[in]       prefix  offset in \a path of the prefix
+ * \param[in]       letter  lower case prefix letter
+ */
+static void zipfile_name_set(char *path, size_t prefix, int letter)
+{
+    if (isupper((unsigned char)path[prefix])) {
+        letter = toupper(letter);
+    }
+    path[prefix] = (char)letter;
+}
+
+
+/** \brief  Unpack file-zipped disk into a D64 image
+ *
+ * Takes the path to any of the files of a file-zipped disk (`x!name` for the
+ * directory, `a!name`, `b!name` etc for the parts), and writes the files
+ * listed in the directory to \a image, which is formatted first. The parts
+ * are processed in order, each in a single pass, with the blocks of the files
+ * streamed through the D64 file writer, so files are allocated as the DOS
+ * would.
+ *
+ * On failure the contents of \a image are undefined, except that the file
+ * being written is removed, so no unclosed file is left behind.
+ *
+ * \param[in,out]   image   d64 image, initialized with cbmfm_d64_init()
+ * \param[in]       path    path to one of the files of the file-zipped disk
+ *
+ * \return  true on success
+ *
+ * \throw   #CBMFM_ERR_IO
+ * \throw   #CBMFM_ERR_READONLY
+ * \throw   #CBMFM_ERR_INVALID_DATA
+ * \throw   #CBMFM_ERR_BUFFER_UNDERFLOW
+ * \throw   #CBMFM_ERR_BUFFER_OVERFLOW
+ * \throw   #CBMFM_ERR_DISK_FULL
+ */
+bool cbmfm_zipfile_unpack(cbmfm_d64_t *image, const char *path)
+{
+    zipfile_state_t state;
+    uint8_t *dir;
+    intmax_t dir_size;
+    bool dir_mapped;
+    char *name;
+    size_t prefix;
+    bool result = true;
+    int letter;
+
+    if (!zipfile_name_prefix(path, &prefix)) {
+        return false;
+    }
+
+    state.image = image;
+    state.writer.open = false;
+    state.dir = NULL;
+    state.files = 0;
+    state.index = 0;
+    state.blocks = 0;
+
+    name = cbmfm_strdup(path);
+    zipfile_name_set(name, prefix, CBMFM_ZIPFILE_DIR_LETTER);
+    dir_size = cbmfm_map_file(&dir, name, &dir_mapped);
+    if (dir_size < 0) {
+        cbmfm_log_error("failed to read directory '%s'\n", name);
+        cbmfm_free(name);
+        return false;
+    }
+    if (dir_size <= CBMFM_ZIPFILE_DIR_COUNT
+            || cbmfm_word_get_le(dir) != CBMFM_ZIPFILE_DIR_LOAD
+            || dir_size < CBMFM_ZIPFILE_DIR_COUNT + 1
+                + dir[CBMFM_ZIPFILE_DIR_COUNT] * CBMFM_ZIPFILE_DIRENT_SIZE) {
+        cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                "invalid file-zip directory", -1);
+        result = false;
+    }
+
+    if (result) {
+        result = cbmfm_d64_format(image, NULL, NULL, false);
+    }
+    if (result) {
+        state.dir = dir + CBMFM_ZIPFILE_DIR_COUNT + 1;
+        state.files = dir[CBMFM_ZIPFILE_DIR_COUNT];
+    }
+
+    for (letter = 'a'; result && state.index < state.files; letter++) {
+        uint8_t *data;
+        intmax_t size;
+        bool mapped;
+
+        if (letter == CBMFM_ZIPFILE_DIR_LETTER) {
+            cbmfm_error_set(CBMFM_ERR_INVALID_DATA,
+                    "too many file-zip parts", -1);
+            result = false;
+            break;
+        }
+        zipfile_name_set(name, prefix, letter);
+        size = cbmfm_map_file(&data, name, &mapped);
+        if (size < 0) {
+            result = false;
+        } else {
+            result = zipfile_decode(&state, data, (size_t)size);
+            if (mapped) {
+                cbmfm_unmap_file(data, (size_t)size);
+            } else {
+                cbmfm_free(data);
+            }
+        }
+        if (!result) {
+            cbmfm_log_error("failed to process '%s'\n", name);
+        }
+    }
+
+    if (!result) {
+        cbmfm_d64_writer_abort(&(state.writer));
+    }
+
+    if (dir_mapped) {
+        cbmfm_unmap_file(dir, (size_t)dir_size);
+    } else {
+        cbmfm_free(dir);
+    }
+    cbmfm_free(name);
+    return result;
+}
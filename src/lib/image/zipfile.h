@@ -0,0 +1,85 @@
+/* vim: set et ts=4 sw=4 sts=4 fdm=marker syntax=c.doxygen : */
+
+/** \file   src/lib/image/zipfile.h
+ * \brief   File-zip (single-file zipcode) handling - header
+ *
+ * \author  Bas Wassink <b.wassink@ziggo.nl>
+ */
+
+/*
+ *  CbmFM - a file manager for CBM 8-bit emulation files
+ *  Copyright (C) 2018  Bas Wassink <b.wassink@ziggo.nl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
+ */
+
+#ifndef CBMFM_LIB_IMAGE_ZIPFILE_H
+#define CBMFM_LIB_IMAGE_ZIPFILE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "cbmfm_types.h"
+
+
+/** \brief  Load address of the parts of a file-zipped disk
+ *
+ * The load address is followed by the number of block entries in the part.
+ */
+#define CBMFM_ZIPFILE_LOAD          0x03ff
+
+/** \brief  Size of the header of a part
+ */
+#define CBMFM_ZIPFILE_HEADER        0x03
+
+/** \brief  Prefix letter of the directory file of a file-zipped disk
+ */
+#define CBMFM_ZIPFILE_DIR_LETTER    'x'
+
+/** \brief  Load address of the directory file
+ *
+ * The directory file is a BASIC program listing the files, with the
+ * directory table appended.
+ */
+#define CBMFM_ZIPFILE_DIR_LOAD      0x0801
+
+/** \brief  Offset in the directory file of the number of directory entries
+ *
+ * The entries follow the count.
+ */
+#define CBMFM_ZIPFILE_DIR_COUNT     0x0200
+
+/** \brief  Size of a directory entry
+ */
+#define CBMFM_ZIPFILE_DIRENT_SIZE   0x15
+
+/** \brief  Offset in a directory entry of the file name
+ */
+#define CBMFM_ZIPFILE_DIRENT_NAME   0x00
+
+/** \brief  Offset in a directory entry of the file type
+ *
+ * The type is stored as a PETSCII letter ('P' for PRG etc.), bit 7 set.
+ */
+#define CBMFM_ZIPFILE_DIRENT_TYPE   0x10
+
+/** \brief  Offset in a directory entry of the size in blocks (16-bit LE)
+ */
+#define CBMFM_ZIPFILE_DIRENT_BLOCKS 0x11
+
+
+bool cbmfm_zipfile_unpack(cbmfm_d64_t *image, const char *path);
+
+#endif
@@ -51,6 +51,10 @@
 #include "test_lib_image_t64.h"
 #include "test_lib_image_lnx.h"
 #include "test_lib_base_zipcode.h"
+#include "test_lib_image_zipdisk.h"
+#include "test_lib_image_sixzip.h"
+#include "test_lib_image_zipfile.h"
+#include "test_lib_image_detect.h"
 
 
 /** \brief  Print usage/help message on stdout
@@ -78,6 +82,10 @@ static void register_modules(void)
     test_module_register(&module_lib_image_t64);
     test_module_register(&module_lib_image_lnx);
     test_module_register(&module_lib_base_zipcode);
+    test_module_register(&module_lib_image_zipdisk);
+    test_module_register(&module_lib_image_sixzip);
+    test_module_register(&module_lib_image_zipfile);
+    test_module_register(&module_lib_image_detect);
 }
 
 
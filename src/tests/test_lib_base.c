@@ -28,14 +28,49 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#ifdef CBMFM_HOST_UNIX
+# include <pthread.h>
+#endif
 
 #include "lib/cbmfm_types.h"
+#include "lib/base/errors.h"
 #include "lib/base/io.h"
+#include "lib/base/log.h"
+#include "lib/base/mem.h"
+#include "lib/base/petasc.h"
 #include "lib/base/image.h"
 
 #include "testcase.h"
 
 
+/** \brief  Log file used by the log test
+ */
+#define LOG_TEST_FILE       "test-log.txt"
+
+/** \brief  Number of messages logged asynchronously by the log test
+ */
+#define LOG_TEST_COUNT      100
+
+/** \brief  Number of blocks processed by the log benchmark
+ */
+#define LOG_BENCH_COUNT     200000
+
+
+/** \brief  Maximum buffer size used by the petasc comparison test
+ */
+#define PETASC_TEST_MAX     320
+
+/** \brief  Buffer size used by the petasc benchmark
+ */
+#define PETASC_BENCH_SIZE   (1 << 20)
+
+/** \brief  Number of passes of the petasc benchmark
+ */
+#define PETASC_BENCH_PASSES 50
+
+
 /** \brief  Test image 'Topaz tools'
  */
 #define ARK_TPZTOOLS_FILE   "data/images/ark/Tpztools.ark"
@@ -44,9 +79,17 @@
  */
 #define ARK_TPZTOOLS_SIZE   40744
 
+/** \brief  Memory map of the test process, used to check unmapping
+ */
+#define PROC_MAPS_FILE      "/proc/self/maps"
+
 
 static bool test_lib_base_io(struct test_case_s *test);
 static bool test_lib_base_image(struct test_case_s *test);
+static bool test_lib_base_image_mapped(struct test_case_s *test);
+static bool test_lib_base_ctx(struct test_case_s *test);
+static bool test_lib_base_log(struct test_case_s *test);
+static bool test_lib_base_petasc(struct test_case_s *test);
 
 
 /** \brief  List of tests for the base library functions
@@ -54,6 +97,12 @@ static bool test_lib_base_image(struct test_case_s *test);
 static test_case_t tests_lib_base[] = {
     { "io", "I/O handling", test_lib_base_io, 0, 0 },
     { "image", "Basic image handling", test_lib_base_image, 0, 0 },
+    { "mapped", "Memory-mapped image handling",
+        test_lib_base_image_mapped, 0, 0 },
+    { "ctx", "Per-thread library context", test_lib_base_ctx, 0, 0 },
+    { "log", "Log levels and asynchronous logging", test_lib_base_log, 0, 0 },
+    { "petasc", "Bulk PETSCII translation and UTF-8 output",
+        test_lib_base_petasc, 0, 0 },
     { NULL, NULL, NULL, 0, 0 }
 };
 
@@ -167,3 +216,559 @@ static bool test_lib_base_image(struct test_case_s *test)
     cbmfm_image_cleanup(&image);
     return true;
 }
+
+
+/** \brief  Check if \a addr lies within a mapping of this process
+ *
+ * Scans #PROC_MAPS_FILE, which is only available on Linux.
+ *
+ * \param[in]   addr    address
+ *
+ * \return  1 if mapped, 0 if not, -1 if it can't be determined
+ */
+static int mapping_present(const void *addr)
+{
+    FILE *fp;
+    char line[4096];
+    uintptr_t a = (uintptr_t)addr;
+    int found = 0;
+
+    fp = fopen(PROC_MAPS_FILE, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    while (found == 0 && fgets(line, (int)sizeof line, fp) != NULL) {
+        uintptr_t start;
+        uintptr_t end;
+
+        if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR, &start, &end) == 2
+                && a >= start && a < end) {
+            found = 1;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+
+/** \brief  Test memory-mapped images in src/lib/base/image.c
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_base_image_mapped(struct test_case_s *test)
+{
+    cbmfm_image_t image;
+    cbmfm_image_t mapped;
+    const void *addr;
+    int present;
+    bool result;
+
+    test->total = 4;
+
+    cbmfm_image_init(&image);
+    cbmfm_image_init(&mapped);
+    printf("..... calling cbmfm_image_read_data(\"%s\" ... ", ARK_TPZTOOLS_FILE);
+    if (!cbmfm_image_read_data(&image, ARK_TPZTOOLS_FILE)) {
+        printf("failed: fatal\n");
+        return false;
+    }
+    printf("OK\n");
+    printf("..... calling cbmfm_image_map_data(\"%s\" ... ", ARK_TPZTOOLS_FILE);
+    if (!cbmfm_image_map_data(&mapped, ARK_TPZTOOLS_FILE)) {
+        printf("failed: fatal\n");
+        cbmfm_image_cleanup(&image);
+        return false;
+    }
+    printf("OK\n");
+
+    /* check mapped flag */
+    result = cbmfm_image_get_mapped(&mapped);
+    printf("..... checking mapped flag: expected true, got %s ... ",
+            result ? "true" : "false");
+    if (result) {
+        printf("OK\n");
+    } else {
+        printf("Failed\n");
+        test->failed++;
+    }
+
+    /* check readonly */
+    result = cbmfm_image_get_readonly(&mapped);
+    printf("..... checking readonly flag: expected true, got %s ... ",
+            result ? "true" : "false");
+    if (result) {
+        printf("OK\n");
+    } else {
+        printf("Failed\n");
+        test->failed++;
+    }
+
+    /* compare data */
+    result = mapped.size == image.size
+        && memcmp(mapped.data, image.data, image.size) == 0;
+    printf("..... comparing mapped data with read data ... %s\n",
+            result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+
+    /* the mapping must be gone from the address space after cleanup */
+    addr = mapped.data;
+    present = mapping_present(addr);
+    printf("... calling cbmfm_image_cleanup()\n");
+    cbmfm_image_cleanup(&mapped);
+    if (present < 0) {
+        printf("..... checking mapping was released ... skipped (no %s)\n",
+                PROC_MAPS_FILE);
+    } else {
+        result = present == 1 && mapping_present(addr) == 0;
+        printf("..... checking mapping was released ... %s\n",
+                result ? "OK" : "failed");
+        if (!result) {
+            test->failed++;
+        }
+    }
+    cbmfm_image_cleanup(&image);
+    return true;
+}
+
+
+#ifdef CBMFM_HOST_UNIX
+/** \brief  Thread function for the context test
+ *
+ * Sets an error in the implicit context of a new thread.
+ *
+ * \param[out] arg     location to store the thread's error code
+ *
+ * \return  NULL
+ */
+static void *ctx_thread_func(void *arg)
+{
+    int *code = arg;
+
+    /* a new thread starts with a clean error state */
+    code[0] = cbmfm_errno;
+    cbmfm_error_set(CBMFM_ERR_IO, "thread error", 42);
+    code[1] = cbmfm_errno;
+    return NULL;
+}
+#endif
+
+
+/** \brief  Test per-thread library context handling
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_base_ctx(struct test_case_s *test)
+{
+    cbmfm_ctx_t ctx;
+    cbmfm_ctx_t *def;
+    FILE *saved;
+    FILE *shared;
+    bool result;
+
+    test->total = 6;
+
+    /* error detail and offset */
+    printf("..... calling cbmfm_error_set(CBMFM_ERR_INVALID_DATA, ...) ... ");
+    cbmfm_error_set(CBMFM_ERR_INVALID_DATA, "test detail", 0x1234);
+    result = cbmfm_errno == CBMFM_ERR_INVALID_DATA
+        && cbmfm_error_detail() != NULL
+        && strcmp(cbmfm_error_detail(), "test detail") == 0
+        && cbmfm_error_offset() == 0x1234;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+
+    /* setting the error code directly drops the stale detail */
+    printf("..... setting cbmfm_errno, checking detail is dropped ... ");
+    cbmfm_errno = CBMFM_ERR_OOM;
+    result = cbmfm_error_detail() == NULL && cbmfm_error_offset() < 0;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+
+    /* setting the same code again without a detail drops the detail too */
+    printf("..... setting same error without detail ... ");
+    cbmfm_error_set(CBMFM_ERR_OOM, "test detail", 0x1234);
+    cbmfm_error_set(CBMFM_ERR_OOM, NULL, -1);
+    result = cbmfm_errno == CBMFM_ERR_OOM && cbmfm_error_detail() == NULL
+        && cbmfm_error_offset() < 0;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+
+    /* closing an inherited log file must leave the default context's file
+     * open */
+    printf("..... closing log file inherited from default context ... ");
+    def = cbmfm_ctx_default();
+    saved = def->log_file;
+    shared = tmpfile();
+    if (shared == NULL) {
+        printf("skipped (no temporary file)\n");
+        test->total--;
+    } else {
+        def->log_file = shared;
+        cbmfm_ctx_init(&ctx);
+        cbmfm_ctx_set(&ctx);
+        cbmfm_log_close();
+        cbmfm_ctx_set(NULL);
+        result = ctx.log_file == NULL && def->log_file == shared
+            && fputs("still open\n", shared) >= 0 && fflush(shared) == 0;
+        def->log_file = saved;
+        fclose(shared);
+        printf("%s\n", result ? "OK" : "failed");
+        if (!result) {
+            test->failed++;
+        }
+    }
+
+    /* explicit context */
+    printf("..... using explicit context, checking isolation ... ");
+    cbmfm_ctx_init(&ctx);
+    cbmfm_ctx_set(&ctx);
+    result = cbmfm_errno == CBMFM_ERR_OK
+        && ctx.log_level == cbmfm_ctx_default()->log_level;
+    cbmfm_errno = CBMFM_ERR_IO;
+    cbmfm_ctx_set(NULL);
+    result = result && ctx.err_code == CBMFM_ERR_IO
+        && cbmfm_errno == CBMFM_ERR_OOM;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+
+#ifdef CBMFM_HOST_UNIX
+    {
+        pthread_t thread;
+        int codes[2] = { -1, -1 };
+
+        printf("..... setting error in another thread ... ");
+        result = pthread_create(&thread, NULL, ctx_thread_func, codes) == 0
+            && pthread_join(thread, NULL) == 0;
+        result = result
+            && codes[0] == CBMFM_ERR_OK
+            && codes[1] == CBMFM_ERR_IO
+            && cbmfm_errno == CBMFM_ERR_OOM;
+        printf("%s\n", result ? "OK" : "failed");
+        if (!result) {
+            test->failed++;
+        }
+    }
+#else
+    test->total--;
+#endif
+    cbmfm_error_clear();
+    return true;
+}
+
+
+/** \brief  Process blocks, logging a debug message for each block
+ *
+ * Mimics the debug logging done per block by the image code.
+ *
+ * \param[out]  sum     checksum of all blocks
+ *
+ * \return  CPU time used in seconds
+ */
+static double log_bench(unsigned int *sum)
+{
+    uint8_t block[254];
+    clock_t start;
+    int i;
+    size_t k;
+
+    *sum = 0;
+    start = clock();
+    for (i = 0; i < LOG_BENCH_COUNT; i++) {
+        unsigned int block_sum = 0;
+
+        memset(block, i & 0xff, sizeof block);
+        for (k = 0; k < sizeof block; k++) {
+            block_sum += block[k];
+        }
+        *sum += block_sum;
+        cbmfm_log_debug("block %d: sum %u\n", i, block_sum);
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+/** \brief  Test log level checks and asynchronous logging
+ *
+ * Uses its own context, so the log configuration of the test runner isn't
+ * affected.
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_base_log(struct test_case_s *test)
+{
+    cbmfm_ctx_t ctx;
+    FILE *fp;
+    char line[256];
+    int evaluated = 0;
+    int lines = 0;
+    int i;
+    unsigned int sums[3];
+    double time_off;
+    double time_sync;
+    double time_async;
+    bool result;
+
+    test->total = 3;
+
+    cbmfm_ctx_init(&ctx);
+    cbmfm_ctx_set(&ctx);
+    if (!cbmfm_log_set_file(LOG_TEST_FILE)) {
+        cbmfm_ctx_set(NULL);
+        cbmfm_perror(__func__);
+        return false;
+    }
+
+    /* arguments of discarded messages must not be evaluated */
+    printf("..... logging debug message at level 'error' ... ");
+    cbmfm_log_set_level(CBMFM_LOG_ERROR);
+    cbmfm_log_debug("evaluated %d\n", ++evaluated);
+    result = evaluated == 0;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+
+    /* all queued messages must end up in the log file */
+    printf("..... logging %d messages asynchronously ... ", LOG_TEST_COUNT);
+    cbmfm_log_set_level(CBMFM_LOG_DEBUG);
+    result = cbmfm_log_async_start();
+    for (i = 0; i < LOG_TEST_COUNT; i++) {
+        cbmfm_log_info("message %d\n", i);
+    }
+    cbmfm_log_close();
+    cbmfm_ctx_set(NULL);
+
+    fp = fopen(LOG_TEST_FILE, "rb");
+    if (fp != NULL) {
+        while (fgets(line, (int)sizeof line, fp) != NULL) {
+            if (strncmp(line, "Info: message ", 14) == 0) {
+                lines++;
+            }
+        }
+        fclose(fp);
+    }
+    remove(LOG_TEST_FILE);
+    result = result && lines == LOG_TEST_COUNT;
+    printf("%d lines -> %s\n", lines, result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+
+    /* cost of debug logging, compared to logging at level 'error' */
+    cbmfm_ctx_init(&ctx);
+    cbmfm_ctx_set(&ctx);
+    if (!cbmfm_log_set_file(LOG_TEST_FILE)) {
+        cbmfm_ctx_set(NULL);
+        cbmfm_perror(__func__);
+        return false;
+    }
+    cbmfm_log_set_level(CBMFM_LOG_ERROR);
+    time_off = log_bench(&sums[0]);
+    cbmfm_log_set_level(CBMFM_LOG_DEBUG);
+    time_sync = log_bench(&sums[1]);
+    result = cbmfm_log_async_start();
+    time_async = log_bench(&sums[2]);
+    cbmfm_log_close();
+    cbmfm_ctx_set(NULL);
+
+    lines = 0;
+    fp = fopen(LOG_TEST_FILE, "rb");
+    if (fp != NULL) {
+        while (fgets(line, (int)sizeof line, fp) != NULL) {
+            if (strncmp(line, "Debug: block ", 13) == 0) {
+                lines++;
+            }
+        }
+        fclose(fp);
+    }
+    remove(LOG_TEST_FILE);
+    /* the synchronous run must log every block, the asynchronous run may
+     * drop messages when the ring buffer is full */
+    result = result && lines >= LOG_BENCH_COUNT
+        && sums[0] == sums[1] && sums[1] == sums[2];
+    printf("..... processing %d blocks: level 'error' %.3fs, debug %.3fs",
+           LOG_BENCH_COUNT, time_off, time_sync);
+    if (time_off > 0.0) {
+        printf(" (%.1fx)", time_sync / time_off);
+    }
+    printf(", debug async %.3fs", time_async);
+    if (time_off > 0.0) {
+        printf(" (%.1fx)", time_async / time_off);
+    }
+    printf(" -> %s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    return true;
+}
+
+
+/** \brief  Reference PETSCII to ASCII string translation, one byte at a time
+ *
+ * \param[out]  asc     target ASCII buffer
+ * \param[in]   pet     PETSCII buffer
+ * \param[in]   n       number of bytes to translate
+ */
+static void petasc_ref(char *asc, const uint8_t *pet, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        uint8_t b = cbmfm_pet_to_asc(pet[i]);
+        asc[i] = b < 0x80 ? (char)b : '_';
+    }
+}
+
+
+/** \brief  Test bulk PETSCII conversion and PETSCII to UTF-8 conversion
+ *
+ * Checks the bulk functions against the single-byte functions for every
+ * code, at every length/alignment up to a few vectors, checks a few known
+ * UTF-8 translations and benchmarks the bulk path against the scalar one.
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  true
+ */
+static bool test_lib_base_petasc(struct test_case_s *test)
+{
+    uint8_t *pet;
+    char *asc;
+    char *ref;
+    uint8_t back[PETASC_TEST_MAX];
+    char utf8[CBMFM_PET_UTF8_SIZE(PETASC_TEST_MAX)];
+    uint32_t seed = 0x12345678;
+    size_t i;
+    size_t offset;
+    size_t len;
+    size_t ulen;
+    int errors = 0;
+    clock_t start;
+    double time_lib;
+    double time_ref;
+    int pass;
+    bool result;
+
+    test->total = 4;
+
+    pet = cbmfm_malloc(PETASC_BENCH_SIZE);
+    asc = cbmfm_malloc(PETASC_BENCH_SIZE);
+    ref = cbmfm_malloc(PETASC_BENCH_SIZE);
+    for (i = 0; i < PETASC_BENCH_SIZE; i++) {
+        seed = seed * 1103515245u + 12345u;
+        pet[i] = (uint8_t)(i < 256 ? i : (seed >> 16));
+    }
+
+    /* bulk translation must match the single-byte functions */
+    printf("..... comparing bulk and single-byte translation ... ");
+    for (offset = 0; offset < 32; offset++) {
+        for (len = 0; len + offset <= PETASC_TEST_MAX; len++) {
+            cbmfm_pet_to_asc_buf(asc, pet + offset, len);
+            petasc_ref(ref, pet + offset, len);
+            if (memcmp(asc, ref, len) != 0) {
+                errors++;
+            }
+            cbmfm_asc_to_pet_buf(back, (const char *)(pet + offset), len);
+            for (i = 0; i < len; i++) {
+                if (back[i] != cbmfm_asc_to_pet(pet[offset + i])) {
+                    errors++;
+                    break;
+                }
+            }
+        }
+    }
+    result = errors == 0;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+
+    /* the string functions stop at 0x00 */
+    printf("..... translating 0-terminated strings ... ");
+    cbmfm_pet_to_asc_str(asc, (const uint8_t *)"\x48\x49\x00\x4a", 4);
+    cbmfm_asc_to_pet_str(back, "hi", 4);
+    result = strcmp(asc, "hi") == 0
+        && memcmp(back, "\x48\x49\x00\x00", 4) == 0;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+
+    /* UTF-8: letters, pound sign, arrows, graphics, legacy computing, pi */
+    printf("..... translating PETSCII to UTF-8 ... ");
+    ulen = cbmfm_pet_to_utf8_str(utf8,
+            (const uint8_t *)"HI\x5c\x5e\x5f\xc1\xc2\xa0\xff", 16);
+    result = ulen == strlen(utf8)
+        && strcmp(utf8, "HI\xc2\xa3\xe2\x86\x91\xe2\x86\x90\xe2\x99\xa0"
+                "\xf0\x9f\xad\xb2\xc2\xa0\xcf\x80") == 0;
+    /* every code must encode to a single valid sequence */
+    for (i = 1; i < 256 && result; i++) {
+        uint8_t c = (uint8_t)i;
+        const uint8_t *u = (const uint8_t *)utf8;
+
+        ulen = cbmfm_pet_to_utf8_str(utf8, &c, 1);
+        if (ulen == 1) {
+            result = u[0] < 0x80;
+        } else if (ulen >= 2 && ulen <= 4) {
+            size_t k;
+
+            static const uint8_t lead_mask[5] = { 0, 0, 0xe0, 0xf0, 0xf8 };
+
+            result = (u[0] & lead_mask[ulen])
+                == (uint8_t)(lead_mask[ulen] << 1);
+            for (k = 1; k < ulen; k++) {
+                result = result && (u[k] & 0xc0) == 0x80;
+            }
+        } else {
+            result = false;
+        }
+    }
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+
+    /* benchmark */
+    start = clock();
+    for (pass = 0; pass < PETASC_BENCH_PASSES; pass++) {
+        cbmfm_pet_to_asc_buf(asc, pet, PETASC_BENCH_SIZE);
+    }
+    time_lib = (double)(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for (pass = 0; pass < PETASC_BENCH_PASSES; pass++) {
+        petasc_ref(ref, pet, PETASC_BENCH_SIZE);
+    }
+    time_ref = (double)(clock() - start) / CLOCKS_PER_SEC;
+    result = memcmp(asc, ref, PETASC_BENCH_SIZE) == 0;
+    printf("..... translating %d bytes %d times: library %.3fs, reference"
+            " %.3fs", PETASC_BENCH_SIZE, PETASC_BENCH_PASSES,
+            time_lib, time_ref);
+    if (time_lib > 0.0) {
+        printf(" (%.1fx)", time_ref / time_lib);
+    }
+    printf(" -> %s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+
+    cbmfm_free(pet);
+    cbmfm_free(asc);
+    cbmfm_free(ref);
+    return true;
+}
@@ -27,14 +27,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 
 #include "cbmfm_types.h"
 #include "lib/base/dxx.h"
 #include "lib/base/dir.h"
 #include "lib/base/dirent.h"
+#include "lib/base/file.h"
 #include "lib/base/image.h"
 #include "lib/base/mem.h"
+#include "lib/base/pattern.h"
 #include "lib/image/d64.h"
 #include "testcase.h"
 
@@ -55,6 +58,9 @@ static cbmfm_d64_t image;
 
 
 static bool test_lib_base_dir_iter(test_case_t *test);
+static bool test_lib_base_dir_find(test_case_t *test);
+static bool test_lib_base_dir_match(test_case_t *test);
+static bool test_lib_base_dir_storage(test_case_t *test);
 
 
 /** \brief  Setup function for the test module
@@ -86,6 +92,12 @@ static void test_lib_base_dir_teardown(void)
 static test_case_t tests_lib_base_dir[] = {
     { "iter", "Dxx directory iterator handling",
         test_lib_base_dir_iter, 0, 0 },
+    { "find", "Directory name index lookups",
+        test_lib_base_dir_find, 0, 0 },
+    { "match", "CBM DOS pattern matching",
+        test_lib_base_dir_match, 0, 0 },
+    { "storage", "Contiguous dirent storage",
+        test_lib_base_dir_storage, 0, 0 },
     { NULL, NULL, NULL, 0, 0 }
 };
 
@@ -151,3 +163,211 @@ static bool test_lib_base_dir_iter(test_case_t *test)
 
     return true;
 }
+
+
+/** \brief  Test name index lookups of dir.c
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_base_dir_find(test_case_t *test)
+{
+    cbmfm_dir_t *dir;
+    uint8_t name[CBMFM_CBMDOS_FILE_NAME_LEN];
+    size_t i;
+    int index;
+
+    test->total = 2;
+
+    dir = cbmfm_d64_dir_read(&image);
+    if (dir == NULL) {
+        printf("..... failed to read directory -> fatal\n");
+        return false;
+    }
+
+    printf("..... looking up every entry by name .. ");
+    for (i = 0; i < dir->entry_used; i++) {
+        index = cbmfm_dir_find(dir, dir->entries[i].filename,
+                CBMFM_CBMDOS_FILE_NAME_LEN);
+        if (index != (int)i) {
+            break;
+        }
+    }
+    printf("%s\n", i == dir->entry_used ? "OK" : "failed");
+    if (i != dir->entry_used) {
+        test->failed++;
+    }
+
+    /* a name that isn't in the directory */
+    memset(name, 0xa0, sizeof name);
+    memcpy(name, "NOPE", 4);
+    printf("..... looking up a non-existing name .. ");
+    index = cbmfm_dir_find(dir, name, sizeof name);
+    printf("%s\n", index < 0 ? "OK" : "failed");
+    if (index >= 0) {
+        test->failed++;
+    }
+
+    cbmfm_dir_free(dir);
+    return true;
+}
+
+
+/** \brief  Test pattern matching of dir.c
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_base_dir_match(test_case_t *test)
+{
+    /** \brief  Patterns and the expected first match in the Armalyte image */
+    static const struct {
+        const char *text;   /**< ASCII pattern */
+        size_t start;       /**< index to start searching */
+        int expected;       /**< expected index */
+    } patterns[] = {
+        { "*",          0,  0 },
+        { "a4*",        0,  5 },
+        { "0:a4*",      0,  5 },
+        { "a4*,p",      0,  5 },
+        { "a4*,P",      0,  5 },
+        { "a4*=s",      0, -1 },
+        { "a4*=S",      0, -1 },
+        { "a?*",        0,  0 },
+        { "a?*",        1,  1 },
+        { "a??",        0, -1 },
+        { "a",          0, -1 }
+    };
+    cbmfm_dir_t *dir;
+    const cbmfm_dir_t *cached;
+    cbmfm_pattern_t pattern;
+    cbmfm_file_t file;
+    size_t i;
+    bool ok;
+
+    test->total = (int)(sizeof patterns / sizeof patterns[0]) + 2;
+
+    dir = cbmfm_d64_dir_read(&image);
+    if (dir == NULL) {
+        printf("..... failed to read directory -> fatal\n");
+        return false;
+    }
+
+    for (i = 0; i < sizeof patterns / sizeof patterns[0]; i++) {
+        int index = -1;
+
+        if (cbmfm_pattern_compile_asc(&pattern, patterns[i].text)) {
+            index = cbmfm_dir_match(dir, &pattern, patterns[i].start);
+        }
+        printf("..... matching \"%s\" from %d: %d -> %s\n",
+                patterns[i].text, (int)patterns[i].start, index,
+                index == patterns[i].expected ? "OK" : "failed");
+        if (index != patterns[i].expected) {
+            test->failed++;
+        }
+    }
+
+    printf("..... compiling invalid type filter \"a*,x\" .. ");
+    if (!cbmfm_pattern_compile_asc(&pattern, "a*,x")) {
+        printf("OK\n");
+    } else {
+        printf("failed\n");
+        test->failed++;
+    }
+
+    /* reading by name must reuse the cached directory */
+    printf("..... reading \"a4*,P\" twice through the cache .. ");
+    cached = cbmfm_image_dir_cache_peek((const cbmfm_image_t *)&image);
+    ok = cached == dir && cbmfm_pattern_compile_asc(&pattern, "a4*,P");
+    for (i = 0; ok && i < 2; i++) {
+        cbmfm_file_init(&file);
+        ok = cbmfm_d64_file_read_from_name(&image, &file, &pattern)
+            && file.size > 0
+            && memcmp(file.name, dir->entries[5].filename,
+                    CBMFM_CBMDOS_FILE_NAME_LEN) == 0
+            && cbmfm_image_dir_cache_peek((const cbmfm_image_t *)&image)
+                == cached;
+        cbmfm_file_cleanup(&file);
+    }
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+
+    cbmfm_dir_free(dir);
+    return true;
+}
+
+
+/** \brief  Test contiguous dirent storage of dir.c
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_base_dir_storage(test_case_t *test)
+{
+    cbmfm_dir_t *dir;
+    cbmfm_dirent_t dirent;
+    uint8_t data[4] = { 0x01, 0x08, 0x60, 0x00 };
+    uint16_t i;
+    bool ok;
+
+    test->total = 3;
+
+    dir = cbmfm_d64_dir_read(&image);
+    if (dir == NULL) {
+        printf("..... failed to read directory -> fatal\n");
+        return false;
+    }
+    printf("..... D64 directory sized for %zu entries .. ", dir->entry_max);
+    ok = dir->entry_max == CBMFM_D64_DIR_ENTRIES_MAX;
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+    cbmfm_dir_free(dir);
+
+    /* grow a dir past its size hint, entries with file data get a copy */
+    printf("..... appending 20 entries to a dir sized for 4 .. ");
+    dir = cbmfm_dir_new_size(4);
+    cbmfm_dirent_init(&dirent);
+    dirent.filedata = data;
+    dirent.filesize = sizeof data;
+    for (i = 0; i < 20; i++) {
+        dirent.index = i;
+        cbmfm_dir_append_dirent(dir, &dirent);
+    }
+    ok = dir->entry_used == 20 && dir->entry_max >= 20;
+    for (i = 0; ok && i < 20; i++) {
+        ok = dir->entries[i].index == i
+            && dir->entries[i].dir == dir
+            && dir->entries[i].filedata != data
+            && memcmp(dir->entries[i].filedata, data, sizeof data) == 0;
+    }
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+    cbmfm_dir_free(dir);
+
+    /* append an entry of a full dir to itself, forcing the array to move */
+    printf("..... appending an entry of a full dir to itself .. ");
+    dir = cbmfm_dir_new_size(1);
+    dirent.index = 42;
+    cbmfm_dir_append_dirent(dir, &dirent);
+    ok = cbmfm_dir_append_dirent(dir, &(dir->entries[0]))
+        && dir->entry_used == 2
+        && dir->entries[1].index == 42
+        && dir->entries[1].dir == dir
+        && dir->entries[1].filedata != dir->entries[0].filedata
+        && memcmp(dir->entries[1].filedata, data, sizeof data) == 0;
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+    cbmfm_dir_free(dir);
+    return true;
+}
@@ -31,7 +31,9 @@
 
 #include "lib/base/image.h"
 #include "lib/base/dir.h"
+#include "lib/base/dxx.h"
 #include "lib/base/errors.h"
+#include "lib/base/mem.h"
 #include "lib/image/d64.h"
 #include "testcase.h"
 
@@ -52,7 +54,9 @@ static cbmfm_d64_t image;
 
 
 static bool test_lib_base_dxx_geometry(test_case_t *test);
+static bool test_lib_base_dxx_tables(test_case_t *test);
 static bool test_lib_base_dxx_block(test_case_t *test);
+static bool test_lib_base_dxx_extents(test_case_t *test);
 
 
 /** \brief  Setup function for the test module
@@ -86,8 +90,12 @@ static void test_lib_base_dxx_teardown(void)
 static test_case_t tests_lib_base_dxx[] = {
     { "geometry", "Dxx image geometry handling",
         test_lib_base_dxx_geometry, 0, 0 },
+    { "tables", "Dxx geometry tables",
+        test_lib_base_dxx_tables, 0, 0 },
     { "block", "Dxx image block handling",
         test_lib_base_dxx_block, 0, 0 },
+    { "extents", "Dxx zero-copy block chain access",
+        test_lib_base_dxx_extents, 0, 0 },
     { NULL, NULL, NULL, 0, 0 }
 };
 
@@ -187,6 +195,108 @@ static bool test_lib_base_dxx_geometry(test_case_t *test)
 }
 
 
+/** \brief  Geometry table test struct
+ */
+typedef struct table_test_s {
+    const char *name;   /**< geometry name */
+    int type;           /**< image type */
+    int tracks;         /**< number of tracks */
+    int blocks;         /**< expected number of blocks */
+} table_test_t;
+
+
+/** \brief  List of geometries to test
+ */
+static const table_test_t table_tests[] = {
+    { "D64 (35 tracks)", CBMFM_IMAGE_TYPE_D64, 35, CBMFM_D64_BLOCK_COUNT },
+    { "D64 (40 tracks)", CBMFM_IMAGE_TYPE_D64, 40, CBMFM_D64_BLOCK_COUNT_EXT },
+    { "D64 (42 tracks)", CBMFM_IMAGE_TYPE_D64, 42, CBMFM_D64_BLOCK_COUNT_42 },
+    { "D71", CBMFM_IMAGE_TYPE_D71, 0, CBMFM_D71_BLOCK_COUNT },
+    { "D80", CBMFM_IMAGE_TYPE_D80, 0, CBMFM_D80_BLOCK_COUNT },
+    { "D81", CBMFM_IMAGE_TYPE_D81, 0, CBMFM_D81_BLOCK_COUNT },
+    { "D82", CBMFM_IMAGE_TYPE_D82, 0, CBMFM_D82_BLOCK_COUNT },
+    { NULL, 0, 0, 0 }
+};
+
+
+/** \brief  Test precomputed geometry tables of dxx.c
+ *
+ * Checks the tables against the speed zones: each (track,sector) must map to
+ * the same block number as cbmfm_dxx_block_number() returns, and each block
+ * number must map back to the same (track,sector).
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_base_dxx_tables(test_case_t *test)
+{
+    int i;
+
+    for (i = 0; table_tests[i].name != NULL; i++) {
+        const cbmfm_dxx_geometry_t *geo;
+        int track;
+        int block = 0;
+        bool ok = true;
+
+        test->total++;
+        printf("..... checking %s geometry .. ", table_tests[i].name);
+        geo = cbmfm_dxx_geometry_get(table_tests[i].type,
+                table_tests[i].tracks);
+        if (geo == NULL) {
+            printf("failed: not found\n");
+            test->failed++;
+            continue;
+        }
+
+        for (track = 1; track <= geo->track_max && ok; track++) {
+            int sector;
+            int blocks = geo->tracks[track].blocks;
+
+            for (sector = 0; sector < blocks; sector++) {
+                int t = 0;
+                int s = 0;
+
+                if (cbmfm_dxx_geometry_block_number(geo, track, sector)
+                        != block
+                        || cbmfm_dxx_block_number(geo->zones, track, sector)
+                        != block
+                        || !cbmfm_dxx_geometry_block_ts(geo, block, &t, &s)
+                        || t != track || s != sector) {
+                    printf("failed at (%d,%d) ", track, sector);
+                    ok = false;
+                    break;
+                }
+                block++;
+            }
+            if (ok && cbmfm_dxx_geometry_block_number(geo, track, blocks)
+                    >= 0) {
+                printf("failed: sector %d accepted on track %d ",
+                        blocks, track);
+                ok = false;
+            }
+        }
+        if (ok && (block != geo->block_count
+                    || block != table_tests[i].blocks)) {
+            printf("failed: got %d blocks ", block);
+            ok = false;
+        }
+        if (ok && cbmfm_dxx_geometry_block_number(geo, geo->track_max + 1, 0)
+                >= 0) {
+            printf("failed: track %d accepted ", geo->track_max + 1);
+            ok = false;
+        }
+        if (ok) {
+            printf("%d blocks, OK\n", block);
+        } else {
+            printf("\n");
+            test->failed++;
+        }
+    }
+    return true;
+}
+
+
 /** \brief  Test block handling of dxx.c
  *
  * \param[in,out]   test    test case
@@ -240,3 +350,85 @@ static bool test_lib_base_dxx_block(test_case_t *test)
 
     return true;
 }
+
+
+/** \brief  Test zero-copy block chain access of dxx.c
+ *
+ * Walks the chain at (17,0) of the test image with the payload iterator and
+ * checks the result against cbmfm_dxx_chain_extents().
+ *
+ * \param[in,out]   test    test case
+ *
+ * \return  false on failure inside the test code, not on test failure(s)
+ */
+static bool test_lib_base_dxx_extents(test_case_t *test)
+{
+    cbmfm_dxx_block_iter_t iter;
+    cbmfm_extent_t *extents;
+    size_t count;
+    size_t total;
+    size_t blocks = 0;
+    size_t bytes = 0;
+    size_t i;
+    bool ok = true;
+
+    test->total = 3;
+
+    printf("..... walking chain at (17,0) with cbmfm_dxx_block_iter_payload() .. ");
+    if (!cbmfm_dxx_block_iter_init(&iter, (cbmfm_dxx_image_t *)&image, 17, 0)) {
+        printf("failed: fatal\n");
+        return false;
+    }
+    while (iter.curr.track != 0) {
+        size_t size;
+        const uint8_t *payload = cbmfm_dxx_block_iter_payload(&iter, &size);
+
+        if (payload == NULL) {
+            break;
+        }
+        blocks++;
+        bytes += size;
+        cbmfm_dxx_block_iter_next(&iter);
+    }
+    printf("%zu blocks, %zu bytes .. ", blocks, bytes);
+    if (blocks == 163) {
+        printf("OK\n");
+    } else {
+        printf("failed\n");
+        test->failed++;
+    }
+
+    printf("..... calling cbmfm_dxx_chain_extents(17, 0) .. ");
+    extents = cbmfm_dxx_chain_extents((cbmfm_dxx_image_t *)&image, 17, 0,
+            &count, &total);
+    if (extents == NULL) {
+        cbmfm_perror("failed");
+        test->failed += 2;
+        return true;
+    }
+    printf("%zu extents, %zu bytes .. ", count, total);
+    if (count == blocks && total == bytes) {
+        printf("OK\n");
+    } else {
+        printf("failed\n");
+        test->failed++;
+    }
+
+    printf("..... checking extents point at block payloads .. ");
+    for (i = 0; i < count; i++) {
+        if (extents[i].offset % CBMFM_BLOCK_SIZE_RAW != 2
+                || extents[i].offset + extents[i].size > image.size
+                || (i < count - 1 && extents[i].size != CBMFM_BLOCK_SIZE_DATA)) {
+            ok = false;
+            break;
+        }
+    }
+    if (ok) {
+        printf("OK\n");
+    } else {
+        printf("failed at extent %zu\n", i);
+        test->failed++;
+    }
+    cbmfm_free(extents);
+    return true;
+}
@@ -31,9 +31,12 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include <string.h>
+#include <time.h>
 
 
 #include "lib/base/errors.h"
+#include "lib/base/io.h"
+#include "lib/base/log.h"
 #include "lib/base/mem.h"
 
 #include "testcase.h"
@@ -187,9 +190,37 @@ static const zc_unpack_test_t unpack_tests[] = {
 
 
 
+/** \brief  Zipcode files used for the RLE decoder tests and benchmark
+ */
+static const char *rle_files[] = {
+    "data/images/zipdisk/1!CUM",
+    "data/images/zipdisk/2!CUM",
+    "data/images/zipdisk/3!CUM",
+    "data/images/zipdisk/4!CUM",
+    "data/images/zipdisk/1!SPHERE.Z64",
+    "data/images/zipdisk/2!SPHERE.Z64",
+    "data/images/zipdisk/3!SPHERE.Z64",
+    "data/images/zipdisk/4!SPHERE.Z64",
+    "data/images/zipdisk/1!comic",
+    "data/images/zipdisk/2!comic",
+    "data/images/zipdisk/3!comic",
+    "data/images/zipdisk/4!comic",
+    NULL
+};
+
+/** \brief  Number of random RLE blocks to compare with the reference decoder
+ */
+#define RLE_RANDOM_COUNT    100000
+
+/** \brief  Number of passes over the sample files in the benchmark
+ */
+#define RLE_BENCH_PASSES    200
+
+
 static bool setup(void);
 static void teardown(void);
 static bool test_lib_base_zipcode_unpack(struct test_case_s *test);
+static bool test_lib_base_zipcode_rle(struct test_case_s *test);
 
 
 /** \brief  List of tests for the base library functions
@@ -197,6 +228,8 @@ static bool test_lib_base_zipcode_unpack(struct test_case_s *test);
 static test_case_t tests_lib_base_zipcode[] = {
     { "unpack", "test unpacking of a zipcoded block",
         test_lib_base_zipcode_unpack, 0, 0 },
+    { "rle", "compare and benchmark the RLE decoder",
+        test_lib_base_zipcode_rle, 0, 0 },
     { NULL, NULL, NULL, 0, 0 }
 };
 
@@ -299,3 +332,245 @@ static bool test_lib_base_zipcode_unpack(struct test_case_s *test)
 
     return true;
 }
+
+
+/** \brief  Reference RLE decoder
+ *
+ * Straight byte-by-byte decoder the library's RLE decoder is checked against,
+ * with identical error handling.
+ *
+ * \param[out]  dst destination of decoded data
+ * \param[in]   src zipcode block entry
+ *
+ * \return  number of bytes used from \a src, or -1 on error
+ */
+static int rle_decode_ref(uint8_t *dst, const uint8_t *src)
+{
+    size_t rle_len = src[CBMFM_ZIPCODE_BLOCK_RLE_LEN];
+    uint8_t pack_byte = src[CBMFM_ZIPCODE_BLOCK_RLE_PACK_BYTE];
+    const uint8_t *rle_data = src + CBMFM_ZIPCODE_BLOCK_RLE_DATA;
+    size_t dst_idx = 0;
+    size_t rle_idx = 0;
+
+    while (dst_idx < 256 && rle_idx < rle_len) {
+        if (rle_data[rle_idx] != pack_byte) {
+            dst[dst_idx++] = rle_data[rle_idx++];
+        } else {
+            int len;
+            uint8_t b;
+
+            if (rle_idx + 2 >= rle_len) {
+                cbmfm_errno = CBMFM_ERR_BUFFER_UNDERFLOW;
+                return -1;
+            }
+            len = rle_data[++rle_idx];
+            b = rle_data[++rle_idx];
+            rle_idx++;
+            while (len-- > 0 && dst_idx < 256) {
+                dst[dst_idx++] = b;
+            }
+            if (dst_idx == 256 && len > 0) {
+                cbmfm_errno = CBMFM_ERR_BUFFER_OVERFLOW;
+                return -1;
+            }
+        }
+    }
+    if (dst_idx < 256) {
+        cbmfm_errno = CBMFM_ERR_BUFFER_UNDERFLOW;
+        return -1;
+    }
+    return (int)rle_idx + 4;
+}
+
+
+/** \brief  Decode RLE block with both decoders and compare the results
+ *
+ * \param[in]   src zipcode block entry, using the RLE method
+ *
+ * \return  true if result, error code and decoded data are identical
+ */
+static bool rle_compare(const uint8_t *src)
+{
+    uint8_t dst_lib[256];
+    uint8_t dst_ref[256];
+    int res_lib;
+    int res_ref;
+    int err_lib;
+    int err_ref;
+
+    memset(dst_lib, 0, sizeof dst_lib);
+    memset(dst_ref, 0, sizeof dst_ref);
+    cbmfm_errno = CBMFM_ERR_OK;
+    res_lib = cbmfm_zipcode_unpack(dst_lib, src);
+    err_lib = cbmfm_errno;
+    cbmfm_errno = CBMFM_ERR_OK;
+    res_ref = rle_decode_ref(dst_ref, src);
+    err_ref = cbmfm_errno;
+
+    return res_lib == res_ref
+        && err_lib == err_ref
+        && (res_lib < 0 || memcmp(dst_lib, dst_ref, sizeof dst_lib) == 0);
+}
+
+
+/** \brief  Collect the RLE block entries of a zipcoded disk file
+ *
+ * \param[in]       data    file data
+ * \param[in]       size    size of \a data
+ * \param[in]       header  size of the file header
+ * \param[out]      blocks  array to store pointers to the RLE entries
+ * \param[in,out]   count   number of entries in \a blocks
+ * \param[in]       max     size of \a blocks
+ */
+static void rle_collect(const uint8_t *data, size_t size, size_t header,
+                        const uint8_t **blocks, size_t *count, size_t max)
+{
+    size_t pos = header;
+
+    while (pos + 3 <= size) {
+        const uint8_t *src = data + pos;
+        size_t entry;
+
+        switch (src[CBMFM_ZIPCODE_BLOCK_TRACK] & 0xc0) {
+            case CBMFM_ZIPCODE_FLAG_STORE:
+                entry = 258;
+                break;
+            case CBMFM_ZIPCODE_FLAG_FILL:
+                entry = 3;
+                break;
+            case CBMFM_ZIPCODE_FLAG_RLE:
+                entry = 4 + (size_t)src[CBMFM_ZIPCODE_BLOCK_RLE_LEN];
+                if (pos + entry <= size && *count < max) {
+                    blocks[(*count)++] = src;
+                }
+                break;
+            default:
+                return;
+        }
+        pos += entry;
+    }
+}
+
+
+/** \brief  Compare the RLE decoder with the reference decoder and time both
+ *
+ * Uses the RLE blocks of the zipcoded disk samples and random RLE blocks.
+ * The timings are informational, only mismatches count as failures.
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_base_zipcode_rle(struct test_case_s *test)
+{
+    uint8_t *files[sizeof rle_files / sizeof rle_files[0]];
+    const uint8_t **blocks;
+    size_t count = 0;
+    size_t max = 4096;
+    size_t mismatches;
+    size_t i;
+    uint32_t seed = 0x12345678;
+    uint8_t random_block[4 + 255];
+    uint8_t dst[256];
+    cbmfm_ctx_t ctx;
+    clock_t start;
+    double time_lib;
+    double time_ref;
+    int pass;
+
+    test->total = 2;
+
+    blocks = cbmfm_malloc(max * sizeof *blocks);
+    for (i = 0; rle_files[i] != NULL; i++) {
+        intmax_t size = cbmfm_read_file(&files[i], rle_files[i]);
+        const char *name = strrchr(rle_files[i], '/') + 1;
+
+        if (size < 0) {
+            files[i] = NULL;
+            continue;
+        }
+        rle_collect(files[i], (size_t)size, name[0] == '1' ? 4 : 2,
+                blocks, &count, max);
+    }
+
+    /* no log messages during the comparison and benchmark */
+    cbmfm_ctx_init(&ctx);
+    cbmfm_ctx_set(&ctx);
+    cbmfm_log_set_level(CBMFM_LOG_NONE);
+
+    printf("..... comparing %zu RLE blocks of the samples with the reference"
+            " decoder ... ", count);
+    mismatches = 0;
+    for (i = 0; i < count; i++) {
+        if (!rle_compare(blocks[i])) {
+            mismatches++;
+        }
+    }
+    printf("%s\n", count > 0 && mismatches == 0 ? "OK" : "failed");
+    if (count == 0 || mismatches > 0) {
+        test->failed++;
+    }
+
+    printf("..... comparing %d random RLE blocks with the reference"
+            " decoder ... ", RLE_RANDOM_COUNT);
+    mismatches = 0;
+    for (pass = 0; pass < RLE_RANDOM_COUNT; pass++) {
+        size_t len;
+
+        /* small alphabet, so pack bytes and runs are frequent */
+        seed = seed * 1103515245u + 12345u;
+        len = (seed >> 16) & 0xff;
+        random_block[0] = 18 | CBMFM_ZIPCODE_FLAG_RLE;
+        random_block[1] = 0;
+        random_block[2] = (uint8_t)len;
+        random_block[3] = 0;
+        for (i = 0; i < len; i++) {
+            seed = seed * 1103515245u + 12345u;
+            random_block[4 + i] = (uint8_t)((seed >> 16) & 0x07);
+            if (i > 0 && random_block[3 + i] == 0) {
+                /* run length */
+                random_block[4 + i] = (uint8_t)((seed >> 20) & 0x7f);
+            }
+        }
+        if (!rle_compare(random_block)) {
+            mismatches++;
+        }
+    }
+    printf("%s\n", mismatches == 0 ? "OK" : "failed");
+    if (mismatches > 0) {
+        test->failed++;
+    }
+
+    /* benchmark */
+    if (count > 0) {
+        start = clock();
+        for (pass = 0; pass < RLE_BENCH_PASSES; pass++) {
+            for (i = 0; i < count; i++) {
+                cbmfm_zipcode_unpack(dst, blocks[i]);
+            }
+        }
+        time_lib = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        start = clock();
+        for (pass = 0; pass < RLE_BENCH_PASSES; pass++) {
+            for (i = 0; i < count; i++) {
+                rle_decode_ref(dst, blocks[i]);
+            }
+        }
+        time_ref = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        printf("..... decoding %zu blocks %d times: library %.3fs, reference"
+                " %.3fs", count, RLE_BENCH_PASSES, time_lib, time_ref);
+        if (time_lib > 0.0) {
+            printf(" (%.1fx)", time_ref / time_lib);
+        }
+        printf("\n");
+    }
+
+    cbmfm_ctx_set(NULL);
+    for (i = 0; rle_files[i] != NULL; i++) {
+        cbmfm_free(files[i]);
+    }
+    cbmfm_free(blocks);
+    return true;
+}
@@ -27,11 +27,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 
 #include "lib/image/ark.h"
 #include "lib/base/image.h"
 #include "lib/base/dir.h"
+#include "lib/base/file.h"
 #include "testcase.h"
 
 #include "test_lib_image_ark.h"
@@ -48,6 +50,8 @@
 static bool test_lib_image_ark_open(test_case_t *test);
 static bool test_lib_image_ark_dir(test_case_t *test);
 static bool test_lib_image_ark_file(test_case_t *test);
+static bool test_lib_image_ark_offsets(test_case_t *test);
+static bool test_lib_image_ark_visit(test_case_t *test);
 
 
 /** \brief  List of tests for the base library functions
@@ -59,6 +63,10 @@ static test_case_t tests_lib_image_ark[] = {
         test_lib_image_ark_dir, 0, 0 },
     { "file", "File handling of Ark archives",
         test_lib_image_ark_file, 0, 0 },
+    { "offsets", "File data offsets of Ark archives",
+        test_lib_image_ark_offsets, 0, 0 },
+    { "visit", "Directory visiting of Ark archives",
+        test_lib_image_ark_visit, 0, 0 },
     { NULL, NULL, NULL, 0, 0 }
 };
 
@@ -256,3 +264,158 @@ static bool test_lib_image_ark_file(test_case_t *test)
     cbmfm_image_cleanup(&image);
     return true;
 }
+
+
+/** \brief  Test file data offsets of Ark archives
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_ark_offsets(test_case_t *test)
+{
+    cbmfm_image_t image;
+    cbmfm_dir_t *dir;
+    cbmfm_file_t file;
+    size_t offset;
+    size_t index;
+    size_t size;
+    bool ok;
+
+    test->total = 3;
+
+    cbmfm_image_init(&image);
+    if (!cbmfm_ark_open(&image, ARK_TPZTOOLS_FILE)) {
+        printf("..... failed to open archive: fatal\n");
+        return false;
+    }
+
+    /* the first file starts at the first block after the directory */
+    printf("..... checking data offsets .. ");
+    dir = cbmfm_ark_read_dir(&image, false);
+    if (dir == NULL) {
+        printf("failed to read directory: fatal\n");
+        cbmfm_image_cleanup(&image);
+        return false;
+    }
+    offset = 0xfe;
+    ok = true;
+    for (index = 0; ok && index < dir->entry_used; index++) {
+        ok = dir->entries[index].extra.ark.data_offset == offset;
+        offset += dir->entries[index].size_blocks * (size_t)0xfe;
+    }
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+
+    /* the last file's data must come from its offset */
+    printf("..... reading last file .. ");
+    index = dir->entry_used - 1;
+    ok = cbmfm_ark_read_file(&image, &file, (int)index);
+    if (ok) {
+        ok = file.size == dir->entries[index].filesize
+            && memcmp(file.data,
+                    image.data + dir->entries[index].extra.ark.data_offset,
+                    file.size) == 0;
+        cbmfm_file_cleanup(&file);
+    }
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+    cbmfm_dir_free(dir);
+
+    /* a truncated archive must be rejected */
+    printf("..... reading directory of truncated archive .. ");
+    size = image.size;
+    image.size = size - 0x200;
+    cbmfm_image_dir_cache_clear(&image);
+    dir = cbmfm_ark_read_dir(&image, false);
+    ok = dir == NULL;
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+        cbmfm_dir_free(dir);
+    }
+    image.size = size;
+
+    cbmfm_image_cleanup(&image);
+    return true;
+}
+
+
+/** \brief  Compare the entries of two Ark directories
+ *
+ * \param[in]   a   directory
+ * \param[in]   b   directory
+ *
+ * \return  true if \a a and \a b contain the same entries
+ */
+static bool ark_dir_equal(const cbmfm_dir_t *a, const cbmfm_dir_t *b)
+{
+    size_t index;
+
+    if (a->entry_used != b->entry_used) {
+        return false;
+    }
+    for (index = 0; index < a->entry_used; index++) {
+        const cbmfm_dirent_t *da = &(a->entries[index]);
+        const cbmfm_dirent_t *db = &(b->entries[index]);
+
+        if (memcmp(da->filename, db->filename, sizeof da->filename) != 0
+                || da->filetype != db->filetype
+                || da->filesize != db->filesize
+                || da->size_blocks != db->size_blocks
+                || da->extra.ark.data_offset != db->extra.ark.data_offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/** \brief  Test directory visiting of Ark archives
+ *
+ * Visits the directory of a freshly opened archive, so nothing is cached,
+ * and compares the entries with the directory read afterwards.
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_ark_visit(test_case_t *test)
+{
+    cbmfm_image_t image;
+    cbmfm_dir_t *visited;
+    cbmfm_dir_t *dir;
+    int count;
+    bool ok;
+
+    test->total = 1;
+
+    cbmfm_image_init(&image);
+    if (!cbmfm_ark_open(&image, ARK_TPZTOOLS_FILE)) {
+        printf("..... failed to open archive: fatal\n");
+        return false;
+    }
+
+    printf("..... visiting '%s' .. ", ARK_TPZTOOLS_FILE);
+    visited = cbmfm_dir_new();
+    count = cbmfm_ark_visit_dir(&image, false, cbmfm_dir_append_visitor,
+            visited);
+    dir = cbmfm_ark_read_dir(&image, false);
+    ok = count >= 0 && dir != NULL
+        && (size_t)count == dir->entry_used
+        && ark_dir_equal(visited, dir);
+    printf("%s (%d entries)\n", ok ? "OK" : "failed", count);
+    if (!ok) {
+        test->failed++;
+    }
+    if (dir != NULL) {
+        cbmfm_dir_free(dir);
+    }
+    cbmfm_dir_free(visited);
+    cbmfm_image_cleanup(&image);
+    return true;
+}
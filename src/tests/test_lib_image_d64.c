@@ -32,7 +32,10 @@
 #include <inttypes.h>
 
 #include "lib/image/d64.h"
+#include "lib/image/validate.h"
 #include "lib/base/dir.h"
+#include "lib/base/dxx.h"
+#include "lib/base/errors.h"
 #include "lib/base/file.h"
 #include "lib/base/image.h"
 #include "lib/base/io.h"
@@ -73,6 +76,14 @@
  */
 #define D64_FORMATTED_40T   "formatted-image-40t.d64"
 
+/** \brief  Number of files to import, enough to extend the directory
+ */
+#define D64_IMPORT_COUNT    20
+
+/** \brief  Host file to import (161 blocks)
+ */
+#define D64_IMPORT_HOST_FILE    "data/images/ark/Tpztools.ark"
+
 
 
 static bool test_lib_image_d64_open(test_case_t *test);
@@ -81,6 +92,11 @@ static bool test_lib_image_d64_format(test_case_t *test);
 static bool test_lib_image_d64_dir(test_case_t *test);
 static bool test_lib_image_d64_read(test_case_t *test);
 static bool test_lib_image_d64_write(test_case_t *test);
+static bool test_lib_image_d64_validate(test_case_t *test);
+static bool test_lib_image_d64_import(test_case_t *test);
+static bool test_lib_image_d64_cache(test_case_t *test);
+static bool test_lib_image_d64_visit(test_case_t *test);
+static bool test_lib_image_d64_readonly(test_case_t *test);
 
 
 /** \brief  List of tests for the base library functions
@@ -98,6 +114,16 @@ static test_case_t tests_lib_image_d64[] = {
         test_lib_image_d64_read, 0, 0 },
     { "write", "File writing of D64 images",
         test_lib_image_d64_write, 0, 0 },
+    { "validate", "Validating D64 images",
+        test_lib_image_d64_validate, 0, 0 },
+    { "import", "Bulk import into D64 images",
+        test_lib_image_d64_import, 0, 0 },
+    { "cache", "Directory caching of D64 images",
+        test_lib_image_d64_cache, 0, 0 },
+    { "visit", "Directory visiting of D64 images",
+        test_lib_image_d64_visit, 0, 0 },
+    { "readonly", "Refusing to alter mapped D64 images",
+        test_lib_image_d64_readonly, 0, 0 },
     { NULL, NULL, NULL, 0, 0 }
 };
 
@@ -196,8 +222,11 @@ static bool test_lib_image_d64_bam(test_case_t *test)
     char disk_name[CBMFM_CBMDOS_FILE_NAME_LEN + 1];
     char disk_id[CBMFM_CBMDOS_DISK_ID_LEN_EXT + 1];
     int blocks_free;
+    int track;
+    int sector;
+    bool state;
 
-    test->total = 4;
+    test->total = 6;
 
     cbmfm_d64_init(&image);
 
@@ -250,6 +279,41 @@ static bool test_lib_image_d64_bam(test_case_t *test)
         test->failed++;
     }
 
+    /* find a track with free blocks and allocate its first free sector */
+    for (track = 1; track <= CBMFM_D64_TRACK_MAX; track++) {
+        if (track != CBMFM_D64_DIR_TRACK
+                && cbmfm_d64_bam_track_get_blocks_free(&image, track) > 0) {
+            break;
+        }
+    }
+    sector = cbmfm_d64_bam_track_get_first_free(&image, track);
+    printf("..... calling cbmfm_d64_bam_track_get_first_free(%d) = %d\n",
+            track, sector);
+    printf("..... allocating (%d,%d) .. ", track, sector);
+    result = sector >= 0
+        && cbmfm_d64_bam_sector_set_free(&image, track, sector, false)
+        && cbmfm_d64_bam_sector_get_free(&image, track, sector, &state)
+        && !state
+        && cbmfm_d64_blocks_free(&image) == blocks_free - 1
+        && cbmfm_d64_bam_ptr_trk(&image, track)[0]
+            == cbmfm_d64_bam_track_get_blocks_free(&image, track)
+        && cbmfm_d64_bam_track_get_first_free(&image, track) != sector;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+
+    /* release it again and resync the mirror from the image data */
+    printf("..... releasing (%d,%d) and resyncing .. ", track, sector);
+    cbmfm_d64_bam_sector_set_free(&image, track, sector, true);
+    cbmfm_d64_bam_sync(&image);
+    result = cbmfm_d64_blocks_free(&image) == blocks_free
+        && cbmfm_d64_bam_track_get_first_free(&image, track) == sector;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+
     cbmfm_d64_cleanup(&image);
     return true;
 }
@@ -306,9 +370,11 @@ static bool test_lib_image_d64_read(test_case_t *test)
 {
     cbmfm_d64_t image;
     cbmfm_file_t file;
+    uint8_t *first;
+    uint8_t *block;
     bool result;
 
-    test->total = 1;
+    test->total = 3;
 
     cbmfm_d64_init(&image);
 
@@ -336,8 +402,33 @@ static bool test_lib_image_d64_read(test_case_t *test)
         }
     }
 
+    /* 162 full blocks and a final block with 241 bytes */
+    printf("..... checking file size: expected 41269, got %zu .. ", file.size);
+    if (file.size == 41269) {
+        printf("OK\n");
+    } else {
+        printf("failed\n");
+        test->failed++;
+    }
+    cbmfm_file_cleanup(&file);
 
+    /* make the second block link back to the first */
+    printf("..... checking a looping chain is rejected .. ");
+    first = image.data + cbmfm_dxx_image_block_offset(
+            (cbmfm_dxx_image_t *)&image, 17, 0);
+    block = image.data + cbmfm_dxx_image_block_offset(
+            (cbmfm_dxx_image_t *)&image, first[0], first[1]);
+    block[0] = 17;
+    block[1] = 0;
+    if (!cbmfm_d64_file_read_from_block(&image, &file, 17, 0)
+            && cbmfm_errno == CBMFM_ERR_INVALID_DATA) {
+        printf("OK\n");
+    } else {
+        printf("failed\n");
+        test->failed++;
+    }
     cbmfm_file_cleanup(&file);
+
     cbmfm_d64_cleanup(&image);
     return true;
 }
@@ -352,10 +443,22 @@ static bool test_lib_image_d64_read(test_case_t *test)
 static bool test_lib_image_d64_write(test_case_t *test)
 {
     cbmfm_d64_t image;
+    cbmfm_d64_t copy;
     cbmfm_dxx_block_iter_t iter;
+    cbmfm_dxx_block_iter_t iter_copy;
+    cbmfm_d64_writer_t writer;
+    cbmfm_file_t file;
+    cbmfm_file_t file_copy;
+    cbmfm_file_t large;
+    cbmfm_dir_t *dir;
+    uint8_t *dir_track;
+    uint8_t *dir_orig;
+    size_t dir_size;
+    size_t pos;
+    int blocks_free;
     bool result;
 
-    test->total = 1;
+    test->total = 5;
 
     cbmfm_d64_init(&image);
 
@@ -377,7 +480,93 @@ static bool test_lib_image_d64_write(test_case_t *test)
         printf("OK\n");
     }
 
+    /* read file at (17,0) and write it to a fresh image in small chunks */
+    if (!cbmfm_d64_file_read_from_block(&image, &file, 17, 0)) {
+        printf("failed to read (17,0): fatal\n");
+        cbmfm_d64_cleanup(&image);
+        return false;
+    }
+    memcpy(file.name, "ARMALYTE\xa0\xa0\xa0\xa0\xa0\xa0\xa0\xa0",
+            CBMFM_CBMDOS_FILE_NAME_LEN);
+    file.type = CBMFM_CBMDOS_PRG | CBMFM_CBMDOS_FILE_CLOSED_BIT;
+
+    cbmfm_d64_init(&copy);
+    cbmfm_d64_format(&copy, "streamed", "01 2a", false);
+
+    printf("..... writing %zu bytes with cbmfm_d64_writer_append() .. ",
+            file.size);
+    result = cbmfm_d64_writer_open(&writer, &copy, file.name, file.type);
+    for (pos = 0; result && pos < file.size; pos += 100) {
+        result = cbmfm_d64_writer_append(&writer, file.data + pos,
+                file.size - pos < 100 ? file.size - pos : 100);
+    }
+    result = result && cbmfm_d64_writer_close(&writer);
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+
+    /* the DOS allocation strategy should reproduce the original chain */
+    printf("..... comparing block chain with the original .. ");
+    cbmfm_dxx_block_iter_init(&iter, (cbmfm_dxx_image_t *)&image, 17, 0);
+    cbmfm_dxx_block_iter_init(&iter_copy, (cbmfm_dxx_image_t *)&copy, 17, 0);
+    do {
+        result = iter.curr.track == iter_copy.curr.track
+            && iter.curr.sector == iter_copy.curr.sector;
+    } while (result && cbmfm_dxx_block_iter_next(&iter)
+            && cbmfm_dxx_block_iter_next(&iter_copy));
+    result = result && cbmfm_d64_blocks_free(&copy) == 664 - 163;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+
+    printf("..... reading back written file via the directory .. ");
+    dir = cbmfm_d64_dir_read(&copy);
+    result = dir != NULL
+        && cbmfm_d64_file_read_from_dirent(&(dir->entries[0]), &file_copy)
+        && dir->entries[0].size_blocks == 163
+        && dir->entries[0].filetype == file.type
+        && file_copy.size == file.size
+        && memcmp(file_copy.data, file.data, file.size) == 0;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    if (dir != NULL) {
+        cbmfm_file_cleanup(&file_copy);
+        cbmfm_dir_free(dir);
+    }
+
+    /* a file that doesn't fit must leave the directory and BAM alone */
+    printf("..... writing a file larger than the free space .. ");
+    blocks_free = cbmfm_d64_blocks_free(&copy);
+    dir_track = copy.data + cbmfm_dxx_image_block_offset(
+            (cbmfm_dxx_image_t *)&copy, CBMFM_D64_DIR_TRACK, 0);
+    dir_size = (size_t)cbmfm_dxx_track_block_count(
+            (cbmfm_dxx_image_t *)&copy, CBMFM_D64_DIR_TRACK)
+        * CBMFM_BLOCK_SIZE_RAW;
+    dir_orig = cbmfm_memdup(dir_track, dir_size);
+    cbmfm_file_init(&large);
+    memcpy(large.name, "TOO LARGE\xa0\xa0\xa0\xa0\xa0\xa0\xa0",
+            CBMFM_CBMDOS_FILE_NAME_LEN);
+    large.type = CBMFM_CBMDOS_PRG | CBMFM_CBMDOS_FILE_CLOSED_BIT;
+    large.size = (size_t)(blocks_free + 1) * CBMFM_BLOCK_SIZE_DATA;
+    large.data = cbmfm_malloc(large.size);
+    memset(large.data, 0x55, large.size);
+    result = !cbmfm_d64_file_write(&copy, &large)
+        && cbmfm_errno == CBMFM_ERR_DISK_FULL
+        && cbmfm_d64_blocks_free(&copy) == blocks_free
+        && memcmp(dir_track, dir_orig, dir_size) == 0;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    cbmfm_file_cleanup(&large);
+    cbmfm_free(dir_orig);
 
+    cbmfm_file_cleanup(&file);
+    cbmfm_d64_cleanup(&copy);
     cbmfm_d64_cleanup(&image);
     return true;
 }
@@ -453,3 +642,493 @@ static bool test_lib_image_d64_format(test_case_t *test)
     cbmfm_d64_cleanup(&image);
     return true;
 }
+
+
+/** \brief  Test validation of D64 images
+ *
+ * Validates the test image, rebuilds its BAM and validates again, then
+ * cross-links two files and checks that is detected.
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_d64_validate(test_case_t *test)
+{
+    cbmfm_d64_t image;
+    cbmfm_d64_validate_t result;
+    cbmfm_d64_writer_t writer;
+    uint8_t name[CBMFM_CBMDOS_FILE_NAME_LEN];
+    uint8_t *entry;
+    uint8_t *block;
+    bool ok;
+
+    test->total = 6;
+
+    cbmfm_d64_init(&image);
+    printf("..... calling cbmfm_d64_open(\"%s\" ... ", D64_ARMALYTE_FILE);
+    if (!cbmfm_d64_open(&image, D64_ARMALYTE_FILE)) {
+        printf("failed: fatal\n");
+        return false;
+    }
+    printf("OK\n");
+
+    printf("..... calling cbmfm_d64_validate():\n");
+    cbmfm_d64_validate(&image, &result);
+    cbmfm_d64_validate_dump(&result);
+    ok = result.files == 12 && result.cross_links == 0 && result.loops == 0
+        && result.illegal_links == 0;
+    printf("..... checking chains .. %s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+
+    printf("..... calling cbmfm_d64_validate_rebuild_bam() .. ");
+    if (!cbmfm_d64_validate_rebuild_bam(&image, &result)) {
+        printf("failed\n");
+        test->failed++;
+    } else {
+        printf("OK\n");
+    }
+    cbmfm_d64_validate_cleanup(&result);
+
+    printf("..... validating again .. ");
+    ok = cbmfm_d64_validate(&image, &result);
+    printf("%d orphans, %d free but used .. %s\n",
+            result.orphans, result.free_used, ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+    cbmfm_d64_validate_cleanup(&result);
+
+    /* point the second file at the first block of the first file */
+    entry = image.data + cbmfm_dxx_image_block_offset(
+            (cbmfm_dxx_image_t *)&image,
+            CBMFM_D64_DIR_TRACK, CBMFM_D64_DIR_SECTOR);
+    entry[CBMFM_DXX_DIRENT_SIZE + CBMFM_D64_DIRENT_FILE_TRACK] =
+        entry[CBMFM_D64_DIRENT_FILE_TRACK];
+    entry[CBMFM_DXX_DIRENT_SIZE + CBMFM_D64_DIRENT_FILE_SECTOR] =
+        entry[CBMFM_D64_DIRENT_FILE_SECTOR];
+    printf("..... checking cross-link detection .. ");
+    cbmfm_d64_validate(&image, &result);
+    if (result.cross_links == 1) {
+        printf("OK\n");
+    } else {
+        printf("failed, got %d cross-links\n", result.cross_links);
+        test->failed++;
+    }
+    cbmfm_d64_validate_cleanup(&result);
+
+    /* turn the first file into a REL file with side sectors pointing at its
+     * own second data block: that's a cross-link, not a loop */
+    entry[CBMFM_DXX_DIRENT_SIZE + CBMFM_D64_DIRENT_FILE_TYPE] = 0x00;
+    block = image.data + cbmfm_dxx_image_block_offset(
+            (cbmfm_dxx_image_t *)&image,
+            entry[CBMFM_D64_DIRENT_FILE_TRACK],
+            entry[CBMFM_D64_DIRENT_FILE_SECTOR]);
+    entry[CBMFM_D64_DIRENT_FILE_TYPE] = CBMFM_CBMDOS_REL
+        | CBMFM_CBMDOS_FILE_CLOSED_BIT;
+    entry[CBMFM_D64_DIRENT_REL_SSB_TRACK] = block[0];
+    entry[CBMFM_D64_DIRENT_REL_SSB_SECTOR] = block[1];
+    printf("..... checking REL side sectors running into their data .. ");
+    cbmfm_d64_validate(&image, &result);
+    if (result.cross_links == 1 && result.loops == 0) {
+        printf("OK\n");
+    } else {
+        printf("failed, got %d cross-links, %d loops\n",
+                result.cross_links, result.loops);
+        test->failed++;
+    }
+    cbmfm_d64_validate_cleanup(&result);
+    cbmfm_d64_cleanup(&image);
+
+    /* an unclosed file is removed and its blocks are freed */
+    printf("..... checking unclosed files are removed .. ");
+    cbmfm_d64_init(&image);
+    cbmfm_d64_format(&image, "splat", "01", false);
+    memset(name, 0xa0, sizeof name);
+    name[0] = 0x53;
+    ok = cbmfm_d64_writer_open(&writer, &image, name, CBMFM_CBMDOS_PRG)
+        && cbmfm_d64_writer_append(&writer, name, sizeof name);
+    ok = ok && !cbmfm_d64_validate(&image, &result)
+        && result.splat_files == 1
+        && cbmfm_d64_validate_rebuild_bam(&image, &result);
+    cbmfm_d64_validate_cleanup(&result);
+    ok = ok && cbmfm_d64_validate(&image, &result)
+        && result.files == 0 && result.splat_files == 0
+        && cbmfm_d64_blocks_free(&image) == 664;
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        cbmfm_d64_validate_dump(&result);
+        test->failed++;
+    }
+    cbmfm_d64_validate_cleanup(&result);
+
+    cbmfm_d64_cleanup(&image);
+    return true;
+}
+
+
+/** \brief  Test bulk import into D64 images
+ *
+ * Imports enough files to extend the directory chain, validates the result
+ * and then checks imports that don't fit leave the image untouched.
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_d64_import(test_case_t *test)
+{
+    cbmfm_d64_t image;
+    cbmfm_d64_import_t files[D64_IMPORT_COUNT + 1];
+    cbmfm_d64_validate_t result;
+    cbmfm_dir_t *dir;
+    uint8_t buffer[1000];
+    uint8_t *snapshot;
+    size_t i;
+    bool ok;
+
+    test->total = 4;
+
+    for (i = 0; i < sizeof buffer; i++) {
+        buffer[i] = (uint8_t)i;
+    }
+    /* a couple of buffers of various sizes and one host file */
+    for (i = 0; i < D64_IMPORT_COUNT; i++) {
+        memset(files[i].name, 0xa0, CBMFM_CBMDOS_FILE_NAME_LEN);
+        files[i].name[0] = (uint8_t)('A' + i);
+        files[i].path = NULL;
+        files[i].data = buffer;
+        files[i].size = (i * 97) % sizeof buffer;
+        files[i].type = CBMFM_CBMDOS_PRG | CBMFM_CBMDOS_FILE_CLOSED_BIT;
+    }
+    files[0].path = D64_IMPORT_HOST_FILE;
+
+    cbmfm_d64_init(&image);
+    cbmfm_d64_format(&image, "import", "01 2a", false);
+
+    printf("..... calling cbmfm_d64_import() with %d files .. ",
+            D64_IMPORT_COUNT);
+    ok = cbmfm_d64_import(&image, files, D64_IMPORT_COUNT);
+    dir = cbmfm_d64_dir_read(&image);
+    ok = ok && dir != NULL && dir->entry_used == D64_IMPORT_COUNT
+        && dir->entries[0].size_blocks == 161
+        && dir->entries[1].size_blocks == 1;
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+    if (dir != NULL) {
+        cbmfm_dir_free(dir);
+    }
+
+    printf("..... validating imported image .. ");
+    ok = cbmfm_d64_validate(&image, &result)
+        && result.files == D64_IMPORT_COUNT;
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        cbmfm_d64_validate_dump(&result);
+        test->failed++;
+    }
+    cbmfm_d64_validate_cleanup(&result);
+
+    /* the Armalyte image itself is 689 blocks, which won't fit */
+    printf("..... checking an overflowing import is rejected .. ");
+    snapshot = cbmfm_memdup(image.data, image.size);
+    files[D64_IMPORT_COUNT] = files[1];
+    files[D64_IMPORT_COUNT].path = D64_ARMALYTE_FILE;
+    ok = !cbmfm_d64_import(&image, files + 1, D64_IMPORT_COUNT)
+        && cbmfm_errno == CBMFM_ERR_DISK_FULL
+        && memcmp(snapshot, image.data, image.size) == 0;
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+
+    /* a block count that doesn't fit in 16 bits must not wrap around */
+    printf("..... checking a 65536 block import is rejected .. ");
+    files[D64_IMPORT_COUNT].path = NULL;
+    files[D64_IMPORT_COUNT].size = (size_t)0x10000 * CBMFM_BLOCK_SIZE_DATA;
+    ok = !cbmfm_d64_import(&image, files + D64_IMPORT_COUNT, 1)
+        && cbmfm_errno == CBMFM_ERR_DISK_FULL
+        && memcmp(snapshot, image.data, image.size) == 0;
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+    cbmfm_free(snapshot);
+
+    cbmfm_d64_cleanup(&image);
+    return true;
+}
+
+
+/** \brief  Test directory caching of D64 images
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_d64_cache(test_case_t *test)
+{
+    cbmfm_d64_t image;
+    cbmfm_dir_t *dir;
+    cbmfm_dir_t *again;
+    cbmfm_file_t file;
+    uint32_t generation;
+    bool ok;
+
+    test->total = 4;
+
+    cbmfm_d64_init(&image);
+    if (!cbmfm_d64_open(&image, D64_ARMALYTE_FILE)) {
+        printf("..... failed to open image: fatal\n");
+        return false;
+    }
+
+    printf("..... reading directory twice .. ");
+    dir = cbmfm_d64_dir_read(&image);
+    again = cbmfm_d64_dir_read(&image);
+    ok = dir != NULL && dir == again;
+    printf("%s\n", ok ? "OK, got cached directory" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+    if (again != NULL) {
+        cbmfm_dir_free(again);
+    }
+
+    /* writing a file bumps the generation, the old dir remains valid */
+    printf("..... reading directory after writing a file .. ");
+    generation = cbmfm_image_get_generation((cbmfm_image_t *)&image);
+    cbmfm_file_init(&file);
+    memcpy(file.name, "NEW\xa0\xa0\xa0\xa0\xa0\xa0\xa0\xa0\xa0\xa0\xa0\xa0\xa0",
+            CBMFM_CBMDOS_FILE_NAME_LEN);
+    file.type = CBMFM_CBMDOS_SEQ | CBMFM_CBMDOS_FILE_CLOSED_BIT;
+    ok = cbmfm_d64_file_write(&image, &file);
+    again = cbmfm_d64_dir_read(&image);
+    ok = ok && again != NULL && again != dir
+        && cbmfm_image_get_generation((cbmfm_image_t *)&image) != generation
+        && dir != NULL && dir->entry_used == 12
+        && again->entry_used == 13;
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+    if (again != NULL) {
+        cbmfm_dir_free(again);
+    }
+    if (dir != NULL) {
+        cbmfm_dir_free(dir);
+    }
+
+    /* BAM and header setters must invalidate the cache too */
+    printf("..... checking BAM and disk name changes bump the generation .. ");
+    generation = cbmfm_image_get_generation((cbmfm_image_t *)&image);
+    ok = cbmfm_d64_bam_sector_set_free(&image, 1, 0, false)
+        && cbmfm_image_get_generation((cbmfm_image_t *)&image) != generation;
+    generation = cbmfm_image_get_generation((cbmfm_image_t *)&image);
+    ok = ok && cbmfm_d64_set_disk_name_asc(&image, "renamed")
+        && cbmfm_image_get_generation((cbmfm_image_t *)&image) != generation;
+    generation = cbmfm_image_get_generation((cbmfm_image_t *)&image);
+    ok = ok && cbmfm_d64_bam_init_bament(&image, 1)
+        && cbmfm_image_get_generation((cbmfm_image_t *)&image) != generation;
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+
+    /* the cached dir is shared: altering it requires a private copy */
+    printf("..... checking the cached directory can't be altered .. ");
+    dir = cbmfm_d64_dir_read(&image);
+    ok = dir != NULL && cbmfm_dir_is_shared(dir)
+        && !cbmfm_dir_append_dirent(dir, &(dir->entries[0]))
+        && cbmfm_errno == CBMFM_ERR_READONLY;
+    if (dir != NULL) {
+        again = cbmfm_d64_dir_read(&image);
+        dir = cbmfm_dir_unshare(dir);
+        ok = ok && again != NULL && dir != again && !cbmfm_dir_is_shared(dir)
+            && cbmfm_dir_append_dirent(dir, &(dir->entries[0]))
+            && dir->entry_used == again->entry_used + 1
+            && dir->entries[again->entry_used].index == again->entries[0].index
+            && memcmp(dir->entries[again->entry_used].filename,
+                    again->entries[0].filename,
+                    sizeof again->entries[0].filename) == 0;
+        cbmfm_dir_free(dir);
+        if (again != NULL) {
+            cbmfm_dir_free(again);
+        }
+    }
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+
+    cbmfm_d64_cleanup(&image);
+    return true;
+}
+
+
+/** \brief  Directory visitor counting blocks, stopping at a block count
+ *
+ * \param[in]       dirent  directory entry
+ * \param[in,out]   data    pointer to an array of two ints: the block count
+ *                          and the count at which to stop (or -1)
+ *
+ * \return  false when the count to stop at is reached
+ */
+static bool d64_visit_count(const cbmfm_dirent_t *dirent, void *data)
+{
+    int *blocks = data;
+
+    blocks[0] += dirent->size_blocks;
+    return blocks[1] < 0 || blocks[0] < blocks[1];
+}
+
+
+/** \brief  Test directory visiting of d64.c
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_d64_visit(test_case_t *test)
+{
+    cbmfm_d64_t image;
+    cbmfm_dir_t *dir;
+    int blocks[2];
+    int uncached;
+    int count;
+    int expected;
+    size_t i;
+    bool ok;
+
+    test->total = 3;
+
+    cbmfm_d64_init(&image);
+    if (!cbmfm_d64_open(&image, D64_ARMALYTE_FILE)) {
+        printf("..... failed to open image: fatal\n");
+        return false;
+    }
+
+    /* stop after the first entry */
+    printf("..... stopping after the first entry .. ");
+    blocks[0] = 0;
+    blocks[1] = 1;
+    count = cbmfm_d64_dir_visit(&image, d64_visit_count, blocks);
+    ok = count == 1;
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+
+    /* all entries, without a cached directory */
+    blocks[0] = 0;
+    blocks[1] = -1;
+    count = cbmfm_d64_dir_visit(&image, d64_visit_count, blocks);
+    uncached = blocks[0];
+
+    dir = cbmfm_d64_dir_read(&image);
+    if (dir == NULL) {
+        printf("..... failed to read directory: fatal\n");
+        cbmfm_d64_cleanup(&image);
+        return false;
+    }
+    expected = 0;
+    for (i = 0; i < dir->entry_used; i++) {
+        expected += dir->entries[i].size_blocks;
+    }
+
+    printf("..... visiting all entries .. ");
+    ok = count == 12 && uncached == expected;
+    printf("%s (%d entries, %d blocks)\n", ok ? "OK" : "failed",
+            count, uncached);
+    if (!ok) {
+        test->failed++;
+    }
+
+    /* same result through the cached directory */
+    printf("..... visiting the cached directory .. ");
+    blocks[0] = 0;
+    blocks[1] = -1;
+    count = cbmfm_d64_dir_visit(&image, d64_visit_count, blocks);
+    ok = count == 12 && blocks[0] == expected;
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+
+    cbmfm_dir_free(dir);
+    cbmfm_d64_cleanup(&image);
+    return true;
+}
+
+
+/** \brief  Test altering a memory-mapped D64 image is refused
+ *
+ * The data of a mapped image isn't writable, so every function altering the
+ * image must fail with #CBMFM_ERR_READONLY instead of touching the data.
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_d64_readonly(test_case_t *test)
+{
+    cbmfm_d64_t image;
+    cbmfm_d64_t copy;
+    cbmfm_d64_validate_t result;
+    cbmfm_dxx_block_iter_t iter;
+    const uint8_t id[CBMFM_CBMDOS_DISK_ID_LEN_EXT] = { 0x30, 0x31, 0xa0,
+        0x32, 0x41 };
+    bool ok;
+
+    test->total = 2;
+
+    cbmfm_d64_init(&image);
+    cbmfm_d64_init(&copy);
+    if (!cbmfm_d64_open_mapped(&image, D64_ARMALYTE_FILE)
+            || !cbmfm_d64_open(&copy, D64_ARMALYTE_FILE)) {
+        printf("..... failed to open image: fatal\n");
+        cbmfm_d64_cleanup(&image);
+        cbmfm_d64_cleanup(&copy);
+        return false;
+    }
+
+    printf("..... calling mutators on a mapped image .. ");
+    ok = !cbmfm_d64_set_disk_name_asc(&image, "mapped")
+        && cbmfm_errno == CBMFM_ERR_READONLY
+        && !cbmfm_d64_set_disk_name_pet(&image, id)
+        && !cbmfm_d64_set_disk_id_asc(&image, "01")
+        && !cbmfm_d64_set_disk_id_asc_ext(&image, "01 2a")
+        && !cbmfm_d64_set_disk_id_pet(&image, id)
+        && !cbmfm_d64_set_disk_id_pet_ext(&image, id)
+        && !cbmfm_d64_bam_sector_set_free(&image, 1, 0, false)
+        && cbmfm_errno == CBMFM_ERR_READONLY
+        && !cbmfm_d64_bam_init_bament(&image, 1)
+        && !cbmfm_d64_bam_init(&image)
+        && !cbmfm_d64_block_write_iter_init(&iter, &image)
+        && !cbmfm_d64_format(&image, "mapped", "01", false)
+        && cbmfm_errno == CBMFM_ERR_READONLY;
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+
+    printf("..... checking the image data is unchanged .. ");
+    ok = cbmfm_d64_validate(&image, &result)
+        && !cbmfm_d64_validate_rebuild_bam(&image, &result)
+        && cbmfm_errno == CBMFM_ERR_READONLY
+        && image.size == copy.size
+        && memcmp(image.data, copy.data, copy.size) == 0;
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+    cbmfm_d64_validate_cleanup(&result);
+
+    cbmfm_d64_cleanup(&image);
+    cbmfm_d64_cleanup(&copy);
+    return true;
+}
@@ -0,0 +1,190 @@
+/* vim: set et ts=4 sw=4 sts=4 fdm=marker syntax=c.doxygen: */
+
+/** \file   src/tests/test_lib_image_detect.c
+ * \brief   Unit test for src/lib/image/detect.c
+ *
+ * \author  Bas Wassink <b.wassink@ziggo.nl>
+ */
+
+/*
+ *  CbmFM - a file manager for CBM 8-bit emulation files
+ *  Copyright (C) 2018  Bas Wassink <b.wassink@ziggo.nl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "lib/base/errors.h"
+#include "lib/base/io.h"
+#include "lib/image/d64.h"
+#include "lib/image/detect.h"
+#include "testcase.h"
+
+#include "test_lib_image_detect.h"
+
+
+/** \brief  Test file and expected image type
+ */
+typedef struct detect_file_s {
+    const char *path;   /**< path to file */
+    int         type;   /**< expected image type */
+} detect_file_t;
+
+
+/** \brief  List of files to detect
+ */
+static const detect_file_t detect_files[] = {
+    { "data/images/ark/Tpztools.ark", CBMFM_IMAGE_TYPE_ARK },
+    { "data/images/d64/armalyte+7dh101%-2004-remember.d64",
+        CBMFM_IMAGE_TYPE_D64 },
+    { "data/images/d64/WeComeInPeace.d64", CBMFM_IMAGE_TYPE_D64 },
+    { "data/images/lnx/HAEGAR.LNX", CBMFM_IMAGE_TYPE_LNX },
+    { "data/images/lnx/Too Wicked.lnx", CBMFM_IMAGE_TYPE_LNX },
+    { "data/images/t64/c64sfreeze-2.52.t64", CBMFM_IMAGE_TYPE_T64 },
+    { "data/images/t64/pallino-padded.t64", CBMFM_IMAGE_TYPE_T64 },
+    { "data/images/d64/README.md", CBMFM_IMAGE_TYPE_INVALID },
+    { "non-existing-file", CBMFM_IMAGE_TYPE_INVALID },
+    { NULL, 0 }
+};
+
+
+/** \brief  D64 image used to test opening through a probe
+ */
+#define D64_ARMALYTE_FILE   "data/images/d64/armalyte+7dh101%-2004-remember.d64"
+
+
+static bool test_lib_image_detect_type(test_case_t *test);
+static bool test_lib_image_detect_probe(test_case_t *test);
+
+
+/** \brief  List of tests for the image detection functions
+ */
+static test_case_t tests_lib_image_detect[] = {
+    { "type", "Detecting image types",
+        test_lib_image_detect_type, 0, 0 },
+    { "probe", "Opening images through a probe",
+        test_lib_image_detect_probe, 0, 0 },
+    { NULL, NULL, NULL, 0, 0 }
+};
+
+
+/** \brief  Test module for the image detection functions
+ */
+test_module_t module_lib_image_detect = {
+    "detect",
+    "Image type detection functions",
+    tests_lib_image_detect,
+    NULL,
+    NULL,
+    0, 0
+};
+
+
+/** \brief  Test image type detection
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_detect_type(test_case_t *test)
+{
+    int i;
+
+    for (i = 0; detect_files[i].path != NULL; i++) {
+        int type;
+
+        test->total++;
+        printf("..... detecting '%s': expected %d, ", detect_files[i].path,
+                detect_files[i].type);
+        type = cbmfm_image_detect_type(detect_files[i].path);
+        printf("got %d .. ", type);
+        if (type == detect_files[i].type) {
+            printf("OK\n");
+        } else {
+            printf("failed\n");
+            test->failed++;
+        }
+    }
+    return true;
+}
+
+
+/** \brief  Test opening an image through a probe
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_detect_probe(test_case_t *test)
+{
+    cbmfm_probe_t probe;
+    cbmfm_d64_t probed;
+    cbmfm_d64_t image;
+    int type;
+    int score;
+
+    test->total = 3;
+
+    printf("..... probing '%s' .. ", D64_ARMALYTE_FILE);
+    if (!cbmfm_probe_open(&probe, D64_ARMALYTE_FILE)) {
+        printf("failed: fatal\n");
+        return false;
+    }
+    type = cbmfm_image_detect_probe(&probe, &score);
+    printf("type %d, score %d .. ", type, score);
+    if (type == CBMFM_IMAGE_TYPE_D64 && score == CBMFM_PROBE_SCORE_SIZE) {
+        printf("OK\n");
+    } else {
+        printf("failed\n");
+        test->failed++;
+    }
+
+    printf("..... opening through probe .. ");
+    cbmfm_d64_init(&probed);
+    if (!cbmfm_d64_open_probe(&probed, &probe)) {
+        printf("failed: fatal\n");
+        cbmfm_probe_close(&probe);
+        return false;
+    }
+    if (probe.fp == NULL) {
+        printf("OK\n");
+    } else {
+        printf("failed: probe still open\n");
+        test->failed++;
+    }
+
+    printf("..... comparing with cbmfm_d64_open() .. ");
+    cbmfm_d64_init(&image);
+    if (!cbmfm_d64_open(&image, D64_ARMALYTE_FILE)) {
+        printf("failed: fatal\n");
+        cbmfm_d64_cleanup(&probed);
+        return false;
+    }
+    if (image.size == probed.size
+            && memcmp(image.data, probed.data, image.size) == 0) {
+        printf("OK\n");
+    } else {
+        printf("failed\n");
+        test->failed++;
+    }
+
+    cbmfm_d64_cleanup(&image);
+    cbmfm_d64_cleanup(&probed);
+    return true;
+}
@@ -27,6 +27,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 
 #include "lib/base/dir.h"
@@ -50,9 +51,40 @@ static const char *lnx_images[] = {
 };
 
 
+/** \brief  Known file data offsets in the test images
+ *
+ * Taken from the archives by hand, each offset holds the load address of the
+ * file.
+ */
+static const struct {
+    const char *path;   /**< Lynx archive */
+    size_t      index;  /**< directory index */
+    size_t      offset; /**< offset of file data */
+} lnx_offsets[] = {
+    { "data/images/lnx/Phobos.lnx",     0,  1016 },
+    { "data/images/lnx/Phobos.lnx",     1, 16510 },
+    { "data/images/lnx/Phobos.lnx",     2, 20066 },
+    { "data/images/lnx/Phobos.lnx",    24, 85344 },
+    { "data/images/lnx/GC97.LNX",       0,   254 },
+    { "data/images/lnx/GC97.LNX",       1, 14732 }
+};
+
+/** \brief  Lynx archive without remainder for the final entry
+ */
+#define LNX_NO_REMAINDER_FILE   "data/images/lnx/GC97.LNX"
+
+/** \brief  Size of the final entry of #LNX_NO_REMAINDER_FILE
+ *
+ * The entry is clamped to the end of the archive.
+ */
+#define LNX_NO_REMAINDER_SIZE   5410
+
+
 static bool test_lib_image_lnx_open(test_case_t *test);
 static bool test_lib_image_lnx_dir(test_case_t *test);
 static bool test_lib_image_lnx_file(test_case_t *test);
+static bool test_lib_image_lnx_offsets(test_case_t *test);
+static bool test_lib_image_lnx_visit(test_case_t *test);
 
 
 /** \brief  List of tests for the base library functions
@@ -64,6 +96,10 @@ static test_case_t tests_lib_image_lnx[] = {
         test_lib_image_lnx_dir, 0, 0 },
     { "file", "File handling of Lynx archives",
         test_lib_image_lnx_file, 0, 0 },
+    { "offsets", "File data offsets of Lynx archives",
+        test_lib_image_lnx_offsets, 0, 0 },
+    { "visit", "Directory visiting of Lynx archives",
+        test_lib_image_lnx_visit, 0, 0 },
     { NULL, NULL, NULL, 0, 0 }
 };
 
@@ -261,3 +297,178 @@ static bool test_lib_image_lnx_file(test_case_t *test)
 
     return true;
 }
+
+
+/** \brief  Test file data offsets of Lynx archives
+ *
+ * Checks the offsets stored in the directory against offsets known from the
+ * test images, that no file extends past the end of its image, and that an
+ * accepted missing remainder doesn't leave an error behind.
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_lnx_offsets(test_case_t *test)
+{
+    cbmfm_lnx_t image;
+    cbmfm_dir_t *dir;
+    size_t index;
+    size_t i;
+    bool ok;
+
+    test->total = 0;
+
+    for (i = 0; lnx_images[i] != NULL; i++) {
+        test->total++;
+        printf("..... checking file sizes of '%s' .. ", lnx_images[i]);
+        cbmfm_lnx_init(&image);
+        if (!cbmfm_lnx_open(&image, lnx_images[i])) {
+            printf("failed to open\n");
+            test->failed++;
+            continue;
+        }
+        dir = cbmfm_lnx_dir_read(&image);
+        ok = dir != NULL;
+        for (index = 0; ok && index < dir->entry_used; index++) {
+            const cbmfm_dirent_t *dirent = &(dir->entries[index]);
+
+            ok = dirent->extra.lnx.data_offset + dirent->filesize
+                <= image.size;
+        }
+        printf("%s\n", ok ? "OK" : "failed");
+        if (!ok) {
+            test->failed++;
+        }
+        if (dir != NULL) {
+            cbmfm_dir_free(dir);
+        }
+        cbmfm_lnx_cleanup(&image);
+    }
+
+    for (i = 0; i < sizeof lnx_offsets / sizeof lnx_offsets[0]; i++) {
+        test->total++;
+        printf("..... checking offset of entry %zu of '%s' .. ",
+                lnx_offsets[i].index, lnx_offsets[i].path);
+        cbmfm_lnx_init(&image);
+        if (!cbmfm_lnx_open(&image, lnx_offsets[i].path)) {
+            printf("failed to open\n");
+            test->failed++;
+            continue;
+        }
+        dir = cbmfm_lnx_dir_read(&image);
+        ok = dir != NULL && lnx_offsets[i].index < dir->entry_used
+            && dir->entries[lnx_offsets[i].index].extra.lnx.data_offset
+                == lnx_offsets[i].offset;
+        printf("%s\n", ok ? "OK" : "failed");
+        if (!ok) {
+            test->failed++;
+        }
+        if (dir != NULL) {
+            cbmfm_dir_free(dir);
+        }
+        cbmfm_lnx_cleanup(&image);
+    }
+
+    /* the missing remainder is accepted without an error */
+    test->total++;
+    printf("..... reading '%s', checking missing remainder .. ",
+            LNX_NO_REMAINDER_FILE);
+    cbmfm_lnx_init(&image);
+    cbmfm_error_clear();
+    ok = cbmfm_lnx_open(&image, LNX_NO_REMAINDER_FILE);
+    dir = ok ? cbmfm_lnx_dir_read(&image) : NULL;
+    ok = dir != NULL && cbmfm_errno == CBMFM_ERR_OK
+        && dir->entries[dir->entry_used - 1].filesize
+            == LNX_NO_REMAINDER_SIZE;
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+    if (dir != NULL) {
+        cbmfm_dir_free(dir);
+    }
+    cbmfm_lnx_cleanup(&image);
+    return true;
+}
+
+
+/** \brief  Compare the entries of two Lynx directories
+ *
+ * \param[in]   a   directory
+ * \param[in]   b   directory
+ *
+ * \return  true if \a a and \a b contain the same entries
+ */
+static bool lnx_dir_equal(const cbmfm_dir_t *a, const cbmfm_dir_t *b)
+{
+    size_t index;
+
+    if (a->entry_used != b->entry_used) {
+        return false;
+    }
+    for (index = 0; index < a->entry_used; index++) {
+        const cbmfm_dirent_t *da = &(a->entries[index]);
+        const cbmfm_dirent_t *db = &(b->entries[index]);
+
+        if (memcmp(da->filename, db->filename, sizeof da->filename) != 0
+                || da->filetype != db->filetype
+                || da->filesize != db->filesize
+                || da->size_blocks != db->size_blocks
+                || da->extra.lnx.data_offset != db->extra.lnx.data_offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/** \brief  Test directory visiting of Lynx archives
+ *
+ * Visits the directory of each freshly opened archive, so nothing is cached,
+ * and compares the entries with the directory read afterwards.
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_lnx_visit(test_case_t *test)
+{
+    cbmfm_lnx_t image;
+    cbmfm_dir_t *visited;
+    cbmfm_dir_t *dir;
+    int count;
+    int i;
+    bool ok;
+
+    test->total = 0;
+
+    for (i = 0; lnx_images[i] != NULL; i++) {
+        test->total++;
+        printf("..... visiting '%s' .. ", lnx_images[i]);
+        cbmfm_lnx_init(&image);
+        if (!cbmfm_lnx_open(&image, lnx_images[i])) {
+            printf("failed to open\n");
+            test->failed++;
+            continue;
+        }
+
+        visited = cbmfm_dir_new();
+        count = cbmfm_lnx_dir_visit(&image, cbmfm_dir_append_visitor,
+                visited);
+        dir = cbmfm_lnx_dir_read(&image);
+        ok = count >= 0 && dir != NULL
+            && (size_t)count == dir->entry_used
+            && lnx_dir_equal(visited, dir);
+        printf("%s (%d entries)\n", ok ? "OK" : "failed", count);
+        if (!ok) {
+            test->failed++;
+        }
+        if (dir != NULL) {
+            cbmfm_dir_free(dir);
+        }
+        cbmfm_dir_free(visited);
+        cbmfm_lnx_cleanup(&image);
+    }
+    return true;
+}
@@ -0,0 +1,203 @@
+/* vim: set et ts=4 sw=4 sts=4 fdm=marker syntax=c.doxygen: */
+
+/** \file   src/tests/test_lib_image_sixzip.c
+ * \brief   Unit test for src/lib/image/sixzip.c
+ *
+ * \author  Bas Wassink <b.wassink@ziggo.nl>
+ */
+
+/*
+ *  CbmFM - a file manager for CBM 8-bit emulation files
+ *  Copyright (C) 2018  Bas Wassink <b.wassink@ziggo.nl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "lib/base/dxx.h"
+#include "lib/base/errors.h"
+#include "lib/base/image.h"
+#include "lib/base/io.h"
+#include "lib/base/mem.h"
+#include "lib/image/d64.h"
+#include "lib/image/sixzip.h"
+#include "testcase.h"
+
+#include "test_lib_image_sixzip.h"
+
+
+/** \brief  Six-zipped disk with a reference D64 image
+ *
+ * Any of the six files can be used.
+ */
+#define SIXZIP_S1_FILE  "data/images/zipsix/4!!S1.PRG"
+
+/** \brief  Reference D64 image of #SIXZIP_S1_FILE
+ */
+#define SIXZIP_S1_D64   "data/images/zipsix/digital-world-s1.d64"
+
+/** \brief  Six-zipped disk without a reference image
+ */
+#define SIXZIP_S2_FILE  "data/images/zipsix/1!!S2.PRG"
+
+
+static bool test_lib_image_sixzip_unpack(test_case_t *test);
+static bool test_lib_image_sixzip_invalid(test_case_t *test);
+
+
+/** \brief  List of tests for the six-zip disk functions
+ */
+static test_case_t tests_lib_image_sixzip[] = {
+    { "unpack", "Unpacking six-zipped disks",
+        test_lib_image_sixzip_unpack, 0, 0 },
+    { "invalid", "Handling invalid six-zipped disks",
+        test_lib_image_sixzip_invalid, 0, 0 },
+    { NULL, NULL, NULL, 0, 0 }
+};
+
+
+/** \brief  Test module for the six-zip disk functions
+ */
+test_module_t module_lib_image_sixzip = {
+    "sixzip",
+    "Six-zip disk (6-file) functions",
+    tests_lib_image_sixzip,
+    NULL,
+    NULL,
+    0, 0
+};
+
+
+/** \brief  Test unpacking six-zipped disks
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_sixzip_unpack(test_case_t *test)
+{
+    cbmfm_d64_t image;
+    uint8_t *ref;
+    intmax_t ref_size;
+    bool result;
+
+    ref_size = cbmfm_read_file(&ref, SIXZIP_S1_D64);
+    if (ref_size < 0) {
+        cbmfm_perror(__func__);
+        return false;
+    }
+
+    test->total = 2;
+    printf("..... unpacking '%s' ... ", SIXZIP_S1_FILE);
+    cbmfm_d64_init(&image);
+    result = cbmfm_sixzip_unpack(&image, SIXZIP_S1_FILE);
+    result = result
+        && (intmax_t)image.size == ref_size
+        && memcmp(image.data, ref, image.size) == 0;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        cbmfm_perror(__func__);
+        test->failed++;
+    }
+
+    /* reuse the image data of the previous disk */
+    printf("..... unpacking '%s' into existing image ... ", SIXZIP_S2_FILE);
+    result = cbmfm_sixzip_unpack(&image, SIXZIP_S2_FILE)
+        && image.size == CBMFM_D64_SIZE_EXT
+        && memcmp(image.data, ref, image.size) != 0;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        cbmfm_perror(__func__);
+        test->failed++;
+    }
+    cbmfm_d64_cleanup(&image);
+    cbmfm_free(ref);
+    return true;
+}
+
+
+/** \brief  Test handling of invalid six-zipped disks
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_sixzip_invalid(test_case_t *test)
+{
+    cbmfm_d64_t image;
+    bool result;
+
+    test->total = 5;
+
+    printf("..... unpacking '%s', expecting invalid data ... ",
+            SIXZIP_S1_D64);
+    cbmfm_d64_init(&image);
+    result = !cbmfm_sixzip_unpack(&image, SIXZIP_S1_D64)
+        && cbmfm_errno == CBMFM_ERR_INVALID_DATA;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    cbmfm_d64_cleanup(&image);
+
+    printf("..... unpacking incomplete set, expecting I/O error ... ");
+    cbmfm_d64_init(&image);
+    result = !cbmfm_sixzip_unpack(&image, "data/images/zipsix/1!!missing")
+        && cbmfm_errno == CBMFM_ERR_IO;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    cbmfm_d64_cleanup(&image);
+
+    printf("..... unpacking into 35-track image, expecting illegal track ... ");
+    cbmfm_d64_init(&image);
+    cbmfm_d64_format(&image, NULL, NULL, false);
+    result = !cbmfm_sixzip_unpack(&image, SIXZIP_S1_FILE)
+        && cbmfm_errno == CBMFM_ERR_ILLEGAL_TRACK;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    cbmfm_d64_cleanup(&image);
+
+    printf("..... unpacking into mapped image, expecting read-only ... ");
+    cbmfm_d64_init(&image);
+    result = cbmfm_d64_open_mapped(&image, SIXZIP_S1_D64)
+        && !cbmfm_sixzip_unpack(&image, SIXZIP_S1_FILE)
+        && cbmfm_errno == CBMFM_ERR_READONLY;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    cbmfm_d64_cleanup(&image);
+
+    printf("..... unpacking into read-only image, expecting read-only ... ");
+    cbmfm_d64_init(&image);
+    cbmfm_image_set_readonly((cbmfm_image_t *)&image, true);
+    result = !cbmfm_sixzip_unpack(&image, SIXZIP_S1_FILE)
+        && cbmfm_errno == CBMFM_ERR_READONLY
+        && image.data == NULL;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    cbmfm_d64_cleanup(&image);
+    return true;
+}
@@ -27,11 +27,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 
 #include "lib/base/dir.h"
 #include "lib/base/dirent.h"
 #include "lib/base/errors.h"
+#include "lib/base/file.h"
+#include "lib/base/image.h"
+#include "lib/base/io.h"
+#include "lib/base/mem.h"
 #include "lib/image/t64.h"
 #include "testcase.h"
 
@@ -52,6 +57,9 @@ static const char *t64_images[] = {
 static bool test_lib_image_t64_open(test_case_t *test);
 static bool test_lib_image_t64_dir(test_case_t *test);
 static bool test_lib_image_t64_file(test_case_t *test);
+static bool test_lib_image_t64_view(test_case_t *test);
+static bool test_lib_image_t64_repair(test_case_t *test);
+static bool test_lib_image_t64_visit(test_case_t *test);
 
 
 /** \brief  List of tests for the base library functions
@@ -63,6 +71,12 @@ static test_case_t tests_lib_image_t64[] = {
         test_lib_image_t64_dir, 0, 0 },
     { "file", "File handling of T64 archives",
         test_lib_image_t64_file, 0, 0 },
+    { "view", "Borrowed file views of T64 archives",
+        test_lib_image_t64_view, 0, 0 },
+    { "repair", "Directory repair of T64 archives",
+        test_lib_image_t64_repair, 0, 0 },
+    { "visit", "Directory visiting of T64 archives",
+        test_lib_image_t64_visit, 0, 0 },
     { NULL, NULL, NULL, 0, 0 }
 };
 
@@ -236,3 +250,246 @@ static bool test_lib_image_t64_file(test_case_t *test)
 
 
 
+
+
+/** \brief  Host file used to check writing borrowed file views
+ */
+#define T64_VIEW_HOST_FILE  "t64-view.prg"
+
+
+/** \brief  Compare a borrowed view of a file with a copy
+ *
+ * \param[in]   view    borrowed file view
+ * \param[in]   copy    file object owning its data
+ *
+ * \return  true when \a view and \a copy have the same contents
+ */
+static bool t64_view_equals(const cbmfm_file_t *view, const cbmfm_file_t *copy)
+{
+    return view->borrowed
+        && !copy->borrowed
+        && cbmfm_file_get_size(view) == copy->size
+        && memcmp(view->prefix, copy->data, view->prefix_len) == 0
+        && memcmp(view->data, copy->data + view->prefix_len, view->size) == 0;
+}
+
+
+/** \brief  Test borrowed file views of T64 archives
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_t64_view(test_case_t *test)
+{
+    cbmfm_t64_t image;
+    cbmfm_dir_t *dir;
+    cbmfm_file_t view;
+    cbmfm_file_t copy;
+    uint8_t *host;
+    intmax_t host_size;
+    uint16_t index;
+    bool ok;
+    int i;
+
+    test->total = 0;
+
+    for (i = 0; t64_images[i] != NULL; i++) {
+        test->total++;
+        printf("..... comparing views and copies of '%s' .. ", t64_images[i]);
+        cbmfm_t64_init(&image);
+        if (!cbmfm_t64_open(&image, t64_images[i])) {
+            printf("failed to open\n");
+            test->failed++;
+            continue;
+        }
+        dir = cbmfm_t64_read_dir(&image);
+        ok = dir != NULL;
+        for (index = 0; ok && index < dir->entry_used; index++) {
+            ok = cbmfm_t64_file_view(dir, &view, index)
+                && cbmfm_t64_read_file(dir, &copy, index);
+            if (ok) {
+                ok = t64_view_equals(&view, &copy);
+                cbmfm_file_cleanup(&copy);
+                cbmfm_file_cleanup(&view);
+            }
+        }
+        printf("%s\n", ok ? "OK" : "failed");
+        if (!ok) {
+            test->failed++;
+        }
+
+        /* writing a view must write the load address followed by the data */
+        if (dir != NULL && dir->entry_used > 0) {
+            test->total++;
+            printf("..... writing view of file #0 to host .. ");
+            ok = cbmfm_t64_file_view(dir, &view, 0)
+                && cbmfm_file_write_host(&view, T64_VIEW_HOST_FILE)
+                && cbmfm_t64_read_file(dir, &copy, 0);
+            if (ok) {
+                host_size = cbmfm_read_file(&host, T64_VIEW_HOST_FILE);
+                ok = host_size == (intmax_t)copy.size
+                    && memcmp(host, copy.data, copy.size) == 0;
+                if (host_size >= 0) {
+                    cbmfm_free(host);
+                }
+                cbmfm_file_cleanup(&copy);
+            }
+            printf("%s\n", ok ? "OK" : "failed");
+            if (!ok) {
+                test->failed++;
+            }
+        }
+
+        if (dir != NULL) {
+            cbmfm_dir_free(dir);
+        }
+        cbmfm_t64_cleanup(&image);
+    }
+    remove(T64_VIEW_HOST_FILE);
+    return true;
+}
+
+
+/** \brief  Test directory repair of T64 archives
+ *
+ * Checks that repaired entries don't extend past the next entry's data or the
+ * end of the image, and that a second read reuses the repaired directory.
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_t64_repair(test_case_t *test)
+{
+    cbmfm_t64_t image;
+    cbmfm_dir_t *dir;
+    cbmfm_dir_t *again;
+    size_t index;
+    bool ok;
+
+    test->total = 2;
+
+    cbmfm_t64_init(&image);
+    if (!cbmfm_t64_open(&image, t64_images[2])) {
+        printf("..... failed to open '%s': fatal\n", t64_images[2]);
+        return false;
+    }
+
+    printf("..... checking repaired sizes of '%s' .. ", t64_images[2]);
+    dir = cbmfm_t64_read_dir(&image);
+    ok = dir != NULL;
+    for (index = 0; ok && index < dir->entry_used; index++) {
+        const cbmfm_dirent_t *dirent = &(dir->entries[index]);
+
+        ok = dirent->extra.t64.data_offset + dirent->filesize - 2
+            <= image.size;
+    }
+    printf("%s\n", ok ? "OK" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+
+    printf("..... reading the directory again .. ");
+    again = cbmfm_t64_read_dir(&image);
+    ok = dir != NULL && again == dir;
+    printf("%s\n", ok ? "OK, got the repaired directory" : "failed");
+    if (!ok) {
+        test->failed++;
+    }
+    if (again != NULL) {
+        cbmfm_dir_free(again);
+    }
+    if (dir != NULL) {
+        cbmfm_dir_free(dir);
+    }
+
+    cbmfm_t64_cleanup(&image);
+    return true;
+}
+
+
+/** \brief  Compare the entries of two T64 directories
+ *
+ * \param[in]   a   directory
+ * \param[in]   b   directory
+ *
+ * \return  true if \a a and \a b contain the same entries
+ */
+static bool t64_dir_equal(const cbmfm_dir_t *a, const cbmfm_dir_t *b)
+{
+    size_t index;
+
+    if (a->entry_used != b->entry_used) {
+        return false;
+    }
+    for (index = 0; index < a->entry_used; index++) {
+        const cbmfm_dirent_t *da = &(a->entries[index]);
+        const cbmfm_dirent_t *db = &(b->entries[index]);
+
+        if (memcmp(da->filename, db->filename, sizeof da->filename) != 0
+                || da->filetype != db->filetype
+                || da->filesize != db->filesize
+                || da->size_blocks != db->size_blocks
+                || da->extra.t64.data_offset != db->extra.t64.data_offset
+                || da->extra.t64.load_addr != db->extra.t64.load_addr
+                || da->extra.t64.end_addr != db->extra.t64.end_addr) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/** \brief  Test directory visiting of T64 archives
+ *
+ * Visits the directory of each freshly opened archive, so nothing is cached,
+ * and compares the entries with a directory read after clearing the cache.
+ * Includes an archive with wrong end addresses, which must be repaired on
+ * both paths.
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_t64_visit(test_case_t *test)
+{
+    cbmfm_t64_t image;
+    cbmfm_dir_t *visited;
+    cbmfm_dir_t *dir;
+    int count;
+    int i;
+    bool ok;
+
+    test->total = 0;
+
+    for (i = 0; t64_images[i] != NULL; i++) {
+        test->total++;
+        printf("..... visiting '%s' .. ", t64_images[i]);
+        cbmfm_t64_init(&image);
+        if (!cbmfm_t64_open(&image, t64_images[i])) {
+            printf("failed to open\n");
+            test->failed++;
+            continue;
+        }
+
+        visited = cbmfm_dir_new();
+        count = cbmfm_t64_visit_dir(&image, cbmfm_dir_append_visitor,
+                visited);
+        cbmfm_image_dir_cache_clear((cbmfm_image_t *)&image);
+        dir = cbmfm_t64_read_dir(&image);
+        ok = count >= 0 && dir != NULL
+            && (size_t)count == dir->entry_used
+            && t64_dir_equal(visited, dir);
+        printf("%s (%d entries)\n", ok ? "OK" : "failed", count);
+        if (!ok) {
+            test->failed++;
+        }
+        if (dir != NULL) {
+            cbmfm_dir_free(dir);
+        }
+        cbmfm_dir_free(visited);
+        cbmfm_t64_cleanup(&image);
+    }
+    return true;
+}
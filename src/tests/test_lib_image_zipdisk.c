@@ -0,0 +1,269 @@
+/* vim: set et ts=4 sw=4 sts=4 fdm=marker syntax=c.doxygen: */
+
+/** \file   src/tests/test_lib_image_zipdisk.c
+ * \brief   Unit test for src/lib/image/zipdisk.c
+ *
+ * \author  Bas Wassink <b.wassink@ziggo.nl>
+ */
+
+/*
+ *  CbmFM - a file manager for CBM 8-bit emulation files
+ *  Copyright (C) 2018  Bas Wassink <b.wassink@ziggo.nl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "lib/base/errors.h"
+#include "lib/base/io.h"
+#include "lib/base/mem.h"
+#include "lib/image/d64.h"
+#include "lib/image/zipdisk.h"
+#include "testcase.h"
+
+#include "test_lib_image_zipdisk.h"
+
+
+/** \brief  Zipcoded disk with a reference D64 image
+ *
+ * Any of the four files can be used.
+ */
+#define ZIPDISK_SPHERE_FILE "data/images/zipdisk/3!SPHERE.Z64"
+
+/** \brief  Reference D64 image of #ZIPDISK_SPHERE_FILE
+ */
+#define ZIPDISK_SPHERE_D64  "data/images/zipdisk/sphere.d64"
+
+
+/** \brief  Zipcoded disks without reference images
+ */
+static const char *zipdisk_files[] = {
+    "data/images/zipdisk/1!CUM",
+    "data/images/zipdisk/4!comic",
+    NULL
+};
+
+
+/** \brief  Template for the files written by the pack test
+ */
+#define ZIPDISK_PACK_FILE   "1!zipdisk-pack-test"
+
+
+static bool test_lib_image_zipdisk_unpack(test_case_t *test);
+static bool test_lib_image_zipdisk_invalid(test_case_t *test);
+static bool test_lib_image_zipdisk_pack(test_case_t *test);
+
+
+/** \brief  List of tests for the zipcode disk functions
+ */
+static test_case_t tests_lib_image_zipdisk[] = {
+    { "unpack", "Unpacking zipcoded disks",
+        test_lib_image_zipdisk_unpack, 0, 0 },
+    { "invalid", "Handling invalid zipcoded disks",
+        test_lib_image_zipdisk_invalid, 0, 0 },
+    { "pack", "Packing and unpacking zipcoded disks",
+        test_lib_image_zipdisk_pack, 0, 0 },
+    { NULL, NULL, NULL, 0, 0 }
+};
+
+
+/** \brief  Test module for the zipcode disk functions
+ */
+test_module_t module_lib_image_zipdisk = {
+    "zipdisk",
+    "Zipcode disk (4-file) functions",
+    tests_lib_image_zipdisk,
+    NULL,
+    NULL,
+    0, 0
+};
+
+
+/** \brief  Test unpacking zipcoded disks
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_zipdisk_unpack(test_case_t *test)
+{
+    cbmfm_d64_t image;
+    uint8_t *ref;
+    intmax_t ref_size;
+    bool result;
+    int i;
+
+    ref_size = cbmfm_read_file(&ref, ZIPDISK_SPHERE_D64);
+    if (ref_size < 0) {
+        cbmfm_perror(__func__);
+        return false;
+    }
+
+    test->total++;
+    printf("..... unpacking '%s' ... ", ZIPDISK_SPHERE_FILE);
+    cbmfm_d64_init(&image);
+    result = cbmfm_zipdisk_unpack(&image, ZIPDISK_SPHERE_FILE);
+    result = result
+        && (intmax_t)image.size == ref_size
+        && memcmp(image.data, ref, image.size) == 0;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        cbmfm_perror(__func__);
+        test->failed++;
+    }
+    cbmfm_d64_cleanup(&image);
+    cbmfm_free(ref);
+
+    for (i = 0; zipdisk_files[i] != NULL; i++) {
+        test->total++;
+        printf("..... unpacking '%s' ... ", zipdisk_files[i]);
+        cbmfm_d64_init(&image);
+        result = cbmfm_zipdisk_unpack(&image, zipdisk_files[i]);
+        printf("%s, %d blocks free\n", result ? "OK" : "failed",
+                result ? cbmfm_d64_blocks_free(&image) : -1);
+        if (!result) {
+            cbmfm_perror(__func__);
+            test->failed++;
+        }
+        cbmfm_d64_cleanup(&image);
+    }
+    return true;
+}
+
+
+/** \brief  Test handling of invalid zipcoded disks
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_zipdisk_invalid(test_case_t *test)
+{
+    cbmfm_d64_t image;
+    bool result;
+
+    test->total = 3;
+
+    printf("..... unpacking '%s', expecting invalid data ... ",
+            ZIPDISK_SPHERE_D64);
+    cbmfm_d64_init(&image);
+    result = !cbmfm_zipdisk_unpack(&image, ZIPDISK_SPHERE_D64)
+        && cbmfm_errno == CBMFM_ERR_INVALID_DATA;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    cbmfm_d64_cleanup(&image);
+
+    printf("..... unpacking incomplete set, expecting I/O error ... ");
+    cbmfm_d64_init(&image);
+    result = !cbmfm_zipdisk_unpack(&image, "data/images/zipdisk/1!missing")
+        && cbmfm_errno == CBMFM_ERR_IO;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    cbmfm_d64_cleanup(&image);
+
+    printf("..... unpacking into a mapped image, expecting read-only ... ");
+    cbmfm_d64_init(&image);
+    result = cbmfm_d64_open_mapped(&image, ZIPDISK_SPHERE_D64)
+        && !cbmfm_zipdisk_unpack(&image, ZIPDISK_SPHERE_FILE)
+        && cbmfm_errno == CBMFM_ERR_READONLY;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    cbmfm_d64_cleanup(&image);
+    return true;
+}
+
+
+/** \brief  Pack \a image, unpack the result and compare with \a image
+ *
+ * \param[in]   image   d64 image
+ *
+ * \return  true if the unpacked image matches \a image
+ */
+static bool zipdisk_round_trip(cbmfm_d64_t *image)
+{
+    cbmfm_d64_t unpacked;
+    char path[sizeof ZIPDISK_PACK_FILE];
+    bool result;
+    int i;
+
+    cbmfm_d64_init(&unpacked);
+    result = cbmfm_zipdisk_pack(image, ZIPDISK_PACK_FILE)
+        && cbmfm_zipdisk_unpack(&unpacked, ZIPDISK_PACK_FILE)
+        && unpacked.size <= image->size
+        && memcmp(unpacked.data, image->data, unpacked.size) == 0;
+    if (!result) {
+        cbmfm_perror(__func__);
+    }
+    cbmfm_d64_cleanup(&unpacked);
+
+    memcpy(path, ZIPDISK_PACK_FILE, sizeof path);
+    for (i = 0; i < CBMFM_ZIPDISK_FILES; i++) {
+        path[0] = (char)('1' + i);
+        remove(path);
+    }
+    return result;
+}
+
+
+/** \brief  Test packing zipcoded disks
+ *
+ * Packs the reference D64 and the unpacked sample disks, and checks unpacking
+ * the result gives back identical images.
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_zipdisk_pack(test_case_t *test)
+{
+    cbmfm_d64_t image;
+    bool result;
+    int i;
+
+    test->total++;
+    printf("..... round-tripping '%s' ... ", ZIPDISK_SPHERE_D64);
+    cbmfm_d64_init(&image);
+    result = cbmfm_d64_open(&image, ZIPDISK_SPHERE_D64)
+        && zipdisk_round_trip(&image);
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    cbmfm_d64_cleanup(&image);
+
+    for (i = 0; zipdisk_files[i] != NULL; i++) {
+        test->total++;
+        printf("..... round-tripping '%s' ... ", zipdisk_files[i]);
+        cbmfm_d64_init(&image);
+        result = cbmfm_zipdisk_unpack(&image, zipdisk_files[i])
+            && zipdisk_round_trip(&image);
+        printf("%s\n", result ? "OK" : "failed");
+        if (!result) {
+            test->failed++;
+        }
+        cbmfm_d64_cleanup(&image);
+    }
+    return true;
+}
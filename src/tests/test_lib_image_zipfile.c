@@ -0,0 +1,423 @@
+/* vim: set et ts=4 sw=4 sts=4 fdm=marker syntax=c.doxygen: */
+
+/** \file   src/tests/test_lib_image_zipfile.c
+ * \brief   Unit test for src/lib/image/zipfile.c
+ *
+ * \author  Bas Wassink <b.wassink@ziggo.nl>
+ */
+
+/*
+ *  CbmFM - a file manager for CBM 8-bit emulation files
+ *  Copyright (C) 2018  Bas Wassink <b.wassink@ziggo.nl>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.*
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+
+#include "lib/base/dir.h"
+#include "lib/base/errors.h"
+#include "lib/base/file.h"
+#include "lib/base/io.h"
+#include "lib/base/mem.h"
+#include "lib/image/d64.h"
+#include "lib/image/zipfile.h"
+#include "testcase.h"
+
+#include "test_lib_image_zipfile.h"
+
+
+/** \brief  File-zipped disks and the images holding their files
+ */
+static const struct {
+    const char *path;   /**< path to one of the files of the set */
+    const char *d64;    /**< D64 image containing the files of the set */
+    size_t      files;  /**< number of files in the set */
+    int         blocks; /**< number of blocks used by the files */
+} zipfile_sets[] = {
+    { "data/images/zipfile/x!hoogo",
+        "data/images/zipfile/zipfile-test-hoogo.d64", 5, 363 },
+    { "data/images/zipfile/a!koalapaintii",
+        "data/images/zipfile/koala-painter-ii-zipfiled.d64", 22, 646 },
+    { NULL, NULL, 0, 0 }
+};
+
+
+/** \brief  Name and size in blocks of the files of the 'hoogo' set
+ */
+static const struct {
+    const char *name;   /**< PETSCII file name */
+    uint16_t    blocks; /**< size in blocks */
+} zipfile_hoogo[] = {
+    { "NOTE TO COLOR-X\xa0", 31 },
+    { "COLOR-X16 V1.0\xa0\xa0", 80 },
+    { "COLOR-X16 MOUSE\xa0", 80 },
+    { "COLOR-X04 V1.0\xa0\xa0", 86 },
+    { "COLOR-X04 MOUSE\xa0", 86 }
+};
+
+
+/** \brief  Name of the directory file written by the reference test
+ *
+ * The parts are written using the same name, with a different prefix letter.
+ */
+#define ZIPFILE_REF_FILE    "x!zipfile-ref-test"
+
+/** \brief  Name of the directory file written by the invalid data test
+ *
+ * The parts are written using the same name, with a different prefix letter.
+ */
+#define ZIPFILE_BAD_FILE    "x!zipfile-bad-test"
+
+
+static bool test_lib_image_zipfile_unpack(test_case_t *test);
+static bool test_lib_image_zipfile_reference(test_case_t *test);
+static bool test_lib_image_zipfile_invalid(test_case_t *test);
+
+
+/** \brief  List of tests for the file-zip functions
+ */
+static test_case_t tests_lib_image_zipfile[] = {
+    { "unpack", "Unpacking file-zipped disks",
+        test_lib_image_zipfile_unpack, 0, 0 },
+    { "reference", "Unpacking file-zipped disks from the reference images",
+        test_lib_image_zipfile_reference, 0, 0 },
+    { "invalid", "Handling invalid file-zipped disks",
+        test_lib_image_zipfile_invalid, 0, 0 },
+    { NULL, NULL, NULL, 0, 0 }
+};
+
+
+/** \brief  Test module for the file-zip functions
+ */
+test_module_t module_lib_image_zipfile = {
+    "zipfile",
+    "File-zip (single-file zipcode) functions",
+    tests_lib_image_zipfile,
+    NULL,
+    NULL,
+    0, 0
+};
+
+
+/** \brief  Check the directory of \a image against set \a index
+ *
+ * \param[in]   image   unpacked d64 image
+ * \param[in]   index   index in #zipfile_sets
+ *
+ * \return  true if the number of files and blocks used match
+ */
+static bool zipfile_check_dir(cbmfm_d64_t *image, int index)
+{
+    cbmfm_dir_t *dir;
+    bool result;
+    size_t i;
+
+    dir = cbmfm_d64_dir_read(image);
+    if (dir == NULL) {
+        return false;
+    }
+    result = dir->entry_used == zipfile_sets[index].files
+        && cbmfm_d64_blocks_free(image) == 664 - zipfile_sets[index].blocks;
+    for (i = 0; result && i < dir->entry_used; i++) {
+        result = cbmfm_cbmdos_is_closed(dir->entries[i].filetype);
+    }
+    /* the first set is listed in full */
+    for (i = 0; result && index == 0 && i < dir->entry_used; i++) {
+        result = memcmp(dir->entries[i].filename, zipfile_hoogo[i].name,
+                CBMFM_CBMDOS_FILE_NAME_LEN) == 0
+            && dir->entries[i].size_blocks == zipfile_hoogo[i].blocks;
+    }
+    cbmfm_dir_free(dir);
+    return result;
+}
+
+
+/** \brief  Test unpacking file-zipped disks
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_zipfile_unpack(test_case_t *test)
+{
+    cbmfm_d64_t image;
+    bool result;
+    int i;
+
+    for (i = 0; zipfile_sets[i].path != NULL; i++) {
+        test->total++;
+        printf("..... unpacking '%s' ... ", zipfile_sets[i].path);
+        cbmfm_d64_init(&image);
+        result = cbmfm_zipfile_unpack(&image, zipfile_sets[i].path)
+            && zipfile_check_dir(&image, i);
+        printf("%s\n", result ? "OK" : "failed");
+        if (!result) {
+            cbmfm_perror(__func__);
+            test->failed++;
+        }
+        cbmfm_d64_cleanup(&image);
+    }
+    return true;
+}
+
+
+/** \brief  Extract the files of \a ref and unpack them into \a image
+ *
+ * The files are written using #ZIPFILE_REF_FILE as template, and removed
+ * afterwards.
+ *
+ * \param[out]  image   d64 image
+ * \param[in]   ref     d64 image holding the files of a file-zipped disk
+ *
+ * \return  true on success
+ */
+static bool zipfile_unpack_ref(cbmfm_d64_t *image, cbmfm_d64_t *ref)
+{
+    cbmfm_dir_t *dir;
+    char path[sizeof ZIPFILE_REF_FILE];
+    bool result = true;
+    size_t i;
+
+    dir = cbmfm_d64_dir_read(ref);
+    if (dir == NULL) {
+        return false;
+    }
+    memcpy(path, ZIPFILE_REF_FILE, sizeof path);
+    for (i = 0; result && i < dir->entry_used; i++) {
+        cbmfm_file_t file;
+
+        cbmfm_file_init(&file);
+        path[0] = (char)tolower(dir->entries[i].filename[0]);
+        result = cbmfm_d64_file_read_from_dirent(&(dir->entries[i]), &file)
+            && cbmfm_file_write_host(&file, path);
+        cbmfm_file_cleanup(&file);
+    }
+
+    result = result && cbmfm_zipfile_unpack(image, ZIPFILE_REF_FILE);
+    if (!result) {
+        cbmfm_perror(__func__);
+    }
+
+    for (i = 0; i < dir->entry_used; i++) {
+        path[0] = (char)tolower(dir->entries[i].filename[0]);
+        remove(path);
+    }
+    cbmfm_dir_free(dir);
+    return result;
+}
+
+
+/** \brief  Test unpacking file-zipped disks from the reference images
+ *
+ * The files of each set are extracted from the reference image holding them,
+ * unpacked, and the result is compared with unpacking the set itself.
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_zipfile_reference(test_case_t *test)
+{
+    cbmfm_d64_t ref;
+    cbmfm_d64_t image;
+    cbmfm_d64_t image_ref;
+    bool result;
+    int i;
+
+    for (i = 0; zipfile_sets[i].path != NULL; i++) {
+        test->total++;
+        printf("..... unpacking files of '%s' ... ", zipfile_sets[i].d64);
+        cbmfm_d64_init(&ref);
+        cbmfm_d64_init(&image);
+        cbmfm_d64_init(&image_ref);
+        result = cbmfm_d64_open(&ref, zipfile_sets[i].d64)
+            && zipfile_unpack_ref(&image_ref, &ref)
+            && cbmfm_zipfile_unpack(&image, zipfile_sets[i].path)
+            && image.size == image_ref.size
+            && memcmp(image.data, image_ref.data, image.size) == 0;
+        printf("%s\n", result ? "OK" : "failed");
+        if (!result) {
+            test->failed++;
+        }
+        cbmfm_d64_cleanup(&image_ref);
+        cbmfm_d64_cleanup(&image);
+        cbmfm_d64_cleanup(&ref);
+    }
+    return true;
+}
+
+
+/** \brief  Copy files \a letters of the 'hoogo' set to #ZIPFILE_BAD_FILE
+ *
+ * \param[in]   letters prefix letters of the files to copy
+ * \param[in]   extra   append a byte to the last file copied
+ *
+ * \return  true on success
+ */
+static bool zipfile_copy_bad(const char *letters, bool extra)
+{
+    char src[] = "data/images/zipfile/x!hoogo";
+    char dest[] = ZIPFILE_BAD_FILE;
+    size_t i;
+    bool result = true;
+
+    for (i = 0; result && letters[i] != '\0'; i++) {
+        uint8_t *data;
+        intmax_t size;
+
+        src[sizeof "data/images/zipfile/" - 1] = letters[i];
+        dest[0] = letters[i];
+        size = cbmfm_read_file(&data, src);
+        if (size < 0) {
+            return false;
+        }
+        if (extra && letters[i + 1] == '\0') {
+            data = cbmfm_realloc(data, (size_t)size + 1);
+            data[size++] = 0x00;
+        }
+        result = cbmfm_write_file(data, (size_t)size, dest);
+        cbmfm_free(data);
+    }
+    return result;
+}
+
+
+/** \brief  Remove files \a letters of #ZIPFILE_BAD_FILE
+ *
+ * \param[in]   letters prefix letters of the files to remove
+ */
+static void zipfile_remove_bad(const char *letters)
+{
+    char path[] = ZIPFILE_BAD_FILE;
+    size_t i;
+
+    for (i = 0; letters[i] != '\0'; i++) {
+        path[0] = letters[i];
+        remove(path);
+    }
+}
+
+
+/** \brief  Check \a image only contains closed files that fit the BAM
+ *
+ * Removed entries (file type 0) are ignored.
+ *
+ * \param[in]   image   d64 image
+ *
+ * \return  bool
+ */
+static bool zipfile_check_closed(cbmfm_d64_t *image)
+{
+    cbmfm_dir_t *dir;
+    int blocks = 0;
+    bool result = true;
+    size_t i;
+
+    dir = cbmfm_d64_dir_read(image);
+    if (dir == NULL) {
+        return false;
+    }
+    for (i = 0; result && i < dir->entry_used; i++) {
+        /* skip removed entries */
+        if (dir->entries[i].filetype == 0) {
+            continue;
+        }
+        result = cbmfm_cbmdos_is_closed(dir->entries[i].filetype);
+        blocks += dir->entries[i].size_blocks;
+    }
+    cbmfm_dir_free(dir);
+    return result && cbmfm_d64_blocks_free(image) == 664 - blocks;
+}
+
+
+/** \brief  Test handling of invalid file-zipped disks
+ *
+ * \param[in,out]   test    test object
+ *
+ * \return  bool
+ */
+static bool test_lib_image_zipfile_invalid(test_case_t *test)
+{
+    cbmfm_d64_t image;
+    bool result;
+
+    test->total = 5;
+
+    printf("..... unpacking '%s', expecting invalid data ... ",
+            zipfile_sets[0].d64);
+    cbmfm_d64_init(&image);
+    result = !cbmfm_zipfile_unpack(&image, zipfile_sets[0].d64)
+        && cbmfm_errno == CBMFM_ERR_INVALID_DATA;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    cbmfm_d64_cleanup(&image);
+
+    printf("..... unpacking incomplete set, expecting I/O error ... ");
+    cbmfm_d64_init(&image);
+    result = !cbmfm_zipfile_unpack(&image, "data/images/zipfile/a!missing")
+        && cbmfm_errno == CBMFM_ERR_IO;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    cbmfm_d64_cleanup(&image);
+
+    /* data after the last block entry of a part */
+    printf("..... unpacking part with trailing data, expecting invalid"
+            " data ... ");
+    cbmfm_d64_init(&image);
+    result = zipfile_copy_bad("xabc", true)
+        && !cbmfm_zipfile_unpack(&image, ZIPFILE_BAD_FILE)
+        && cbmfm_errno == CBMFM_ERR_INVALID_DATA;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    zipfile_remove_bad("xabc");
+    cbmfm_d64_cleanup(&image);
+
+    /* the file spanning the first and the missing second part is removed */
+    printf("..... unpacking set without second part, checking files ... ");
+    cbmfm_d64_init(&image);
+    result = zipfile_copy_bad("xa", false)
+        && !cbmfm_zipfile_unpack(&image, ZIPFILE_BAD_FILE)
+        && cbmfm_errno == CBMFM_ERR_IO
+        && zipfile_check_closed(&image);
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    zipfile_remove_bad("xa");
+    cbmfm_d64_cleanup(&image);
+
+    printf("..... unpacking into mapped image, expecting read-only ... ");
+    cbmfm_d64_init(&image);
+    result = cbmfm_d64_open_mapped(&image, zipfile_sets[0].d64)
+        && !cbmfm_zipfile_unpack(&image, zipfile_sets[0].path)
+        && cbmfm_errno == CBMFM_ERR_READONLY;
+    printf("%s\n", result ? "OK" : "failed");
+    if (!result) {
+        test->failed++;
+    }
+    cbmfm_d64_cleanup(&image);
+    return true;
+}